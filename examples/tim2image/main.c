@@ -45,8 +45,7 @@ int main(int argc, char **argv) {
     /* Load the TIM into a PLImage structure. */
 
     PLImage image;
-    PLresult result = plLoadImage(argv[1], &image);
-    if(result != PL_RESULT_SUCCESS) {
+    if(!plLoadImage(argv[1], &image)) {
         printf("Failed to load TIM image!\n%s", plGetError());
         return 1;
     }
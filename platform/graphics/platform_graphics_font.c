@@ -192,7 +192,7 @@ PLBitmapFont *plCreateBitmapFont(const char *path) {
     }
 
     PLImage image;
-    if(plLoadImage(_pl_font.line_buffer, &image) != PL_RESULT_SUCCESS) {
+    if(!plLoadImage(_pl_font.line_buffer, &image)) {
         plDeleteBitmapFont(font);
         return NULL;
     }
@@ -112,6 +112,7 @@ unsigned int _plTranslateColourFormat(PLColourFormat format) {
         case PL_COLOURFORMAT_RGBA:  return GL_RGBA;
         case PL_COLOURFORMAT_BGR:   return GL_BGR;
         case PL_COLOURFORMAT_BGRA:  return GL_BGRA;
+        case PL_COLOURFORMAT_L:     return GL_LUMINANCE;
 #elif defined(VL_MODE_GLIDE)
         default:
         case PL_COLOURFORMAT_RGBA:  return GR_COLORFORMAT_RGBA;
@@ -138,11 +139,13 @@ unsigned int _plTranslateTextureFormat(PLImageFormat format) {
         case PL_IMAGEFORMAT_RGBA16:       return GL_RGBA16;
 #if defined(PL_MODE_OPENGL_CORE)
         case PL_IMAGEFORMAT_RGBA16F:      return GL_RGBA16F;
+        case PL_IMAGEFORMAT_RGBA32F:      return GL_RGBA32F;
 #endif
         case PL_IMAGEFORMAT_RGBA_DXT1:    return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
         case PL_IMAGEFORMAT_RGB_DXT1:     return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
         case PL_IMAGEFORMAT_RGBA_DXT3:    return GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
         case PL_IMAGEFORMAT_RGBA_DXT5:    return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case PL_IMAGEFORMAT_L8:           return GL_LUMINANCE8;
     }
 }
 
@@ -409,9 +412,52 @@ void plSetTextureEnvironmentMode(PLTextureEnvironmentMode mode) {
 
 /////////////////////
 
+/* Makes a copy of the image compressed to DXT5, or DXT1 if
+ * there's no alpha to keep, for PL_TEXTUREFLAG_COMPRESS. */
+static bool CompressTextureImage(const PLImage *upload, PLImage *out) {
+    *out = *upload;
+    out->levels = (upload->levels > 0) ? upload->levels : 1;
+    if((out->data = calloc(out->levels, sizeof(uint8_t*))) == NULL) {
+        ReportError(PL_RESULT_MEMORYALLOC, "Failed to allocate memory for compressed texture");
+        return false;
+    }
+
+    unsigned int width = upload->width, height = upload->height;
+    for(unsigned int i = 0; i < out->levels; ++i) {
+        unsigned int size = _plGetImageSize(upload->format, width, height);
+        if((out->data[i] = malloc(size ? size : 1)) == NULL) {
+            ReportError(PL_RESULT_MEMORYALLOC, "Failed to allocate memory for compressed texture");
+            plFreeImage(out);
+            return false;
+        }
+        memcpy(out->data[i], upload->data[i], size);
+
+        width = (width > 1) ? width / 2 : 1;
+        height = (height > 1) ? height / 2 : 1;
+    }
+
+    PLImageFormat format = (plGetSamplesPerPixel(upload->colour_format) == 4) ?
+                           PL_IMAGEFORMAT_RGBA_DXT5 : PL_IMAGEFORMAT_RGB_DXT1;
+    if(!plCompressImage(out, format, PL_COMPRESSIONQUALITY_NORMAL)) {
+        plFreeImage(out);
+        return false;
+    }
+
+    return true;
+}
+
 bool plUploadTextureImage(PLTexture *texture, const PLImage *upload) {
     plAssert(texture);
 
+    /* anything that can't be compressed is just uploaded as it is */
+    PLImage compressed;
+    if((texture->flags & PL_TEXTUREFLAG_COMPRESS) && !plIsCompressedImageFormat(upload->format) &&
+       CompressTextureImage(upload, &compressed)) {
+        bool result = plUploadTextureImage(texture, &compressed);
+        plFreeImage(&compressed);
+        return result;
+    }
+
     plBindTexture(texture);
 
     texture->width      = upload->width;
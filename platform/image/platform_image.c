@@ -27,6 +27,163 @@ For more information, please refer to <http://unlicense.org>
 #include <PL/platform_image.h>
 #include <PL/platform_filesystem.h>
 #include <PL/platform_math.h>
+#include <PL/platform_package.h>
+
+#include <sys/stat.h>
+
+#if defined(_WIN32)
+static BOOL CALLBACK CallImageOnceSetup(PINIT_ONCE once, PVOID parameter, PVOID *context) {
+    (*(void (**)(void))parameter)();
+    return TRUE;
+}
+#endif
+
+void CallImageOnce(PLImageOnce *once, void (*Setup)(void)) {
+#if !defined(_WIN32)
+    pthread_once(once, Setup);
+#else
+    InitOnceExecuteOnce(once, CallImageOnceSetup, &Setup, NULL);
+#endif
+}
+
+/////////////////////////////////////////////////////////////////
+// Codecs
+
+typedef struct PLImageCodec {
+    char extension[16];                         // Only checked for codecs without any magic
+    uint8_t magic[PL_MAX_IMAGE_MAGIC_LENGTH];
+    unsigned int magic_length;
+
+    PLresult (*LoadImage)(PLBinaryReader *reader, PLImage *out);
+} PLImageCodec;
+
+static const PLImageCodec builtin_codecs[] = {
+        { "dds", { 'D', 'D', 'S', ' ' }, 4, LoadDDSImage },
+        { "tim", { 16, 0, 0, 0 }, 4, LoadTIMImage },
+        { PLIMAGE_EXTENSION_VTF, { 'V', 'T', 'F', '\0' }, 4, _plLoadVTFImage },
+        { PLIMAGE_EXTENSION_DTX, { 0, 0, 0, 0 }, 4, _plLoadDTXImage },     // resource type, rather than an ident
+        { "bmp", { 'B', 'M' }, 2, _plLoadBMPImage },
+        { PLIMAGE_EXTENSION_PNG, { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' }, 8, LoadSTBImage },
+        { PLIMAGE_EXTENSION_JPG, { 0xFF, 0xD8, 0xFF }, 3, LoadSTBImage },
+        { PLIMAGE_EXTENSION_TIFF, { 'I', 'I', 42, 0 }, 4, LoadTIFFImage },
+        { PLIMAGE_EXTENSION_TIFF, { 'M', 'M', 0, 42 }, 4, LoadTIFFImage },
+
+        { PLIMAGE_EXTENSION_FTX, { 0 }, 0, _plLoadFTXImage },
+        { PLIMAGE_EXTENSION_PPM, { 0 }, 0, _plLoadPPMImage },
+        { PLIMAGE_EXTENSION_TGA, { 0 }, 0, LoadSTBImage },
+};
+
+static PLImageCodec image_codecs[PL_MAX_IMAGE_CODECS];
+static unsigned int num_image_codecs = 0;
+
+static bool AddImageCodec(const char *extension, const uint8_t *magic, unsigned int magic_length,
+                          PLresult (*LoadImage)(PLBinaryReader *reader, PLImage *out)) {
+    plAssert(LoadImage);
+
+    if(num_image_codecs >= PL_MAX_IMAGE_CODECS) {
+        ReportError(PL_RESULT_MEMORY_EOA, "no room left for another image codec");
+        return false;
+    }
+
+    if(magic_length > PL_MAX_IMAGE_MAGIC_LENGTH || (magic_length > 0 && magic == NULL)) {
+        ReportError(PL_RESULT_IMAGEFORMAT, "invalid magic for image codec, %u bytes", magic_length);
+        return false;
+    }
+
+    if(magic_length == 0 && !plIsValidString(extension)) {
+        ReportError(PL_RESULT_IMAGEFORMAT, "image codec needs either magic or an extension");
+        return false;
+    }
+
+    PLImageCodec *codec = &image_codecs[num_image_codecs++];
+    memset(codec, 0, sizeof(PLImageCodec));
+    if(extension != NULL) {
+        snprintf(codec->extension, sizeof(codec->extension), "%s", extension);
+    }
+    if(magic_length > 0) {
+        memcpy(codec->magic, magic, magic_length);
+    }
+    codec->magic_length = magic_length;
+    codec->LoadImage = LoadImage;
+
+    return true;
+}
+
+static void RegisterBuiltinImageCodecs(void) {
+    for(unsigned int i = 0; i < plArrayElements(builtin_codecs); ++i) {
+        AddImageCodec(builtin_codecs[i].extension, builtin_codecs[i].magic, builtin_codecs[i].magic_length,
+                      builtin_codecs[i].LoadImage);
+    }
+}
+
+/* the built-in codecs always come first, whenever anything else is registered */
+static PLImageOnce builtin_codecs_once = PL_IMAGE_ONCE_INIT;
+
+/* Not safe to call while other threads are loading images */
+bool plRegisterImageCodec(const char *extension, const uint8_t *magic, unsigned int magic_length,
+                          PLresult (*LoadImage)(PLBinaryReader *reader, PLImage *out)) {
+    CallImageOnce(&builtin_codecs_once, RegisterBuiltinImageCodecs);
+    return AddImageCodec(extension, magic, magic_length, LoadImage);
+}
+
+/* Picks out the codec for the given file from the start of it, which only has
+ * to be read the once, falling back on the extension for those without magic. */
+static const PLImageCodec *FindImageCodec(const uint8_t *magic, size_t length, const char *path) {
+    CallImageOnce(&builtin_codecs_once, RegisterBuiltinImageCodecs);
+
+    for(unsigned int i = 0; i < num_image_codecs; ++i) {
+        const PLImageCodec *codec = &image_codecs[i];
+        if(codec->magic_length > 0 && codec->magic_length <= length &&
+           memcmp(codec->magic, magic, codec->magic_length) == 0) {
+            return codec;
+        }
+    }
+
+    const char *extension = plGetFileExtension(path);
+    if(!plIsValidString(extension)) {
+        return NULL;
+    }
+
+    for(unsigned int i = 0; i < num_image_codecs; ++i) {
+        const PLImageCodec *codec = &image_codecs[i];
+        if(codec->magic_length == 0 && pl_strcasecmp(codec->extension, extension) == 0) {
+            return codec;
+        }
+    }
+
+    return NULL;
+}
+
+/////////////////////////////////////////////////////////////////
+
+static PLresult LoadImage(PLBinaryReader *reader, const char *path, PLImage *out) {
+    size_t length = reader->length - plGetBinaryReaderOffset(reader);
+    if(length > PL_MAX_IMAGE_MAGIC_LENGTH) {
+        length = PL_MAX_IMAGE_MAGIC_LENGTH;
+    }
+
+    const uint8_t *magic = plGetBinaryReaderData(reader, length);
+    if(magic == NULL) {
+        return PL_RESULT_FILEREAD;
+    }
+
+    const PLImageCodec *codec = FindImageCodec(magic, length, path);
+    if(codec == NULL) {
+        ReportError(PL_RESULT_FILETYPE, "unrecognised image format, %s", path);
+        return PL_RESULT_FILETYPE;
+    }
+
+    if(!plSeekBinaryReader(reader, codec->magic_length)) {
+        return PL_RESULT_FILEREAD;
+    }
+
+    PLresult result = codec->LoadImage(reader, out);
+    if(result == PL_RESULT_SUCCESS) {
+        strncpy(out->path, path, sizeof(out->path));
+    }
+
+    return result;
+}
 
 PLresult plLoadImagef(FILE *fin, const char *path, PLImage *out) {
     if(!fin) {
@@ -34,32 +191,278 @@ PLresult plLoadImagef(FILE *fin, const char *path, PLImage *out) {
         return PL_RESULT_FILEREAD;
     }
 
-    PLresult result = PL_RESULT_FILETYPE;
-    if(DDSFormatCheck(fin)) {
-        result = LoadDDSImage(fin, out);
-    } else if(TIMFormatCheck(fin)) {
-        result = LoadTIMImage(fin, out);
-    } else if(_plVTFFormatCheck(fin)) {
-        result = _plLoadVTFImage(fin, out);
-    } else if(_plDTXFormatCheck(fin)) {
-        result = _plLoadDTXImage(fin, out);
-    } else if(_plBMPFormatCheck(fin)) {
-        result = _plLoadBMPImage(fin, out);
-    } else {
-        const char *extension = plGetFileExtension(path);
-        if(plIsValidString(extension)) {
-            if (!strncmp(extension, PLIMAGE_EXTENSION_FTX, 3)) {
-                result = _plLoadFTXImage(fin, out);
-            } else if (!strncmp(extension, PLIMAGE_EXTENSION_PPM, 3)) {
-                result = _plLoadPPMImage(fin, out);
-            }
+    rewind(fin);
+
+    PLBinaryReader reader;
+    if(!plSetupBinaryReaderFile(&reader, fin)) {
+        return PL_RESULT_FILEREAD;
+    }
+
+    PLresult result = LoadImage(&reader, path, out);
+    plCloseBinaryReader(&reader);
+
+    return result;
+}
+
+/* Decodes the image straight out of the given memory, which could be a
+ * mapped file or package entry. The path is only used for its extension,
+ * for formats without any magic, and may be NULL. */
+PLresult plLoadImageFromMemory(const uint8_t *data, size_t length, const char *path, PLImage *out) {
+    if(data == NULL) {
+        ReportError(PL_RESULT_FILEREAD, "invalid image data");
+        return PL_RESULT_FILEREAD;
+    }
+
+    PLBinaryReader reader;
+    plSetupBinaryReader(&reader, data, length);
+
+    return LoadImage(&reader, (path != NULL) ? path : "", out);
+}
+
+/////////////////////////////////////////////////////////////////
+// Packaged Images
+
+#define PL_MAX_IMAGE_PACKAGES   4
+
+/* Packages that images are loaded out of without being mounted are kept
+ * open afterwards, so a run of images from the same one only has it opened
+ * and parsed the once. Any that have since been replaced are reopened. */
+typedef struct PLImagePackage {
+    PLPackage *package;
+    struct stat st;         // of the file, when it was opened
+    unsigned int users;     // loads still going on from it
+    unsigned long last_used;
+} PLImagePackage;
+
+static PLImagePackage image_packages[PL_MAX_IMAGE_PACKAGES];
+static unsigned long image_package_clock = 0;
+#if !defined(_WIN32)
+static pthread_mutex_t image_package_lock = PTHREAD_MUTEX_INITIALIZER;
+#else
+static SRWLOCK image_package_lock = SRWLOCK_INIT;
+#endif
+
+static void LockImagePackages(void) {
+#if !defined(_WIN32)
+    pthread_mutex_lock(&image_package_lock);
+#else
+    AcquireSRWLockExclusive(&image_package_lock);
+#endif
+}
+
+static void UnlockImagePackages(void) {
+#if !defined(_WIN32)
+    pthread_mutex_unlock(&image_package_lock);
+#else
+    ReleaseSRWLockExclusive(&image_package_lock);
+#endif
+}
+
+/* Packages are written out under another name then moved over the top of
+ * the old one, so it'll be a different file as well as having changed. */
+static bool IsSameImagePackageFile(const struct stat *a, const struct stat *b) {
+    return (a->st_dev == b->st_dev && a->st_ino == b->st_ino &&
+            a->st_size == b->st_size && a->st_mtime == b->st_mtime);
+}
+
+/* Returns the slot already holding the package at the given path, if it's still
+ * up to date, handing back any out of date ones nobody's using to be deleted.
+ * Must be called with the packages locked. */
+static PLImagePackage *FindImagePackage(const char *path, const struct stat *st,
+                                        PLPackage **stale, unsigned int *num_stale) {
+    for(unsigned int i = 0; i < PL_MAX_IMAGE_PACKAGES; ++i) {
+        PLImagePackage *slot = &image_packages[i];
+        if(slot->package == NULL || strcmp(slot->package->path, path) != 0) {
+            continue;
+        }
+
+        if(IsSameImagePackageFile(&slot->st, st)) {
+            return slot;
+        }
+
+        /* out of date, though it can only go once nobody's using it */
+        if(slot->users == 0) {
+            stale[(*num_stale)++] = slot->package;
+            slot->package = NULL;
         }
     }
 
-    if(result == PL_RESULT_SUCCESS) {
-        strncpy(out->path, path, sizeof(out->path));
+    return NULL;
+}
+
+static void DeleteImagePackages(PLPackage **packages, unsigned int num_packages) {
+    for(unsigned int i = 0; i < num_packages; ++i) {
+        plDeletePackage(packages[i]);
+    }
+}
+
+/* Returns the package at the given path, opening it if it isn't already. If
+ * every slot is busy, it's opened just for the caller, and cached is false.
+ * Packages are opened and deleted without the lock held, so loads out of any
+ * others aren't held up behind them. */
+static PLPackage *AcquireImagePackage(const char *path, bool *cached) {
+    struct stat st;
+    if(stat(path, &st) != 0) {
+        ReportError(PL_RESULT_FILEREAD, "Failed to load package, %s!", path);
+        return NULL;
+    }
+
+    PLPackage *stale[PL_MAX_IMAGE_PACKAGES];
+    unsigned int num_stale = 0;
+
+    LockImagePackages();
+
+    PLImagePackage *slot = FindImagePackage(path, &st, stale, &num_stale);
+    if(slot != NULL) {
+        slot->users++;
+        slot->last_used = ++image_package_clock;
+        PLPackage *package = slot->package;
+        UnlockImagePackages();
+
+        DeleteImagePackages(stale, num_stale);
+
+        *cached = true;
+        return package;
+    }
+
+    UnlockImagePackages();
+
+    DeleteImagePackages(stale, num_stale);
+    num_stale = 0;
+
+    PLPackage *package = plLoadPackage(path, PL_PACKAGEFLAG_MAP);
+    if(package == NULL) {
+        return NULL;
+    }
+
+    LockImagePackages();
+
+    /* someone else may have opened it in the meantime, in which case theirs wins */
+    slot = FindImagePackage(path, &st, stale, &num_stale);
+    if(slot != NULL) {
+        slot->users++;
+        slot->last_used = ++image_package_clock;
+        PLPackage *opened = slot->package;
+        UnlockImagePackages();
+
+        DeleteImagePackages(stale, num_stale);
+        plDeletePackage(package);
+
+        *cached = true;
+        return opened;
+    }
+
+    /* take whichever slot's free, or was used the longest ago */
+    for(unsigned int i = 0; i < PL_MAX_IMAGE_PACKAGES; ++i) {
+        PLImagePackage *other = &image_packages[i];
+        if(other->users > 0) {
+            continue;
+        }
+
+        if(slot == NULL || other->package == NULL ||
+           (slot->package != NULL && other->last_used < slot->last_used)) {
+            slot = other;
+        }
+
+        if(slot->package == NULL) {
+            break;
+        }
+    }
+
+    *cached = (slot != NULL);
+    if(slot != NULL) {
+        if(slot->package != NULL) {
+            stale[num_stale++] = slot->package;
+        }
+
+        slot->package = package;
+        slot->st = st;
+        slot->users = 1;
+        slot->last_used = ++image_package_clock;
+    }
+
+    UnlockImagePackages();
+
+    DeleteImagePackages(stale, num_stale);
+
+    return package;
+}
+
+static void ReleaseImagePackage(PLPackage *package, bool cached) {
+    if(!cached) {
+        plDeletePackage(package);
+        return;
+    }
+
+    LockImagePackages();
+    for(unsigned int i = 0; i < PL_MAX_IMAGE_PACKAGES; ++i) {
+        if(image_packages[i].package == package) {
+            image_packages[i].users--;
+            break;
+        }
+    }
+    UnlockImagePackages();
+}
+
+/* Closes any packages still held open from loading images. */
+void ShutdownImage(void) {
+    LockImagePackages();
+    for(unsigned int i = 0; i < PL_MAX_IMAGE_PACKAGES; ++i) {
+        PLImagePackage *slot = &image_packages[i];
+        if(slot->package != NULL && slot->users == 0) {
+            plDeletePackage(slot->package);
+            slot->package = NULL;
+        }
+    }
+    UnlockImagePackages();
+}
+
+/* Loads the image from the package named before the separator, using the
+ * package if it's already mounted, otherwise opening it, or picking up the
+ * one that's still open from the last image loaded out of it. */
+static PLresult LoadPackagedImage(const char *path, const char *separator, PLImage *out) {
+    char package_path[PL_SYSTEM_MAX_PATH];
+    size_t length = (size_t)(separator - path);
+    if(length >= sizeof(package_path)) {
+        ReportError(PL_RESULT_FILEPATH, "package path is too long, %s", path);
+        return PL_RESULT_FILEPATH;
     }
 
+    memcpy(package_path, path, length);
+    package_path[length] = '\0';
+
+    const char *entry = separator + 1;
+
+    PLresult result = PL_RESULT_FILEREAD;
+
+    /* mounted packages are loaded from under the mount lock, so they can't go from under us */
+    const uint8_t *data;
+    size_t size;
+    if(plLoadMountedFileFrom(package_path, entry, &data, &size)) {
+        result = plLoadImageFromMemory(data, size, entry, out);
+        if(result == PL_RESULT_SUCCESS) {
+            strncpy(out->path, path, sizeof(out->path));
+        }
+        plReleaseMountedFile(entry, data);
+        return result;
+    }
+
+    bool cached = false;
+    PLPackage *package = AcquireImagePackage(package_path, &cached);
+    if(package == NULL) {
+        return plGetFunctionResult();
+    }
+
+    if(plLoadPackageFile(package, entry, &data, &size)) {
+        result = plLoadImageFromMemory(data, size, entry, out);
+        if(result == PL_RESULT_SUCCESS) {
+            strncpy(out->path, path, sizeof(out->path));
+        }
+        plReleasePackageFile(package, entry);
+    }
+
+    ReleaseImagePackage(package, cached);
+
     return result;
 }
 
@@ -69,22 +472,24 @@ bool plLoadImage(const char *path, PLImage *out) {
         return false;
     }
 
+    /* anything past a drive letter could be a packaged image,
+     * but only if there isn't a file by that name already */
+    const char *separator = strrchr(path, ':');
+    if(separator != NULL && separator - path > 1 && !plFileExists(path)) {
+        return (LoadPackagedImage(path, separator, out) == PL_RESULT_SUCCESS);
+    }
+
     FILE *fin = fopen(path, "rb");
     if(fin == NULL) {
         ReportError(PL_RESULT_FILEREAD, "Failed to load image, %s!\n", path);
         return false;
     }
 
-    if(strrchr(path, ':')) {
-        // Very likely a packaged image.
-        // example/package.wad:myimage
-    }
-
     PLresult result = plLoadImagef(fin, path, out);
 
     fclose(fin);
 
-    return result;
+    return (result == PL_RESULT_SUCCESS);
 }
 
 PLresult plWriteImage(const PLImage *image, const char *path) {
@@ -121,69 +526,36 @@ unsigned int plGetSamplesPerPixel(PLColourFormat format) {
         case PL_COLOURFORMAT_RGB: {
             return 3;
         }
-    }
-
-    return 0;
-}
-
-bool plConvertPixelFormat(PLImage *image, PLImageFormat new_format) {
-    /* TODO: Make this thing more extensible... */
-    if(image->format == PL_IMAGEFORMAT_RGB5A1 && new_format == PL_IMAGEFORMAT_RGBA8) {
-        uint8_t *levels[image->levels];
-        memset(levels, 0, image->levels * sizeof(uint8_t*));
-
-        /* Make a new copy of each detail level in the new format. */
-
-        unsigned int lw = image->width;
-        unsigned int lh = image->height;
 
-        for(unsigned int l = 0; l < image->levels; ++l) {
-            levels[l] = _plImageDataRGB5A1toRGBA8(image->data[l], lw * lh);
-            if(levels[l] == NULL) {
-                /* Memory allocation failed, ditch any buffers we've created so far. */
-                for(unsigned int m = 0; m < image->levels; ++m) {
-                    free(levels[m]);
-                }
-
-                ReportError(PL_RESULT_MEMORYALLOC, "Couldn't allocate memory for image data");
-                return false;
-            }
-
-            lw /= 2;
-            lh /= 2;
-        }
-
-        /* Now that all levels have been converted, free and replace the old buffers. */
-
-        for(unsigned int l = 0; l < image->levels; ++l) {
-            free(image->data[l]);
-            image->data[l] = levels[l];
+        case PL_COLOURFORMAT_L: {
+            return 1;
         }
-
-        image->format = new_format;
-        /* TODO: Update colour_format */
-
-        return true;
     }
 
-    ReportError(PL_RESULT_IMAGEFORMAT, "Unsupported image format conversion");
-    return false;
+    return 0;
 }
 
 unsigned int _plGetImageSize(PLImageFormat format, unsigned int width, unsigned int height) {
     switch(format) {
-        case PL_IMAGEFORMAT_RGB_DXT1:   return (width * height) >> 1;
-        case PL_IMAGEFORMAT_RGBA_DXT1:  return width * height * 4;
+        /* S3TC comes in whole blocks of 4x4 */
+        case PL_IMAGEFORMAT_RGB_DXT1:
+        case PL_IMAGEFORMAT_RGBA_DXT1:  return ((width + 3) / 4) * ((height + 3) / 4) * 8;
         case PL_IMAGEFORMAT_RGBA_DXT3:
-        case PL_IMAGEFORMAT_RGBA_DXT5:  return width * height;
+        case PL_IMAGEFORMAT_RGBA_DXT5:  return ((width + 3) / 4) * ((height + 3) / 4) * 16;
 
-        case PL_IMAGEFORMAT_RGB5A1:     return width * height * 2;
-        case PL_IMAGEFORMAT_RGB8:
-        case PL_IMAGEFORMAT_RGB565:     return width * height * 3;
+        case PL_IMAGEFORMAT_RGB4:
         case PL_IMAGEFORMAT_RGBA4:
+        case PL_IMAGEFORMAT_RGB5:
+        case PL_IMAGEFORMAT_RGB5A1:
+        case PL_IMAGEFORMAT_RGB565:     return width * height * 2;
+        case PL_IMAGEFORMAT_RGB8:       return width * height * 3;
         case PL_IMAGEFORMAT_RGBA8:      return width * height * 4;
         case PL_IMAGEFORMAT_RGBA16F:
         case PL_IMAGEFORMAT_RGBA16:     return width * height * 8;
+        case PL_IMAGEFORMAT_RGBA32F:    return width * height * 16;
+
+        case PL_IMAGEFORMAT_L1:         return ((width + 7) / 8) * height;
+        case PL_IMAGEFORMAT_L8:         return width * height;
 
         default:    return 0;
     }
@@ -232,32 +604,3 @@ bool plIsCompressedImageFormat(PLImageFormat format) {
             return true;
     }
 }
-
-#define scale_5to8(i) ((((double)(i)) / 31) * 255)
-
-uint8_t *_plImageDataRGB5A1toRGBA8(const uint8_t *src, size_t n_pixels) {
-    uint8_t *dst = malloc(n_pixels * 4);
-    if(dst == NULL) {
-        return NULL;
-    }
-
-    uint8_t *dp = dst;
-
-    for(size_t i = 0; i < n_pixels; ++i) {
-        /* Red */
-        *(dp++) = scale_5to8((src[0] & 0xF8) >> 3);
-
-        /* Green */
-        *(dp++) = scale_5to8(((src[0] & 0x07) << 2) | ((src[1] & 0xC0) >> 6));
-
-        /* Blue */
-        *(dp++) = scale_5to8((src[1] & 0x3E) >> 1);
-
-        /* Alpha */
-        *(dp++) = (src[1] & 0x01) ? 255 : 0;
-
-        src += 2;
-    }
-
-    return dst;
-}
@@ -53,20 +53,9 @@ typedef struct __attribute((packed)) BMPInfoHeader {
     uint32_t palette_important;
 } BMPInfoHeader;
 
-bool _plBMPFormatCheck(FILE *fin) {
-    rewind(fin);
-
-    uint8_t ident[2];
-    if(fread(&ident, sizeof(uint8_t), 2, fin) != 2) {
-        return false;
-    }
-
-    return (bool)(strncmp((const char*)ident, "BM", 2) == 0);
-}
-
-PLresult _plLoadBMPImage(FILE *fin, PLImage *out) {
+PLresult _plLoadBMPImage(PLBinaryReader *reader, PLImage *out) {
     BMPHeader header;
-    if (fread(&header, sizeof(BMPHeader), 1, fin) != 1) {
+    if (!plReadBinary(reader, &header, sizeof(BMPHeader))) {
         return PL_RESULT_FILEREAD;
     }
 
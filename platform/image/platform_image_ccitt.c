@@ -0,0 +1,503 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+
+#include <PL/platform_image.h>
+
+/*	CCITT Group 3 and 4 fax coding (ITU-T T.4 and T.6)
+ *	Each row is a series of alternating white and black runs, starting with
+ *	white, which are either coded as lengths (1D) or by where they change
+ *	relative to the row before (2D). Codes are looked up a whole table's
+ *	worth of bits at a time, rather than walked through a bit at a time.
+ */
+
+#define CCITT_WHITE_BITS    12  // longest white code
+#define CCITT_BLACK_BITS    13  // longest black code
+#define CCITT_MODE_BITS     7   // longest 2D mode code, bar the extensions
+
+#define CCITT_EOL           0x001   // 000000000001, as 12 bits
+
+typedef struct CCITTCode {
+    uint16_t run;       // Length of the run, anything from 64 up is followed by another code
+    uint8_t length;     // Number of bits for the code, 0 if it's not valid
+} CCITTCode;
+
+enum {
+    CCITT_PASS,
+    CCITT_HORIZONTAL,
+    CCITT_VERTICAL_0,
+    CCITT_VERTICAL_R1,
+    CCITT_VERTICAL_R2,
+    CCITT_VERTICAL_R3,
+    CCITT_VERTICAL_L1,
+    CCITT_VERTICAL_L2,
+    CCITT_VERTICAL_L3,
+    CCITT_EXTENSION,
+};
+
+static const int ccitt_vertical_offsets[] = { 0, 1, 2, 3, -1, -2, -3 };
+
+/////////////////////////////////////////////////////////////////
+// Codes
+
+static const char *ccitt_white_terminating[64] = {
+        "00110101", "000111", "0111", "1000", "1011", "1100", "1110", "1111",
+        "10011", "10100", "00111", "01000", "001000", "000011", "110100", "110101",
+        "101010", "101011", "0100111", "0001100", "0001000", "0010111", "0000011", "0000100",
+        "0101000", "0101011", "0010011", "0100100", "0011000", "00000010", "00000011", "00011010",
+        "00011011", "00010010", "00010011", "00010100", "00010101", "00010110", "00010111", "00101000",
+        "00101001", "00101010", "00101011", "00101100", "00101101", "00000100", "00000101", "00001010",
+        "00001011", "01010010", "01010011", "01010100", "01010101", "00100100", "00100101", "01011000",
+        "01011001", "01011010", "01011011", "01001010", "01001011", "00110010", "00110011", "00110100",
+};
+
+/* 64 through to 1728 */
+static const char *ccitt_white_makeup[27] = {
+        "11011", "10010", "010111", "0110111", "00110110", "00110111", "01100100",
+        "01100101", "01101000", "01100111", "011001100", "011001101", "011010010", "011010011",
+        "011010100", "011010101", "011010110", "011010111", "011011000", "011011001", "011011010",
+        "011011011", "010011000", "010011001", "010011010", "011000", "010011011",
+};
+
+static const char *ccitt_black_terminating[64] = {
+        "0000110111", "010", "11", "10", "011", "0011", "0010", "00011",
+        "000101", "000100", "0000100", "0000101", "0000111", "00000100", "00000111", "000011000",
+        "0000010111", "0000011000", "0000001000", "00001100111", "00001101000", "00001101100", "00000110111", "00000101000",
+        "00000010111", "00000011000", "000011001010", "000011001011", "000011001100", "000011001101", "000001101000", "000001101001",
+        "000001101010", "000001101011", "000011010010", "000011010011", "000011010100", "000011010101", "000011010110", "000011010111",
+        "000001101100", "000001101101", "000011011010", "000011011011", "000001010100", "000001010101", "000001010110", "000001010111",
+        "000001100100", "000001100101", "000001010010", "000001010011", "000000100100", "000000110111", "000000111000", "000000100111",
+        "000000101000", "000001011000", "000001011001", "000000101011", "000000101100", "000001011010", "000001100110", "000001100111",
+};
+
+/* 64 through to 1728 */
+static const char *ccitt_black_makeup[27] = {
+        "0000001111", "000011001000", "000011001001", "000001011011", "000000110011", "000000110100", "000000110101",
+        "0000001101100", "0000001101101", "0000001001010", "0000001001011", "0000001001100", "0000001001101", "0000001110010",
+        "0000001110011", "0000001110100", "0000001110101", "0000001110110", "0000001110111", "0000001010010", "0000001010011",
+        "0000001010100", "0000001010101", "0000001011010", "0000001011011", "0000001100100", "0000001100101",
+};
+
+/* 1792 through to 2560, shared by both white and black */
+static const char *ccitt_extended_makeup[13] = {
+        "00000001000", "00000001100", "00000001101", "000000010010", "000000010011", "000000010100", "000000010101",
+        "000000010110", "000000010111", "000000011100", "000000011101", "000000011110", "000000011111",
+};
+
+static const struct {
+    unsigned int mode;
+    const char *code;
+} ccitt_mode_codes[] = {
+        { CCITT_PASS,        "0001" },
+        { CCITT_HORIZONTAL,  "001" },
+        { CCITT_VERTICAL_0,  "1" },
+        { CCITT_VERTICAL_R1, "011" },
+        { CCITT_VERTICAL_R2, "000011" },
+        { CCITT_VERTICAL_R3, "0000011" },
+        { CCITT_VERTICAL_L1, "010" },
+        { CCITT_VERTICAL_L2, "000010" },
+        { CCITT_VERTICAL_L3, "0000010" },
+        { CCITT_EXTENSION,   "0000001" },
+};
+
+static CCITTCode ccitt_white_table[1 << CCITT_WHITE_BITS];
+static CCITTCode ccitt_black_table[1 << CCITT_BLACK_BITS];
+static CCITTCode ccitt_mode_table[1 << CCITT_MODE_BITS];
+
+/* Fills in every entry of the table beginning with the given code,
+ * whatever the bits that follow it happen to be. */
+static void AddCCITTCode(CCITTCode *table, unsigned int table_bits, const char *code, unsigned int run) {
+    unsigned int length = (unsigned int)strlen(code);
+    plAssert(length > 0 && length <= table_bits);
+
+    unsigned int value = 0;
+    for(unsigned int i = 0; i < length; ++i) {
+        value = (value << 1) | (code[i] == '1');
+    }
+
+    unsigned int shift = table_bits - length;
+    for(unsigned int i = value << shift; i < ((value + 1) << shift); ++i) {
+        plAssert(table[i].length == 0);    // no code should be the start of another
+        table[i].run = (uint16_t)run;
+        table[i].length = (uint8_t)length;
+    }
+}
+
+static void AddCCITTRunCodes(CCITTCode *table, unsigned int table_bits,
+                             const char **terminating, const char **makeup) {
+    for(unsigned int i = 0; i < 64; ++i) {
+        AddCCITTCode(table, table_bits, terminating[i], i);
+    }
+    for(unsigned int i = 0; i < 27; ++i) {
+        AddCCITTCode(table, table_bits, makeup[i], (i + 1) * 64);
+    }
+    for(unsigned int i = 0; i < plArrayElements(ccitt_extended_makeup); ++i) {
+        AddCCITTCode(table, table_bits, ccitt_extended_makeup[i], 1792 + i * 64);
+    }
+}
+
+static void SetupCCITTTables(void) {
+    AddCCITTRunCodes(ccitt_white_table, CCITT_WHITE_BITS, ccitt_white_terminating, ccitt_white_makeup);
+    AddCCITTRunCodes(ccitt_black_table, CCITT_BLACK_BITS, ccitt_black_terminating, ccitt_black_makeup);
+    for(unsigned int i = 0; i < plArrayElements(ccitt_mode_codes); ++i) {
+        AddCCITTCode(ccitt_mode_table, CCITT_MODE_BITS, ccitt_mode_codes[i].code, ccitt_mode_codes[i].mode);
+    }
+}
+
+/////////////////////////////////////////////////////////////////
+// Bits
+
+typedef struct CCITTBits {
+    const uint8_t *src, *end;
+
+    uint64_t buffer;        // Next bits up, from the most significant down
+    unsigned int count;     // Number of bits within the buffer, including any padding beyond the end
+
+    size_t consumed, total; // Bits used up so far, out of those there are
+} CCITTBits;
+
+/* Tops up the buffer, with zeros once there's nothing left. */
+static PL_INLINE void RefillCCITTBits(CCITTBits *bits) {
+    while(bits->count <= 56) {
+        uint64_t byte = (bits->src < bits->end) ? *bits->src++ : 0;
+        bits->buffer |= byte << (56 - bits->count);
+        bits->count += 8;
+    }
+}
+
+static PL_INLINE unsigned int PeekCCITTBits(const CCITTBits *bits, unsigned int n) {
+    return (unsigned int)(bits->buffer >> (64 - n));
+}
+
+static PL_INLINE void ConsumeCCITTBits(CCITTBits *bits, unsigned int n) {
+    bits->buffer <<= n;
+    bits->count -= n;
+    bits->consumed += n;
+}
+
+static PL_INLINE bool CCITTBitsLeft(const CCITTBits *bits) {
+    return bits->consumed < bits->total;
+}
+
+/* Skips over an EOL, along with any fill bits ahead of it, if one's next. */
+static bool SkipCCITTEOL(CCITTBits *bits) {
+    RefillCCITTBits(bits);
+    if(!CCITTBitsLeft(bits) || PeekCCITTBits(bits, 11) != 0) {
+        return false;
+    }
+
+    for(;;) {
+        RefillCCITTBits(bits);
+        if(!CCITTBitsLeft(bits)) {
+            return false;
+        }
+
+        unsigned int zeros = (bits->buffer != 0) ? (unsigned int)__builtin_clzll(bits->buffer) : 64;
+        if(zeros >= 56) {
+            ConsumeCCITTBits(bits, 56);
+            continue;
+        }
+
+        ConsumeCCITTBits(bits, zeros + 1);
+        return true;
+    }
+}
+
+/* Hunts down the next EOL after broken data, a bit at a time. */
+static bool FindCCITTEOL(CCITTBits *bits) {
+    while(CCITTBitsLeft(bits)) {
+        RefillCCITTBits(bits);
+        if(PeekCCITTBits(bits, 12) == CCITT_EOL) {
+            ConsumeCCITTBits(bits, 12);
+            return true;
+        }
+        ConsumeCCITTBits(bits, 1);
+    }
+
+    return false;
+}
+
+/////////////////////////////////////////////////////////////////
+// Rows
+
+/* Each row is held as the positions at which the colour changes, the first
+ * to black, the next back to white and so on, followed by the width of
+ * the row at least three times over so searches always come to a stop. */
+#define CCITT_ROW_PADDING   4
+
+typedef struct CCITTRow {
+    unsigned int *changes;
+    unsigned int num_changes;
+} CCITTRow;
+
+typedef enum CCITTStatus {
+    CCITT_STATUS_OK,
+    CCITT_STATUS_END,       // ran out of data, or hit the end of the page
+    CCITT_STATUS_ERROR,
+} CCITTStatus;
+
+static PL_INLINE bool AddCCITTChange(CCITTRow *row, unsigned int position, unsigned int width) {
+    if(position > width || row->num_changes > width) {
+        return false;
+    }
+
+    row->changes[row->num_changes++] = position;
+    return true;
+}
+
+static void FinishCCITTRow(CCITTRow *row, unsigned int width) {
+    for(unsigned int i = 0; i < CCITT_ROW_PADDING; ++i) {
+        row->changes[row->num_changes + i] = width;
+    }
+}
+
+/* Reads in a run of the given colour, made up of however many codes. */
+static CCITTStatus ReadCCITTRun(CCITTBits *bits, bool black, unsigned int *run) {
+    const CCITTCode *table = black ? ccitt_black_table : ccitt_white_table;
+    unsigned int table_bits = black ? CCITT_BLACK_BITS : CCITT_WHITE_BITS;
+
+    *run = 0;
+    for(;;) {
+        if(!CCITTBitsLeft(bits)) {
+            return CCITT_STATUS_END;
+        }
+
+        RefillCCITTBits(bits);
+        const CCITTCode *code = &table[PeekCCITTBits(bits, table_bits)];
+        if(code->length == 0) {
+            return CCITT_STATUS_ERROR;
+        }
+
+        ConsumeCCITTBits(bits, code->length);
+        *run += code->run;
+        if(code->run < 64) {
+            return CCITT_STATUS_OK;
+        }
+    }
+}
+
+static CCITTStatus DecodeCCITTRow1D(CCITTBits *bits, CCITTRow *row, unsigned int width) {
+    unsigned int a0 = 0;
+    bool black = false;
+    while(a0 < width) {
+        unsigned int run;
+        CCITTStatus status = ReadCCITTRun(bits, black, &run);
+        if(status != CCITT_STATUS_OK) {
+            return status;
+        }
+
+        a0 += run;
+        if(!AddCCITTChange(row, a0, width)) {
+            return CCITT_STATUS_ERROR;
+        }
+        black = !black;
+    }
+
+    return CCITT_STATUS_OK;
+}
+
+static CCITTStatus DecodeCCITTRow2D(CCITTBits *bits, const CCITTRow *reference, CCITTRow *row, unsigned int width) {
+    const unsigned int *ref = reference->changes;
+
+    /* a0 starts out on an imaginary white pixel just before the row */
+    int a0 = -1;
+    unsigned int b = 0;
+    bool black = false;
+    while(a0 < (int)width) {
+        /* b1 is the first change on the reference row past a0 to the
+         * opposite colour, which for black is every other one from the first */
+        while((int)ref[b] <= a0 && ref[b] < width) {
+            b++;
+        }
+        if((b & 1) != black) {
+            b++;
+        }
+        unsigned int b1 = ref[b], b2 = ref[b + 1];
+
+        if(!CCITTBitsLeft(bits)) {
+            return CCITT_STATUS_END;
+        }
+
+        RefillCCITTBits(bits);
+        const CCITTCode *code = &ccitt_mode_table[PeekCCITTBits(bits, CCITT_MODE_BITS)];
+        if(code->length == 0) {
+            /* the page may be marked as finished with a pair of EOLs */
+            return (PeekCCITTBits(bits, 12) == CCITT_EOL) ? CCITT_STATUS_END : CCITT_STATUS_ERROR;
+        }
+        ConsumeCCITTBits(bits, code->length);
+
+        switch(code->run) {
+            case CCITT_PASS:
+                a0 = (int)b2;
+                break;
+
+            case CCITT_HORIZONTAL: {
+                unsigned int first, second;
+                CCITTStatus status = ReadCCITTRun(bits, black, &first);
+                if(status == CCITT_STATUS_OK) {
+                    status = ReadCCITTRun(bits, !black, &second);
+                }
+                if(status != CCITT_STATUS_OK) {
+                    return status;
+                }
+
+                unsigned int a1 = ((a0 < 0) ? 0 : (unsigned int)a0) + first;
+                unsigned int a2 = a1 + second;
+                if(!AddCCITTChange(row, a1, width) || !AddCCITTChange(row, a2, width)) {
+                    return CCITT_STATUS_ERROR;
+                }
+                a0 = (int)a2;
+                break;
+            }
+
+            case CCITT_EXTENSION:
+                /* uncompressed mode isn't supported */
+                return CCITT_STATUS_ERROR;
+
+            default: {
+                int a1 = (int)b1 + ccitt_vertical_offsets[code->run - CCITT_VERTICAL_0];
+                if(a1 < 0 || a1 < a0 || !AddCCITTChange(row, (unsigned int)a1, width)) {
+                    return CCITT_STATUS_ERROR;
+                }
+                a0 = a1;
+                black = !black;
+
+                /* moving back to the left may have passed over a change */
+                if(b > 0) {
+                    b--;
+                }
+                break;
+            }
+        }
+    }
+
+    return CCITT_STATUS_OK;
+}
+
+/* Sets the bits for the given range of pixels. */
+static void FillCCITTRun(uint8_t *dest, unsigned int start, unsigned int end) {
+    if(start >= end) {
+        return;
+    }
+
+    unsigned int first = start >> 3, last = (end - 1) >> 3;
+    uint8_t head = (uint8_t)(0xFF >> (start & 7));
+    uint8_t tail = (uint8_t)(0xFF << (7 - ((end - 1) & 7)));
+    if(first == last) {
+        dest[first] |= head & tail;
+        return;
+    }
+
+    dest[first] |= head;
+    memset(dest + first + 1, 0xFF, last - first - 1);
+    dest[last] |= tail;
+}
+
+static void RenderCCITTRow(const CCITTRow *row, unsigned int width, uint8_t *dest) {
+    for(unsigned int i = 0; i < row->num_changes; i += 2) {
+        unsigned int end = (i + 1 < row->num_changes) ? row->changes[i + 1] : width;
+        FillCCITTRun(dest, row->changes[i], end);
+    }
+}
+
+/////////////////////////////////////////////////////////////////
+
+/* Decodes up to the given number of rows into dest, which should be cleared
+ * beforehand, setting the bits for black pixels, most significant first.
+ * Anything left over once the data runs out is left white. Group 3 picks up
+ * again from the next row after any broken one, while Group 4 can't. */
+bool DecodeCCITTImage(const uint8_t *src, size_t length, CCITTCoding coding, unsigned int options,
+                      unsigned int width, unsigned int rows, uint8_t *dest, size_t pitch) {
+    static PLImageOnce once = PL_IMAGE_ONCE_INIT;
+    CallImageOnce(&once, SetupCCITTTables);
+
+    if(width == 0) {
+        return true;
+    }
+
+    unsigned int *changes = malloc(sizeof(unsigned int) * ((width + 1 + CCITT_ROW_PADDING) * 2));
+    if(changes == NULL) {
+        return false;
+    }
+
+    /* the row before the first is taken to be white */
+    CCITTRow current = { changes, 0 };
+    CCITTRow reference = { changes + width + 1 + CCITT_ROW_PADDING, 0 };
+    FinishCCITTRow(&reference, width);
+
+    CCITTBits bits;
+    memset(&bits, 0, sizeof(CCITTBits));
+    bits.src = src;
+    bits.end = src + length;
+    bits.total = length * 8;
+
+    bool result = true;
+    for(unsigned int y = 0; y < rows; ++y) {
+        bool two_d = (coding == CCITT_CODING_G4);
+        if(coding == CCITT_CODING_G3) {
+            SkipCCITTEOL(&bits);
+            if(options & CCITT_OPTION_2D) {
+                RefillCCITTBits(&bits);
+                two_d = (PeekCCITTBits(&bits, 1) == 0);
+                ConsumeCCITTBits(&bits, 1);
+            }
+        } else if(coding == CCITT_CODING_RLE && y > 0) {
+            RefillCCITTBits(&bits);
+            ConsumeCCITTBits(&bits, (unsigned int)((8 - (bits.consumed & 7)) & 7));
+        }
+
+        if(!CCITTBitsLeft(&bits)) {
+            break;
+        }
+
+        current.num_changes = 0;
+        CCITTStatus status = two_d ? DecodeCCITTRow2D(&bits, &reference, &current, width) :
+                             DecodeCCITTRow1D(&bits, &current, width);
+        FinishCCITTRow(&current, width);
+        RenderCCITTRow(&current, width, dest + pitch * y);
+
+        if(status == CCITT_STATUS_END) {
+            break;
+        } else if(status == CCITT_STATUS_ERROR) {
+            if(coding != CCITT_CODING_G3) {
+                result = false;
+                break;
+            }
+
+            if(!FindCCITTEOL(&bits)) {
+                break;
+            }
+        }
+
+        CCITTRow swap = reference;
+        reference = current;
+        current = swap;
+    }
+
+    free(changes);
+
+    return result;
+}
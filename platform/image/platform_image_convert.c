@@ -0,0 +1,1040 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+
+#include <PL/platform_image.h>
+
+#if !defined(_WIN32)
+#   include <pthread.h>
+#   include <unistd.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#   include <immintrin.h>
+#   define CONVERT_X86
+#endif
+
+/*	Pixel format conversion
+ *	Anything without a more direct route, such as between two byte orders
+ *	or two high dynamic range formats, goes through a row of 8-bit RGBA,
+ *	or for S3TC a row of blocks' worth.
+ *	The vector kernels come out exactly the same as the plain C, and levels
+ *	are converted in place wherever the pixels don't get any larger, bar S3TC.
+ *	Packed formats are little-endian 16-bit words, holding the channels of
+ *	their colour format from the least significant bit up.
+ */
+
+#define CONVERT_MAX_THREADS         16
+#define CONVERT_THREAD_THRESHOLD    (256 * 1024)    // converted size of a level before it's worth spreading out
+#define CONVERT_BAND_ROWS           16              // rows handed out to a thread at a time
+
+enum {
+    CONVERT_CHANNEL_RED,
+    CONVERT_CHANNEL_GREEN,
+    CONVERT_CHANNEL_BLUE,
+    CONVERT_CHANNEL_ALPHA,
+};
+
+typedef enum ConvertKind {
+    CONVERT_KIND_BYTES,     // RGB8 and RGBA8
+    CONVERT_KIND_PACKED,    // RGB4, RGBA4, RGB5, RGB5A1 and RGB565
+    CONVERT_KIND_GREY,      // L8
+    CONVERT_KIND_BILEVEL,   // L1, which can only be converted from
+    CONVERT_KIND_HDR,       // RGBA16, RGBA16F and RGBA32F
+    CONVERT_KIND_S3TC,      // DXT1, DXT3 and DXT5
+} ConvertKind;
+
+typedef struct ConvertFormat {
+    PLImageFormat format;
+    ConvertKind kind;
+    unsigned int channels;
+    unsigned int pixel_size;    // in bytes, 0 for bilevel and S3TC
+    unsigned int block_size;    // in bytes, for each 4x4 block of S3TC
+
+    int8_t order[4];            // which of RGBA each stored channel is
+    int8_t rgba[4];             // and where each of RGBA is stored, -1 for no alpha
+    bool straight;              // stored as RGBA, or near enough
+
+    /* where each of RGBA sits within a packed pixel, 0 bits for no alpha */
+    uint8_t shift[4], bits[4];
+} ConvertFormat;
+
+/* Scales a packed channel of the given number of bits up to 8, rounded to
+ * nearest, as (value * scale + bias) >> shift, all within 16 bits; a channel
+ * that isn't there at all comes out opaque. */
+static const struct {
+    uint16_t scale, bias, shift;
+} packed_expansions[7] = {
+        [0] = { 0, 255, 0 },
+        [1] = { 255, 0, 0 },
+        [4] = { 17, 0, 0 },
+        [5] = { 527, 23, 6 },
+        [6] = { 259, 33, 6 },
+};
+
+/* each byte of a bilevel image, spread out to a byte per pixel */
+static uint8_t l1_expanded[256][8];
+
+static void SetupL1Expanded(void) {
+    for(unsigned int i = 0; i < 256; ++i) {
+        for(unsigned int j = 0; j < 8; ++j) {
+            l1_expanded[i][j] = (uint8_t)((i & (0x80 >> j)) ? 255 : 0);
+        }
+    }
+}
+
+static void ExpandBilevelRow(const uint8_t *src, uint8_t *dest, unsigned int width) {
+    unsigned int x = 0;
+    for(; x + 8 <= width; x += 8) {
+        memcpy(dest + x, l1_expanded[src[x >> 3]], 8);
+    }
+    if(x < width) {
+        memcpy(dest + x, l1_expanded[src[x >> 3]], width - x);
+    }
+}
+
+/////////////////////////////////////////////////////////////////
+
+/* Rearranges the channels of each pixel, taking each from the given index in
+ * the source or making it opaque for -1. Works in place so long as the pixels
+ * don't get any larger. */
+static void ShuffleBytesC(const uint8_t *src, unsigned int src_channels, uint8_t *dest, unsigned int dest_channels,
+                          const int8_t *map, unsigned int width) {
+    for(unsigned int x = 0; x < width; ++x, src += src_channels, dest += dest_channels) {
+        uint8_t pixel[4];
+        for(unsigned int i = 0; i < dest_channels; ++i) {
+            pixel[i] = (map[i] < 0) ? 255 : src[map[i]];
+        }
+        memcpy(dest, pixel, dest_channels);
+    }
+}
+
+static void DecodePackedC(const uint8_t *src, uint8_t *dest, const ConvertFormat *format, unsigned int width) {
+    for(unsigned int x = 0; x < width; ++x, src += 2, dest += 4) {
+        unsigned int pixel = src[0] | (src[1] << 8);
+        for(unsigned int c = 0; c < 4; ++c) {
+            unsigned int bits = format->bits[c];
+            unsigned int value = (pixel >> format->shift[c]) & ((1u << bits) - 1);
+            dest[c] = (uint8_t)((value * packed_expansions[bits].scale + packed_expansions[bits].bias) >>
+                                packed_expansions[bits].shift);
+        }
+    }
+}
+
+/* Each channel is scaled down to exactly round(value * max / 255). */
+static void EncodePackedC(const uint8_t *src, uint8_t *dest, const ConvertFormat *format, unsigned int width) {
+    for(unsigned int x = 0; x < width; ++x, src += 4, dest += 2) {
+        unsigned int pixel = 0;
+        for(unsigned int c = 0; c < 4; ++c) {
+            unsigned int t = src[c] * ((1u << format->bits[c]) - 1) + 128;
+            pixel |= ((t + (t >> 8)) >> 8) << format->shift[c];
+        }
+        dest[0] = (uint8_t)pixel;
+        dest[1] = (uint8_t)(pixel >> 8);
+    }
+}
+
+static void ExpandGreyC(const uint8_t *src, uint8_t *dest, unsigned int width) {
+    for(unsigned int x = 0; x < width; ++x, dest += 4) {
+        dest[0] = dest[1] = dest[2] = src[x];
+        dest[3] = 255;
+    }
+}
+
+/* Rec. 601 luma, in 8-bit fixed point */
+static void ReduceGreyC(const uint8_t *src, uint8_t *dest, unsigned int width) {
+    for(unsigned int x = 0; x < width; ++x, src += 4) {
+        dest[x] = (uint8_t)((src[0] * 77 + src[1] * 150 + src[2] * 29 + 128) >> 8);
+    }
+}
+
+#if defined(CONVERT_X86)
+
+/* four pixels at a time, with alpha filled in afterwards where there's none to take */
+__attribute__((target("ssse3")))
+static void ShuffleBytesSSSE3(const uint8_t *src, unsigned int src_channels, uint8_t *dest, unsigned int dest_channels,
+                              const int8_t *map, unsigned int width) {
+    int8_t indices[16], opaque[16];
+    memset(indices, -1, sizeof(indices));
+    memset(opaque, 0, sizeof(opaque));
+    for(unsigned int p = 0; p < 4; ++p) {
+        for(unsigned int i = 0; i < dest_channels; ++i) {
+            indices[p * dest_channels + i] = (int8_t)((map[i] < 0) ? -1 : (int)(p * src_channels) + map[i]);
+            opaque[p * dest_channels + i] = (int8_t)((map[i] < 0) ? -1 : 0);
+        }
+    }
+
+    __m128i shuffle = _mm_loadu_si128((const __m128i*)indices);
+    __m128i fill = _mm_loadu_si128((const __m128i*)opaque);
+
+    /* 16 bytes are read at a time, so three channel rows stop short of the end */
+    unsigned int x = 0, margin = (src_channels == 4) ? 4 : 6;
+    for(; x + margin <= width; x += 4) {
+        __m128i pixels = _mm_loadu_si128((const __m128i*)(src + x * src_channels));
+        pixels = _mm_or_si128(_mm_shuffle_epi8(pixels, shuffle), fill);
+        if(dest_channels == 4) {
+            _mm_storeu_si128((__m128i*)(dest + x * 4), pixels);
+        } else {
+            uint32_t last = (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(pixels, 8));
+            _mm_storel_epi64((__m128i*)(dest + x * 3), pixels);
+            memcpy(dest + x * 3 + 8, &last, sizeof(last));
+        }
+    }
+
+    ShuffleBytesC(src + x * src_channels, src_channels, dest + x * dest_channels, dest_channels, map, width - x);
+}
+
+__attribute__((target("sse2")))
+static void DecodePackedSSE2(const uint8_t *src, uint8_t *dest, const ConvertFormat *format, unsigned int width) {
+    __m128i mask[4], scale[4], bias[4], shift[4], expand[4];
+    for(unsigned int c = 0; c < 4; ++c) {
+        unsigned int bits = format->bits[c];
+        mask[c] = _mm_set1_epi16((short)((1u << bits) - 1));
+        scale[c] = _mm_set1_epi16((short)packed_expansions[bits].scale);
+        bias[c] = _mm_set1_epi16((short)packed_expansions[bits].bias);
+        shift[c] = _mm_cvtsi32_si128(format->shift[c]);
+        expand[c] = _mm_cvtsi32_si128(packed_expansions[bits].shift);
+    }
+
+    unsigned int x = 0;
+    for(; x + 8 <= width; x += 8) {
+        __m128i pixels = _mm_loadu_si128((const __m128i*)(src + x * 2));
+        __m128i channels[4];
+        for(unsigned int c = 0; c < 4; ++c) {
+            __m128i value = _mm_and_si128(_mm_srl_epi16(pixels, shift[c]), mask[c]);
+            channels[c] = _mm_srl_epi16(_mm_add_epi16(_mm_mullo_epi16(value, scale[c]), bias[c]), expand[c]);
+        }
+
+        __m128i rg = _mm_or_si128(channels[0], _mm_slli_epi16(channels[1], 8));
+        __m128i ba = _mm_or_si128(channels[2], _mm_slli_epi16(channels[3], 8));
+        _mm_storeu_si128((__m128i*)(dest + x * 4), _mm_unpacklo_epi16(rg, ba));
+        _mm_storeu_si128((__m128i*)(dest + x * 4 + 16), _mm_unpackhi_epi16(rg, ba));
+    }
+
+    DecodePackedC(src + x * 2, dest + x * 4, format, width - x);
+}
+
+/* four pixels, one to each 32-bit lane */
+__attribute__((target("sse2")))
+static PL_INLINE __m128i EncodePacked4SSE2(__m128i pixels, const __m128i *scale, const __m128i *shift) {
+    const __m128i byte = _mm_set1_epi32(0xFF);
+    const __m128i half = _mm_set1_epi32(128);
+    __m128i out = _mm_setzero_si128();
+    for(unsigned int c = 0; c < 4; ++c) {
+        __m128i value = _mm_and_si128(_mm_srli_epi32(pixels, (int)(c * 8)), byte);
+        __m128i t = _mm_add_epi32(_mm_mullo_epi16(value, scale[c]), half);
+        t = _mm_srli_epi32(_mm_add_epi32(t, _mm_srli_epi32(t, 8)), 8);
+        out = _mm_or_si128(out, _mm_sll_epi32(t, shift[c]));
+    }
+    return out;
+}
+
+__attribute__((target("sse2")))
+static void EncodePackedSSE2(const uint8_t *src, uint8_t *dest, const ConvertFormat *format, unsigned int width) {
+    __m128i scale[4], shift[4];
+    for(unsigned int c = 0; c < 4; ++c) {
+        scale[c] = _mm_set1_epi32((int)((1u << format->bits[c]) - 1));
+        shift[c] = _mm_cvtsi32_si128(format->shift[c]);
+    }
+
+    /* biased, so the full 16 bits get through a signed pack */
+    const __m128i bias = _mm_set1_epi32(0x8000);
+    const __m128i unbias = _mm_set1_epi16((short)0x8000);
+
+    unsigned int x = 0;
+    for(; x + 8 <= width; x += 8) {
+        __m128i lo = EncodePacked4SSE2(_mm_loadu_si128((const __m128i*)(src + x * 4)), scale, shift);
+        __m128i hi = EncodePacked4SSE2(_mm_loadu_si128((const __m128i*)(src + x * 4 + 16)), scale, shift);
+        __m128i packed = _mm_packs_epi32(_mm_sub_epi32(lo, bias), _mm_sub_epi32(hi, bias));
+        _mm_storeu_si128((__m128i*)(dest + x * 2), _mm_xor_si128(packed, unbias));
+    }
+
+    EncodePackedC(src + x * 4, dest + x * 2, format, width - x);
+}
+
+__attribute__((target("sse2")))
+static void ExpandGreySSE2(const uint8_t *src, uint8_t *dest, unsigned int width) {
+    const __m128i opaque = _mm_set1_epi8((char)0xFF);
+
+    unsigned int x = 0;
+    for(; x + 16 <= width; x += 16) {
+        __m128i grey = _mm_loadu_si128((const __m128i*)(src + x));
+        __m128i gg = _mm_unpacklo_epi8(grey, grey);
+        __m128i ga = _mm_unpacklo_epi8(grey, opaque);
+        _mm_storeu_si128((__m128i*)(dest + x * 4), _mm_unpacklo_epi16(gg, ga));
+        _mm_storeu_si128((__m128i*)(dest + x * 4 + 16), _mm_unpackhi_epi16(gg, ga));
+        gg = _mm_unpackhi_epi8(grey, grey);
+        ga = _mm_unpackhi_epi8(grey, opaque);
+        _mm_storeu_si128((__m128i*)(dest + x * 4 + 32), _mm_unpacklo_epi16(gg, ga));
+        _mm_storeu_si128((__m128i*)(dest + x * 4 + 48), _mm_unpackhi_epi16(gg, ga));
+    }
+
+    ExpandGreyC(src + x, dest + x * 4, width - x);
+}
+
+__attribute__((target("sse2")))
+static PL_INLINE __m128i ReduceGrey4SSE2(__m128i pixels) {
+    const __m128i byte = _mm_set1_epi32(0xFF);
+    __m128i r = _mm_mullo_epi16(_mm_and_si128(pixels, byte), _mm_set1_epi32(77));
+    __m128i g = _mm_mullo_epi16(_mm_and_si128(_mm_srli_epi32(pixels, 8), byte), _mm_set1_epi32(150));
+    __m128i b = _mm_mullo_epi16(_mm_and_si128(_mm_srli_epi32(pixels, 16), byte), _mm_set1_epi32(29));
+    __m128i sum = _mm_add_epi32(_mm_add_epi32(r, g), _mm_add_epi32(b, _mm_set1_epi32(128)));
+    return _mm_srli_epi32(sum, 8);
+}
+
+__attribute__((target("sse2")))
+static void ReduceGreySSE2(const uint8_t *src, uint8_t *dest, unsigned int width) {
+    unsigned int x = 0;
+    for(; x + 16 <= width; x += 16) {
+        const __m128i *pixels = (const __m128i*)(src + x * 4);
+        __m128i lo = _mm_packs_epi32(ReduceGrey4SSE2(_mm_loadu_si128(pixels)),
+                                     ReduceGrey4SSE2(_mm_loadu_si128(pixels + 1)));
+        __m128i hi = _mm_packs_epi32(ReduceGrey4SSE2(_mm_loadu_si128(pixels + 2)),
+                                     ReduceGrey4SSE2(_mm_loadu_si128(pixels + 3)));
+        _mm_storeu_si128((__m128i*)(dest + x), _mm_packus_epi16(lo, hi));
+    }
+
+    ReduceGreyC(src + x * 4, dest + x, width - x);
+}
+
+/* only worth it between four channels, the rest fall back on SSSE3 */
+__attribute__((target("avx2")))
+static void ShuffleBytesAVX2(const uint8_t *src, unsigned int src_channels, uint8_t *dest, unsigned int dest_channels,
+                             const int8_t *map, unsigned int width) {
+    if(src_channels != 4 || dest_channels != 4) {
+        ShuffleBytesSSSE3(src, src_channels, dest, dest_channels, map, width);
+        return;
+    }
+
+    /* indices are within each 128-bit lane */
+    int8_t indices[32], opaque[32];
+    for(unsigned int p = 0; p < 8; ++p) {
+        for(unsigned int i = 0; i < 4; ++i) {
+            indices[p * 4 + i] = (int8_t)((map[i] < 0) ? -1 : (int)((p & 3) * 4) + map[i]);
+            opaque[p * 4 + i] = (int8_t)((map[i] < 0) ? -1 : 0);
+        }
+    }
+
+    __m256i shuffle = _mm256_loadu_si256((const __m256i*)indices);
+    __m256i fill = _mm256_loadu_si256((const __m256i*)opaque);
+
+    unsigned int x = 0;
+    for(; x + 8 <= width; x += 8) {
+        __m256i pixels = _mm256_loadu_si256((const __m256i*)(src + x * 4));
+        _mm256_storeu_si256((__m256i*)(dest + x * 4), _mm256_or_si256(_mm256_shuffle_epi8(pixels, shuffle), fill));
+    }
+
+    ShuffleBytesSSSE3(src + x * 4, 4, dest + x * 4, 4, map, width - x);
+}
+
+__attribute__((target("avx2")))
+static void DecodePackedAVX2(const uint8_t *src, uint8_t *dest, const ConvertFormat *format, unsigned int width) {
+    __m256i mask[4], scale[4], bias[4];
+    __m128i shift[4], expand[4];
+    for(unsigned int c = 0; c < 4; ++c) {
+        unsigned int bits = format->bits[c];
+        mask[c] = _mm256_set1_epi16((short)((1u << bits) - 1));
+        scale[c] = _mm256_set1_epi16((short)packed_expansions[bits].scale);
+        bias[c] = _mm256_set1_epi16((short)packed_expansions[bits].bias);
+        shift[c] = _mm_cvtsi32_si128(format->shift[c]);
+        expand[c] = _mm_cvtsi32_si128(packed_expansions[bits].shift);
+    }
+
+    unsigned int x = 0;
+    for(; x + 16 <= width; x += 16) {
+        __m256i pixels = _mm256_loadu_si256((const __m256i*)(src + x * 2));
+        __m256i channels[4];
+        for(unsigned int c = 0; c < 4; ++c) {
+            __m256i value = _mm256_and_si256(_mm256_srl_epi16(pixels, shift[c]), mask[c]);
+            channels[c] = _mm256_srl_epi16(_mm256_add_epi16(_mm256_mullo_epi16(value, scale[c]), bias[c]), expand[c]);
+        }
+
+        /* unpacking works within each lane, leaving pixels 0-3 and 8-11, then 4-7 and 12-15 */
+        __m256i rg = _mm256_or_si256(channels[0], _mm256_slli_epi16(channels[1], 8));
+        __m256i ba = _mm256_or_si256(channels[2], _mm256_slli_epi16(channels[3], 8));
+        __m256i lo = _mm256_unpacklo_epi16(rg, ba);
+        __m256i hi = _mm256_unpackhi_epi16(rg, ba);
+        _mm256_storeu_si256((__m256i*)(dest + x * 4), _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i*)(dest + x * 4 + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+
+    DecodePackedSSE2(src + x * 2, dest + x * 4, format, width - x);
+}
+
+__attribute__((target("avx2")))
+static PL_INLINE __m256i EncodePacked8AVX2(__m256i pixels, const __m256i *scale, const __m128i *shift) {
+    const __m256i byte = _mm256_set1_epi32(0xFF);
+    const __m256i half = _mm256_set1_epi32(128);
+    __m256i out = _mm256_setzero_si256();
+    for(unsigned int c = 0; c < 4; ++c) {
+        __m256i value = _mm256_and_si256(_mm256_srli_epi32(pixels, (int)(c * 8)), byte);
+        __m256i t = _mm256_add_epi32(_mm256_mullo_epi16(value, scale[c]), half);
+        t = _mm256_srli_epi32(_mm256_add_epi32(t, _mm256_srli_epi32(t, 8)), 8);
+        out = _mm256_or_si256(out, _mm256_sll_epi32(t, shift[c]));
+    }
+    return out;
+}
+
+__attribute__((target("avx2")))
+static void EncodePackedAVX2(const uint8_t *src, uint8_t *dest, const ConvertFormat *format, unsigned int width) {
+    __m256i scale[4];
+    __m128i shift[4];
+    for(unsigned int c = 0; c < 4; ++c) {
+        scale[c] = _mm256_set1_epi32((int)((1u << format->bits[c]) - 1));
+        shift[c] = _mm_cvtsi32_si128(format->shift[c]);
+    }
+
+    unsigned int x = 0;
+    for(; x + 16 <= width; x += 16) {
+        __m256i lo = EncodePacked8AVX2(_mm256_loadu_si256((const __m256i*)(src + x * 4)), scale, shift);
+        __m256i hi = EncodePacked8AVX2(_mm256_loadu_si256((const __m256i*)(src + x * 4 + 32)), scale, shift);
+        /* packing also works within each lane, so the middle two quarters need swapping */
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256((__m256i*)(dest + x * 2), packed);
+    }
+
+    EncodePackedSSE2(src + x * 4, dest + x * 2, format, width - x);
+}
+
+#endif
+
+/////////////////////////////////////////////////////////////////
+
+typedef struct ConvertKernels {
+    void (*ShuffleBytes)(const uint8_t *src, unsigned int src_channels, uint8_t *dest, unsigned int dest_channels,
+                         const int8_t *map, unsigned int width);
+    void (*DecodePacked)(const uint8_t *src, uint8_t *dest, const ConvertFormat *format, unsigned int width);
+    void (*EncodePacked)(const uint8_t *src, uint8_t *dest, const ConvertFormat *format, unsigned int width);
+    void (*ExpandGrey)(const uint8_t *src, uint8_t *dest, unsigned int width);
+    void (*ReduceGrey)(const uint8_t *src, uint8_t *dest, unsigned int width);
+} ConvertKernels;
+
+static ConvertKernels convert_kernels = {
+        ShuffleBytesC,
+        DecodePackedC, EncodePackedC,
+        ExpandGreyC, ReduceGreyC,
+};
+
+static void SetupConvertKernels(void) {
+    SetupL1Expanded();
+
+#if defined(CONVERT_X86)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("sse2")) {
+        convert_kernels.DecodePacked = DecodePackedSSE2;
+        convert_kernels.EncodePacked = EncodePackedSSE2;
+        convert_kernels.ExpandGrey = ExpandGreySSE2;
+        convert_kernels.ReduceGrey = ReduceGreySSE2;
+    }
+    if(__builtin_cpu_supports("ssse3")) {
+        convert_kernels.ShuffleBytes = ShuffleBytesSSSE3;
+    }
+    if(__builtin_cpu_supports("avx2")) {
+        convert_kernels.ShuffleBytes = ShuffleBytesAVX2;
+        convert_kernels.DecodePacked = DecodePackedAVX2;
+        convert_kernels.EncodePacked = EncodePackedAVX2;
+    }
+#endif
+}
+
+static const ConvertKernels *GetConvertKernels(void) {
+    static PLImageOnce once = PL_IMAGE_ONCE_INIT;
+    CallImageOnce(&once, SetupConvertKernels);
+    return &convert_kernels;
+}
+
+/////////////////////////////////////////////////////////////////
+
+/* Which of RGBA each stored channel is, for a format with the given number of
+ * them, dropping alpha or tacking it on the end where the two disagree. */
+static void GetChannelOrder(PLColourFormat colour_format, unsigned int channels, int8_t *order) {
+    static const char *channel_orders[] = {
+            [PL_COLOURFORMAT_ARGB] = "ARGB",
+            [PL_COLOURFORMAT_ABGR] = "ABGR",
+            [PL_COLOURFORMAT_RGB] = "RGB",
+            [PL_COLOURFORMAT_BGR] = "BGR",
+            [PL_COLOURFORMAT_RGBA] = "RGBA",
+            [PL_COLOURFORMAT_BGRA] = "BGRA",
+    };
+
+    const char *letters = "RGBA";
+    if((unsigned int)colour_format < plArrayElements(channel_orders) && channel_orders[colour_format] != NULL) {
+        letters = channel_orders[colour_format];
+    }
+
+    unsigned int n = 0;
+    for(; *letters != '\0' && n < channels; ++letters) {
+        if(*letters == 'A' && channels < 4) {
+            continue;
+        }
+        order[n++] = (int8_t)(strchr("RGBA", *letters) - "RGBA");
+    }
+
+    if(n < channels) {
+        order[n] = CONVERT_CHANNEL_ALPHA;
+    }
+}
+
+static bool SetupConvertFormat(ConvertFormat *cf, PLImageFormat format, PLColourFormat colour_format) {
+    memset(cf, 0, sizeof(ConvertFormat));
+    cf->format = format;
+
+    unsigned int colour_bits = 0, alpha_bits = 0;
+    switch(format) {
+        case PL_IMAGEFORMAT_RGB4:
+            cf->kind = CONVERT_KIND_PACKED; cf->channels = 3; colour_bits = 4; break;
+        case PL_IMAGEFORMAT_RGBA4:
+            cf->kind = CONVERT_KIND_PACKED; cf->channels = 4; colour_bits = 4; alpha_bits = 4; break;
+        case PL_IMAGEFORMAT_RGB5:
+        case PL_IMAGEFORMAT_RGB565:
+            cf->kind = CONVERT_KIND_PACKED; cf->channels = 3; colour_bits = 5; break;
+        case PL_IMAGEFORMAT_RGB5A1:
+            cf->kind = CONVERT_KIND_PACKED; cf->channels = 4; colour_bits = 5; alpha_bits = 1; break;
+        case PL_IMAGEFORMAT_RGB8:
+            cf->kind = CONVERT_KIND_BYTES; cf->channels = 3; cf->pixel_size = 3; break;
+        case PL_IMAGEFORMAT_RGBA8:
+            cf->kind = CONVERT_KIND_BYTES; cf->channels = 4; cf->pixel_size = 4; break;
+        case PL_IMAGEFORMAT_RGBA16:
+        case PL_IMAGEFORMAT_RGBA16F:
+            cf->kind = CONVERT_KIND_HDR; cf->channels = 4; cf->pixel_size = 8; break;
+        case PL_IMAGEFORMAT_RGBA32F:
+            cf->kind = CONVERT_KIND_HDR; cf->channels = 4; cf->pixel_size = 16; break;
+        case PL_IMAGEFORMAT_L1:
+            cf->kind = CONVERT_KIND_BILEVEL; cf->channels = 1; break;
+        case PL_IMAGEFORMAT_L8:
+            cf->kind = CONVERT_KIND_GREY; cf->channels = 1; cf->pixel_size = 1; break;
+        case PL_IMAGEFORMAT_RGB_DXT1:
+            cf->kind = CONVERT_KIND_S3TC; cf->channels = 3; break;
+        case PL_IMAGEFORMAT_RGBA_DXT1:
+        case PL_IMAGEFORMAT_RGBA_DXT3:
+        case PL_IMAGEFORMAT_RGBA_DXT5:
+            cf->kind = CONVERT_KIND_S3TC; cf->channels = 4; break;
+        default:
+            return false;
+    }
+
+    for(unsigned int c = 0; c < 4; ++c) {
+        cf->order[c] = (int8_t)c;
+    }
+    /* S3TC is always RGB(A), whatever it's labelled as */
+    if(cf->channels >= 3 && cf->kind != CONVERT_KIND_S3TC) {
+        GetChannelOrder(colour_format, cf->channels, cf->order);
+    }
+
+    cf->straight = (cf->order[0] == CONVERT_CHANNEL_RED && cf->order[1] == CONVERT_CHANNEL_GREEN &&
+                    cf->order[2] == CONVERT_CHANNEL_BLUE);
+
+    memset(cf->rgba, -1, sizeof(cf->rgba));
+    for(unsigned int i = 0; i < cf->channels; ++i) {
+        cf->rgba[cf->order[i]] = (int8_t)i;
+    }
+
+    if(cf->kind == CONVERT_KIND_S3TC) {
+        cf->block_size = GetS3TCBlockSize(format);
+    } else if(cf->kind == CONVERT_KIND_PACKED) {
+        cf->pixel_size = 2;
+
+        unsigned int shift = 0;
+        for(unsigned int i = 0; i < cf->channels; ++i) {
+            unsigned int c = (unsigned int)cf->order[i];
+            unsigned int bits = colour_bits;
+            if(c == CONVERT_CHANNEL_ALPHA) {
+                bits = alpha_bits;
+            } else if(c == CONVERT_CHANNEL_GREEN && format == PL_IMAGEFORMAT_RGB565) {
+                bits = 6;
+            }
+
+            cf->shift[c] = (uint8_t)shift;
+            cf->bits[c] = (uint8_t)bits;
+            shift += bits;
+        }
+    }
+
+    return true;
+}
+
+/* For S3TC, a row is a row of blocks. */
+static size_t GetConvertPitch(const ConvertFormat *format, unsigned int width) {
+    if(format->kind == CONVERT_KIND_BILEVEL) {
+        return (width + 7) / 8;
+    } else if(format->kind == CONVERT_KIND_S3TC) {
+        return (size_t)((width + 3) / 4) * format->block_size;
+    }
+
+    return (size_t)width * format->pixel_size;
+}
+
+/////////////////////////////////////////////////////////////////
+
+typedef struct ConvertPlan {
+    ConvertFormat from, to;
+    const ConvertKernels *kernels;
+
+    int8_t map[4];  // where each channel of the new format comes from within the old, -1 for opaque
+    bool swizzle;   // whether map is anything other than straight through
+
+    PLCompressionQuality quality;   // for anything going to S3TC
+
+    /* scratch holds a row of RGBA8 to go through, or four for S3TC,
+     * and one more on top, see GetConvertScratchSize */
+    void (*ConvertRow)(const struct ConvertPlan *plan, const uint8_t *src, uint8_t *dest, uint8_t *scratch,
+                       unsigned int width);
+    /* or where either side is S3TC, between a row of blocks and up to four rows of pixels */
+    void (*ConvertBlockRow)(const struct ConvertPlan *plan, const uint8_t *src, size_t src_pitch, uint8_t *dest,
+                            size_t dest_pitch, unsigned int rows, uint8_t *scratch, unsigned int width);
+} ConvertPlan;
+
+static size_t GetConvertScratchSize(const ConvertPlan *plan, unsigned int width) {
+    size_t rows = (plan->ConvertBlockRow != NULL) ? 5 : 2;
+    return ((size_t)width * 4 * rows) + 1;
+}
+
+static void ConvertBytesRow(const ConvertPlan *plan, const uint8_t *src, uint8_t *dest, uint8_t *scratch,
+                            unsigned int width) {
+    plan->kernels->ShuffleBytes(src, plan->from.channels, dest, plan->to.channels, plan->map, width);
+}
+
+static void ConvertBilevelRow(const ConvertPlan *plan, const uint8_t *src, uint8_t *dest, uint8_t *scratch,
+                              unsigned int width) {
+    ExpandBilevelRow(src, dest, width);
+}
+
+/* Between two of RGBA8, RGBA16, RGBA16F and RGBA32F, without losing any precision
+ * on the way, and then put into the new order a sample at a time. */
+static void ConvertHDRRow(const ConvertPlan *plan, const uint8_t *src, uint8_t *dest, uint8_t *scratch,
+                          unsigned int width) {
+    if(plan->from.format != plan->to.format) {
+        ConvertHDRPixels(src, plan->from.format, dest, plan->to.format, width);
+    } else if(src != dest) {
+        memcpy(dest, src, (size_t)width * plan->to.pixel_size);
+    }
+
+    if(!plan->swizzle) {
+        return;
+    }
+
+    size_t sample_size = plan->to.pixel_size / 4;
+    for(unsigned int x = 0; x < width; ++x, dest += plan->to.pixel_size) {
+        uint8_t pixel[16];
+        memcpy(pixel, dest, plan->to.pixel_size);
+        for(unsigned int i = 0; i < 4; ++i) {
+            memcpy(dest + i * sample_size, pixel + plan->map[i] * sample_size, sample_size);
+        }
+    }
+}
+
+static void DecodeRow(const ConvertPlan *plan, const uint8_t *src, uint8_t *rgba, uint8_t *temp, unsigned int width) {
+    const ConvertKernels *kernels = plan->kernels;
+    const ConvertFormat *from = &plan->from;
+
+    switch(from->kind) {
+        case CONVERT_KIND_BYTES:
+            kernels->ShuffleBytes(src, from->channels, rgba, 4, from->rgba, width);
+            break;
+        case CONVERT_KIND_PACKED:
+            kernels->DecodePacked(src, rgba, from, width);
+            break;
+        case CONVERT_KIND_GREY:
+            kernels->ExpandGrey(src, rgba, width);
+            break;
+        case CONVERT_KIND_BILEVEL:
+            ExpandBilevelRow(src, temp, width);
+            kernels->ExpandGrey(temp, rgba, width);
+            break;
+        case CONVERT_KIND_HDR:
+            ConvertHDRPixels(src, from->format, rgba, PL_IMAGEFORMAT_RGBA8, width);
+            if(!from->straight) {
+                kernels->ShuffleBytes(rgba, 4, rgba, 4, from->rgba, width);
+            }
+            break;
+        default:
+            plAssert(0);
+            break;
+    }
+}
+
+static void EncodeRow(const ConvertPlan *plan, const uint8_t *rgba, uint8_t *dest, uint8_t *temp, unsigned int width) {
+    const ConvertKernels *kernels = plan->kernels;
+    const ConvertFormat *to = &plan->to;
+
+    switch(to->kind) {
+        case CONVERT_KIND_BYTES:
+            kernels->ShuffleBytes(rgba, 4, dest, to->channels, to->order, width);
+            break;
+        case CONVERT_KIND_PACKED:
+            kernels->EncodePacked(rgba, dest, to, width);
+            break;
+        case CONVERT_KIND_GREY:
+            kernels->ReduceGrey(rgba, dest, width);
+            break;
+        case CONVERT_KIND_HDR:
+            if(!to->straight) {
+                kernels->ShuffleBytes(rgba, 4, temp, 4, to->order, width);
+                rgba = temp;
+            }
+            ConvertHDRPixels(rgba, PL_IMAGEFORMAT_RGBA8, dest, to->format, width);
+            break;
+        default:
+            plAssert(0);
+            break;
+    }
+}
+
+/* The whole row is read in before any of it's written back
+ * out, so this is fine for converting in place. */
+static void ConvertRowThroughRGBA(const ConvertPlan *plan, const uint8_t *src, uint8_t *dest, uint8_t *scratch,
+                                  unsigned int width) {
+    uint8_t *temp = scratch + (size_t)width * 4;
+    DecodeRow(plan, src, scratch, temp, width);
+    EncodeRow(plan, scratch, dest, temp, width);
+}
+
+/* Goes through four rows of RGBA8 in scratch, unless a row of blocks can be
+ * decoded straight into place, or encoded straight from RGBA8 as it is. */
+static void ConvertS3TCRow(const ConvertPlan *plan, const uint8_t *src, size_t src_pitch, uint8_t *dest,
+                           size_t dest_pitch, unsigned int rows, uint8_t *scratch, unsigned int width) {
+    const ConvertFormat *from = &plan->from, *to = &plan->to;
+    size_t pitch = (size_t)width * 4;
+    uint8_t *temp = scratch + pitch * 4;
+
+    if(from->kind == CONVERT_KIND_S3TC) {
+        if(to->format == PL_IMAGEFORMAT_RGBA8 && !plan->swizzle) {
+            DecodeS3TCBlocks(src, from->format, dest, dest_pitch, width, rows);
+            return;
+        }
+        DecodeS3TCBlocks(src, from->format, scratch, pitch, width, rows);
+    } else if(from->format == PL_IMAGEFORMAT_RGBA8 && from->straight) {
+        EncodeS3TCBlocks(src, src_pitch, width, rows, dest, to->format, plan->quality);
+        return;
+    } else {
+        for(unsigned int y = 0; y < rows; ++y) {
+            DecodeRow(plan, src + src_pitch * y, scratch + pitch * y, temp, width);
+        }
+    }
+
+    if(to->kind == CONVERT_KIND_S3TC) {
+        EncodeS3TCBlocks(scratch, pitch, width, rows, dest, to->format, plan->quality);
+        return;
+    }
+
+    for(unsigned int y = 0; y < rows; ++y) {
+        EncodeRow(plan, scratch + pitch * y, dest + dest_pitch * y, temp, width);
+    }
+}
+
+/* Returns false if there's no way to get from one to the other. If the two are
+ * the same already, ConvertRow and ConvertBlockRow are both left NULL. */
+static bool SetupConvertPlan(ConvertPlan *plan, PLImageFormat from, PLColourFormat from_colour,
+                             PLImageFormat to, PLColourFormat to_colour, PLCompressionQuality quality) {
+    memset(plan, 0, sizeof(ConvertPlan));
+
+    /* whatever's being converted to has to be described by its colour format,
+     * whereas what's already there is taken as best it can be */
+    if(!SetupConvertFormat(&plan->from, from, from_colour) || !SetupConvertFormat(&plan->to, to, to_colour) ||
+       plan->to.channels != plGetSamplesPerPixel(to_colour)) {
+        return false;
+    } else if(plan->to.kind == CONVERT_KIND_S3TC &&
+              to_colour != ((plan->to.channels == 3) ? PL_COLOURFORMAT_RGB : PL_COLOURFORMAT_RGBA)) {
+        return false;
+    }
+
+    plan->kernels = GetConvertKernels();
+    plan->quality = quality;
+
+    for(unsigned int i = 0; i < plan->to.channels; ++i) {
+        plan->map[i] = plan->from.rgba[plan->to.order[i]];
+        if(plan->map[i] != (int8_t)i) {
+            plan->swizzle = true;
+        }
+    }
+
+    ConvertKind from_kind = plan->from.kind, to_kind = plan->to.kind;
+    if(from == to && (plan->to.channels == 1 || to_kind == CONVERT_KIND_S3TC || !plan->swizzle)) {
+        return true;
+    } else if(to_kind == CONVERT_KIND_BILEVEL) {
+        return false;
+    }
+
+    if(from_kind == CONVERT_KIND_S3TC || to_kind == CONVERT_KIND_S3TC) {
+        plan->ConvertBlockRow = ConvertS3TCRow;
+    } else if(from_kind == CONVERT_KIND_BYTES && to_kind == CONVERT_KIND_BYTES) {
+        plan->ConvertRow = ConvertBytesRow;
+    } else if(from_kind == CONVERT_KIND_BILEVEL && to_kind == CONVERT_KIND_GREY) {
+        plan->ConvertRow = ConvertBilevelRow;
+    } else if((from_kind == CONVERT_KIND_HDR || to_kind == CONVERT_KIND_HDR) &&
+              (from == to || CanConvertHDRPixels(from, to))) {
+        plan->ConvertRow = ConvertHDRRow;
+    } else {
+        plan->ConvertRow = ConvertRowThroughRGBA;
+    }
+
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////
+
+typedef struct ConvertJob {
+    const ConvertPlan *plan;
+    const uint8_t *src;
+    uint8_t *dest;
+    size_t src_pitch, dest_pitch;
+    size_t src_step, dest_step;     // from one row to the next, four rows of pixels for a row of blocks
+    unsigned int width, height;
+    unsigned int rows;  // to go through, rows of blocks where either side is S3TC
+
+    unsigned int num_bands;
+    unsigned int next;  // next band of rows up for grabs
+} ConvertJob;
+
+static void ConvertImageBands(ConvertJob *job, uint8_t *scratch) {
+    const ConvertPlan *plan = job->plan;
+    for(;;) {
+        unsigned int band = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+        if(band >= job->num_bands) {
+            break;
+        }
+
+        unsigned int y = band * CONVERT_BAND_ROWS;
+        unsigned int end = (job->rows - y > CONVERT_BAND_ROWS) ? y + CONVERT_BAND_ROWS : job->rows;
+        for(; y < end; ++y) {
+            const uint8_t *src = job->src + job->src_step * y;
+            uint8_t *dest = job->dest + job->dest_step * y;
+            if(plan->ConvertBlockRow != NULL) {
+                unsigned int rows = (job->height - y * 4 > 4) ? 4 : job->height - y * 4;
+                plan->ConvertBlockRow(plan, src, job->src_pitch, dest, job->dest_pitch, rows, scratch, job->width);
+            } else {
+                plan->ConvertRow(plan, src, dest, scratch, job->width);
+            }
+        }
+    }
+}
+
+#if !defined(_WIN32)
+static void *ConvertImageBandsThread(void *data) {
+    ConvertJob *job = (ConvertJob*)data;
+
+    uint8_t *scratch = malloc(GetConvertScratchSize(job->plan, job->width));
+    if(scratch == NULL) {
+        /* the other threads can pick up the slack */
+        return NULL;
+    }
+
+    ConvertImageBands(job, scratch);
+    free(scratch);
+
+    return NULL;
+}
+#endif
+
+/* Pixels that stay the same size can be converted in place by any number of
+ * threads, and smaller ones can be too, so long as it's done in order. */
+static bool CanConvertInPlace(const ConvertPlan *plan, unsigned int width, unsigned int height) {
+    if(plan->ConvertBlockRow != NULL) {
+        return false;
+    }
+
+    size_t src_pitch = GetConvertPitch(&plan->from, width);
+    size_t dest_pitch = GetConvertPitch(&plan->to, width);
+    return (dest_pitch == src_pitch) || (dest_pitch < src_pitch && dest_pitch * height < CONVERT_THREAD_THRESHOLD);
+}
+
+/* Converts a level from src to dest, which may be one and the same, see
+ * CanConvertInPlace. As scratch is always there for this thread to fall
+ * back on, it can't fail part way through. */
+static void ConvertImageLevel(const ConvertPlan *plan, const uint8_t *src, uint8_t *dest,
+                              unsigned int width, unsigned int height, uint8_t *scratch) {
+    ConvertJob job;
+    job.plan = plan;
+    job.src = src;
+    job.dest = dest;
+    job.src_pitch = GetConvertPitch(&plan->from, width);
+    job.dest_pitch = GetConvertPitch(&plan->to, width);
+    job.src_step = job.src_pitch;
+    job.dest_step = job.dest_pitch;
+    job.width = width;
+    job.height = height;
+    job.rows = height;
+    if(plan->ConvertBlockRow != NULL) {
+        job.rows = (height + 3) / 4;
+        if(plan->from.kind != CONVERT_KIND_S3TC) {
+            job.src_step *= 4;
+        }
+        if(plan->to.kind != CONVERT_KIND_S3TC) {
+            job.dest_step *= 4;
+        }
+    }
+    job.num_bands = (job.rows + CONVERT_BAND_ROWS - 1) / CONVERT_BAND_ROWS;
+    job.next = 0;
+
+    /* on Windows everything's converted on the calling thread alone */
+#if !defined(_WIN32)
+    pthread_t threads[CONVERT_MAX_THREADS - 1];
+    unsigned int num_threads = 0;
+
+    /* going by whichever side's larger, as compressing is a lot more work than its size suggests */
+    size_t size = ((job.src_step > job.dest_step) ? job.src_step : job.dest_step) * job.rows;
+
+    unsigned int max_threads = 1;
+    if(size >= CONVERT_THREAD_THRESHOLD && (src != dest || job.src_pitch == job.dest_pitch)) {
+        long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        max_threads = (num_cpus > 0) ? (unsigned int)num_cpus : 1;
+        if(max_threads > CONVERT_MAX_THREADS) {
+            max_threads = CONVERT_MAX_THREADS;
+        }
+        if(max_threads > job.num_bands) {
+            max_threads = job.num_bands;
+        }
+    }
+
+    while(num_threads + 1 < max_threads &&
+          pthread_create(&threads[num_threads], NULL, ConvertImageBandsThread, &job) == 0) {
+        ++num_threads;
+    }
+#endif
+
+    ConvertImageBands(&job, scratch);
+
+#if !defined(_WIN32)
+    for(unsigned int i = 0; i < num_threads; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+#endif
+}
+
+static bool ConvertImage(PLImage *image, PLImageFormat format, PLColourFormat colour_format,
+                         PLCompressionQuality quality) {
+    ConvertPlan plan;
+    if(!SetupConvertPlan(&plan, image->format, image->colour_format, format, colour_format, quality)) {
+        ReportError(PL_RESULT_IMAGEFORMAT, "Unsupported image format conversion");
+        return false;
+    }
+
+    if(plan.ConvertRow == NULL && plan.ConvertBlockRow == NULL) {
+        image->colour_format = colour_format;
+        return true;
+    }
+
+    /* Anything that can't be converted in place gets a new buffer up front, along
+     * with scratch for the widest level, so nothing's touched unless it all fits. */
+
+    uint8_t *levels[image->levels];
+    memset(levels, 0, image->levels * sizeof(uint8_t*));
+
+    uint8_t *scratch = malloc(GetConvertScratchSize(&plan, image->width));
+    bool failed = (scratch == NULL);
+
+    unsigned int lw = image->width;
+    unsigned int lh = image->height;
+
+    for(unsigned int l = 0; l < image->levels && !failed; ++l) {
+        if(!CanConvertInPlace(&plan, lw, lh)) {
+            size_t size = GetConvertPitch(&plan.to, lw) * lh;
+            failed = ((levels[l] = malloc(size ? size : 1)) == NULL);
+        }
+
+        lw = (lw > 1) ? lw / 2 : 1;
+        lh = (lh > 1) ? lh / 2 : 1;
+    }
+
+    if(failed) {
+        for(unsigned int l = 0; l < image->levels; ++l) {
+            free(levels[l]);
+        }
+        free(scratch);
+
+        ReportError(PL_RESULT_MEMORYALLOC, "Couldn't allocate memory for image data");
+        return false;
+    }
+
+    lw = image->width;
+    lh = image->height;
+
+    for(unsigned int l = 0; l < image->levels; ++l) {
+        if(levels[l] != NULL) {
+            ConvertImageLevel(&plan, image->data[l], levels[l], lw, lh, scratch);
+            free(image->data[l]);
+            image->data[l] = levels[l];
+        } else {
+            ConvertImageLevel(&plan, image->data[l], image->data[l], lw, lh, scratch);
+
+            /* give back whatever's no longer needed, if it can be */
+            size_t size = GetConvertPitch(&plan.to, lw) * lh;
+            if(size < GetConvertPitch(&plan.from, lw) * lh) {
+                uint8_t *shrunk = realloc(image->data[l], size ? size : 1);
+                if(shrunk != NULL) {
+                    image->data[l] = shrunk;
+                }
+            }
+        }
+
+        lw = (lw > 1) ? lw / 2 : 1;
+        lh = (lh > 1) ? lh / 2 : 1;
+    }
+
+    free(scratch);
+
+    image->format = format;
+    image->colour_format = colour_format;
+    image->size = _plGetImageSize(format, image->width, image->height);
+
+    return true;
+}
+
+bool plConvertImageFormat(PLImage *image, PLImageFormat format, PLColourFormat colour_format) {
+    return ConvertImage(image, format, colour_format, PL_COMPRESSIONQUALITY_NORMAL);
+}
+
+bool plConvertPixelFormat(PLImage *image, PLImageFormat new_format) {
+    ConvertFormat cf;
+    if(!SetupConvertFormat(&cf, new_format, PL_COLOURFORMAT_RGBA)) {
+        ReportError(PL_RESULT_IMAGEFORMAT, "Unsupported image format conversion");
+        return false;
+    }
+
+    /* keep to the same order, bar adding or dropping alpha */
+    PLColourFormat colour_format = image->colour_format;
+    bool bgr = (colour_format == PL_COLOURFORMAT_BGR || colour_format == PL_COLOURFORMAT_BGRA ||
+                colour_format == PL_COLOURFORMAT_ABGR);
+    if(cf.channels == 1) {
+        colour_format = PL_COLOURFORMAT_L;
+    } else if(cf.channels == 3) {
+        colour_format = bgr ? PL_COLOURFORMAT_BGR : PL_COLOURFORMAT_RGB;
+    } else if(plGetSamplesPerPixel(colour_format) != 4) {
+        colour_format = bgr ? PL_COLOURFORMAT_BGRA : PL_COLOURFORMAT_RGBA;
+    }
+
+    return plConvertImageFormat(image, new_format, colour_format);
+}
+
+bool plCompressImage(PLImage *image, PLImageFormat format, PLCompressionQuality quality) {
+    ConvertFormat cf;
+    if(!SetupConvertFormat(&cf, format, PL_COLOURFORMAT_RGBA) || cf.kind != CONVERT_KIND_S3TC) {
+        ReportError(PL_RESULT_IMAGEFORMAT, "Unsupported image compression format");
+        return false;
+    }
+
+    return ConvertImage(image, format, (cf.channels == 3) ? PL_COLOURFORMAT_RGB : PL_COLOURFORMAT_RGBA, quality);
+}
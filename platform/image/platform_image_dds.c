@@ -52,19 +52,9 @@ enum DDSFlag {
     DDS_CAPS,
 };
 
-bool DDSFormatCheck(FILE *fin) {
-    rewind(fin);
-
-    PLchar ident[4];
-    fread(ident, sizeof(PLchar), 4, fin);
-
-    return (bool)(strncmp(ident, "DDS", 3) == 0);
-}
-
-PLresult LoadDDSImage(FILE *fin, PLImage *out) {
+PLresult LoadDDSImage(PLBinaryReader *reader, PLImage *out) {
     DDSHeader header;
-    memset(&header, 0, sizeof(DDSHeader));
-    if(fread(&header, sizeof(DDSHeader), 1, fin) != 1) {
+    if(!plReadBinary(reader, &header, sizeof(DDSHeader))) {
         return PL_RESULT_FILEREAD;
     }
 
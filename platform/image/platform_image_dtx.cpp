@@ -95,24 +95,12 @@ uint8_t _plGetDTXFormat(DTXHeader *dtx) {
     return dtx->extra[2];
 }
 
-bool _plDTXFormatCheck(FILE *fin) {
-    rewind(fin);
-
-    // Try reading in the type first, as Lithtech has "resource types" rather than idents.
-    int type;
-    if(fread(&type, sizeof(int), 1, fin) != 1) {
-        return false;
-    }
-
-    return (type == 0);
-}
-
-PLresult _plLoadDTXImage(FILE *fin, PLImage *out) {
+PLresult _plLoadDTXImage(PLBinaryReader *reader, PLImage *out) {
     _plSetCurrentFunction("_plLoadDTXImage");
 
     DTXHeader header;
     memset(&header, 0, sizeof(header));
-    if (fread(&header, sizeof(DTXHeader), 1, fin) != 1)
+    if (!plReadBinary(reader, &header, sizeof(DTXHeader)))
         return PL_RESULT_FILEREAD;
     else if ((header.version < DTX_VERSION_MAX) || (header.version > DTX_VERSION_MIN))
         return PL_RESULT_FILEVERSION;
@@ -170,7 +158,7 @@ PLresult _plLoadDTXImage(FILE *fin, PLImage *out) {
     out->data = new uint8_t*[header.mipmaps];
     out->data[0] = new uint8_t[out->size];
 
-    fread(out->data[0], sizeof(uint8_t), out->size, fin);
+    plReadBinary(reader, out->data[0], out->size);
 
     /*	for (PLuint i = 0; i < (PLuint)size; i += 4)
     {
@@ -36,21 +36,20 @@ typedef struct FTXHeader {
     uint32_t alpha;
 } FTXHeader;
 
-PLresult _plLoadFTXImage(FILE *fin, PLImage *out) {
+PLresult _plLoadFTXImage(PLBinaryReader *reader, PLImage *out) {
     plFunctionStart();
 
     FTXHeader header;
-    memset(&header, 0, sizeof(FTXHeader));
-    header.width = (unsigned int)plGetLittleLong(fin);
-    header.height = (unsigned int)plGetLittleLong(fin);
-    header.alpha = (unsigned int)plGetLittleLong(fin);
+    header.width = plReadBinaryLittleUInt32(reader);
+    header.height = plReadBinaryLittleUInt32(reader);
+    header.alpha = plReadBinaryLittleUInt32(reader);
 
     memset(out, 0, sizeof(PLImage));
     out->size = (unsigned int)(header.width * header.height * 4);
     out->data = new uint8_t*[1];
     out->data[0] = new uint8_t[out->size];
 
-    if (fread(out->data[0], sizeof(uint8_t), out->size, fin) != out->size) {
+    if(!plReadBinary(reader, out->data[0], out->size)) {
         return PL_RESULT_FILEREAD;
     }
 
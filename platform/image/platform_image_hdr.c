@@ -0,0 +1,412 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+#include <PL/platform_image.h>
+
+#include <math.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#   include <immintrin.h>
+#   define HDR_X86
+#endif
+
+/*	High dynamic range pixels
+ *	Conversion between 8 and 16-bit integer, half and single precision
+ *	float samples. Halves are converted by the CPU where it's able to
+ *	(F16C), otherwise by hand, rounding the same way, and the vector
+ *	kernels come out exactly the same as the plain C below. Floats are
+ *	clamped to 0-1 on the way down to integers.
+ */
+
+#define HDR_BLOCK_SAMPLES   1024    // samples converted through floats at a time
+
+typedef union HDRFloatBits {
+    uint32_t u;
+    float f;
+} HDRFloatBits;
+
+static PL_INLINE float HalfToFloat(uint16_t half) {
+    HDRFloatBits out = { (uint32_t)(half & 0x7FFF) << 13 };
+    uint32_t exponent = out.u & (0x1Fu << 23);
+    out.u += (127 - 15) << 23;
+    if(exponent == (0x1Fu << 23)) {
+        /* infinity or NaN, which always comes out quiet */
+        out.u += (128 - 16) << 23;
+        if(out.u & 0x7FFFFF) {
+            out.u |= 0x400000;
+        }
+    } else if(exponent == 0) {
+        /* zero or denormal, which is left to the FPU to normalise */
+        HDRFloatBits magic = { 113u << 23 };
+        out.u += 1 << 23;
+        out.f -= magic.f;
+    }
+
+    out.u |= (uint32_t)(half & 0x8000) << 16;
+    return out.f;
+}
+
+static PL_INLINE uint16_t FloatToHalf(float value) {
+    HDRFloatBits in = { .f = value };
+    uint32_t sign = in.u & 0x80000000u;
+    in.u ^= sign;
+
+    uint16_t out;
+    if(in.u >= (143u << 23)) {
+        /* too large, infinity or NaN, keeping what's left of the payload */
+        out = (uint16_t)((in.u > 0x7F800000u) ? (0x7E00 | ((in.u >> 13) & 0x3FF)) : 0x7C00);
+    } else if(in.u < (113u << 23)) {
+        /* too small to be normal, so the FPU rounds it off to a denormal */
+        HDRFloatBits magic = { ((127 - 15) + (23 - 10) + 1) << 23 };
+        in.f += magic.f;
+        out = (uint16_t)(in.u - magic.u);
+    } else {
+        /* rounded to nearest, ties to even, which may carry up into the exponent */
+        uint32_t odd = (in.u >> 13) & 1;
+        in.u -= 112u << 23;
+        in.u += 0xFFF + odd;
+        out = (uint16_t)(in.u >> 13);
+    }
+
+    return (uint16_t)(out | (sign >> 16));
+}
+
+static PL_INLINE float ClampHDR(float value) {
+    /* NaN ends up as 0 */
+    return (value > 0) ? ((value < 1) ? value : 1) : 0;
+}
+
+static void ConvertHalfToFloatC(const uint16_t *src, float *dest, size_t count) {
+    for(size_t i = 0; i < count; ++i) {
+        dest[i] = HalfToFloat(src[i]);
+    }
+}
+
+static void ConvertFloatToHalfC(const float *src, uint16_t *dest, size_t count) {
+    for(size_t i = 0; i < count; ++i) {
+        dest[i] = FloatToHalf(src[i]);
+    }
+}
+
+static void ConvertU8ToFloatC(const uint8_t *src, float *dest, size_t count) {
+    for(size_t i = 0; i < count; ++i) {
+        dest[i] = (float)src[i] * (1.0f / 255);
+    }
+}
+
+static void ConvertFloatToU8C(const float *src, uint8_t *dest, size_t count) {
+    for(size_t i = 0; i < count; ++i) {
+        dest[i] = (uint8_t)lrintf(ClampHDR(src[i]) * 255);
+    }
+}
+
+static void ConvertU16ToFloatC(const uint16_t *src, float *dest, size_t count) {
+    for(size_t i = 0; i < count; ++i) {
+        dest[i] = (float)src[i] * (1.0f / 65535);
+    }
+}
+
+static void ConvertFloatToU16C(const float *src, uint16_t *dest, size_t count) {
+    for(size_t i = 0; i < count; ++i) {
+        dest[i] = (uint16_t)lrintf(ClampHDR(src[i]) * 65535);
+    }
+}
+
+/* Rounded to nearest, the same as value / 257. */
+static void ConvertU16ToU8C(const uint16_t *src, uint8_t *dest, size_t count) {
+    for(size_t i = 0; i < count; ++i) {
+        dest[i] = (uint8_t)((src[i] * 255u + 32895) >> 16);
+    }
+}
+
+static void ConvertU8ToU16C(const uint8_t *src, uint16_t *dest, size_t count) {
+    for(size_t i = 0; i < count; ++i) {
+        dest[i] = (uint16_t)(src[i] * 257);
+    }
+}
+
+#if defined(HDR_X86)
+
+/////////////////////////////////////////////////////////////////
+// SSE2
+
+__attribute__((target("sse2")))
+static PL_INLINE __m128i ConvertFloatToIntSSE2(const float *src, __m128 scale) {
+    const __m128 one = _mm_set1_ps(1.0f);
+    __m128 value = _mm_max_ps(_mm_loadu_ps(src), _mm_setzero_ps());    // NaN gives the second
+    return _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(value, one), scale));
+}
+
+__attribute__((target("sse2")))
+static void ConvertU8ToFloatSSE2(const uint8_t *src, float *dest, size_t count) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 scale = _mm_set1_ps(1.0f / 255);
+
+    size_t i = 0;
+    for(; i + 16 <= count; i += 16) {
+        __m128i value = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i lo = _mm_unpacklo_epi8(value, zero), hi = _mm_unpackhi_epi8(value, zero);
+        _mm_storeu_ps(dest + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), scale));
+        _mm_storeu_ps(dest + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), scale));
+        _mm_storeu_ps(dest + i + 8, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), scale));
+        _mm_storeu_ps(dest + i + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), scale));
+    }
+
+    ConvertU8ToFloatC(src + i, dest + i, count - i);
+}
+
+__attribute__((target("sse2")))
+static void ConvertFloatToU8SSE2(const float *src, uint8_t *dest, size_t count) {
+    const __m128 scale = _mm_set1_ps(255);
+
+    size_t i = 0;
+    for(; i + 16 <= count; i += 16) {
+        __m128i lo = _mm_packs_epi32(ConvertFloatToIntSSE2(src + i, scale), ConvertFloatToIntSSE2(src + i + 4, scale));
+        __m128i hi = _mm_packs_epi32(ConvertFloatToIntSSE2(src + i + 8, scale), ConvertFloatToIntSSE2(src + i + 12, scale));
+        _mm_storeu_si128((__m128i*)(dest + i), _mm_packus_epi16(lo, hi));
+    }
+
+    ConvertFloatToU8C(src + i, dest + i, count - i);
+}
+
+__attribute__((target("sse2")))
+static void ConvertU16ToFloatSSE2(const uint16_t *src, float *dest, size_t count) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 scale = _mm_set1_ps(1.0f / 65535);
+
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+        __m128i value = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm_storeu_ps(dest + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(value, zero)), scale));
+        _mm_storeu_ps(dest + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(value, zero)), scale));
+    }
+
+    ConvertU16ToFloatC(src + i, dest + i, count - i);
+}
+
+/* There's no unsigned pack down to 16-bit before SSE4.1, so
+ * everything's moved down into the signed range and back. */
+__attribute__((target("sse2")))
+static void ConvertFloatToU16SSE2(const float *src, uint16_t *dest, size_t count) {
+    const __m128 scale = _mm_set1_ps(65535);
+    const __m128i bias = _mm_set1_epi32(32768);
+    const __m128i flip = _mm_set1_epi16((short)0x8000);
+
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+        __m128i lo = _mm_sub_epi32(ConvertFloatToIntSSE2(src + i, scale), bias);
+        __m128i hi = _mm_sub_epi32(ConvertFloatToIntSSE2(src + i + 4, scale), bias);
+        _mm_storeu_si128((__m128i*)(dest + i), _mm_xor_si128(_mm_packs_epi32(lo, hi), flip));
+    }
+
+    ConvertFloatToU16C(src + i, dest + i, count - i);
+}
+
+/* The top half of value * 255 + 32895, which is the top half of value * 255
+ * plus a carry out of the bottom half whenever that's over 32640. */
+__attribute__((target("sse2")))
+static PL_INLINE __m128i ConvertU16ToU8x8SSE2(__m128i value) {
+    const __m128i scale = _mm_set1_epi16(255);
+    const __m128i flip = _mm_set1_epi16((short)0x8000);
+    const __m128i limit = _mm_set1_epi16((short)(32640 ^ 0x8000));
+    __m128i high = _mm_mulhi_epu16(value, scale);
+    __m128i low = _mm_xor_si128(_mm_mullo_epi16(value, scale), flip);
+    return _mm_sub_epi16(high, _mm_cmpgt_epi16(low, limit));
+}
+
+__attribute__((target("sse2")))
+static void ConvertU16ToU8SSE2(const uint16_t *src, uint8_t *dest, size_t count) {
+    size_t i = 0;
+    for(; i + 16 <= count; i += 16) {
+        __m128i lo = ConvertU16ToU8x8SSE2(_mm_loadu_si128((const __m128i*)(src + i)));
+        __m128i hi = ConvertU16ToU8x8SSE2(_mm_loadu_si128((const __m128i*)(src + i + 8)));
+        _mm_storeu_si128((__m128i*)(dest + i), _mm_packus_epi16(lo, hi));
+    }
+
+    ConvertU16ToU8C(src + i, dest + i, count - i);
+}
+
+__attribute__((target("sse2")))
+static void ConvertU8ToU16SSE2(const uint8_t *src, uint16_t *dest, size_t count) {
+    size_t i = 0;
+    for(; i + 16 <= count; i += 16) {
+        __m128i value = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm_storeu_si128((__m128i*)(dest + i), _mm_unpacklo_epi8(value, value));
+        _mm_storeu_si128((__m128i*)(dest + i + 8), _mm_unpackhi_epi8(value, value));
+    }
+
+    ConvertU8ToU16C(src + i, dest + i, count - i);
+}
+
+/////////////////////////////////////////////////////////////////
+// F16C
+
+__attribute__((target("avx,f16c")))
+static void ConvertHalfToFloatF16C(const uint16_t *src, float *dest, size_t count) {
+    size_t i = 0;
+    for(; i + 16 <= count; i += 16) {
+        _mm256_storeu_ps(dest + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(src + i))));
+        _mm256_storeu_ps(dest + i + 8, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(src + i + 8))));
+    }
+
+    ConvertHalfToFloatC(src + i, dest + i, count - i);
+}
+
+__attribute__((target("avx,f16c")))
+static void ConvertFloatToHalfF16C(const float *src, uint16_t *dest, size_t count) {
+    size_t i = 0;
+    for(; i + 16 <= count; i += 16) {
+        __m128i lo = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+        __m128i hi = _mm256_cvtps_ph(_mm256_loadu_ps(src + i + 8), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128((__m128i*)(dest + i), lo);
+        _mm_storeu_si128((__m128i*)(dest + i + 8), hi);
+    }
+
+    ConvertFloatToHalfC(src + i, dest + i, count - i);
+}
+
+#endif
+
+/////////////////////////////////////////////////////////////////
+
+typedef struct HDRKernels {
+    void (*HalfToFloat)(const uint16_t *src, float *dest, size_t count);
+    void (*FloatToHalf)(const float *src, uint16_t *dest, size_t count);
+    void (*U8ToFloat)(const uint8_t *src, float *dest, size_t count);
+    void (*FloatToU8)(const float *src, uint8_t *dest, size_t count);
+    void (*U16ToFloat)(const uint16_t *src, float *dest, size_t count);
+    void (*FloatToU16)(const float *src, uint16_t *dest, size_t count);
+    void (*U16ToU8)(const uint16_t *src, uint8_t *dest, size_t count);
+    void (*U8ToU16)(const uint8_t *src, uint16_t *dest, size_t count);
+} HDRKernels;
+
+static HDRKernels hdr_kernels = {
+        ConvertHalfToFloatC, ConvertFloatToHalfC,
+        ConvertU8ToFloatC, ConvertFloatToU8C,
+        ConvertU16ToFloatC, ConvertFloatToU16C,
+        ConvertU16ToU8C, ConvertU8ToU16C,
+};
+
+static void SetupHDRKernels(void) {
+#if defined(HDR_X86)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("sse2")) {
+        hdr_kernels.U8ToFloat = ConvertU8ToFloatSSE2;
+        hdr_kernels.FloatToU8 = ConvertFloatToU8SSE2;
+        hdr_kernels.U16ToFloat = ConvertU16ToFloatSSE2;
+        hdr_kernels.FloatToU16 = ConvertFloatToU16SSE2;
+        hdr_kernels.U16ToU8 = ConvertU16ToU8SSE2;
+        hdr_kernels.U8ToU16 = ConvertU8ToU16SSE2;
+    }
+    if(__builtin_cpu_supports("avx") && __builtin_cpu_supports("f16c")) {
+        hdr_kernels.HalfToFloat = ConvertHalfToFloatF16C;
+        hdr_kernels.FloatToHalf = ConvertFloatToHalfF16C;
+    }
+#endif
+}
+
+static const HDRKernels *GetHDRKernels(void) {
+    static PLImageOnce once = PL_IMAGE_ONCE_INIT;
+    CallImageOnce(&once, SetupHDRKernels);
+    return &hdr_kernels;
+}
+
+void ConvertHalfToFloat(const uint16_t *src, float *dest, size_t count) {
+    GetHDRKernels()->HalfToFloat(src, dest, count);
+}
+
+void ConvertFloatToHalf(const float *src, uint16_t *dest, size_t count) {
+    GetHDRKernels()->FloatToHalf(src, dest, count);
+}
+
+/////////////////////////////////////////////////////////////////
+
+/* Size of each sample, for the formats that can be converted between here. */
+static size_t GetHDRSampleSize(PLImageFormat format) {
+    switch(format) {
+        case PL_IMAGEFORMAT_RGBA8:      return 1;
+        case PL_IMAGEFORMAT_RGBA16:
+        case PL_IMAGEFORMAT_RGBA16F:    return 2;
+        case PL_IMAGEFORMAT_RGBA32F:    return 4;
+        default:                        return 0;
+    }
+}
+
+static void ConvertHDRToFloat(const HDRKernels *kernels, const uint8_t *src, PLImageFormat format,
+                              float *dest, size_t count) {
+    switch(format) {
+        case PL_IMAGEFORMAT_RGBA8:      kernels->U8ToFloat(src, dest, count); break;
+        case PL_IMAGEFORMAT_RGBA16:     kernels->U16ToFloat((const uint16_t*)src, dest, count); break;
+        case PL_IMAGEFORMAT_RGBA16F:    kernels->HalfToFloat((const uint16_t*)src, dest, count); break;
+        default:                        memcpy(dest, src, count * sizeof(float)); break;
+    }
+}
+
+static void ConvertHDRFromFloat(const HDRKernels *kernels, const float *src, uint8_t *dest,
+                                PLImageFormat format, size_t count) {
+    switch(format) {
+        case PL_IMAGEFORMAT_RGBA8:      kernels->FloatToU8(src, dest, count); break;
+        case PL_IMAGEFORMAT_RGBA16:     kernels->FloatToU16(src, (uint16_t*)dest, count); break;
+        case PL_IMAGEFORMAT_RGBA16F:    kernels->FloatToHalf(src, (uint16_t*)dest, count); break;
+        default:                        memcpy(dest, src, count * sizeof(float)); break;
+    }
+}
+
+bool CanConvertHDRPixels(PLImageFormat from, PLImageFormat to) {
+    return (from != to && GetHDRSampleSize(from) != 0 && GetHDRSampleSize(to) != 0);
+}
+
+/* Converts count pixels between any two of RGBA8, RGBA16, RGBA16F and RGBA32F,
+ * see CanConvertHDRPixels. Anything without a direct route goes through floats,
+ * a block at a time. */
+void ConvertHDRPixels(const uint8_t *src, PLImageFormat from, uint8_t *dest, PLImageFormat to, size_t count) {
+    plAssert(CanConvertHDRPixels(from, to));
+
+    const HDRKernels *kernels = GetHDRKernels();
+    size_t samples = count * 4;
+
+    if(from == PL_IMAGEFORMAT_RGBA16 && to == PL_IMAGEFORMAT_RGBA8) {
+        kernels->U16ToU8((const uint16_t*)src, dest, samples);
+        return;
+    } else if(from == PL_IMAGEFORMAT_RGBA8 && to == PL_IMAGEFORMAT_RGBA16) {
+        kernels->U8ToU16(src, (uint16_t*)dest, samples);
+        return;
+    } else if(from == PL_IMAGEFORMAT_RGBA32F) {
+        ConvertHDRFromFloat(kernels, (const float*)src, dest, to, samples);
+        return;
+    } else if(to == PL_IMAGEFORMAT_RGBA32F) {
+        ConvertHDRToFloat(kernels, src, from, (float*)dest, samples);
+        return;
+    }
+
+    size_t src_size = GetHDRSampleSize(from), dest_size = GetHDRSampleSize(to);
+    float block[HDR_BLOCK_SAMPLES];
+    for(size_t i = 0; i < samples; i += HDR_BLOCK_SAMPLES) {
+        size_t n = (samples - i < HDR_BLOCK_SAMPLES) ? samples - i : HDR_BLOCK_SAMPLES;
+        ConvertHDRToFloat(kernels, src + i * src_size, from, block, n);
+        ConvertHDRFromFloat(kernels, block, dest + i * dest_size, to, n);
+    }
+}
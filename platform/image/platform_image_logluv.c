@@ -0,0 +1,182 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+#include <PL/platform_image.h>
+
+#include <math.h>
+
+/*	LogLuv
+ *	Greg Ward Larson's encoding for high dynamic range TIFFs, which holds
+ *	the log of absolute luminance along with CIE (u', v') chromaticity,
+ *	as either luminance alone (LogL, 16-bit), or 24 or 32 bits of colour.
+ *	Everything comes out as linear RGBA floats, the same as libtiff would
+ *	hand back, from which the table of chromaticity codes below is taken.
+ */
+
+#define LOGLUV_UV_SCALE     410.0   // 32-bit u and v are 8-bit fixed point
+#define LOGLUV_UV_SIZE      0.0035  // 24-bit u and v are codes for squares of this size
+#define LOGLUV_UV_VSTART    0.016940
+#define LOGLUV_UV_CODES     16289
+#define LOGLUV_U_NEUTRAL    (4.0 / 19.0)   // white, for any code out of range
+#define LOGLUV_V_NEUTRAL    (9.0 / 19.0)
+
+/* Squares are only given for where there's some colour, so each row,
+ * going up in v, starts at its own u and the codes follow on from the
+ * row before. */
+static const struct {
+    float u;
+    uint16_t first;
+} logluv_uv_rows[] = {
+        { 0.247663f, 0 }, { 0.243779f, 4 }, { 0.241684f, 10 }, { 0.237874f, 17 },
+        { 0.235906f, 26 }, { 0.232153f, 36 }, { 0.228352f, 48 }, { 0.226259f, 62 },
+        { 0.222371f, 77 }, { 0.220410f, 94 }, { 0.214710f, 112 }, { 0.212714f, 133 },
+        { 0.210721f, 155 }, { 0.204976f, 178 }, { 0.202986f, 204 }, { 0.199245f, 231 },
+        { 0.195525f, 260 }, { 0.193560f, 291 }, { 0.189878f, 323 }, { 0.186216f, 357 },
+        { 0.186216f, 393 }, { 0.182592f, 429 }, { 0.179003f, 467 }, { 0.175466f, 507 },
+        { 0.172001f, 549 }, { 0.172001f, 593 }, { 0.168612f, 637 }, { 0.168612f, 683 },
+        { 0.163575f, 729 }, { 0.158642f, 778 }, { 0.158642f, 830 }, { 0.158642f, 882 },
+        { 0.153815f, 934 }, { 0.153815f, 989 }, { 0.149097f, 1044 }, { 0.149097f, 1102 },
+        { 0.142746f, 1160 }, { 0.142746f, 1222 }, { 0.142746f, 1284 }, { 0.138270f, 1346 },
+        { 0.138270f, 1411 }, { 0.138270f, 1476 }, { 0.132166f, 1541 }, { 0.132166f, 1610 },
+        { 0.126204f, 1679 }, { 0.126204f, 1752 }, { 0.126204f, 1825 }, { 0.120381f, 1898 },
+        { 0.120381f, 1975 }, { 0.120381f, 2052 }, { 0.120381f, 2129 }, { 0.112962f, 2206 },
+        { 0.112962f, 2288 }, { 0.112962f, 2370 }, { 0.107450f, 2452 }, { 0.107450f, 2538 },
+        { 0.107450f, 2624 }, { 0.107450f, 2710 }, { 0.100343f, 2796 }, { 0.100343f, 2887 },
+        { 0.100343f, 2978 }, { 0.095126f, 3069 }, { 0.095126f, 3164 }, { 0.095126f, 3259 },
+        { 0.095126f, 3354 }, { 0.088276f, 3449 }, { 0.088276f, 3549 }, { 0.088276f, 3649 },
+        { 0.088276f, 3749 }, { 0.081523f, 3849 }, { 0.081523f, 3954 }, { 0.081523f, 4059 },
+        { 0.081523f, 4164 }, { 0.074861f, 4269 }, { 0.074861f, 4379 }, { 0.074861f, 4489 },
+        { 0.074861f, 4599 }, { 0.068290f, 4709 }, { 0.068290f, 4824 }, { 0.068290f, 4939 },
+        { 0.068290f, 5054 }, { 0.063573f, 5169 }, { 0.063573f, 5288 }, { 0.063573f, 5407 },
+        { 0.063573f, 5526 }, { 0.057219f, 5645 }, { 0.057219f, 5769 }, { 0.057219f, 5893 },
+        { 0.057219f, 6017 }, { 0.050985f, 6141 }, { 0.050985f, 6270 }, { 0.050985f, 6399 },
+        { 0.050985f, 6528 }, { 0.050985f, 6657 }, { 0.044859f, 6786 }, { 0.044859f, 6920 },
+        { 0.044859f, 7054 }, { 0.044859f, 7188 }, { 0.040571f, 7322 }, { 0.040571f, 7460 },
+        { 0.040571f, 7598 }, { 0.040571f, 7736 }, { 0.036339f, 7874 }, { 0.036339f, 8016 },
+        { 0.036339f, 8158 }, { 0.036339f, 8300 }, { 0.032139f, 8442 }, { 0.032139f, 8588 },
+        { 0.032139f, 8734 }, { 0.032139f, 8880 }, { 0.027947f, 9026 }, { 0.027947f, 9176 },
+        { 0.027947f, 9326 }, { 0.023739f, 9476 }, { 0.023739f, 9630 }, { 0.023739f, 9784 },
+        { 0.023739f, 9938 }, { 0.019504f, 10092 }, { 0.019504f, 10250 }, { 0.019504f, 10408 },
+        { 0.016976f, 10566 }, { 0.016976f, 10727 }, { 0.016976f, 10888 }, { 0.016976f, 11049 },
+        { 0.012639f, 11210 }, { 0.012639f, 11375 }, { 0.012639f, 11540 }, { 0.009991f, 11705 },
+        { 0.009991f, 11873 }, { 0.009991f, 12041 }, { 0.009016f, 12209 }, { 0.009016f, 12379 },
+        { 0.009016f, 12549 }, { 0.006217f, 12719 }, { 0.006217f, 12892 }, { 0.005097f, 13065 },
+        { 0.005097f, 13240 }, { 0.005097f, 13415 }, { 0.003909f, 13590 }, { 0.003909f, 13767 },
+        { 0.002340f, 13944 }, { 0.002389f, 14121 }, { 0.001068f, 14291 }, { 0.001653f, 14455 },
+        { 0.000717f, 14612 }, { 0.001614f, 14762 }, { 0.000270f, 14905 }, { 0.000484f, 15041 },
+        { 0.001103f, 15170 }, { 0.001242f, 15293 }, { 0.001188f, 15408 }, { 0.001011f, 15517 },
+        { 0.000709f, 15620 }, { 0.000301f, 15717 }, { 0.002416f, 15806 }, { 0.003251f, 15888 },
+        { 0.003246f, 15964 }, { 0.004141f, 16033 }, { 0.005963f, 16095 }, { 0.008839f, 16150 },
+        { 0.010490f, 16197 }, { 0.016994f, 16237 }, { 0.023659f, 16268 },
+};
+
+static void DecodeLogLuvUV(unsigned int code, double *u, double *v) {
+    if(code >= LOGLUV_UV_CODES) {
+        *u = LOGLUV_U_NEUTRAL;
+        *v = LOGLUV_V_NEUTRAL;
+        return;
+    }
+
+    unsigned int lower = 0, upper = plArrayElements(logluv_uv_rows);
+    while(upper - lower > 1) {
+        unsigned int middle = (lower + upper) / 2;
+        if(code >= logluv_uv_rows[middle].first) {
+            lower = middle;
+        } else {
+            upper = middle;
+        }
+    }
+
+    *u = logluv_uv_rows[lower].u + (code - logluv_uv_rows[lower].first + 0.5) * LOGLUV_UV_SIZE;
+    *v = LOGLUV_UV_VSTART + (lower + 0.5) * LOGLUV_UV_SIZE;
+}
+
+/* 15 bits of log luminance, 256 steps to each doubling, plus a sign. */
+static PL_INLINE double DecodeLogL16(unsigned int value) {
+    unsigned int log = value & 0x7FFF;
+    if(log == 0) {
+        return 0;
+    }
+
+    double y = exp2((log + 0.5) / 256 - 64);
+    return (value & 0x8000) ? -y : y;
+}
+
+/* 10 bits of log luminance, which can only be positive. */
+static PL_INLINE double DecodeLogL10(unsigned int value) {
+    if(value == 0) {
+        return 0;
+    }
+
+    return exp2((value + 0.5) / 64 - 12);
+}
+
+/* From luminance and chromaticity over to XYZ, and then RGB, using the same primaries
+ * as libtiff (CCIR 709) with an equal energy white, so that grey stays grey. */
+static PL_INLINE void StoreLogLuvPixel(double luminance, double u, double v, float *dest) {
+    dest[3] = 1.0f;
+    if(luminance <= 0) {
+        dest[0] = dest[1] = dest[2] = 0;
+        return;
+    }
+
+    double s = 1 / (6 * u - 16 * v + 12);
+    double x = 9 * u * s, y = 4 * v * s;
+    double cx = x / y * luminance, cy = luminance, cz = (1 - x - y) / y * luminance;
+
+    dest[0] = (float)(2.690 * cx - 1.276 * cy - 0.414 * cz);
+    dest[1] = (float)(-1.022 * cx + 1.978 * cy + 0.044 * cz);
+    dest[2] = (float)(0.061 * cx - 0.224 * cy + 1.163 * cz);
+}
+
+void ConvertLogLRow(const uint16_t *src, float *dest, unsigned int width) {
+    for(unsigned int x = 0; x < width; ++x, dest += 4) {
+        dest[0] = dest[1] = dest[2] = (float)DecodeLogL16(src[x]);
+        dest[3] = 1.0f;
+    }
+}
+
+/* 10 bits of luminance above 14 of chromaticity, as three bytes from the top down. */
+void ConvertLogLuv24Row(const uint8_t *src, float *dest, unsigned int width) {
+    for(unsigned int x = 0; x < width; ++x, src += 3, dest += 4) {
+        unsigned int value = ((unsigned int)src[0] << 16) | (src[1] << 8) | src[2];
+
+        double u, v;
+        DecodeLogLuvUV(value & 0x3FFF, &u, &v);
+        StoreLogLuvPixel(DecodeLogL10(value >> 14), u, v, dest);
+    }
+}
+
+/* 16 bits of luminance, then 8 bits each of u and v. */
+void ConvertLogLuv32Row(const uint32_t *src, float *dest, unsigned int width) {
+    for(unsigned int x = 0; x < width; ++x, dest += 4) {
+        uint32_t value = src[x];
+
+        double u = (((value >> 8) & 0xFF) + 0.5) / LOGLUV_UV_SCALE;
+        double v = ((value & 0xFF) + 0.5) / LOGLUV_UV_SCALE;
+        StoreLogLuvPixel(DecodeLogL16(value >> 16), u, v, dest);
+    }
+}
@@ -15,18 +15,36 @@ TERMS AND CONDITIONS FOR COPYING, DISTRIBUTION AND MODIFICATION
 */
 
 #include "PL/platform_image.h"
+#include "PL/platform_filesystem.h"
 
 /*	PPM Format	*/
 
 #define    PPM_HEADER_SIZE    70
 
-PLresult _plLoadPPMImage(FILE *fin, PLImage *out) {
+// Reads up to and including the next newline, like fgets.
+static char *ReadPPMLine(char *dest, size_t length, PLBinaryReader *reader) {
+    size_t i = 0;
+    while (i + 1 < length) {
+        const uint8_t *c = plGetBinaryReaderData(reader, 1);
+        if (c == NULL)
+            break;
+
+        dest[i++] = (char)*c;
+        if (*c == '\n')
+            break;
+    }
+    dest[i] = '\0';
+
+    return (i > 0) ? dest : NULL;
+}
+
+PLresult _plLoadPPMImage(PLBinaryReader *reader, PLImage *out) {
     _plSetCurrentFunction("_plLoadPPMImage");
 
     char header[PPM_HEADER_SIZE];
     memset(&header, 0, sizeof(header));
 
-    fgets(header, PPM_HEADER_SIZE, fin);
+    ReadPPMLine(header, PPM_HEADER_SIZE, reader);
     if (strncmp(header, "P6", 2)) {
         ReportError(PL_RESULT_FILEVERSION, "Unsupported PPM type!\n");
         return PL_RESULT_FILEVERSION;
@@ -35,7 +53,8 @@ PLresult _plLoadPPMImage(FILE *fin, PLImage *out) {
     int i = 0, d;
     unsigned int w = 0, h = 0;
     while (i < 3) {
-        fgets(header, PPM_HEADER_SIZE, fin);
+        if (ReadPPMLine(header, PPM_HEADER_SIZE, reader) == NULL)
+            return PL_RESULT_FILEREAD;
         if (header[0] == '#')
             continue;
 
@@ -53,7 +72,7 @@ PLresult _plLoadPPMImage(FILE *fin, PLImage *out) {
     out->data = new uint8_t*[1];
     out->data[0] = new uint8_t[out->size];
 
-    fread(out->data[0], sizeof(uint8_t), out->size, fin);
+    plReadBinary(reader, out->data[0], out->size);
 
     out->width = w;
     out->height = h;
@@ -0,0 +1,810 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+
+#include <PL/platform_image.h>
+
+#include <limits.h>
+#include <math.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#   include <immintrin.h>
+#   define S3TC_X86
+#endif
+
+/*	S3 texture compression, otherwise known as DXT or BC1 through to 3
+ *	Each block of 4x4 pixels comes down to a palette of four colours, and
+ *	for DXT5 another of eight alphas, which every pixel then picks from;
+ *	with SSSE3 that's a row of the block at a time. Colours in between
+ *	are rounded to nearest, from the endpoints expanded out to 8 bits.
+ *	Compressing goes the other way, picking a pair of endpoints for each
+ *	block and then the nearest of the palette they give for every pixel,
+ *	which with SSE2 is done for the whole block at once.
+ */
+
+#define S3TC_BLOCK_PIXELS   4
+
+enum {
+    S3TC_DXT1,
+    S3TC_DXT1_ALPHA,    // where the fourth colour can be transparent
+    S3TC_DXT3,
+    S3TC_DXT5,
+};
+
+static int GetS3TCType(PLImageFormat format) {
+    switch(format) {
+        case PL_IMAGEFORMAT_RGB_DXT1:   return S3TC_DXT1;
+        case PL_IMAGEFORMAT_RGBA_DXT1:  return S3TC_DXT1_ALPHA;
+        case PL_IMAGEFORMAT_RGBA_DXT3:  return S3TC_DXT3;
+        case PL_IMAGEFORMAT_RGBA_DXT5:  return S3TC_DXT5;
+        default:                        return -1;
+    }
+}
+
+unsigned int GetS3TCBlockSize(PLImageFormat format) {
+    switch(GetS3TCType(format)) {
+        case S3TC_DXT1:
+        case S3TC_DXT1_ALPHA:   return 8;
+        case S3TC_DXT3:
+        case S3TC_DXT5:         return 16;
+        default:                return 0;
+    }
+}
+
+static PL_INLINE void ExpandS3TCColour(unsigned int colour, uint8_t *dest) {
+    unsigned int r = (colour >> 11) & 31, g = (colour >> 5) & 63, b = colour & 31;
+    dest[0] = (uint8_t)((r << 3) | (r >> 2));
+    dest[1] = (uint8_t)((g << 2) | (g >> 4));
+    dest[2] = (uint8_t)((b << 3) | (b >> 2));
+    dest[3] = 255;
+}
+
+/* Four RGBA colours, where DXT3 and DXT5 always interpolate both of the
+ * last two, whereas DXT1 only does so if the first endpoint's the larger. */
+static void GetS3TCPalette(const uint8_t *block, int type, uint8_t *palette) {
+    unsigned int c0 = block[0] | (block[1] << 8), c1 = block[2] | (block[3] << 8);
+    ExpandS3TCColour(c0, palette);
+    ExpandS3TCColour(c1, palette + 4);
+
+    if(c0 > c1 || type == S3TC_DXT3 || type == S3TC_DXT5) {
+        for(unsigned int c = 0; c < 3; ++c) {
+            palette[8 + c] = (uint8_t)((palette[c] * 2 + palette[4 + c] + 1) / 3);
+            palette[12 + c] = (uint8_t)((palette[c] + palette[4 + c] * 2 + 1) / 3);
+        }
+        palette[15] = 255;
+    } else {
+        for(unsigned int c = 0; c < 3; ++c) {
+            palette[8 + c] = (uint8_t)((palette[c] + palette[4 + c] + 1) / 2);
+            palette[12 + c] = 0;
+        }
+        palette[15] = (type == S3TC_DXT1_ALPHA) ? 0 : 255;
+    }
+    palette[11] = 255;
+}
+
+static void GetS3TCAlphaPalette(const uint8_t *block, uint8_t *palette) {
+    unsigned int a0 = block[0], a1 = block[1];
+    palette[0] = (uint8_t)a0;
+    palette[1] = (uint8_t)a1;
+
+    if(a0 > a1) {
+        for(unsigned int i = 1; i < 7; ++i) {
+            palette[i + 1] = (uint8_t)(((7 - i) * a0 + i * a1 + 3) / 7);
+        }
+    } else {
+        for(unsigned int i = 1; i < 5; ++i) {
+            palette[i + 1] = (uint8_t)(((5 - i) * a0 + i * a1 + 2) / 5);
+        }
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+}
+
+/* three bits for each of the 16 pixels */
+static void GetS3TCAlphaIndices(const uint8_t *block, uint8_t *indices) {
+    uint64_t bits = 0;
+    for(unsigned int i = 0; i < 6; ++i) {
+        bits |= (uint64_t)block[2 + i] << (i * 8);
+    }
+    for(unsigned int i = 0; i < 16; ++i, bits >>= 3) {
+        indices[i] = (uint8_t)(bits & 7);
+    }
+}
+
+static void DecodeS3TCBlocksC(const uint8_t *src, int type, uint8_t *dest, size_t pitch, unsigned int count) {
+    size_t block_size = (type == S3TC_DXT3 || type == S3TC_DXT5) ? 16 : 8;
+    for(unsigned int i = 0; i < count; ++i, src += block_size, dest += S3TC_BLOCK_PIXELS * 4) {
+        const uint8_t *colour = src + block_size - 8;
+        uint8_t palette[16];
+        GetS3TCPalette(colour, type, palette);
+
+        uint8_t alphas[16];
+        if(type == S3TC_DXT3) {
+            for(unsigned int p = 0; p < 16; ++p) {
+                alphas[p] = (uint8_t)(((src[p / 2] >> ((p & 1) * 4)) & 15) * 17);
+            }
+        } else if(type == S3TC_DXT5) {
+            uint8_t alpha_palette[8], indices[16];
+            GetS3TCAlphaPalette(src, alpha_palette);
+            GetS3TCAlphaIndices(src, indices);
+            for(unsigned int p = 0; p < 16; ++p) {
+                alphas[p] = alpha_palette[indices[p]];
+            }
+        }
+
+        uint32_t indices = colour[4] | (colour[5] << 8) | (colour[6] << 16) | ((uint32_t)colour[7] << 24);
+        for(unsigned int y = 0; y < S3TC_BLOCK_PIXELS; ++y) {
+            uint8_t *row = dest + pitch * y;
+            for(unsigned int x = 0; x < S3TC_BLOCK_PIXELS; ++x, indices >>= 2, row += 4) {
+                memcpy(row, palette + (indices & 3) * 4, 4);
+                if(type == S3TC_DXT3 || type == S3TC_DXT5) {
+                    row[3] = alphas[y * S3TC_BLOCK_PIXELS + x];
+                }
+            }
+        }
+    }
+}
+
+#if defined(S3TC_X86)
+
+/* for each row's worth of indices, where in the palette each byte comes from */
+static uint8_t s3tc_row_shuffles[256][16];
+/* and where each row's alpha comes from, out of all 16 */
+static uint8_t s3tc_alpha_shuffles[S3TC_BLOCK_PIXELS][16];
+
+static void SetupS3TCShuffles(void) {
+    for(unsigned int i = 0; i < 256; ++i) {
+        for(unsigned int p = 0; p < 16; ++p) {
+            s3tc_row_shuffles[i][p] = (uint8_t)(((i >> ((p / 4) * 2)) & 3) * 4 + (p & 3));
+        }
+    }
+
+    for(unsigned int y = 0; y < S3TC_BLOCK_PIXELS; ++y) {
+        memset(s3tc_alpha_shuffles[y], 0x80, 16);
+        for(unsigned int x = 0; x < S3TC_BLOCK_PIXELS; ++x) {
+            s3tc_alpha_shuffles[y][x * 4 + 3] = (uint8_t)(y * S3TC_BLOCK_PIXELS + x);
+        }
+    }
+}
+
+__attribute__((target("ssse3")))
+static void DecodeS3TCBlocksSSSE3(const uint8_t *src, int type, uint8_t *dest, size_t pitch, unsigned int count) {
+    const bool alpha = (type == S3TC_DXT3 || type == S3TC_DXT5);
+    const size_t block_size = alpha ? 16 : 8;
+    const __m128i colour_mask = _mm_set1_epi32(0x00FFFFFF);
+    const __m128i nibble = _mm_set1_epi8(15);
+
+    for(unsigned int i = 0; i < count; ++i, src += block_size, dest += S3TC_BLOCK_PIXELS * 4) {
+        const uint8_t *colour = src + block_size - 8;
+        uint8_t palette[16];
+        GetS3TCPalette(colour, type, palette);
+        __m128i colours = _mm_loadu_si128((const __m128i*)palette);
+
+        __m128i alphas = _mm_setzero_si128();
+        if(type == S3TC_DXT3) {
+            __m128i bits = _mm_loadl_epi64((const __m128i*)src);
+            __m128i lo = _mm_and_si128(bits, nibble);
+            __m128i hi = _mm_and_si128(_mm_srli_epi16(bits, 4), nibble);
+            alphas = _mm_unpacklo_epi8(lo, hi);
+            alphas = _mm_or_si128(alphas, _mm_slli_epi16(alphas, 4));
+        } else if(type == S3TC_DXT5) {
+            uint8_t alpha_palette[16], indices[16];
+            GetS3TCAlphaPalette(src, alpha_palette);
+            GetS3TCAlphaIndices(src, indices);
+            alphas = _mm_shuffle_epi8(_mm_loadl_epi64((const __m128i*)alpha_palette),
+                                      _mm_loadu_si128((const __m128i*)indices));
+        }
+
+        for(unsigned int y = 0; y < S3TC_BLOCK_PIXELS; ++y) {
+            __m128i shuffle = _mm_loadu_si128((const __m128i*)s3tc_row_shuffles[colour[4 + y]]);
+            __m128i row = _mm_shuffle_epi8(colours, shuffle);
+            if(alpha) {
+                shuffle = _mm_loadu_si128((const __m128i*)s3tc_alpha_shuffles[y]);
+                __m128i row_alphas = _mm_shuffle_epi8(alphas, shuffle);
+                row = _mm_or_si128(_mm_and_si128(row, colour_mask), row_alphas);
+            }
+            _mm_storeu_si128((__m128i*)(dest + pitch * y), row);
+        }
+    }
+}
+
+#endif
+
+/////////////////////////////////////////////////////////////////
+// Compression
+
+#define S3TC_OPAQUE             0xFFFF  // mask with a bit set for every pixel in the block
+#define S3TC_MAX_REFINEMENTS    8
+
+/* Where each pixel falls on the line from e0 to e1, as the nearest of
+ * steps + 1 points spaced evenly along it, starting from 0 at e0. */
+static void ProjectS3TCColoursC(const uint8_t *block, const uint8_t *e0, const uint8_t *e1, unsigned int steps,
+                                uint8_t *positions) {
+    int d[3] = { e1[0] - e0[0], e1[1] - e0[1], e1[2] - e0[2] };
+    int length = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+    if(length == 0) {
+        memset(positions, 0, 16);
+        return;
+    }
+
+    float scale = (float)steps / (float)length;
+    for(unsigned int p = 0; p < 16; ++p, block += 4) {
+        int dot = (block[0] - e0[0]) * d[0] + (block[1] - e0[1]) * d[1] + (block[2] - e0[2]) * d[2];
+        float t = (float)dot * scale + 0.5f;
+        if(t < 0.0f) {
+            t = 0.0f;
+        } else if(t > (float)steps) {
+            t = (float)steps;
+        }
+        positions[p] = (uint8_t)t;
+    }
+}
+
+/* Picks the nearest of the eight alphas for each pixel, the first of any that tie. */
+static void SelectS3TCAlphasC(const uint8_t *alphas, const uint8_t *palette, uint8_t *indices) {
+    for(unsigned int p = 0; p < 16; ++p) {
+        unsigned int best = 256;
+        for(unsigned int i = 0; i < 8; ++i) {
+            unsigned int d = (unsigned int)abs(alphas[p] - palette[i]);
+            if(d < best) {
+                best = d;
+                indices[p] = (uint8_t)i;
+            }
+        }
+    }
+}
+
+#if defined(S3TC_X86)
+
+__attribute__((target("sse2")))
+static void ProjectS3TCColoursSSE2(const uint8_t *block, const uint8_t *e0, const uint8_t *e1, unsigned int steps,
+                                   uint8_t *positions) {
+    int d[3] = { e1[0] - e0[0], e1[1] - e0[1], e1[2] - e0[2] };
+    int length = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+    if(length == 0) {
+        memset(positions, 0, 16);
+        return;
+    }
+
+    /* alpha is multiplied by zero, leaving each dot product split over a pair of lanes */
+    const __m128i origin = _mm_setr_epi16(e0[0], e0[1], e0[2], 0, e0[0], e0[1], e0[2], 0);
+    const __m128i direction = _mm_setr_epi16(d[0], d[1], d[2], 0, d[0], d[1], d[2], 0);
+    const __m128 scale = _mm_set1_ps((float)steps / (float)length);
+    const __m128 half = _mm_set1_ps(0.5f), last = _mm_set1_ps((float)steps);
+    const __m128i zero = _mm_setzero_si128();
+
+    __m128i quarters[4];
+    for(unsigned int q = 0; q < 4; ++q) {
+        __m128i pixels = _mm_loadu_si128((const __m128i*)(block + q * 16));
+        __m128 lo = _mm_castsi128_ps(_mm_madd_epi16(_mm_sub_epi16(_mm_unpacklo_epi8(pixels, zero), origin), direction));
+        __m128 hi = _mm_castsi128_ps(_mm_madd_epi16(_mm_sub_epi16(_mm_unpackhi_epi8(pixels, zero), origin), direction));
+        __m128i dot = _mm_add_epi32(_mm_castps_si128(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0))),
+                                    _mm_castps_si128(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1))));
+        __m128 t = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(dot), scale), half);
+        quarters[q] = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(t, _mm_setzero_ps()), last));
+    }
+
+    __m128i packed = _mm_packus_epi16(_mm_packs_epi32(quarters[0], quarters[1]),
+                                      _mm_packs_epi32(quarters[2], quarters[3]));
+    _mm_storeu_si128((__m128i*)positions, packed);
+}
+
+__attribute__((target("sse2")))
+static void SelectS3TCAlphasSSE2(const uint8_t *alphas, const uint8_t *palette, uint8_t *indices) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i a = _mm_loadu_si128((const __m128i*)alphas);
+    __m128i best = _mm_set1_epi8(-1), chosen = zero;
+    for(unsigned int i = 0; i < 8; ++i) {
+        __m128i v = _mm_set1_epi8((char)palette[i]);
+        __m128i d = _mm_or_si128(_mm_subs_epu8(a, v), _mm_subs_epu8(v, a));
+        /* only taken if it's strictly closer */
+        __m128i further = _mm_cmpeq_epi8(_mm_subs_epu8(best, d), zero);
+        chosen = _mm_or_si128(_mm_and_si128(further, chosen), _mm_andnot_si128(further, _mm_set1_epi8((char)i)));
+        best = _mm_min_epu8(best, d);
+    }
+    _mm_storeu_si128((__m128i*)indices, chosen);
+}
+
+#endif
+
+/////////////////////////////////////////////////////////////////
+
+typedef struct S3TCKernels {
+    void (*DecodeBlocks)(const uint8_t *src, int type, uint8_t *dest, size_t pitch, unsigned int count);
+    void (*ProjectColours)(const uint8_t *block, const uint8_t *e0, const uint8_t *e1, unsigned int steps,
+                           uint8_t *positions);
+    void (*SelectAlphas)(const uint8_t *alphas, const uint8_t *palette, uint8_t *indices);
+} S3TCKernels;
+
+static S3TCKernels s3tc_kernels = {
+        DecodeS3TCBlocksC,
+        ProjectS3TCColoursC, SelectS3TCAlphasC,
+};
+
+static void SetupS3TCKernels(void) {
+#if defined(S3TC_X86)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("sse2")) {
+        s3tc_kernels.ProjectColours = ProjectS3TCColoursSSE2;
+        s3tc_kernels.SelectAlphas = SelectS3TCAlphasSSE2;
+    }
+    if(__builtin_cpu_supports("ssse3")) {
+        SetupS3TCShuffles();
+        s3tc_kernels.DecodeBlocks = DecodeS3TCBlocksSSSE3;
+    }
+#endif
+}
+
+static const S3TCKernels *GetS3TCKernels(void) {
+    static PLImageOnce once = PL_IMAGE_ONCE_INIT;
+    CallImageOnce(&once, SetupS3TCKernels);
+    return &s3tc_kernels;
+}
+
+/* Decodes a row of blocks into the given number of rows of RGBA8, up to four,
+ * stopping short at the edge of the image where it doesn't line up with them. */
+void DecodeS3TCBlocks(const uint8_t *src, PLImageFormat format, uint8_t *dest, size_t pitch,
+                      unsigned int width, unsigned int rows) {
+    const S3TCKernels *kernels = GetS3TCKernels();
+
+    int type = GetS3TCType(format);
+    plAssert(type >= 0 && rows <= S3TC_BLOCK_PIXELS);
+
+    unsigned int blocks = width / S3TC_BLOCK_PIXELS;
+    if(rows == S3TC_BLOCK_PIXELS) {
+        kernels->DecodeBlocks(src, type, dest, pitch, blocks);
+    } else {
+        for(unsigned int i = 0; i < blocks; ++i) {
+            uint8_t block[S3TC_BLOCK_PIXELS * S3TC_BLOCK_PIXELS * 4];
+            kernels->DecodeBlocks(src + i * GetS3TCBlockSize(format), type, block, S3TC_BLOCK_PIXELS * 4, 1);
+            for(unsigned int y = 0; y < rows; ++y) {
+                memcpy(dest + pitch * y + i * S3TC_BLOCK_PIXELS * 4, block + y * S3TC_BLOCK_PIXELS * 4,
+                       S3TC_BLOCK_PIXELS * 4);
+            }
+        }
+    }
+
+    unsigned int remainder = width - blocks * S3TC_BLOCK_PIXELS;
+    if(remainder > 0) {
+        uint8_t block[S3TC_BLOCK_PIXELS * S3TC_BLOCK_PIXELS * 4];
+        kernels->DecodeBlocks(src + blocks * GetS3TCBlockSize(format), type, block, S3TC_BLOCK_PIXELS * 4, 1);
+        for(unsigned int y = 0; y < rows; ++y) {
+            memcpy(dest + pitch * y + blocks * S3TC_BLOCK_PIXELS * 4, block + y * S3TC_BLOCK_PIXELS * 4,
+                   remainder * 4);
+        }
+    }
+}
+
+/////////////////////////////////////////////////////////////////
+
+static PL_INLINE unsigned int QuantiseS3TCChannel(int value, unsigned int max) {
+    unsigned int t = (unsigned int)value * max + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+static PL_INLINE unsigned int QuantiseS3TCColour(const int *rgb) {
+    return (QuantiseS3TCChannel(rgb[0], 31) << 11) | (QuantiseS3TCChannel(rgb[1], 63) << 5) |
+           QuantiseS3TCChannel(rgb[2], 31);
+}
+
+/* The corners of the box around the colours, across whichever diagonal they
+ * seem to lie along, pulled in a little as they rarely sit right at the ends. */
+static void GetS3TCBoxEndpoints(const uint8_t *block, unsigned int opaque, int *lo, int *hi) {
+    int min[3] = { 255, 255, 255 }, max[3] = { 0, 0, 0 };
+    for(unsigned int p = 0; p < 16; ++p) {
+        if(!(opaque & (1u << p))) {
+            continue;
+        }
+        for(unsigned int c = 0; c < 3; ++c) {
+            if(block[p * 4 + c] < min[c]) min[c] = block[p * 4 + c];
+            if(block[p * 4 + c] > max[c]) max[c] = block[p * 4 + c];
+        }
+    }
+
+    /* red and green are each checked for going against blue */
+    int centre[3] = { (min[0] + max[0]) / 2, (min[1] + max[1]) / 2, (min[2] + max[2]) / 2 };
+    int rb = 0, gb = 0;
+    for(unsigned int p = 0; p < 16; ++p) {
+        if(!(opaque & (1u << p))) {
+            continue;
+        }
+        int b = block[p * 4 + 2] - centre[2];
+        rb += (block[p * 4] - centre[0]) * b;
+        gb += (block[p * 4 + 1] - centre[1]) * b;
+    }
+
+    for(unsigned int c = 0; c < 3; ++c) {
+        lo[c] = min[c];
+        hi[c] = max[c];
+    }
+    if(rb < 0) {
+        lo[0] = max[0];
+        hi[0] = min[0];
+    }
+    if(gb < 0) {
+        lo[1] = max[1];
+        hi[1] = min[1];
+    }
+
+    for(unsigned int c = 0; c < 3; ++c) {
+        int inset = (hi[c] - lo[c]) / 16;
+        lo[c] += inset;
+        hi[c] -= inset;
+    }
+}
+
+/* The two colours furthest apart along the axis they vary the most in,
+ * found by power iteration on their covariance. Returns false if the axis
+ * can't be found, or the colours don't spread out along it. */
+static bool GetS3TCAxisEndpoints(const uint8_t *block, unsigned int opaque, int *lo, int *hi) {
+    float mean[3] = { 0.0f, 0.0f, 0.0f };
+    int min[3] = { 255, 255, 255 }, max[3] = { 0, 0, 0 };
+    unsigned int count = 0;
+    for(unsigned int p = 0; p < 16; ++p) {
+        if(!(opaque & (1u << p))) {
+            continue;
+        }
+        for(unsigned int c = 0; c < 3; ++c) {
+            mean[c] += block[p * 4 + c];
+            if(block[p * 4 + c] < min[c]) min[c] = block[p * 4 + c];
+            if(block[p * 4 + c] > max[c]) max[c] = block[p * 4 + c];
+        }
+        ++count;
+    }
+    for(unsigned int c = 0; c < 3; ++c) {
+        mean[c] /= (float)count;
+    }
+
+    /* rr, rg, rb, gg, gb, bb */
+    float covariance[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+    for(unsigned int p = 0; p < 16; ++p) {
+        if(!(opaque & (1u << p))) {
+            continue;
+        }
+        float r = block[p * 4] - mean[0], g = block[p * 4 + 1] - mean[1], b = block[p * 4 + 2] - mean[2];
+        covariance[0] += r * r;
+        covariance[1] += r * g;
+        covariance[2] += r * b;
+        covariance[3] += g * g;
+        covariance[4] += g * b;
+        covariance[5] += b * b;
+    }
+
+    /* started across the same diagonal as the box, as colours going against
+     * each other can cancel out to nothing along the other one */
+    float axis[3] = { (float)(max[0] - min[0]), (float)(max[1] - min[1]), (float)(max[2] - min[2]) };
+    if(covariance[2] < 0.0f) {
+        axis[0] = -axis[0];
+    }
+    if(covariance[4] < 0.0f) {
+        axis[1] = -axis[1];
+    }
+
+    for(unsigned int i = 0; i < 4; ++i) {
+        float x = covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2];
+        float y = covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2];
+        float z = covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2];
+        float largest = fmaxf(fabsf(x), fmaxf(fabsf(y), fabsf(z)));
+        if(largest == 0.0f) {
+            return false;
+        }
+        axis[0] = x / largest;
+        axis[1] = y / largest;
+        axis[2] = z / largest;
+    }
+
+    const uint8_t *first = NULL, *last = NULL;
+    float low = 0.0f, high = 0.0f;
+    for(unsigned int p = 0; p < 16; ++p) {
+        if(!(opaque & (1u << p))) {
+            continue;
+        }
+        const uint8_t *pixel = block + p * 4;
+        float d = pixel[0] * axis[0] + pixel[1] * axis[1] + pixel[2] * axis[2];
+        if(first == NULL || d < low) {
+            first = pixel;
+            low = d;
+        }
+        if(last == NULL || d > high) {
+            last = pixel;
+            high = d;
+        }
+    }
+
+    if(high <= low) {
+        return false;
+    }
+
+    for(unsigned int c = 0; c < 3; ++c) {
+        lo[c] = first[c];
+        hi[c] = last[c];
+    }
+
+    return true;
+}
+
+/* Solves for the endpoints that best fit the pixels, by least squares, given
+ * where each one's ended up between them. Returns false if they're all in the
+ * same place, as there's then nothing to go on. */
+static bool FitS3TCEndpoints(const uint8_t *block, unsigned int opaque, const uint8_t *positions, unsigned int steps,
+                             int *lo, int *hi) {
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+    float ax[3] = { 0.0f, 0.0f, 0.0f }, bx[3] = { 0.0f, 0.0f, 0.0f };
+    unsigned int seen = 0;
+    for(unsigned int p = 0; p < 16; ++p) {
+        if(!(opaque & (1u << p))) {
+            continue;
+        }
+        seen |= 1u << positions[p];
+
+        float b = (float)positions[p] / (float)steps, a = 1.0f - b;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for(unsigned int c = 0; c < 3; ++c) {
+            ax[c] += a * block[p * 4 + c];
+            bx[c] += b * block[p * 4 + c];
+        }
+    }
+
+    if((seen & (seen - 1)) == 0) {
+        return false;
+    }
+
+    float determinant = aa * bb - ab * ab;
+    for(unsigned int c = 0; c < 3; ++c) {
+        float l = (ax[c] * bb - bx[c] * ab) / determinant;
+        float h = (bx[c] * aa - ax[c] * ab) / determinant;
+        lo[c] = (int)(fminf(fmaxf(l, 0.0f), 255.0f) + 0.5f);
+        hi[c] = (int)(fminf(fmaxf(h, 0.0f), 255.0f) + 0.5f);
+    }
+
+    return true;
+}
+
+/* Puts together a colour block from the two quantised endpoints and how far
+ * along from lo to hi each pixel is, in thirds, or in halves with the fourth
+ * colour left for transparency. */
+static void PackS3TCColours(unsigned int lo, unsigned int hi, const uint8_t *positions, unsigned int opaque,
+                            bool transparent, uint8_t *dest) {
+    static const uint8_t four_colours[4] = { 0, 2, 3, 1 };
+    static const uint8_t three_colours[3] = { 0, 2, 1 };
+
+    /* four colours needs the first endpoint larger, three the second */
+    bool flip = transparent ? (hi < lo) : (hi > lo);
+    unsigned int c0 = flip ? hi : lo, c1 = flip ? lo : hi;
+    unsigned int steps = transparent ? 2 : 3;
+
+    uint32_t indices = 0;
+    if(c0 != c1 || transparent) {
+        for(unsigned int p = 16; p-- > 0;) {
+            unsigned int index = 3;
+            if(opaque & (1u << p)) {
+                unsigned int position = flip ? steps - positions[p] : positions[p];
+                index = transparent ? three_colours[position] : four_colours[position];
+            }
+            indices = (indices << 2) | index;
+        }
+    }
+
+    dest[0] = (uint8_t)c0;
+    dest[1] = (uint8_t)(c0 >> 8);
+    dest[2] = (uint8_t)c1;
+    dest[3] = (uint8_t)(c1 >> 8);
+    for(unsigned int i = 0; i < 4; ++i) {
+        dest[4 + i] = (uint8_t)(indices >> (i * 8));
+    }
+}
+
+static unsigned int GetS3TCColourError(const uint8_t *block, unsigned int opaque, const uint8_t *colour, int type) {
+    uint8_t palette[16];
+    GetS3TCPalette(colour, type, palette);
+
+    uint32_t indices = colour[4] | (colour[5] << 8) | (colour[6] << 16) | ((uint32_t)colour[7] << 24);
+    unsigned int error = 0;
+    for(unsigned int p = 0; p < 16; ++p, indices >>= 2) {
+        if(!(opaque & (1u << p))) {
+            continue;
+        }
+        const uint8_t *c = palette + (indices & 3) * 4;
+        for(unsigned int i = 0; i < 3; ++i) {
+            int d = block[p * 4 + i] - c[i];
+            error += (unsigned int)(d * d);
+        }
+    }
+
+    return error;
+}
+
+/* Quantises the endpoints and puts together the block from them, leaving
+ * where each pixel ended up between the two in positions. */
+static void PlaceS3TCColours(const S3TCKernels *kernels, const uint8_t *block, unsigned int opaque, bool transparent,
+                             const int *lo, const int *hi, uint8_t *positions, uint8_t *dest) {
+    unsigned int c_lo = QuantiseS3TCColour(lo), c_hi = QuantiseS3TCColour(hi);
+    uint8_t e0[4], e1[4];
+    ExpandS3TCColour(c_lo, e0);
+    ExpandS3TCColour(c_hi, e1);
+    kernels->ProjectColours(block, e0, e1, transparent ? 2 : 3, positions);
+
+    PackS3TCColours(c_lo, c_hi, positions, opaque, transparent, dest);
+}
+
+/* Fast takes the endpoints from the bounding box, otherwise they're taken from
+ * along the principal axis and then refit by least squares, once for normal and
+ * for high for as long as it keeps getting any closer. The box is kept to fall
+ * back on, so neither ever does worse than fast would have. */
+static void EncodeS3TCColours(const S3TCKernels *kernels, const uint8_t *block, int type,
+                              PLCompressionQuality quality, uint8_t *dest) {
+    unsigned int opaque = S3TC_OPAQUE;
+    if(type == S3TC_DXT1_ALPHA) {
+        for(unsigned int p = 0; p < 16; ++p) {
+            if(block[p * 4 + 3] < 128) {
+                opaque &= ~(1u << p);
+            }
+        }
+    }
+
+    if(opaque == 0) {
+        memset(dest, 0, 4);
+        memset(dest + 4, 0xFF, 4);
+        return;
+    }
+
+    bool transparent = (opaque != S3TC_OPAQUE);
+    unsigned int steps = transparent ? 2 : 3;
+
+    int lo[3], hi[3];
+    uint8_t positions[16];
+    GetS3TCBoxEndpoints(block, opaque, lo, hi);
+    PlaceS3TCColours(kernels, block, opaque, transparent, lo, hi, positions, dest);
+    if(quality == PL_COMPRESSIONQUALITY_FAST) {
+        return;
+    }
+
+    unsigned int best = GetS3TCColourError(block, opaque, dest, type);
+    if(best == 0) {
+        return;
+    }
+
+    /* if there's no axis to go along, the box is refit instead */
+    GetS3TCAxisEndpoints(block, opaque, lo, hi);
+
+    unsigned int refinements = (quality == PL_COMPRESSIONQUALITY_NORMAL) ? 1 : S3TC_MAX_REFINEMENTS;
+    unsigned int last = UINT_MAX;
+    for(unsigned int i = 0;; ++i) {
+        uint8_t candidate[8];
+        PlaceS3TCColours(kernels, block, opaque, transparent, lo, hi, positions, candidate);
+
+        unsigned int error = GetS3TCColourError(block, opaque, candidate, type);
+        if(error >= last) {
+            break;
+        }
+        last = error;
+
+        if(error < best) {
+            memcpy(dest, candidate, 8);
+            best = error;
+        }
+
+        if(error == 0 || i == refinements || !FitS3TCEndpoints(block, opaque, positions, steps, lo, hi)) {
+            break;
+        }
+    }
+}
+
+static unsigned int GetS3TCAlphaError(const uint8_t *alphas, const uint8_t *palette, const uint8_t *indices) {
+    unsigned int error = 0;
+    for(unsigned int p = 0; p < 16; ++p) {
+        int d = alphas[p] - palette[indices[p]];
+        error += (unsigned int)(d * d);
+    }
+    return error;
+}
+
+/* The smallest and largest alphas with six more in between them, and for
+ * high quality the other way round too, with 0 and 255 set aside and only
+ * four in between the rest, if there's any of either to be had. */
+static void EncodeS3TCAlphas(const S3TCKernels *kernels, const uint8_t *block, PLCompressionQuality quality,
+                             uint8_t *dest) {
+    uint8_t alphas[16];
+    unsigned int min = 255, max = 0, inner_min = 255, inner_max = 0;
+    for(unsigned int p = 0; p < 16; ++p) {
+        unsigned int a = alphas[p] = block[p * 4 + 3];
+        if(a < min) min = a;
+        if(a > max) max = a;
+        if(a != 0 && a != 255) {
+            if(a < inner_min) inner_min = a;
+            if(a > inner_max) inner_max = a;
+        }
+    }
+
+    uint8_t palette[8], indices[16];
+    dest[0] = (uint8_t)max;
+    dest[1] = (uint8_t)min;
+    GetS3TCAlphaPalette(dest, palette);
+    kernels->SelectAlphas(alphas, palette, indices);
+
+    if(quality == PL_COMPRESSIONQUALITY_HIGH && (min == 0 || max == 255) && inner_min <= inner_max) {
+        uint8_t other[2] = { (uint8_t)inner_min, (uint8_t)inner_max };
+        uint8_t other_palette[8], other_indices[16];
+        GetS3TCAlphaPalette(other, other_palette);
+        kernels->SelectAlphas(alphas, other_palette, other_indices);
+        if(GetS3TCAlphaError(alphas, other_palette, other_indices) < GetS3TCAlphaError(alphas, palette, indices)) {
+            dest[0] = other[0];
+            dest[1] = other[1];
+            memcpy(indices, other_indices, sizeof(indices));
+        }
+    }
+
+    uint64_t bits = 0;
+    for(unsigned int p = 16; p-- > 0;) {
+        bits = (bits << 3) | indices[p];
+    }
+    for(unsigned int i = 0; i < 6; ++i) {
+        dest[2 + i] = (uint8_t)(bits >> (i * 8));
+    }
+}
+
+static void EncodeS3TCExplicitAlphas(const uint8_t *block, uint8_t *dest) {
+    for(unsigned int p = 0; p < 16; p += 2) {
+        dest[p / 2] = (uint8_t)(QuantiseS3TCChannel(block[p * 4 + 3], 15) |
+                                (QuantiseS3TCChannel(block[p * 4 + 7], 15) << 4));
+    }
+}
+
+/* Encodes a row of blocks from the given number of rows of RGBA8, up to four,
+ * where any block that runs off the edge of the image repeats the last row and
+ * column. DXT1 with alpha treats anything less than half opaque as transparent. */
+void EncodeS3TCBlocks(const uint8_t *src, size_t pitch, unsigned int width, unsigned int rows, uint8_t *dest,
+                      PLImageFormat format, PLCompressionQuality quality) {
+    const S3TCKernels *kernels = GetS3TCKernels();
+
+    int type = GetS3TCType(format);
+    plAssert(type >= 0 && rows > 0 && rows <= S3TC_BLOCK_PIXELS);
+
+    size_t block_size = GetS3TCBlockSize(format);
+    for(unsigned int x = 0; x < width; x += S3TC_BLOCK_PIXELS, dest += block_size) {
+        uint8_t block[S3TC_BLOCK_PIXELS * S3TC_BLOCK_PIXELS * 4];
+        for(unsigned int y = 0; y < S3TC_BLOCK_PIXELS; ++y) {
+            const uint8_t *row = src + pitch * ((y < rows) ? y : rows - 1);
+            if(width - x >= S3TC_BLOCK_PIXELS) {
+                memcpy(block + y * S3TC_BLOCK_PIXELS * 4, row + x * 4, S3TC_BLOCK_PIXELS * 4);
+                continue;
+            }
+            for(unsigned int i = 0; i < S3TC_BLOCK_PIXELS; ++i) {
+                unsigned int column = (x + i < width) ? x + i : width - 1;
+                memcpy(block + (y * S3TC_BLOCK_PIXELS + i) * 4, row + column * 4, 4);
+            }
+        }
+
+        if(type == S3TC_DXT3) {
+            EncodeS3TCExplicitAlphas(block, dest);
+        } else if(type == S3TC_DXT5) {
+            EncodeS3TCAlphas(kernels, block, quality, dest);
+        }
+        EncodeS3TCColours(kernels, block, type, quality, dest + block_size - 8);
+    }
+}
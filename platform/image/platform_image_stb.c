@@ -0,0 +1,163 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+
+#include <PL/platform_image.h>
+#include <PL/platform_filesystem.h>
+
+/*	PNG, JPEG and TGA, through stb_image	*/
+
+#define STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_STATIC
+#define STBI_ONLY_PNG
+#define STBI_ONLY_JPEG
+#define STBI_ONLY_TGA
+#define STBI_NO_STDIO
+#define STBI_ASSERT(x)  plAssert(x)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"    // kept static, so everything we don't use warns
+#include "stb_image.h"
+#pragma GCC diagnostic pop
+
+static int ReadSTBImage(void *user, char *data, int size) {
+    PLBinaryReader *reader = (PLBinaryReader*)user;
+
+    size_t available = reader->length - plGetBinaryReaderOffset(reader);
+    if((size_t)size > available) {
+        size = (int)available;
+    }
+
+    if(!plReadBinary(reader, data, (size_t)size)) {
+        return 0;
+    }
+
+    return size;
+}
+
+static void SkipSTBImage(void *user, int n) {
+    PLBinaryReader *reader = (PLBinaryReader*)user;
+
+    /* negative to go back over what's already been read */
+    size_t offset = plGetBinaryReaderOffset(reader);
+    if(n < 0 && (size_t)(-n) > offset) {
+        n = -(int)offset;
+    }
+
+    plSeekBinaryReader(reader, offset + n);
+}
+
+static int EofSTBImage(void *user) {
+    PLBinaryReader *reader = (PLBinaryReader*)user;
+    return (reader->error || plGetBinaryReaderOffset(reader) >= reader->length);
+}
+
+/* stb_image needs the image from the very start, magic and all, and
+ * allocates the pixels itself, which are then handed straight over
+ * as the first level rather than being copied out again. */
+PLresult LoadSTBImage(PLBinaryReader *reader, PLImage *out) {
+    if(!plSeekBinaryReader(reader, 0)) {
+        return PL_RESULT_FILEREAD;
+    }
+
+    /* there's no single channel format, so anything grey is expanded out */
+    int width, height, channels;
+    stbi_uc *pixels;
+    if(reader->file == NULL) {
+        /* already in memory, so it can be read from directly */
+        if(reader->size > INT_MAX) {
+            ReportError(PL_RESULT_FILEREAD, "image is too large to decode");
+            return PL_RESULT_FILEREAD;
+        }
+
+        int size = (int)reader->size;
+        if(!stbi_info_from_memory(reader->data, size, &width, &height, &channels)) {
+            channels = 0;
+        }
+
+        channels = (channels == 1 || channels == 3) ? 3 : 4;
+        pixels = stbi_load_from_memory(reader->data, size, &width, &height, NULL, channels);
+    } else {
+        stbi_io_callbacks callbacks = { ReadSTBImage, SkipSTBImage, EofSTBImage };
+        if(!stbi_info_from_callbacks(&callbacks, reader, &width, &height, &channels)) {
+            channels = 0;
+        }
+
+        plSeekBinaryReader(reader, 0);
+        reader->error = false;
+
+        channels = (channels == 1 || channels == 3) ? 3 : 4;
+        pixels = stbi_load_from_callbacks(&callbacks, reader, &width, &height, NULL, channels);
+    }
+
+    if(pixels == NULL) {
+        ReportError(PL_RESULT_FILEREAD, "failed to decode image, %s", stbi_failure_reason());
+        return PL_RESULT_FILEREAD;
+    }
+
+    memset(out, 0, sizeof(PLImage));
+
+    out->width = (unsigned int)width;
+    out->height = (unsigned int)height;
+    if(channels == 4) {
+        out->format = PL_IMAGEFORMAT_RGBA8;
+        out->colour_format = PL_COLOURFORMAT_RGBA;
+    } else {
+        out->format = PL_IMAGEFORMAT_RGB8;
+        out->colour_format = PL_COLOURFORMAT_RGB;
+    }
+
+    out->size = _plGetImageSize(out->format, out->width, out->height);
+    out->levels = 1;
+
+    out->data = calloc(1, sizeof(uint8_t*));
+    if(out->data == NULL) {
+        stbi_image_free(pixels);
+        ReportError(PL_RESULT_MEMORYALLOC, "couldn't allocate output image buffer");
+        return PL_RESULT_MEMORYALLOC;
+    }
+    out->data[0] = pixels;
+
+    return PL_RESULT_SUCCESS;
+}
+
+/* For images held within others, such as the JPEG strips of a TIFF, which are
+ * decoded straight from memory into the given number of channels. */
+uint8_t *DecodeSTBImage(const uint8_t *data, size_t length, unsigned int channels,
+                        unsigned int *width, unsigned int *height) {
+    if(length > INT_MAX) {
+        return NULL;
+    }
+
+    int w, h;
+    stbi_uc *pixels = stbi_load_from_memory(data, (int)length, &w, &h, NULL, (int)channels);
+    if(pixels == NULL) {
+        return NULL;
+    }
+
+    *width = (unsigned int)w;
+    *height = (unsigned int)h;
+    return pixels;
+}
@@ -0,0 +1,1736 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+
+#include <PL/platform_image.h>
+#include <PL/platform_filesystem.h>
+
+#if !defined(_WIN32)
+#   include <pthread.h>
+#   include <unistd.h>
+#endif
+
+#if defined(PL_USE_ZLIB)
+#   include <zlib.h>
+#endif
+
+/*	Tagged Image File Format (https://www.adobe.io/open/standards/TIFF.html)
+ *	Only the first image within the file is read. The image is split into
+ *	strips or tiles, each of which is compressed on its own, so they're
+ *	spread across threads and each decoded straight into place. Fax pages
+ *	are kept at a bit per pixel, as they can be rather large, while floating
+ *	point and LogLuv images are kept as floats, and 16-bit integer samples at
+ *	16 bits, rather than losing range.
+ */
+
+#define TIFF_MAX_THREADS        16
+#define TIFF_THREAD_THRESHOLD   (256 * 1024)    // decoded size of the image before it's worth spreading out
+
+enum {
+    TIFF_TAG_IMAGEWIDTH         = 256,
+    TIFF_TAG_IMAGELENGTH        = 257,
+    TIFF_TAG_BITSPERSAMPLE      = 258,
+    TIFF_TAG_COMPRESSION        = 259,
+    TIFF_TAG_PHOTOMETRIC        = 262,
+    TIFF_TAG_FILLORDER          = 266,
+    TIFF_TAG_STRIPOFFSETS       = 273,
+    TIFF_TAG_SAMPLESPERPIXEL    = 277,
+    TIFF_TAG_ROWSPERSTRIP       = 278,
+    TIFF_TAG_STRIPBYTECOUNTS    = 279,
+    TIFF_TAG_PLANARCONFIG       = 284,
+    TIFF_TAG_T4OPTIONS          = 292,
+    TIFF_TAG_PREDICTOR          = 317,
+    TIFF_TAG_COLORMAP           = 320,
+    TIFF_TAG_TILEWIDTH          = 322,
+    TIFF_TAG_TILELENGTH         = 323,
+    TIFF_TAG_TILEOFFSETS        = 324,
+    TIFF_TAG_TILEBYTECOUNTS     = 325,
+    TIFF_TAG_EXTRASAMPLES       = 338,
+    TIFF_TAG_SAMPLEFORMAT       = 339,
+    TIFF_TAG_JPEGTABLES         = 347,
+    TIFF_TAG_YCBCRCOEFFICIENTS  = 529,
+    TIFF_TAG_YCBCRSUBSAMPLING   = 530,
+    TIFF_TAG_REFERENCEBLACKWHITE= 532,
+};
+
+enum {
+    TIFF_TYPE_BYTE      = 1,
+    TIFF_TYPE_ASCII     = 2,
+    TIFF_TYPE_SHORT     = 3,
+    TIFF_TYPE_LONG      = 4,
+    TIFF_TYPE_RATIONAL  = 5,
+};
+
+enum {
+    TIFF_COMPRESSION_NONE           = 1,
+    TIFF_COMPRESSION_CCITT_RLE      = 2,
+    TIFF_COMPRESSION_CCITT_T4       = 3,
+    TIFF_COMPRESSION_CCITT_T6       = 4,
+    TIFF_COMPRESSION_LZW            = 5,
+    TIFF_COMPRESSION_JPEG           = 7,
+    TIFF_COMPRESSION_ADOBE_DEFLATE  = 8,
+    TIFF_COMPRESSION_PACKBITS       = 32773,
+    TIFF_COMPRESSION_DEFLATE        = 32946,
+    TIFF_COMPRESSION_SGILOG         = 34676,
+    TIFF_COMPRESSION_SGILOG24       = 34677,
+};
+
+enum {
+    TIFF_PHOTOMETRIC_WHITEISZERO    = 0,
+    TIFF_PHOTOMETRIC_BLACKISZERO    = 1,
+    TIFF_PHOTOMETRIC_RGB            = 2,
+    TIFF_PHOTOMETRIC_PALETTE        = 3,
+    TIFF_PHOTOMETRIC_YCBCR          = 6,
+    TIFF_PHOTOMETRIC_LOGL           = 32844,
+    TIFF_PHOTOMETRIC_LOGLUV         = 32845,
+};
+
+#define TIFF_PLANARCONFIG_SEPARATE      2
+#define TIFF_PREDICTOR_HORIZONTAL       2
+#define TIFF_FILLORDER_LSB2MSB          2
+#define TIFF_SAMPLEFORMAT_UINT          1
+#define TIFF_SAMPLEFORMAT_IEEEFP        3
+#define TIFF_T4OPTION_2D                1
+
+#define TIFF_EXTRASAMPLE_ASSOCALPHA     1
+#define TIFF_EXTRASAMPLE_UNASSALPHA     2
+
+typedef struct TIFFChunk {
+    size_t offset, length;      // Compressed data within the file
+    const uint8_t *data;
+
+    unsigned int x, y;          // Position within the image
+    unsigned int width, height; // Area covered within the image, which for tiles may be less than a whole tile
+    unsigned int plane;         // Sample held, if each is stored separately
+} TIFFChunk;
+
+typedef struct TIFFImage {
+    bool big_endian;
+
+    unsigned int width, height;
+    unsigned int bits_per_sample;
+    unsigned int samples_per_pixel;
+    unsigned int compression;
+    unsigned int photometric;
+    unsigned int fill_order;
+    unsigned int planar_config;
+    unsigned int predictor;
+    unsigned int sample_format;
+    unsigned int t4_options;
+    bool alpha;                 // first extra sample is alpha
+    bool premultiplied;         // colour has been multiplied by alpha
+
+    uint16_t *colour_map;       // red, then green, then blue, each 1 << bits_per_sample long
+
+    unsigned int subsampling[2];    // YCbCr chroma is only held for every so many pixels across and down
+    float luma[3];                  // share of luma from each of red, green and blue
+    float reference[6];             // black and white points for each of Y, Cb and Cr
+    YCbCrCoefficients ycbcr;
+    uint8_t *ycbcr_ranges;          // maps Y, Cb and Cr onto their full range, when they don't already cover it
+
+    uint8_t *jpeg_tables;       // shared by the JPEG data for every chunk
+    size_t jpeg_tables_length;
+
+    bool tiled;
+    unsigned int chunk_width, chunk_height; // of a tile, or a strip
+
+    TIFFChunk *chunks;
+    unsigned int num_chunks;
+    uint8_t *chunk_data;        // compressed data for every chunk, when it had to be read in
+
+    size_t row_length;          // Decoded length of each row within a chunk, in bytes
+    unsigned int row_height;    // Rows of pixels covered by each of those, more than one for subsampled YCbCr
+    size_t chunk_length;        // Decoded length of a whole chunk
+
+    uint8_t *pixels;
+    unsigned int channels;
+    bool bilevel;               // a bit per pixel, as it's stored, rather than channels
+    bool hdr;                   // RGBA floats, rather than channels of a byte each
+    bool wide;                  // RGBA of 16 bits each, rather than channels of a byte each
+    size_t pitch;               // length of each row of pixels
+
+    unsigned int next;          // next chunk up for grabs
+    unsigned int failed;        // first chunk to fail, +1, 0 for none
+} TIFFImage;
+
+/////////////////////////////////////////////////////////////////
+// Tags
+
+static uint16_t ReadTIFFShort(const TIFFImage *tiff, PLBinaryReader *reader) {
+    return tiff->big_endian ? plReadBinaryBigUInt16(reader) : plReadBinaryLittleUInt16(reader);
+}
+
+static uint32_t ReadTIFFLong(const TIFFImage *tiff, PLBinaryReader *reader) {
+    return tiff->big_endian ? plReadBinaryBigUInt32(reader) : plReadBinaryLittleUInt32(reader);
+}
+
+typedef struct TIFFTag {
+    uint16_t tag, type;
+    uint32_t count;
+    size_t value;       // Offset of the values within the file
+} TIFFTag;
+
+/* Reads in the values for the given tag, which can be stored as either
+ * bytes, shorts or longs, handing back the first if there's only one. */
+static bool ReadTIFFTagValues(const TIFFImage *tiff, PLBinaryReader *reader, const TIFFTag *tag,
+                              uint32_t *values, uint32_t count) {
+    if(!plSeekBinaryReader(reader, tag->value)) {
+        return false;
+    }
+
+    for(uint32_t i = 0; i < count; ++i) {
+        switch(tag->type) {
+            case TIFF_TYPE_BYTE:    values[i] = plReadBinaryUInt8(reader); break;
+            case TIFF_TYPE_SHORT:   values[i] = ReadTIFFShort(tiff, reader); break;
+            case TIFF_TYPE_LONG:    values[i] = ReadTIFFLong(tiff, reader); break;
+            default:
+                ReportError(PL_RESULT_FILETYPE, "unexpected type (%u) for TIFF tag %u", tag->type, tag->tag);
+                return false;
+        }
+    }
+
+    return !reader->error;
+}
+
+/* As above, for fractions, though some have been known to store whole numbers. */
+static bool ReadTIFFTagRationals(const TIFFImage *tiff, PLBinaryReader *reader, const TIFFTag *tag,
+                                 float *values, uint32_t count) {
+    if(tag->count < count) {
+        ReportError(PL_RESULT_FILETYPE, "too few values (%u) for TIFF tag %u", tag->count, tag->tag);
+        return false;
+    }
+
+    if(tag->type != TIFF_TYPE_RATIONAL) {
+        uint32_t whole[8];
+        plAssert(count <= plArrayElements(whole));
+        if(!ReadTIFFTagValues(tiff, reader, tag, whole, count)) {
+            return false;
+        }
+
+        for(uint32_t i = 0; i < count; ++i) {
+            values[i] = (float)whole[i];
+        }
+        return true;
+    }
+
+    if(!plSeekBinaryReader(reader, tag->value)) {
+        return false;
+    }
+
+    for(uint32_t i = 0; i < count; ++i) {
+        uint32_t numerator = ReadTIFFLong(tiff, reader);
+        uint32_t denominator = ReadTIFFLong(tiff, reader);
+        values[i] = (denominator != 0) ? (float)numerator / (float)denominator : 0;
+    }
+
+    return !reader->error;
+}
+
+static uint32_t ReadTIFFTagValue(const TIFFImage *tiff, PLBinaryReader *reader, const TIFFTag *tag) {
+    uint32_t value = 0;
+    ReadTIFFTagValues(tiff, reader, tag, &value, 1);
+    return value;
+}
+
+/* Reads in an array of offsets or byte counts, one for each chunk. */
+static size_t *ReadTIFFTagArray(const TIFFImage *tiff, PLBinaryReader *reader, const TIFFTag *tag, unsigned int count) {
+    if(tag == NULL || tag->count != count) {
+        ReportError(PL_RESULT_FILETYPE, "expected %u strips or tiles within TIFF", count);
+        return NULL;
+    }
+
+    uint32_t *values = malloc(sizeof(uint32_t) * count);
+    size_t *array = malloc(sizeof(size_t) * count);
+    if(values == NULL || array == NULL) {
+        ReportError(PL_RESULT_MEMORYALLOC, "failed to allocate TIFF strips");
+        free(values);
+        free(array);
+        return NULL;
+    }
+
+    if(!ReadTIFFTagValues(tiff, reader, tag, values, count)) {
+        free(values);
+        free(array);
+        return NULL;
+    }
+
+    for(unsigned int i = 0; i < count; ++i) {
+        array[i] = values[i];
+    }
+    free(values);
+
+    return array;
+}
+
+/////////////////////////////////////////////////////////////////
+// Decompression
+
+/* Each decoder fills dest with up to length bytes of decoded data for the
+ * given chunk, returning false if the data is broken. Data that runs out
+ * early just leaves the rest of the chunk as it is. */
+typedef bool (*TIFFDecodeFunction)(const TIFFImage *tiff, const TIFFChunk *chunk, const uint8_t *src, uint8_t *dest, size_t length);
+
+static bool DecodeTIFFNone(const TIFFImage *tiff, const TIFFChunk *chunk, const uint8_t *src, uint8_t *dest, size_t length) {
+    memcpy(dest, src, (chunk->length < length) ? chunk->length : length);
+    return true;
+}
+
+static bool DecodeTIFFPackBits(const TIFFImage *tiff, const TIFFChunk *chunk, const uint8_t *src, uint8_t *dest, size_t length) {
+    const uint8_t *end = src + chunk->length;
+    size_t out = 0;
+    while(src < end && out < length) {
+        int n = (int8_t)*src++;
+        if(n >= 0) {
+            size_t run = (size_t)n + 1;
+            if(run > (size_t)(end - src)) {
+                run = (size_t)(end - src);
+            }
+            if(run > length - out) {
+                run = length - out;
+            }
+
+            memcpy(dest + out, src, run);
+            src += n + 1;
+            out += run;
+        } else if(n != -128) {
+            if(src >= end) {
+                break;
+            }
+
+            size_t run = (size_t)(1 - n);
+            if(run > length - out) {
+                run = length - out;
+            }
+
+            memset(dest + out, *src++, run);
+            out += run;
+        }
+    }
+
+    return true;
+}
+
+#define TIFF_LZW_CLEAR      256
+#define TIFF_LZW_EOI        257
+#define TIFF_LZW_FIRST      258
+#define TIFF_LZW_MAX_BITS   12
+
+static bool DecodeTIFFLZW(const TIFFImage *tiff, const TIFFChunk *chunk, const uint8_t *src, uint8_t *dest, size_t length) {
+    /* each string is the one before it plus a byte, so only that
+     * much needs keeping, along with where it begins and its length */
+    uint16_t prefix[1 << TIFF_LZW_MAX_BITS];
+    uint8_t suffix[1 << TIFF_LZW_MAX_BITS];
+    uint8_t first[1 << TIFF_LZW_MAX_BITS];
+    uint16_t lengths[1 << TIFF_LZW_MAX_BITS];
+    for(unsigned int i = 0; i < 256; ++i) {
+        suffix[i] = first[i] = (uint8_t)i;
+        lengths[i] = 1;
+    }
+
+    const uint8_t *end = src + chunk->length;
+    uint32_t bits = 0;
+    unsigned int num_bits = 0;
+    unsigned int code_bits = 9;
+    unsigned int next = TIFF_LZW_FIRST;
+    int previous = -1;
+    size_t out = 0;
+
+    /* older encoders packed the codes from the least significant bit up,
+     * which always begins with a clear code, and widened them a code later */
+    bool old_style = (chunk->length >= 2 && src[0] == 0 && (src[1] & 1));
+    unsigned int early = old_style ? 0 : 1;
+
+    while(out < length) {
+        while(num_bits < code_bits) {
+            if(src >= end) {
+                return true;
+            }
+            if(old_style) {
+                bits |= (uint32_t)*src++ << num_bits;
+            } else {
+                bits = (bits << 8) | *src++;
+            }
+            num_bits += 8;
+        }
+
+        unsigned int code;
+        if(old_style) {
+            code = bits & ((1u << code_bits) - 1);
+            bits >>= code_bits;
+        } else {
+            code = (bits >> (num_bits - code_bits)) & ((1u << code_bits) - 1);
+        }
+        num_bits -= code_bits;
+
+        if(code == TIFF_LZW_CLEAR) {
+            code_bits = 9;
+            next = TIFF_LZW_FIRST;
+            previous = -1;
+            continue;
+        } else if(code == TIFF_LZW_EOI) {
+            break;
+        }
+
+        if(previous == -1) {
+            if(code > 255) {
+                return false;
+            }
+
+            dest[out++] = (uint8_t)code;
+            previous = (int)code;
+            continue;
+        }
+
+        if(code > next || (code == next && next >= (1u << TIFF_LZW_MAX_BITS))) {
+            return false;
+        }
+
+        if(next < (1u << TIFF_LZW_MAX_BITS)) {
+            prefix[next] = (uint16_t)previous;
+            first[next] = first[previous];
+            suffix[next] = (code == next) ? first[previous] : first[code];
+            lengths[next] = (uint16_t)(lengths[previous] + 1);
+            next++;
+
+            /* the width usually goes up a code early */
+            if(next >= (1u << code_bits) - early && code_bits < TIFF_LZW_MAX_BITS) {
+                code_bits++;
+            }
+        }
+
+        /* written out backwards, from the end of the string */
+        unsigned int string_length = lengths[code];
+        unsigned int c = code;
+        if(out + string_length <= length) {
+            uint8_t *p = dest + out + string_length;
+            while(c > 255) {
+                *--p = suffix[c];
+                c = prefix[c];
+            }
+            *--p = (uint8_t)c;
+        } else {
+            for(size_t i = string_length; i-- > 0; c = prefix[c]) {
+                if(out + i < length) {
+                    dest[out + i] = suffix[c];
+                }
+                if(c <= 255) {
+                    break;
+                }
+            }
+            string_length = (unsigned int)(length - out);
+        }
+
+        out += string_length;
+        previous = (int)code;
+    }
+
+    return true;
+}
+
+#if defined(PL_USE_ZLIB)
+static bool DecodeTIFFDeflate(const TIFFImage *tiff, const TIFFChunk *chunk, const uint8_t *src, uint8_t *dest, size_t length) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(z_stream));
+    if(inflateInit(&stream) != Z_OK) {
+        return false;
+    }
+
+    stream.next_in = (Bytef*)src;
+    stream.avail_in = (uInt)chunk->length;
+    stream.next_out = dest;
+    stream.avail_out = (uInt)length;
+
+    int status = inflate(&stream, Z_FINISH);
+    inflateEnd(&stream);
+
+    /* running out of room is fine, there may be padding beyond what we're after */
+    return (status == Z_STREAM_END || status == Z_BUF_ERROR || (status == Z_OK && stream.avail_out == 0));
+}
+#endif
+
+/* Each chunk is a JPEG of its own, bar the tables they all share, which are
+ * stored separately as a JPEG without any image. stb_image keeps the reason
+ * for any failure in a static, but that's all chunks on other threads share. */
+static bool DecodeTIFFJPEG(const TIFFImage *tiff, const TIFFChunk *chunk, const uint8_t *src, uint8_t *dest, size_t length) {
+    const uint8_t *data = src;
+    size_t data_length = chunk->length;
+
+    /* the tables end where the chunk begins, so both are dropped */
+    uint8_t *joined = NULL;
+    if(tiff->jpeg_tables != NULL && chunk->length > 2) {
+        size_t tables_length = tiff->jpeg_tables_length - 2;
+        data_length = tables_length + chunk->length - 2;
+        if((joined = malloc(data_length)) == NULL) {
+            return false;
+        }
+
+        memcpy(joined, tiff->jpeg_tables, tables_length);
+        memcpy(joined + tables_length, src + 2, chunk->length - 2);
+        data = joined;
+    }
+
+    unsigned int width, height;
+    uint8_t *pixels = DecodeSTBImage(data, data_length, tiff->samples_per_pixel, &width, &height);
+    free(joined);
+    if(pixels == NULL) {
+        return false;
+    }
+
+    /* the image may not cover quite the same area as the chunk */
+    size_t pitch = (size_t)width * tiff->samples_per_pixel;
+    size_t copy = (pitch < tiff->row_length) ? pitch : tiff->row_length;
+    for(unsigned int y = 0; y < height && tiff->row_length * (y + 1) <= length; ++y) {
+        memcpy(dest + tiff->row_length * y, pixels + pitch * y, copy);
+    }
+    free(pixels);
+
+    return true;
+}
+
+static bool DecodeTIFFCCITT(const TIFFImage *tiff, const TIFFChunk *chunk, const uint8_t *src, uint8_t *dest, size_t length) {
+    CCITTCoding coding = CCITT_CODING_RLE;
+    unsigned int options = 0;
+    if(tiff->compression == TIFF_COMPRESSION_CCITT_T4) {
+        coding = CCITT_CODING_G3;
+        if(tiff->t4_options & TIFF_T4OPTION_2D) {
+            options |= CCITT_OPTION_2D;
+        }
+    } else if(tiff->compression == TIFF_COMPRESSION_CCITT_T6) {
+        coding = CCITT_CODING_G4;
+    }
+
+    unsigned int rows = (unsigned int)(length / tiff->row_length);
+    return DecodeCCITTImage(src, chunk->length, coding, options, tiff->chunk_width, rows, dest, tiff->row_length);
+}
+
+/* SGI's run length coding for LogL and LogLuv, where each row is split up into
+ * its bytes, from the most significant down, each of which is coded on its own.
+ * Every pixel is decoded to a 16 or 32-bit value, which is left native. */
+static bool DecodeTIFFSGILog(const TIFFImage *tiff, const TIFFChunk *chunk, const uint8_t *src, uint8_t *dest, size_t length) {
+    const uint8_t *end = src + chunk->length;
+    unsigned int bytes = (tiff->photometric == TIFF_PHOTOMETRIC_LOGL) ? 2 : 4;
+    unsigned int width = tiff->chunk_width;
+
+    for(size_t row = 0; row + tiff->row_length <= length; row += tiff->row_length) {
+        uint16_t *short_values = (uint16_t*)(dest + row);
+        uint32_t *long_values = (uint32_t*)(dest + row);
+        for(unsigned int shift = bytes * 8; shift > 0;) {
+            shift -= 8;
+            for(unsigned int x = 0; x < width;) {
+                if(src >= end) {
+                    return true;
+                }
+
+                /* either a run of one byte, or a number of bytes as they are */
+                unsigned int n = *src++;
+                bool run = (n >= 128);
+                if(run) {
+                    n -= 126;
+                    if(src >= end) {
+                        return true;
+                    }
+                }
+
+                for(; n > 0 && x < width && src < end; --n, ++x) {
+                    uint32_t value = (uint32_t)*src << shift;
+                    if(!run) {
+                        ++src;
+                    }
+
+                    if(bytes == 2) {
+                        short_values[x] |= (uint16_t)value;
+                    } else {
+                        long_values[x] |= value;
+                    }
+                }
+
+                if(run) {
+                    ++src;
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+static const struct {
+    unsigned int compression;
+    TIFFDecodeFunction Decode;
+} tiff_decoders[] = {
+        { TIFF_COMPRESSION_NONE, DecodeTIFFNone },
+        { TIFF_COMPRESSION_CCITT_RLE, DecodeTIFFCCITT },
+        { TIFF_COMPRESSION_CCITT_T4, DecodeTIFFCCITT },
+        { TIFF_COMPRESSION_CCITT_T6, DecodeTIFFCCITT },
+        { TIFF_COMPRESSION_LZW, DecodeTIFFLZW },
+        { TIFF_COMPRESSION_JPEG, DecodeTIFFJPEG },
+        { TIFF_COMPRESSION_PACKBITS, DecodeTIFFPackBits },
+        { TIFF_COMPRESSION_SGILOG, DecodeTIFFSGILog },
+        { TIFF_COMPRESSION_SGILOG24, DecodeTIFFNone },    // just packed down to three bytes
+#if defined(PL_USE_ZLIB)
+        { TIFF_COMPRESSION_ADOBE_DEFLATE, DecodeTIFFDeflate },
+        { TIFF_COMPRESSION_DEFLATE, DecodeTIFFDeflate },
+#endif
+};
+
+static TIFFDecodeFunction GetTIFFDecoder(unsigned int compression) {
+    for(unsigned int i = 0; i < plArrayElements(tiff_decoders); ++i) {
+        if(tiff_decoders[i].compression == compression) {
+            return tiff_decoders[i].Decode;
+        }
+    }
+
+    return NULL;
+}
+
+/////////////////////////////////////////////////////////////////
+// Conversion
+
+static uint8_t tiff_reversed_bits[256];
+
+static void SetupTIFFReversedBits(void) {
+    for(unsigned int i = 0; i < 256; ++i) {
+        uint8_t b = 0;
+        for(unsigned int j = 0; j < 8; ++j) {
+            b |= ((i >> j) & 1) << (7 - j);
+        }
+        tiff_reversed_bits[i] = b;
+    }
+}
+
+/* Undoes horizontal differencing, where each sample is stored
+ * relative to the same sample of the pixel before it. */
+static void UndoTIFFPredictor(const TIFFImage *tiff, uint8_t *row, unsigned int width) {
+    unsigned int stride = (tiff->planar_config == TIFF_PLANARCONFIG_SEPARATE) ? 1 : tiff->samples_per_pixel;
+    size_t count = (size_t)width * stride;
+
+    if(tiff->bits_per_sample == 8) {
+        for(size_t i = stride; i < count; ++i) {
+            row[i] = (uint8_t)(row[i] + row[i - stride]);
+        }
+    } else if(tiff->bits_per_sample == 16) {
+        for(size_t i = stride; i < count; ++i) {
+            uint8_t *a = row + i * 2, *b = row + (i - stride) * 2;
+            uint16_t value = tiff->big_endian ?
+                    (uint16_t)(((a[0] << 8) | a[1]) + ((b[0] << 8) | b[1])) :
+                    (uint16_t)((a[0] | (a[1] << 8)) + (b[0] | (b[1] << 8)));
+            a[tiff->big_endian ? 0 : 1] = (uint8_t)(value >> 8);
+            a[tiff->big_endian ? 1 : 0] = (uint8_t)value;
+        }
+    }
+}
+
+/* Unpacks count samples from the given row into a byte each,
+ * scaling them up to fill the whole range. */
+static void UnpackTIFFSamples(const TIFFImage *tiff, const uint8_t *row, uint8_t *dest, size_t count) {
+    switch(tiff->bits_per_sample) {
+        case 1:
+        case 2:
+        case 4: {
+            unsigned int bits = tiff->bits_per_sample;
+            unsigned int mask = (1u << bits) - 1;
+            unsigned int scale = 255 / mask;
+            for(size_t i = 0; i < count; ++i) {
+                size_t bit = i * bits;
+                unsigned int value = (row[bit >> 3] >> (8 - bits - (bit & 7))) & mask;
+                dest[i] = (uint8_t)(value * scale);
+            }
+            break;
+        }
+
+        case 8:
+            memcpy(dest, row, count);
+            break;
+
+        default:
+            break;
+    }
+}
+
+/* Writes out one row of the chunk, already unpacked to a byte per sample. */
+static void ConvertTIFFRow(const TIFFImage *tiff, const TIFFChunk *chunk, const uint8_t *samples, uint8_t *dest) {
+    unsigned int channels = tiff->channels;
+    unsigned int width = chunk->width;
+
+    if(tiff->planar_config == TIFF_PLANARCONFIG_SEPARATE) {
+        bool grey = (tiff->photometric != TIFF_PHOTOMETRIC_RGB);
+        unsigned int colour_samples = grey ? 1 : 3;
+        if(chunk->plane < colour_samples) {
+            for(unsigned int x = 0; x < width; ++x) {
+                uint8_t value = samples[x];
+                if(tiff->photometric == TIFF_PHOTOMETRIC_WHITEISZERO) {
+                    value = (uint8_t)~value;
+                }
+
+                if(grey) {
+                    dest[x * channels] = dest[x * channels + 1] = dest[x * channels + 2] = value;
+                } else {
+                    dest[x * channels + chunk->plane] = value;
+                }
+            }
+        } else if(chunk->plane == colour_samples && tiff->alpha) {
+            for(unsigned int x = 0; x < width; ++x) {
+                dest[x * channels + 3] = samples[x];
+            }
+        }
+        return;
+    }
+
+    unsigned int spp = tiff->samples_per_pixel;
+    switch(tiff->photometric) {
+        case TIFF_PHOTOMETRIC_WHITEISZERO:
+        case TIFF_PHOTOMETRIC_BLACKISZERO: {
+            uint8_t invert = (tiff->photometric == TIFF_PHOTOMETRIC_WHITEISZERO) ? 0xFF : 0;
+            for(unsigned int x = 0; x < width; ++x, samples += spp, dest += channels) {
+                dest[0] = dest[1] = dest[2] = samples[0] ^ invert;
+                if(tiff->alpha) {
+                    dest[3] = samples[1];
+                }
+            }
+            break;
+        }
+
+        case TIFF_PHOTOMETRIC_RGB:
+            if(spp == channels) {
+                memcpy(dest, samples, (size_t)width * channels);
+                break;
+            }
+
+            for(unsigned int x = 0; x < width; ++x, samples += spp, dest += channels) {
+                dest[0] = samples[0];
+                dest[1] = samples[1];
+                dest[2] = samples[2];
+                if(tiff->alpha) {
+                    dest[3] = samples[3];
+                }
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+/* As UnpackTIFFSamples, for 16-bit samples, which are only put into native order. */
+static void UnpackTIFFWideSamples(const TIFFImage *tiff, const uint8_t *row, uint16_t *dest, size_t count) {
+    for(size_t i = 0; i < count; ++i, row += 2) {
+        dest[i] = tiff->big_endian ? (uint16_t)((row[0] << 8) | row[1]) : (uint16_t)(row[0] | (row[1] << 8));
+    }
+}
+
+/* As ConvertTIFFRow, for 16-bit samples, always out to RGBA. */
+static void ConvertTIFFWideRow(const TIFFImage *tiff, const TIFFChunk *chunk, const uint16_t *samples, uint16_t *dest) {
+    unsigned int width = chunk->width;
+    unsigned int colour_samples = (tiff->photometric == TIFF_PHOTOMETRIC_RGB) ? 3 : 1;
+    uint16_t invert = (tiff->photometric == TIFF_PHOTOMETRIC_WHITEISZERO) ? 0xFFFF : 0;
+
+    if(tiff->planar_config == TIFF_PLANARCONFIG_SEPARATE) {
+        for(unsigned int x = 0; x < width; ++x, dest += 4) {
+            if(chunk->plane == 0 && !tiff->alpha) {
+                dest[3] = 0xFFFF;
+            }
+
+            if(chunk->plane >= colour_samples) {
+                if(chunk->plane == colour_samples && tiff->alpha) {
+                    dest[3] = samples[x];
+                }
+            } else if(colour_samples == 1) {
+                dest[0] = dest[1] = dest[2] = samples[x] ^ invert;
+            } else {
+                dest[chunk->plane] = samples[x];
+            }
+        }
+        return;
+    }
+
+    unsigned int spp = tiff->samples_per_pixel;
+    for(unsigned int x = 0; x < width; ++x, samples += spp, dest += 4) {
+        if(colour_samples == 1) {
+            dest[0] = dest[1] = dest[2] = samples[0] ^ invert;
+        } else {
+            dest[0] = samples[0];
+            dest[1] = samples[1];
+            dest[2] = samples[2];
+        }
+        dest[3] = tiff->alpha ? samples[colour_samples] : 0xFFFF;
+    }
+}
+
+/* As UnpackTIFFSamples, for floating point samples, which are converted in place
+ * to native order before being widened out to single precision. */
+static void UnpackTIFFFloatSamples(const TIFFImage *tiff, uint8_t *row, float *dest, size_t count) {
+    switch(tiff->bits_per_sample) {
+        case 16: {
+            uint16_t *values = (uint16_t*)row;
+            for(size_t i = 0; i < count; ++i, row += 2) {
+                values[i] = tiff->big_endian ? (uint16_t)((row[0] << 8) | row[1]) : (uint16_t)(row[0] | (row[1] << 8));
+            }
+            ConvertHalfToFloat(values, dest, count);
+            break;
+        }
+
+        case 32:
+            for(size_t i = 0; i < count; ++i, row += 4) {
+                uint32_t value = tiff->big_endian ?
+                        ((uint32_t)row[0] << 24) | ((uint32_t)row[1] << 16) | ((uint32_t)row[2] << 8) | row[3] :
+                        ((uint32_t)row[3] << 24) | ((uint32_t)row[2] << 16) | ((uint32_t)row[1] << 8) | row[0];
+                memcpy(&dest[i], &value, sizeof(float));
+            }
+            break;
+
+        case 64:
+            for(size_t i = 0; i < count; ++i, row += 8) {
+                uint64_t value = 0;
+                for(unsigned int j = 0; j < 8; ++j) {
+                    value = (value << 8) | row[tiff->big_endian ? j : 7 - j];
+                }
+
+                double d;
+                memcpy(&d, &value, sizeof(double));
+                dest[i] = (float)d;
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+/* As ConvertTIFFRow, for floating point samples, always out to RGBA. */
+static void ConvertTIFFFloatRow(const TIFFImage *tiff, const TIFFChunk *chunk, const float *samples, float *dest) {
+    unsigned int width = chunk->width;
+    unsigned int colour_samples = (tiff->photometric == TIFF_PHOTOMETRIC_RGB) ? 3 : 1;
+
+    if(tiff->planar_config == TIFF_PLANARCONFIG_SEPARATE) {
+        for(unsigned int x = 0; x < width; ++x, dest += 4) {
+            if(chunk->plane == 0 && !tiff->alpha) {
+                dest[3] = 1.0f;
+            }
+
+            if(chunk->plane >= colour_samples) {
+                if(chunk->plane == colour_samples && tiff->alpha) {
+                    dest[3] = samples[x];
+                }
+            } else if(colour_samples == 1) {
+                dest[0] = dest[1] = dest[2] = samples[x];
+            } else {
+                dest[chunk->plane] = samples[x];
+            }
+        }
+        return;
+    }
+
+    unsigned int spp = tiff->samples_per_pixel;
+    for(unsigned int x = 0; x < width; ++x, samples += spp, dest += 4) {
+        if(colour_samples == 1) {
+            dest[0] = dest[1] = dest[2] = samples[0];
+        } else {
+            dest[0] = samples[0];
+            dest[1] = samples[1];
+            dest[2] = samples[2];
+        }
+        dest[3] = tiff->alpha ? samples[colour_samples] : 1.0f;
+    }
+}
+
+/* Palette indices are read straight from the row, rather than unpacked
+ * and scaled, as they may have more than a byte's worth of range. */
+static void ConvertTIFFPaletteRow(const TIFFImage *tiff, const TIFFChunk *chunk, const uint8_t *row, uint8_t *dest) {
+    unsigned int bits = tiff->bits_per_sample;
+    unsigned int entries = 1u << bits;
+    const uint16_t *red = tiff->colour_map;
+    const uint16_t *green = red + entries;
+    const uint16_t *blue = green + entries;
+
+    for(unsigned int x = 0; x < chunk->width; ++x, dest += tiff->channels) {
+        unsigned int index;
+        if(bits == 16) {
+            index = tiff->big_endian ? ((row[x * 2] << 8) | row[x * 2 + 1]) : (row[x * 2] | (row[x * 2 + 1] << 8));
+        } else {
+            size_t bit = (size_t)x * bits;
+            index = (row[bit >> 3] >> (8 - bits - (bit & 7))) & (entries - 1);
+        }
+
+        dest[0] = (uint8_t)(red[index] >> 8);
+        dest[1] = (uint8_t)(green[index] >> 8);
+        dest[2] = (uint8_t)(blue[index] >> 8);
+    }
+}
+
+/* Subsampled YCbCr is stored in blocks, each holding the luma for every pixel
+ * it covers, row by row, followed by just the one Cb and Cr, so each decoded
+ * row holds a whole row of blocks, which are split back out again here. */
+static void ConvertTIFFYCbCrRows(const TIFFImage *tiff, const TIFFChunk *chunk, const uint8_t *row,
+                                 uint8_t *samples, unsigned int y) {
+    unsigned int across = tiff->subsampling[0], down = tiff->subsampling[1];
+    unsigned int block_length = across * down + 2;
+    unsigned int blocks = (chunk->width + across - 1) / across;
+
+    uint8_t *luma = samples;
+    uint8_t *cb = luma + (size_t)blocks * across;
+    uint8_t *cr = cb + blocks;
+    for(unsigned int i = 0; i < blocks; ++i) {
+        cb[i] = row[i * block_length + across * down];
+        cr[i] = row[i * block_length + across * down + 1];
+    }
+
+    const uint8_t *ranges = tiff->ycbcr_ranges;
+    if(ranges != NULL) {
+        for(unsigned int i = 0; i < blocks; ++i) {
+            cb[i] = ranges[256 + cb[i]];
+            cr[i] = ranges[512 + cr[i]];
+        }
+    }
+
+    for(unsigned int j = 0; j < down && y + j < chunk->height; ++j) {
+        for(unsigned int i = 0; i < blocks; ++i) {
+            memcpy(luma + i * across, row + i * block_length + j * across, across);
+        }
+
+        if(ranges != NULL) {
+            for(unsigned int i = 0; i < chunk->width; ++i) {
+                luma[i] = ranges[luma[i]];
+            }
+        }
+
+        uint8_t *dest = tiff->pixels + tiff->pitch * (chunk->y + y + j) + (size_t)chunk->x * tiff->channels;
+        ConvertYCbCrRow(&tiff->ycbcr, luma, cb, cr, dest, chunk->width, across, tiff->channels);
+    }
+}
+
+typedef struct TIFFScratch {
+    uint8_t *compressed;    // used to flip the bits around, for those stored backwards
+    size_t compressed_size;
+    uint8_t *decoded;       // a whole chunk
+    uint8_t *samples;       // a row of unpacked samples
+} TIFFScratch;
+
+static bool DecodeTIFFChunk(TIFFImage *tiff, TIFFScratch *scratch, const TIFFChunk *chunk) {
+    const uint8_t *src = chunk->data;
+    if(tiff->fill_order == TIFF_FILLORDER_LSB2MSB) {
+        if(chunk->length > scratch->compressed_size) {
+            uint8_t *compressed = realloc(scratch->compressed, chunk->length);
+            if(compressed == NULL) {
+                return false;
+            }
+            scratch->compressed = compressed;
+            scratch->compressed_size = chunk->length;
+        }
+
+        for(size_t i = 0; i < chunk->length; ++i) {
+            scratch->compressed[i] = tiff_reversed_bits[chunk->data[i]];
+        }
+        src = scratch->compressed;
+    }
+
+    /* strips at the bottom only hold what's left of the image */
+    unsigned int rows = tiff->tiled ? tiff->chunk_height : chunk->height;
+    size_t length = tiff->row_length * ((rows + tiff->row_height - 1) / tiff->row_height);
+
+    memset(scratch->decoded, 0, length);
+    if(!GetTIFFDecoder(tiff->compression)(tiff, chunk, src, scratch->decoded, length)) {
+        return false;
+    }
+
+    if(tiff->photometric == TIFF_PHOTOMETRIC_YCBCR) {
+        for(unsigned int y = 0; y < chunk->height; y += tiff->row_height) {
+            ConvertTIFFYCbCrRows(tiff, chunk, scratch->decoded + tiff->row_length * (y / tiff->row_height),
+                                 scratch->samples, y);
+        }
+        return true;
+    }
+
+    unsigned int row_samples = chunk->width;
+    if(tiff->planar_config != TIFF_PLANARCONFIG_SEPARATE) {
+        row_samples *= tiff->samples_per_pixel;
+    }
+
+    /* a set bit is white, whichever way around it was stored */
+    if(tiff->bilevel) {
+        uint8_t invert = (tiff->photometric == TIFF_PHOTOMETRIC_WHITEISZERO) ? 0xFF : 0;
+        size_t row_length = (chunk->width + 7) / 8;
+        for(unsigned int y = 0; y < chunk->height; ++y) {
+            const uint8_t *row = scratch->decoded + tiff->row_length * y;
+            uint8_t *dest = tiff->pixels + tiff->pitch * (chunk->y + y) + chunk->x / 8;
+            for(size_t i = 0; i < row_length; ++i) {
+                dest[i] = row[i] ^ invert;
+            }
+        }
+        return true;
+    }
+
+    if(tiff->hdr) {
+        for(unsigned int y = 0; y < chunk->height; ++y) {
+            uint8_t *row = scratch->decoded + tiff->row_length * y;
+            float *dest = (float*)(tiff->pixels + tiff->pitch * (chunk->y + y)) + (size_t)chunk->x * 4;
+            switch(tiff->photometric) {
+                case TIFF_PHOTOMETRIC_LOGL:
+                    ConvertLogLRow((const uint16_t*)row, dest, chunk->width);
+                    break;
+                case TIFF_PHOTOMETRIC_LOGLUV:
+                    if(tiff->compression == TIFF_COMPRESSION_SGILOG24) {
+                        ConvertLogLuv24Row(row, dest, chunk->width);
+                    } else {
+                        ConvertLogLuv32Row((const uint32_t*)row, dest, chunk->width);
+                    }
+                    break;
+                default:
+                    UnpackTIFFFloatSamples(tiff, row, (float*)scratch->samples, row_samples);
+                    ConvertTIFFFloatRow(tiff, chunk, (const float*)scratch->samples, dest);
+                    break;
+            }
+        }
+        return true;
+    }
+
+    for(unsigned int y = 0; y < chunk->height; ++y) {
+        uint8_t *row = scratch->decoded + tiff->row_length * y;
+
+        if(tiff->predictor == TIFF_PREDICTOR_HORIZONTAL) {
+            UndoTIFFPredictor(tiff, row, tiff->tiled ? tiff->chunk_width : chunk->width);
+        }
+
+        if(tiff->wide) {
+            uint16_t *dest = (uint16_t*)(tiff->pixels + tiff->pitch * (chunk->y + y)) + (size_t)chunk->x * 4;
+            UnpackTIFFWideSamples(tiff, row, (uint16_t*)scratch->samples, row_samples);
+            ConvertTIFFWideRow(tiff, chunk, (const uint16_t*)scratch->samples, dest);
+            continue;
+        }
+
+        uint8_t *dest = tiff->pixels + tiff->pitch * (chunk->y + y) + (size_t)chunk->x * tiff->channels;
+
+        if(tiff->photometric == TIFF_PHOTOMETRIC_PALETTE) {
+            ConvertTIFFPaletteRow(tiff, chunk, row, dest);
+            continue;
+        }
+
+        UnpackTIFFSamples(tiff, row, scratch->samples, row_samples);
+        ConvertTIFFRow(tiff, chunk, scratch->samples, dest);
+    }
+
+    return true;
+}
+
+static void *DecodeTIFFChunks(void *data) {
+    TIFFImage *tiff = data;
+
+    TIFFScratch scratch;
+    memset(&scratch, 0, sizeof(TIFFScratch));
+    size_t samples_length = (size_t)(tiff->chunk_width + 4) * tiff->samples_per_pixel;    // room for YCbCr blocks to overhang
+    if(tiff->hdr) {
+        samples_length *= sizeof(float);
+    } else if(tiff->wide) {
+        samples_length *= sizeof(uint16_t);
+    }
+
+    scratch.decoded = malloc(tiff->chunk_length);
+    scratch.samples = malloc(samples_length);
+    if(scratch.decoded == NULL || scratch.samples == NULL) {
+        /* any other threads can pick up the slack */
+        free(scratch.decoded);
+        free(scratch.samples);
+        return NULL;
+    }
+
+    for(;;) {
+        unsigned int i = __atomic_fetch_add(&tiff->next, 1, __ATOMIC_RELAXED);
+        if(i >= tiff->num_chunks) {
+            break;
+        }
+
+        if(!DecodeTIFFChunk(tiff, &scratch, &tiff->chunks[i])) {
+            unsigned int expected = 0;
+            __atomic_compare_exchange_n(&tiff->failed, &expected, i + 1, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+        }
+    }
+
+    free(scratch.compressed);
+    free(scratch.decoded);
+    free(scratch.samples);
+
+    return NULL;
+}
+
+#if !defined(_WIN32)
+typedef pthread_t TIFFThread;
+#else
+typedef HANDLE TIFFThread;
+
+static DWORD WINAPI DecodeTIFFChunksThread(LPVOID data) {
+    DecodeTIFFChunks(data);
+    return 0;
+}
+#endif
+
+static unsigned int GetTIFFProcessorCount(void) {
+#if !defined(_WIN32)
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return (num_cpus > 0) ? (unsigned int)num_cpus : 1;
+#else
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (info.dwNumberOfProcessors > 0) ? (unsigned int)info.dwNumberOfProcessors : 1;
+#endif
+}
+
+static bool StartTIFFThread(TIFFThread *thread, TIFFImage *tiff) {
+#if !defined(_WIN32)
+    return (pthread_create(thread, NULL, DecodeTIFFChunks, tiff) == 0);
+#else
+    *thread = CreateThread(NULL, 0, DecodeTIFFChunksThread, tiff, 0, NULL);
+    return (*thread != NULL);
+#endif
+}
+
+static void JoinTIFFThread(TIFFThread thread) {
+#if !defined(_WIN32)
+    pthread_join(thread, NULL);
+#else
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+#endif
+}
+
+/* Decodes every chunk, spreading them across as many
+ * threads as is worthwhile for the size of the image. */
+static bool DecodeTIFFImage(TIFFImage *tiff) {
+    tiff->next = 0;
+    tiff->failed = 0;
+
+    TIFFThread threads[TIFF_MAX_THREADS - 1];
+    unsigned int num_threads = 0;
+
+    unsigned int max_threads = 1;
+    if(tiff->pitch * tiff->height >= TIFF_THREAD_THRESHOLD) {
+        max_threads = GetTIFFProcessorCount();
+        if(max_threads > TIFF_MAX_THREADS) {
+            max_threads = TIFF_MAX_THREADS;
+        }
+        if(max_threads > tiff->num_chunks) {
+            max_threads = tiff->num_chunks;
+        }
+    }
+
+    while(num_threads + 1 < max_threads && StartTIFFThread(&threads[num_threads], tiff)) {
+        ++num_threads;
+    }
+
+    DecodeTIFFChunks(tiff);
+
+    for(unsigned int i = 0; i < num_threads; ++i) {
+        JoinTIFFThread(threads[i]);
+    }
+
+    if(tiff->failed != 0) {
+        ReportError(PL_RESULT_FILEREAD, "failed to decode TIFF strip or tile %u", tiff->failed - 1);
+        return false;
+    }
+
+    /* every thread failed to get going */
+    if(tiff->next < tiff->num_chunks) {
+        ReportError(PL_RESULT_MEMORYALLOC, "failed to allocate TIFF decode buffers");
+        return false;
+    }
+
+    /* alpha may be stored separately, so this has to wait until everything's in */
+    if(tiff->alpha && tiff->premultiplied && tiff->hdr) {
+        float *pixel = (float*)tiff->pixels;
+        for(size_t i = 0, n = (size_t)tiff->width * tiff->height; i < n; ++i, pixel += 4) {
+            if(pixel[3] > 0) {
+                pixel[0] /= pixel[3];
+                pixel[1] /= pixel[3];
+                pixel[2] /= pixel[3];
+            }
+        }
+    } else if(tiff->alpha && tiff->premultiplied && tiff->wide) {
+        uint16_t *pixel = (uint16_t*)tiff->pixels;
+        for(size_t i = 0, n = (size_t)tiff->width * tiff->height; i < n; ++i, pixel += 4) {
+            uint32_t a = pixel[3];
+            if(a == 0 || a == 0xFFFF) {
+                continue;
+            }
+
+            for(unsigned int j = 0; j < 3; ++j) {
+                uint32_t c = (pixel[j] * 0xFFFFu + a / 2) / a;
+                pixel[j] = (uint16_t)((c > 0xFFFF) ? 0xFFFF : c);
+            }
+        }
+    } else if(tiff->alpha && tiff->premultiplied) {
+        uint8_t *pixel = tiff->pixels;
+        for(size_t i = 0, n = (size_t)tiff->width * tiff->height; i < n; ++i, pixel += 4) {
+            unsigned int a = pixel[3];
+            if(a == 0 || a == 255) {
+                continue;
+            }
+
+            for(unsigned int j = 0; j < 3; ++j) {
+                unsigned int c = (pixel[j] * 255 + a / 2) / a;
+                pixel[j] = (uint8_t)((c > 255) ? 255 : c);
+            }
+        }
+    }
+
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////
+
+static bool ReadTIFFDirectory(TIFFImage *tiff, PLBinaryReader *reader) {
+    uint32_t directory = ReadTIFFLong(tiff, reader);
+    if(!plSeekBinaryReader(reader, directory)) {
+        return false;
+    }
+
+    unsigned int num_tags = ReadTIFFShort(tiff, reader);
+    TIFFTag *tags = calloc(num_tags, sizeof(TIFFTag));
+    if(tags == NULL) {
+        ReportError(PL_RESULT_MEMORYALLOC, "failed to allocate TIFF tags");
+        return false;
+    }
+
+    for(unsigned int i = 0; i < num_tags; ++i) {
+        tags[i].tag = ReadTIFFShort(tiff, reader);
+        tags[i].type = ReadTIFFShort(tiff, reader);
+        tags[i].count = ReadTIFFLong(tiff, reader);
+
+        /* anything that fits is stored in place of the offset */
+        size_t size = (tags[i].type == TIFF_TYPE_SHORT) ? 2 : (tags[i].type == TIFF_TYPE_LONG) ? 4 :
+                      (tags[i].type == TIFF_TYPE_RATIONAL) ? 8 : 1;
+        if(size * tags[i].count <= 4) {
+            tags[i].value = plGetBinaryReaderOffset(reader);
+            plSkipBinaryReader(reader, 4);
+        } else {
+            tags[i].value = ReadTIFFLong(tiff, reader);
+        }
+    }
+
+    if(reader->error) {
+        free(tags);
+        return false;
+    }
+
+    tiff->compression = TIFF_COMPRESSION_NONE;
+    tiff->bits_per_sample = 1;
+    tiff->samples_per_pixel = 1;
+    tiff->fill_order = 1;
+    tiff->planar_config = 1;
+    tiff->sample_format = TIFF_SAMPLEFORMAT_UINT;
+    tiff->photometric = (unsigned int)-1;
+
+    tiff->subsampling[0] = tiff->subsampling[1] = 2;
+    tiff->luma[0] = 0.299f;
+    tiff->luma[1] = 0.587f;
+    tiff->luma[2] = 0.114f;
+    const float reference[6] = { 0, 255, 128, 255, 128, 255 };
+    memcpy(tiff->reference, reference, sizeof(reference));
+
+    bool result = false;
+
+    uint32_t rows_per_strip = UINT32_MAX;
+    const TIFFTag *offsets = NULL, *byte_counts = NULL, *tile_offsets = NULL, *tile_byte_counts = NULL;
+    const TIFFTag *colour_map = NULL, *bits_per_sample = NULL, *jpeg_tables = NULL;
+
+    for(unsigned int i = 0; i < num_tags; ++i) {
+        const TIFFTag *tag = &tags[i];
+        switch(tag->tag) {
+            case TIFF_TAG_IMAGEWIDTH:       tiff->width = ReadTIFFTagValue(tiff, reader, tag); break;
+            case TIFF_TAG_IMAGELENGTH:      tiff->height = ReadTIFFTagValue(tiff, reader, tag); break;
+            case TIFF_TAG_BITSPERSAMPLE:    bits_per_sample = tag; break;
+            case TIFF_TAG_COMPRESSION:      tiff->compression = ReadTIFFTagValue(tiff, reader, tag); break;
+            case TIFF_TAG_PHOTOMETRIC:      tiff->photometric = ReadTIFFTagValue(tiff, reader, tag); break;
+            case TIFF_TAG_FILLORDER:        tiff->fill_order = ReadTIFFTagValue(tiff, reader, tag); break;
+            case TIFF_TAG_STRIPOFFSETS:     offsets = tag; break;
+            case TIFF_TAG_SAMPLESPERPIXEL:  tiff->samples_per_pixel = ReadTIFFTagValue(tiff, reader, tag); break;
+            case TIFF_TAG_ROWSPERSTRIP:     rows_per_strip = ReadTIFFTagValue(tiff, reader, tag); break;
+            case TIFF_TAG_STRIPBYTECOUNTS:  byte_counts = tag; break;
+            case TIFF_TAG_PLANARCONFIG:     tiff->planar_config = ReadTIFFTagValue(tiff, reader, tag); break;
+            case TIFF_TAG_T4OPTIONS:        tiff->t4_options = ReadTIFFTagValue(tiff, reader, tag); break;
+            case TIFF_TAG_PREDICTOR:        tiff->predictor = ReadTIFFTagValue(tiff, reader, tag); break;
+            case TIFF_TAG_COLORMAP:         colour_map = tag; break;
+            case TIFF_TAG_TILEWIDTH:        tiff->chunk_width = ReadTIFFTagValue(tiff, reader, tag); break;
+            case TIFF_TAG_TILELENGTH:       tiff->chunk_height = ReadTIFFTagValue(tiff, reader, tag); break;
+            case TIFF_TAG_TILEOFFSETS:      tile_offsets = tag; break;
+            case TIFF_TAG_TILEBYTECOUNTS:   tile_byte_counts = tag; break;
+            case TIFF_TAG_EXTRASAMPLES: {
+                uint32_t extra = ReadTIFFTagValue(tiff, reader, tag);
+                tiff->alpha = (extra == TIFF_EXTRASAMPLE_ASSOCALPHA || extra == TIFF_EXTRASAMPLE_UNASSALPHA);
+                tiff->premultiplied = (extra == TIFF_EXTRASAMPLE_ASSOCALPHA);
+                break;
+            }
+            case TIFF_TAG_SAMPLEFORMAT:     tiff->sample_format = ReadTIFFTagValue(tiff, reader, tag); break;
+            case TIFF_TAG_JPEGTABLES:       jpeg_tables = tag; break;
+            case TIFF_TAG_YCBCRCOEFFICIENTS:
+                if(!ReadTIFFTagRationals(tiff, reader, tag, tiff->luma, 3)) {
+                    goto FINISHED;
+                }
+                break;
+            case TIFF_TAG_YCBCRSUBSAMPLING:
+                if(!ReadTIFFTagValues(tiff, reader, tag, tiff->subsampling, 2)) {
+                    goto FINISHED;
+                }
+                break;
+            case TIFF_TAG_REFERENCEBLACKWHITE:
+                if(!ReadTIFFTagRationals(tiff, reader, tag, tiff->reference, 6)) {
+                    goto FINISHED;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    /* every sample is expected to be the same size */
+    if(bits_per_sample != NULL) {
+        uint32_t bits[8] = { 0 };
+        uint32_t count = (bits_per_sample->count < 8) ? bits_per_sample->count : 8;
+        if(!ReadTIFFTagValues(tiff, reader, bits_per_sample, bits, count)) {
+            goto FINISHED;
+        }
+
+        for(uint32_t i = 1; i < count; ++i) {
+            if(bits[i] != bits[0]) {
+                ReportError(PL_RESULT_IMAGEFORMAT, "differing bits per sample within TIFF");
+                goto FINISHED;
+            }
+        }
+        tiff->bits_per_sample = bits[0];
+    }
+
+    if(colour_map != NULL && tiff->bits_per_sample <= 16) {
+        uint32_t count = 3u << tiff->bits_per_sample;
+        if(colour_map->count != count) {
+            ReportError(PL_RESULT_FILETYPE, "unexpected size for TIFF colour map");
+            goto FINISHED;
+        }
+
+        tiff->colour_map = malloc(sizeof(uint16_t) * count);
+        if(tiff->colour_map == NULL) {
+            ReportError(PL_RESULT_MEMORYALLOC, "failed to allocate TIFF colour map");
+            goto FINISHED;
+        }
+
+        if(!plSeekBinaryReader(reader, colour_map->value)) {
+            goto FINISHED;
+        }
+        for(uint32_t i = 0; i < count; ++i) {
+            tiff->colour_map[i] = ReadTIFFShort(tiff, reader);
+        }
+    }
+
+    /* with the EOI at the end and the SOI at the start of each chunk */
+    if(jpeg_tables != NULL && jpeg_tables->count >= 4) {
+        tiff->jpeg_tables_length = jpeg_tables->count;
+        if((tiff->jpeg_tables = malloc(tiff->jpeg_tables_length)) == NULL) {
+            ReportError(PL_RESULT_MEMORYALLOC, "failed to allocate TIFF JPEG tables");
+            goto FINISHED;
+        }
+
+        if(!plSeekBinaryReader(reader, jpeg_tables->value) ||
+           !plReadBinary(reader, tiff->jpeg_tables, tiff->jpeg_tables_length)) {
+            goto FINISHED;
+        }
+    }
+
+    if(tiff->width == 0 || tiff->height == 0) {
+        ReportError(PL_RESULT_IMAGERESOLUTION, "invalid TIFF size, %ux%u", tiff->width, tiff->height);
+        goto FINISHED;
+    }
+
+    /* tiles were once stored using the same tags as strips */
+    tiff->tiled = (tiff->chunk_width != 0 && tiff->chunk_height != 0);
+    if(tiff->tiled) {
+        if(tile_offsets != NULL) {
+            offsets = tile_offsets;
+            byte_counts = tile_byte_counts;
+        }
+    } else {
+        tiff->chunk_width = tiff->width;
+        tiff->chunk_height = (rows_per_strip == 0 || rows_per_strip > tiff->height) ? tiff->height : rows_per_strip;
+    }
+
+    unsigned int across = (tiff->width + tiff->chunk_width - 1) / tiff->chunk_width;
+    unsigned int down = (tiff->height + tiff->chunk_height - 1) / tiff->chunk_height;
+    unsigned int planes = (tiff->planar_config == TIFF_PLANARCONFIG_SEPARATE) ? tiff->samples_per_pixel : 1;
+    tiff->num_chunks = across * down * planes;
+
+    size_t *chunk_offsets = ReadTIFFTagArray(tiff, reader, offsets, tiff->num_chunks);
+    size_t *chunk_lengths = ReadTIFFTagArray(tiff, reader, byte_counts, tiff->num_chunks);
+    tiff->chunks = calloc(tiff->num_chunks, sizeof(TIFFChunk));
+    if(chunk_offsets == NULL || chunk_lengths == NULL || tiff->chunks == NULL) {
+        free(chunk_offsets);
+        free(chunk_lengths);
+        goto FINISHED;
+    }
+
+    for(unsigned int i = 0; i < tiff->num_chunks; ++i) {
+        TIFFChunk *chunk = &tiff->chunks[i];
+        unsigned int position = i % (across * down);
+        chunk->plane = i / (across * down);
+        chunk->x = (position % across) * tiff->chunk_width;
+        chunk->y = (position / across) * tiff->chunk_height;
+        chunk->width = (chunk->x + tiff->chunk_width > tiff->width) ? tiff->width - chunk->x : tiff->chunk_width;
+        chunk->height = (chunk->y + tiff->chunk_height > tiff->height) ? tiff->height - chunk->y : tiff->chunk_height;
+        chunk->offset = chunk_offsets[i];
+        chunk->length = chunk_lengths[i];
+    }
+
+    free(chunk_offsets);
+    free(chunk_lengths);
+
+    result = true;
+
+    FINISHED:
+    free(tags);
+    return result;
+}
+
+/* Works out how to get from YCbCr over to RGB, which is only possible
+ * for 8-bit samples, stored together, within a TIFF. */
+static bool SetupTIFFYCbCr(TIFFImage *tiff) {
+    unsigned int across = tiff->subsampling[0], down = tiff->subsampling[1];
+    if((across != 1 && across != 2 && across != 4) || (down != 1 && down != 2 && down != 4) ||
+       tiff->bits_per_sample != 8 || tiff->samples_per_pixel != 3 || tiff->planar_config == TIFF_PLANARCONFIG_SEPARATE) {
+        ReportError(PL_RESULT_IMAGEFORMAT, "unsupported TIFF YCbCr layout, %ux%u subsampling", across, down);
+        return false;
+    }
+
+    if(tiff->tiled && ((tiff->chunk_width % across) != 0 || (tiff->chunk_height % down) != 0)) {
+        ReportError(PL_RESULT_FILETYPE, "TIFF tiles don't fit the YCbCr subsampling");
+        return false;
+    }
+
+    if(!SetupYCbCrCoefficients(&tiff->ycbcr, tiff->luma[0], tiff->luma[1], tiff->luma[2])) {
+        ReportError(PL_RESULT_IMAGEFORMAT, "unsupported TIFF YCbCr coefficients");
+        return false;
+    }
+
+    tiff->row_height = down;
+
+    /* anything with headroom or footroom is scaled out to cover the lot */
+    const float *reference = tiff->reference;
+    if(reference[0] == 0 && reference[1] == 255 && reference[2] == 128 && reference[3] == 255 &&
+       reference[4] == 128 && reference[5] == 255) {
+        return true;
+    }
+
+    if((tiff->ycbcr_ranges = malloc(256 * 3)) == NULL) {
+        ReportError(PL_RESULT_MEMORYALLOC, "failed to allocate TIFF YCbCr ranges");
+        return false;
+    }
+
+    for(unsigned int i = 0; i < 3; ++i) {
+        float black = reference[i * 2], white = reference[i * 2 + 1];
+        float range = (white != black) ? white - black : 1;
+        for(int j = 0; j < 256; ++j) {
+            /* chroma is centred around 128, either side of which is half the range */
+            float value = (i == 0) ? (j - black) * 255 / range : (j - black) * 127 / range + 128;
+            tiff->ycbcr_ranges[i * 256 + j] = (uint8_t)((value < 0) ? 0 : (value > 255) ? 255 : value + 0.5f);
+        }
+    }
+
+    return true;
+}
+
+/* LogL and LogLuv are always stored the same way, whatever the bits per sample
+ * or sample format say, as those are what libtiff should hand them back out as. */
+static bool SetupTIFFLogLuv(TIFFImage *tiff) {
+    bool luminance = (tiff->photometric == TIFF_PHOTOMETRIC_LOGL);
+    if((tiff->compression != TIFF_COMPRESSION_SGILOG && tiff->compression != TIFF_COMPRESSION_SGILOG24) ||
+       (luminance ? tiff->photometric != TIFF_PHOTOMETRIC_LOGL : tiff->photometric != TIFF_PHOTOMETRIC_LOGLUV) ||
+       (luminance && tiff->compression == TIFF_COMPRESSION_SGILOG24)) {
+        ReportError(PL_RESULT_IMAGEFORMAT, "unsupported TIFF LogLuv compression (%u) and photometric interpretation (%u)",
+                    tiff->compression, tiff->photometric);
+        return false;
+    }
+
+    if(tiff->planar_config == TIFF_PLANARCONFIG_SEPARATE) {
+        ReportError(PL_RESULT_IMAGEFORMAT, "unsupported TIFF LogLuv layout");
+        return false;
+    }
+
+    unsigned int bytes = luminance ? 2 : (tiff->compression == TIFF_COMPRESSION_SGILOG24) ? 3 : 4;
+
+    tiff->hdr = true;
+    tiff->alpha = false;
+    tiff->channels = 4;
+    tiff->pitch = (size_t)tiff->width * 4 * sizeof(float);
+    tiff->row_height = 1;
+    tiff->row_length = (size_t)tiff->chunk_width * bytes;
+    tiff->chunk_length = tiff->row_length * tiff->chunk_height;
+
+    return true;
+}
+
+/* Checks whether we can actually do anything with what's been read in. */
+static bool SetupTIFFImage(TIFFImage *tiff) {
+    if(GetTIFFDecoder(tiff->compression) == NULL) {
+        ReportError(PL_RESULT_IMAGEFORMAT, "unsupported TIFF compression (%u)", tiff->compression);
+        return false;
+    }
+
+    if(tiff->compression == TIFF_COMPRESSION_SGILOG || tiff->compression == TIFF_COMPRESSION_SGILOG24 ||
+       tiff->photometric == TIFF_PHOTOMETRIC_LOGL || tiff->photometric == TIFF_PHOTOMETRIC_LOGLUV) {
+        return SetupTIFFLogLuv(tiff);
+    }
+
+    tiff->hdr = (tiff->sample_format == TIFF_SAMPLEFORMAT_IEEEFP);
+    if(tiff->sample_format != TIFF_SAMPLEFORMAT_UINT && !tiff->hdr) {
+        ReportError(PL_RESULT_IMAGEFORMAT, "unsupported TIFF sample format (%u)", tiff->sample_format);
+        return false;
+    }
+
+    unsigned int colour_samples;
+    switch(tiff->photometric) {
+        case TIFF_PHOTOMETRIC_WHITEISZERO:
+        case TIFF_PHOTOMETRIC_BLACKISZERO:
+            colour_samples = 1;
+            break;
+        case TIFF_PHOTOMETRIC_RGB:
+            colour_samples = 3;
+            break;
+        case TIFF_PHOTOMETRIC_PALETTE:
+            colour_samples = 1;
+            if(tiff->colour_map == NULL) {
+                ReportError(PL_RESULT_FILETYPE, "missing colour map for TIFF");
+                return false;
+            }
+            tiff->alpha = false;
+            break;
+        case TIFF_PHOTOMETRIC_YCBCR:
+            colour_samples = 3;
+            tiff->alpha = false;
+            break;
+        default:
+            ReportError(PL_RESULT_IMAGEFORMAT, "unsupported TIFF photometric interpretation (%u)", tiff->photometric);
+            return false;
+    }
+
+    unsigned int bits = tiff->bits_per_sample;
+    if(tiff->hdr ? (bits != 16 && bits != 32 && bits != 64) : (bits != 1 && bits != 2 && bits != 4 && bits != 8 && bits != 16)) {
+        ReportError(PL_RESULT_IMAGEFORMAT, "unsupported TIFF bits per sample (%u)", bits);
+        return false;
+    }
+
+    if(tiff->samples_per_pixel < colour_samples) {
+        ReportError(PL_RESULT_FILETYPE, "too few samples per pixel (%u) for TIFF", tiff->samples_per_pixel);
+        return false;
+    }
+
+    if(tiff->samples_per_pixel == colour_samples) {
+        tiff->alpha = false;
+    }
+
+    tiff->channels = tiff->alpha ? 4 : 3;
+    tiff->pitch = (size_t)tiff->width * tiff->channels;
+    tiff->row_height = 1;
+
+    /* floats are kept as they are, without any prediction, which differs for them */
+    if(tiff->hdr) {
+        if(tiff->photometric != TIFF_PHOTOMETRIC_BLACKISZERO && tiff->photometric != TIFF_PHOTOMETRIC_RGB) {
+            ReportError(PL_RESULT_IMAGEFORMAT, "unsupported TIFF photometric interpretation (%u) for floating point",
+                        tiff->photometric);
+            return false;
+        }
+
+        if(tiff->predictor > 1) {
+            ReportError(PL_RESULT_IMAGEFORMAT, "unsupported TIFF predictor (%u) for floating point", tiff->predictor);
+            return false;
+        }
+
+        tiff->channels = 4;
+        tiff->pitch = (size_t)tiff->width * 4 * sizeof(float);
+    } else if(bits == 16 && tiff->photometric != TIFF_PHOTOMETRIC_PALETTE) {
+        /* palette indices only ever end up as colours out of the map */
+        tiff->wide = true;
+        tiff->channels = 4;
+        tiff->pitch = (size_t)tiff->width * 4 * sizeof(uint16_t);
+    }
+
+    /* the JPEG decoder does any conversion from YCbCr itself */
+    if(tiff->compression == TIFF_COMPRESSION_JPEG) {
+        if(bits != 8 || (tiff->samples_per_pixel != 1 && tiff->samples_per_pixel != 3) ||
+           tiff->planar_config == TIFF_PLANARCONFIG_SEPARATE) {
+            ReportError(PL_RESULT_IMAGEFORMAT, "unsupported JPEG compressed TIFF layout");
+            return false;
+        }
+
+        if(tiff->photometric == TIFF_PHOTOMETRIC_YCBCR) {
+            tiff->photometric = TIFF_PHOTOMETRIC_RGB;
+        }
+    } else if(tiff->photometric == TIFF_PHOTOMETRIC_YCBCR && !SetupTIFFYCbCr(tiff)) {
+        return false;
+    }
+
+    /* fax pages stay as they are, a bit per pixel */
+    if(tiff->compression == TIFF_COMPRESSION_CCITT_RLE || tiff->compression == TIFF_COMPRESSION_CCITT_T4 ||
+       tiff->compression == TIFF_COMPRESSION_CCITT_T6) {
+        if(bits != 1 || tiff->samples_per_pixel != 1 || tiff->photometric > TIFF_PHOTOMETRIC_BLACKISZERO) {
+            ReportError(PL_RESULT_IMAGEFORMAT, "CCITT compressed TIFF isn't bilevel");
+            return false;
+        }
+
+        /* tiles should always be a multiple of 16 across, so this is only for safety */
+        if(tiff->tiled && (tiff->chunk_width % 8) != 0) {
+            ReportError(PL_RESULT_IMAGEFORMAT, "unsupported TIFF tile width (%u) for CCITT", tiff->chunk_width);
+            return false;
+        }
+
+        tiff->bilevel = true;
+        tiff->channels = 1;
+        tiff->pitch = (tiff->width + 7) / 8;
+    }
+
+    unsigned int row_samples = tiff->chunk_width;
+    if(tiff->planar_config != TIFF_PLANARCONFIG_SEPARATE) {
+        row_samples *= tiff->samples_per_pixel;
+    }
+
+    tiff->row_length = ((size_t)row_samples * bits + 7) / 8;
+    if(tiff->photometric == TIFF_PHOTOMETRIC_YCBCR) {
+        unsigned int blocks = (tiff->chunk_width + tiff->subsampling[0] - 1) / tiff->subsampling[0];
+        tiff->row_length = (size_t)blocks * (tiff->subsampling[0] * tiff->subsampling[1] + 2);
+    }
+    tiff->chunk_length = tiff->row_length * ((tiff->chunk_height + tiff->row_height - 1) / tiff->row_height);
+
+    return true;
+}
+
+/* Points each chunk at its compressed data, either straight out of
+ * memory or read into one block, in order, ahead of decoding. */
+static bool ReadTIFFChunks(TIFFImage *tiff, PLBinaryReader *reader) {
+    for(unsigned int i = 0; i < tiff->num_chunks; ++i) {
+        const TIFFChunk *chunk = &tiff->chunks[i];
+        if(chunk->offset > reader->length || chunk->length > reader->length - chunk->offset) {
+            ReportError(PL_RESULT_FILEREAD, "TIFF strip or tile %u lies outside of the file", i);
+            return false;
+        }
+    }
+
+    if(reader->file == NULL) {
+        for(unsigned int i = 0; i < tiff->num_chunks; ++i) {
+            tiff->chunks[i].data = reader->data + tiff->chunks[i].offset;
+        }
+        return true;
+    }
+
+    size_t total = 0;
+    for(unsigned int i = 0; i < tiff->num_chunks; ++i) {
+        total += tiff->chunks[i].length;
+    }
+
+    tiff->chunk_data = malloc(total ? total : 1);
+    if(tiff->chunk_data == NULL) {
+        ReportError(PL_RESULT_MEMORYALLOC, "failed to allocate TIFF data");
+        return false;
+    }
+
+    uint8_t *data = tiff->chunk_data;
+    for(unsigned int i = 0; i < tiff->num_chunks; ++i) {
+        TIFFChunk *chunk = &tiff->chunks[i];
+        if(!plSeekBinaryReader(reader, chunk->offset) || !plReadBinary(reader, data, chunk->length)) {
+            return false;
+        }
+
+        chunk->data = data;
+        data += chunk->length;
+    }
+
+    return true;
+}
+
+PLresult LoadTIFFImage(PLBinaryReader *reader, PLImage *out) {
+    static PLImageOnce once = PL_IMAGE_ONCE_INIT;
+    CallImageOnce(&once, SetupTIFFReversedBits);
+
+    TIFFImage tiff;
+    memset(&tiff, 0, sizeof(TIFFImage));
+
+    /* the magic is either side of the byte order, so check which it was */
+    if(!plSeekBinaryReader(reader, 0)) {
+        return PL_RESULT_FILEREAD;
+    }
+    tiff.big_endian = (plReadBinaryUInt8(reader) == 'M');
+    plSkipBinaryReader(reader, 3);
+
+    PLresult result = PL_RESULT_FILEREAD;
+    if(!ReadTIFFDirectory(&tiff, reader) || !SetupTIFFImage(&tiff) || !ReadTIFFChunks(&tiff, reader)) {
+        result = plGetFunctionResult();
+        goto FINISHED;
+    }
+
+    memset(out, 0, sizeof(PLImage));
+    out->width = tiff.width;
+    out->height = tiff.height;
+    if(tiff.bilevel) {
+        out->format = PL_IMAGEFORMAT_L1;
+        out->colour_format = PL_COLOURFORMAT_L;
+    } else if(tiff.hdr) {
+        out->format = PL_IMAGEFORMAT_RGBA32F;
+        out->colour_format = PL_COLOURFORMAT_RGBA;
+    } else if(tiff.wide) {
+        out->format = PL_IMAGEFORMAT_RGBA16;
+        out->colour_format = PL_COLOURFORMAT_RGBA;
+    } else {
+        out->format = (tiff.channels == 4) ? PL_IMAGEFORMAT_RGBA8 : PL_IMAGEFORMAT_RGB8;
+        out->colour_format = (tiff.channels == 4) ? PL_COLOURFORMAT_RGBA : PL_COLOURFORMAT_RGB;
+    }
+    out->size = _plGetImageSize(out->format, out->width, out->height);
+    out->levels = 1;
+
+    /* the size has to fit into an unsigned int */
+    if((uint64_t)tiff.pitch * tiff.height != out->size) {
+        ReportError(PL_RESULT_IMAGERESOLUTION, "TIFF is too large, %ux%u", tiff.width, tiff.height);
+        result = PL_RESULT_IMAGERESOLUTION;
+        goto FINISHED;
+    }
+
+    out->data = calloc(1, sizeof(uint8_t*));
+    if(out->data == NULL || (out->data[0] = calloc(out->size, 1)) == NULL) {
+        ReportError(PL_RESULT_MEMORYALLOC, "failed to allocate image data");
+        free(out->data);
+        out->data = NULL;
+        result = PL_RESULT_MEMORYALLOC;
+        goto FINISHED;
+    }
+
+    tiff.pixels = out->data[0];
+    if(!DecodeTIFFImage(&tiff)) {
+        result = plGetFunctionResult();
+        plFreeImage(out);
+        goto FINISHED;
+    }
+
+    result = PL_RESULT_SUCCESS;
+
+    FINISHED:
+    free(tiff.colour_map);
+    free(tiff.ycbcr_ranges);
+    free(tiff.jpeg_tables);
+    free(tiff.chunks);
+    free(tiff.chunk_data);
+
+    return result;
+}
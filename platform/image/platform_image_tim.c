@@ -26,6 +26,7 @@ For more information, please refer to <http://unlicense.org>
 */
 
 #include <PL/platform_image.h>
+#include <PL/platform_filesystem.h>
 
 /*  http://rewiki.regengedanken.de/wiki/.TIM
  *  https://mrclick.zophar.net/TilEd/download/timgfx.txt
@@ -49,6 +50,8 @@ typedef struct TIMPaletteInfo {
     uint16_t palette_height; /* ...length of the palette in 16-bit words. */
 } TIMPaletteInfo;
 
+#define TIM_PALETTE_INFO_LENGTH 12  /* as stored, always little-endian */
+
 typedef struct TIMImageInfo {
     uint32_t image_size; /* Length of image header and pixel data, in bytes */
     uint16_t org_x;
@@ -57,6 +60,8 @@ typedef struct TIMImageInfo {
     uint16_t height;     /* Height of the image, in pixels */
 } TIMImageInfo;
 
+#define TIM_IMAGE_INFO_LENGTH   12
+
 enum TIMType {
     TIM_TYPE_4BPP   = 0,
     TIM_TYPE_8BPP   = 1,
@@ -66,17 +71,6 @@ enum TIMType {
 
 #define TIM_IDENT   16
 
-bool TIMFormatCheck(FILE *fin) {
-    rewind(fin);
-
-    uint32_t ident;
-    if(fread(&ident, sizeof(uint32_t), 1, fin) != 1) {
-        return false;
-    }
-
-    return (bool)(ident == TIM_IDENT);
-}
-
 PLresult WriteTIMImage(const PLImage *image, const char *path) {
     if(!plIsValidString(path)) {
         return PL_RESULT_FILEPATH;
@@ -85,52 +79,35 @@ PLresult WriteTIMImage(const PLImage *image, const char *path) {
     return PL_RESULT_SUCCESS;
 }
 
-/* Convert a 16-bit TIM colour value to RGB5A1. */
+/* TIM colours are already red, green and blue from the least significant bit
+ * up, which is all RGB5A1 needs, bar the alpha bit. */
 static uint16_t _tim16toRGB51A(uint16_t colour_in) {
-    uint16_t colour_out = 0;
-
-    uint8_t *cin  = (uint8_t*)(&colour_in);
-    uint8_t *cout = (uint8_t*)(&colour_out);
-
-    /* Shift the colour bits around:
-     * GGGRRRRR:ABBBBBGG => RRRRRGGG:GGBBBBBA
-    */
-
-    /* Red */
-    cout[0] |= (cin[0] & 0x1F) << 3;
-
-    /* Green */
-    cout[0] |= (cin[1] & 0x03) << 1;
-    cout[0] |= (cin[0] & 0x80) >> 7;
-    cout[1] |= (cin[0] & 0x60) << 1;
-
-    /* Blue */
-    cout[1] |= (cin[1] & 0x7C) >> 1;
+    uint16_t colour_out = colour_in & 0x7FFF;
 
     /* Handle the alpha channel... if the "STP" bit in the TIM data is on, the colour is
      * transparent, unless the colour is black, in which case the bit is inverted.
     */
 
     bool is_black = (colour_out == 0);
-    bool stp_on   = (cin[1] & 0x80);
+    bool stp_on   = (colour_in & 0x8000);
 
     if((is_black && stp_on) || (!is_black && !stp_on)) {
-        cout[1] |= 0x01;
+        colour_out |= 0x8000;
     }
 
     return colour_out;
 }
 
-PLresult LoadTIMImage(FILE *fin, PLImage *out) {
+PLresult LoadTIMImage(PLBinaryReader *reader, PLImage *out) {
     memset(out, 0, sizeof(PLImage));
 
     uint16_t *palette = NULL;
-    void *image_data  = NULL;
 
     TIMHeader header;
-    if (fread(&header, sizeof(TIMHeader), 1, fin) != 1) {
-        goto UNEXPECTED_EOF;
-    }
+    header.flag1 = plReadBinaryUInt8(reader);
+    header.flag2 = plReadBinaryUInt8(reader);
+    header.flag3 = plReadBinaryUInt8(reader);
+    header.flag4 = plReadBinaryUInt8(reader);
 
     uint32_t palette_size = 0; /* Number of colours in palette */
 
@@ -138,7 +115,12 @@ PLresult LoadTIMImage(FILE *fin, PLImage *out) {
         /* File has a palette (CLUT), read it it in */
 
         TIMPaletteInfo palette_info;
-        if(fread(&palette_info, sizeof(TIMPaletteInfo), 1, fin) != 1) {
+        palette_info.palette_size   = plReadBinaryLittleUInt32(reader);
+        palette_info.palette_org_x  = plReadBinaryLittleUInt16(reader);
+        palette_info.palette_org_y  = plReadBinaryLittleUInt16(reader);
+        palette_info.palette_width  = plReadBinaryLittleUInt16(reader);
+        palette_info.palette_height = plReadBinaryLittleUInt16(reader);
+        if(reader->error) {
             goto UNEXPECTED_EOF;
         }
 
@@ -147,7 +129,7 @@ PLresult LoadTIMImage(FILE *fin, PLImage *out) {
 
         /* Check the size and width/height values in the header match. */
         if(palette_size >= palette_info.palette_size
-            || (palette_size * sizeof(uint16_t)) != (palette_info.palette_size - sizeof(palette_info)))
+            || (palette_size * sizeof(uint16_t)) != (palette_info.palette_size - TIM_PALETTE_INFO_LENGTH))
         {
             ReportError(PL_RESULT_FILETYPE, "invalid size/width/height in TIM palette header");
             goto ERR_CLEANUP;
@@ -159,13 +141,18 @@ PLresult LoadTIMImage(FILE *fin, PLImage *out) {
             goto ERR_CLEANUP;
         }
 
-        if(fread(palette, sizeof(uint16_t), palette_size, fin) != palette_size) {
+        if(!plReadBinaryLittleUInt16Array(reader, palette, palette_size)) {
             goto UNEXPECTED_EOF;
         }
     }
 
     TIMImageInfo image_info;
-    if(fread(&image_info, sizeof(TIMImageInfo), 1, fin) != 1) {
+    image_info.image_size = plReadBinaryLittleUInt32(reader);
+    image_info.org_x      = plReadBinaryLittleUInt16(reader);
+    image_info.org_y      = plReadBinaryLittleUInt16(reader);
+    image_info.width      = plReadBinaryLittleUInt16(reader);
+    image_info.height     = plReadBinaryLittleUInt16(reader);
+    if(reader->error) {
         goto UNEXPECTED_EOF;
     }
 
@@ -173,22 +160,17 @@ PLresult LoadTIMImage(FILE *fin, PLImage *out) {
     {
         uint32_t image_width_bytes = ((uint32_t)(image_info.width)) * 2;
         if(image_width_bytes >= image_info.image_size
-            || (image_width_bytes * image_info.height) != (image_info.image_size - sizeof(image_info)))
+            || (image_width_bytes * image_info.height) != (image_info.image_size - TIM_IMAGE_INFO_LENGTH))
         {
             ReportError(PL_RESULT_FILETYPE, "invalid size/width/height in TIM image header");
             goto ERR_CLEANUP;
         }
     }
 
-    /* Read in the image data. */
-    size_t image_data_len = image_info.image_size - sizeof(image_info);
-    image_data            = malloc(image_data_len);
+    /* Read in the image data, which stays valid until the next read. */
+    size_t image_data_len = image_info.image_size - TIM_IMAGE_INFO_LENGTH;
+    const uint8_t *image_data = plGetBinaryReaderData(reader, image_data_len);
     if(image_data == NULL) {
-        ReportError(PL_RESULT_MEMORYALLOC, "couldn't allocate input image buffer");
-        goto ERR_CLEANUP;
-    }
-
-    if(fread(image_data, image_data_len, 1, fin) != 1) {
         goto UNEXPECTED_EOF;
     }
 
@@ -244,10 +226,10 @@ PLresult LoadTIMImage(FILE *fin, PLImage *out) {
 
     switch(type) {
         case TIM_TYPE_4BPP: {
-            uint8_t  *indata  = image_data;
+            const uint8_t *indata = image_data;
             uint16_t *outdata = (uint16_t*)(out->data[0]);
 
-            for(; indata < (uint8_t*)(image_data + image_data_len); ++indata) {
+            for(; indata < image_data + image_data_len; ++indata) {
                 uint8_t p1 = (*indata & 0x0F);
                 uint8_t p2 = (*indata & 0xF0) >> 4;
 
@@ -264,10 +246,10 @@ PLresult LoadTIMImage(FILE *fin, PLImage *out) {
         }
 
         case TIM_TYPE_8BPP: {
-            uint8_t  *indata  = image_data;
+            const uint8_t *indata = image_data;
             uint16_t *outdata = (uint16_t*)(out->data[0]);
 
-            for(; indata < (uint8_t*)(image_data + image_data_len); ++indata) {
+            for(; indata < image_data + image_data_len; ++indata) {
                 uint8_t p = *indata;
 
                 if(p >= palette_size) {
@@ -287,9 +269,8 @@ PLresult LoadTIMImage(FILE *fin, PLImage *out) {
             goto ERR_CLEANUP;
     };
 
-    out->colour_format = PL_COLOURFORMAT_ABGR;
+    out->colour_format = PL_COLOURFORMAT_RGBA;
 
-    free(image_data);
     free(palette);
 
     return PL_RESULT_SUCCESS;
@@ -304,7 +285,6 @@ PLresult LoadTIMImage(FILE *fin, PLImage *out) {
         free(out->data);
     }
 
-    free(image_data);
     free(palette);
 
     return plGetFunctionResult();
@@ -147,8 +147,9 @@ enum VTFFormat {
 void _plConvertVTFFormat(PLImage *image, unsigned int in) {
     switch(in) {
         case VTF_FORMAT_A8:
-            image->format = PL_IMAGEFORMAT_RGB4;
-            image->colour_format = PL_COLOURFORMAT_RGB;
+            /* read in as it is, then expanded, see _plExpandVTFAlpha */
+            image->format = PL_IMAGEFORMAT_L8;
+            image->colour_format = PL_COLOURFORMAT_L;
             break;
         case VTF_FORMAT_ABGR8888:
             image->format = PL_IMAGEFORMAT_RGBA8;
@@ -212,6 +213,7 @@ void _plConvertVTFFormat(PLImage *image, unsigned int in) {
         case VTF_FORMAT_RGBA16161616:
             image->format = PL_IMAGEFORMAT_RGBA16;
             image->colour_format = PL_COLOURFORMAT_RGBA;
+            break;
         case VTF_FORMAT_RGBA16161616F:
             image->format = PL_IMAGEFORMAT_RGBA16F;
             image->colour_format = PL_COLOURFORMAT_RGBA;
@@ -225,23 +227,34 @@ void _plConvertVTFFormat(PLImage *image, unsigned int in) {
     }
 }
 
-bool _plVTFFormatCheck(FILE *fin) {
-    rewind(fin);
+/* There's no format of our own that's only alpha, so A8 is spread
+ * out into RGBA8, with the colour left black as GL and D3D do. */
+static bool _plExpandVTFAlpha(PLImage *image, unsigned int size) {
+    uint8_t *rgba = calloc(size, 4);
+    if(rgba == NULL) {
+        ReportError(PL_RESULT_MEMORYALLOC, "failed to allocate %u bytes", size * 4);
+        return false;
+    }
 
-    char ident[4];
-    fread(ident, sizeof(char), 4, fin);
+    for(unsigned int i = 0; i < size; ++i) {
+        rgba[i * 4 + 3] = image->data[0][i];
+    }
 
-    return (bool)(strncmp(ident, "VTF", 3) == 0);
+    free(image->data[0]);
+    image->data[0] = rgba;
+    image->format = PL_IMAGEFORMAT_RGBA8;
+    image->colour_format = PL_COLOURFORMAT_RGBA;
+    return true;
 }
 
-PLresult _plLoadVTFImage(FILE *fin, PLImage *out) {
+PLresult _plLoadVTFImage(PLBinaryReader *reader, PLImage *out) {
     plFunctionStart();
 
     VTFHeader header;
     memset(&header, 0, sizeof(VTFHeader));
 #define VTF_VERSION(maj, min)   ((((maj)) == header.version[1] && (min) <= header.version[0]) || (maj) < header.version[0])
 
-    if (fread(&header, sizeof(VTFHeader), 1, fin) != 1) {
+    if (!plReadBinary(reader, &header, sizeof(VTFHeader))) {
         return PL_RESULT_FILEREAD;
     }
 
@@ -268,13 +281,13 @@ PLresult _plLoadVTFImage(FILE *fin, PLImage *out) {
     VTFHeader72 header2;
     if (header.version[1] >= 2) {
         memset(&header2, 0, sizeof(VTFHeader72));
-        if (fread(&header2, sizeof(VTFHeader72), 1, fin) != 1)
+        if (!plReadBinary(reader, &header2, sizeof(VTFHeader72)))
             return PL_RESULT_FILEREAD;
     }
     VTFHeader73 header3;
     if (header.version[1] >= 3) {
         memset(&header3, 0, sizeof(VTFHeader73));
-        if (fread(&header3, sizeof(VTFHeader73), 1, fin) != 1)
+        if (!plReadBinary(reader, &header3, sizeof(VTFHeader73)))
             return PL_RESULT_FILEREAD;
     }
 
@@ -288,6 +301,8 @@ PLresult _plLoadVTFImage(FILE *fin, PLImage *out) {
     out->levels = 1;
     out->data = (uint8_t**)calloc(1, sizeof(uint8_t*));
 
+    PLuint data_size = 0;
+
     /*
     if (header.version[1] >= 3) {
         for (PLuint i = 0; i < header3.numresources; i++) {
@@ -300,7 +315,7 @@ PLresult _plLoadVTFImage(FILE *fin, PLImage *out) {
         }
 
         // VTF's typically include a tiny thumbnail image at the start, which we'll skip.
-        fseek(fin, header.lowresimagewidth * header.lowresimageheight / 2, SEEK_CUR);
+        plSkipBinaryReader(reader, header.lowresimagewidth * header.lowresimageheight / 2);
 
         for (int mipmap = 0; mipmap < header.mipmaps; ++mipmap) {
             for(unsigned int frame = 0; frame < header.frames; ++frame) {
@@ -311,15 +326,16 @@ PLresult _plLoadVTFImage(FILE *fin, PLImage *out) {
                     PLuint mipsize = _plGetImageSize(out->format, mipw, miph);
                     if(mipmap == (header.mipmaps - 1)) {
                         out->data[0] = (uint8_t*)calloc(mipsize, sizeof(uint8_t));
-                        if (fread(out->data[0], sizeof(uint8_t), mipsize, fin) != mipsize) {
+                        if (!plReadBinary(reader, out->data[0], mipsize)) {
                             plFreeImage(out);
                             return PL_RESULT_FILEREAD;
                         }
+                        data_size = mipsize;
                     } else {
-                        fseek(fin, mipsize, SEEK_CUR);
+                        plSkipBinaryReader(reader, mipsize);
                     }
 
-                    if(feof(fin)) {
+                    if(reader->error) {
                         perror(PL_FUNCTION);
                         break;
                     }
@@ -328,5 +344,10 @@ PLresult _plLoadVTFImage(FILE *fin, PLImage *out) {
         }
     }
 
+    if(header.highresimageformat == VTF_FORMAT_A8 && out->data[0] != NULL && !_plExpandVTFAlpha(out, data_size)) {
+        plFreeImage(out);
+        return PL_RESULT_MEMORYALLOC;
+    }
+
     return PL_RESULT_SUCCESS;
 }
\ No newline at end of file
@@ -0,0 +1,377 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+
+#include <PL/platform_image.h>
+
+#include <math.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#   include <immintrin.h>
+#   define YCBCR_X86
+#endif
+
+/*	YCbCr to RGB
+ *	Converted a row at a time, with any subsampled chroma repeated across
+ *	the pixels it covers. Everything's done in 14-bit fixed point so that
+ *	the vector kernels, picked depending on what the CPU can do, come
+ *	out exactly the same as the plain C below.
+ */
+
+#define YCBCR_SHIFT     14
+#define YCBCR_ONE       (1 << YCBCR_SHIFT)
+#define YCBCR_HALF      (1 << (YCBCR_SHIFT - 1))
+
+/* Works out the coefficients from the share of luma given to each
+ * colour, usually 0.299, 0.587 and 0.114, returning false if they
+ * don't make sense or are too large to be held. */
+bool SetupYCbCrCoefficients(YCbCrCoefficients *coefficients, float luma_red, float luma_green, float luma_blue) {
+    if(luma_red <= 0 || luma_green <= 0 || luma_blue <= 0) {
+        return false;
+    }
+
+    float cr_r = 2 - 2 * luma_red;
+    float cb_b = 2 - 2 * luma_blue;
+    float cr_g = -cr_r * luma_red / luma_green;
+    float cb_g = -cb_b * luma_blue / luma_green;
+    if(cr_r >= 2 || cb_b >= 2 || cr_g <= -2 || cb_g <= -2) {
+        return false;
+    }
+
+    coefficients->cr_r = (int16_t)lrintf(cr_r * YCBCR_ONE);
+    coefficients->cb_g = (int16_t)lrintf(cb_g * YCBCR_ONE);
+    coefficients->cr_g = (int16_t)lrintf(cr_g * YCBCR_ONE);
+    coefficients->cb_b = (int16_t)lrintf(cb_b * YCBCR_ONE);
+
+    return true;
+}
+
+static PL_INLINE uint8_t ClampYCbCr(int value) {
+    return (uint8_t)((value < 0) ? 0 : (value > 255) ? 255 : value);
+}
+
+/* Two 16-bit values as one 32-bit, the first in the low half, for pairing up with
+ * what's been interleaved together so they can be multiplied and summed at once. */
+static PL_INLINE int32_t PairYCbCr(int low, int high) {
+    return (int32_t)(((uint32_t)(uint16_t)high << 16) | (uint16_t)low);
+}
+
+static PL_INLINE unsigned int GetYCbCrShift(unsigned int subsampling) {
+    return (subsampling == 4) ? 2 : (subsampling == 2) ? 1 : 0;
+}
+
+static void ConvertYCbCrRowC(const YCbCrCoefficients *coefficients, const uint8_t *y, const uint8_t *cb,
+                             const uint8_t *cr, uint8_t *dest, unsigned int width, unsigned int subsampling,
+                             unsigned int channels) {
+    unsigned int shift = GetYCbCrShift(subsampling);
+    for(unsigned int x = 0; x < width; ++x, dest += channels) {
+        int luma = (y[x] << YCBCR_SHIFT) + YCBCR_HALF;
+        int blue = cb[x >> shift] - 128;
+        int red = cr[x >> shift] - 128;
+
+        dest[0] = ClampYCbCr((luma + coefficients->cr_r * red) >> YCBCR_SHIFT);
+        dest[1] = ClampYCbCr((luma + coefficients->cb_g * blue + coefficients->cr_g * red) >> YCBCR_SHIFT);
+        dest[2] = ClampYCbCr((luma + coefficients->cb_b * blue) >> YCBCR_SHIFT);
+        if(channels == 4) {
+            dest[3] = 255;
+        }
+    }
+}
+
+#if defined(YCBCR_X86)
+
+/////////////////////////////////////////////////////////////////
+// SSE2
+
+/* Loads the chroma covering 16 pixels, repeated out to one for each. */
+__attribute__((target("sse2")))
+static PL_INLINE __m128i LoadYCbCrChromaSSE2(const uint8_t *src, unsigned int subsampling) {
+    if(subsampling == 1) {
+        return _mm_loadu_si128((const __m128i*)src);
+    }
+
+    if(subsampling == 2) {
+        __m128i chroma = _mm_loadl_epi64((const __m128i*)src);
+        return _mm_unpacklo_epi8(chroma, chroma);
+    }
+
+    int32_t packed;
+    memcpy(&packed, src, sizeof(int32_t));
+    __m128i chroma = _mm_cvtsi32_si128(packed);
+    chroma = _mm_unpacklo_epi8(chroma, chroma);
+    return _mm_unpacklo_epi8(chroma, chroma);
+}
+
+/* Each channel for 8 pixels, as 16-bit. Pairing luma up with the chroma
+ * lets each be multiplied and summed in one go, into 32-bit. */
+__attribute__((target("sse2")))
+static PL_INLINE void ConvertYCbCr8SSE2(const YCbCrCoefficients *coefficients, __m128i y, __m128i cb, __m128i cr,
+                                        __m128i *red, __m128i *green, __m128i *blue) {
+    const __m128i k_red = _mm_set1_epi32(PairYCbCr(YCBCR_ONE, coefficients->cr_r));
+    const __m128i k_green = _mm_set1_epi32(PairYCbCr(YCBCR_ONE, coefficients->cb_g));
+    const __m128i k_green_cr = _mm_set1_epi32(PairYCbCr(coefficients->cr_g, 0));
+    const __m128i k_blue = _mm_set1_epi32(PairYCbCr(YCBCR_ONE, coefficients->cb_b));
+    const __m128i half = _mm_set1_epi32(YCBCR_HALF);
+    const __m128i zero = _mm_setzero_si128();
+
+    __m128i y_cr_lo = _mm_unpacklo_epi16(y, cr), y_cr_hi = _mm_unpackhi_epi16(y, cr);
+    __m128i y_cb_lo = _mm_unpacklo_epi16(y, cb), y_cb_hi = _mm_unpackhi_epi16(y, cb);
+    __m128i cr_lo = _mm_unpacklo_epi16(cr, zero), cr_hi = _mm_unpackhi_epi16(cr, zero);
+
+    __m128i lo = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(y_cr_lo, k_red), half), YCBCR_SHIFT);
+    __m128i hi = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(y_cr_hi, k_red), half), YCBCR_SHIFT);
+    *red = _mm_packs_epi32(lo, hi);
+
+    lo = _mm_add_epi32(_mm_madd_epi16(y_cb_lo, k_green), _mm_madd_epi16(cr_lo, k_green_cr));
+    hi = _mm_add_epi32(_mm_madd_epi16(y_cb_hi, k_green), _mm_madd_epi16(cr_hi, k_green_cr));
+    lo = _mm_srai_epi32(_mm_add_epi32(lo, half), YCBCR_SHIFT);
+    hi = _mm_srai_epi32(_mm_add_epi32(hi, half), YCBCR_SHIFT);
+    *green = _mm_packs_epi32(lo, hi);
+
+    lo = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(y_cb_lo, k_blue), half), YCBCR_SHIFT);
+    hi = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(y_cb_hi, k_blue), half), YCBCR_SHIFT);
+    *blue = _mm_packs_epi32(lo, hi);
+}
+
+/* Squeezes four RGBX pixels down to the first 12 bytes. */
+__attribute__((target("sse2")))
+static PL_INLINE __m128i PackRGBSSE2(__m128i pixels) {
+    const __m128i low = _mm_set_epi32(0, 0xFFFFFF, 0, 0xFFFFFF);
+    const __m128i high = _mm_set_epi32(0xFFFF, (int)0xFF000000, 0xFFFF, (int)0xFF000000);
+    pixels = _mm_or_si128(_mm_and_si128(pixels, low), _mm_and_si128(_mm_srli_epi64(pixels, 8), high));
+    return _mm_or_si128(_mm_move_epi64(pixels), _mm_slli_si128(_mm_srli_si128(pixels, 8), 6));
+}
+
+__attribute__((target("sse2")))
+static void ConvertYCbCrRowSSE2(const YCbCrCoefficients *coefficients, const uint8_t *y, const uint8_t *cb,
+                                const uint8_t *cr, uint8_t *dest, unsigned int width, unsigned int subsampling,
+                                unsigned int channels) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bias = _mm_set1_epi16(128);
+    const __m128i alpha = _mm_set1_epi8((char)0xFF);
+    unsigned int shift = GetYCbCrShift(subsampling);
+
+    unsigned int x = 0;
+    for(; x + 16 <= width; x += 16, dest += 16 * channels) {
+        __m128i luma = _mm_loadu_si128((const __m128i*)(y + x));
+        __m128i blue = LoadYCbCrChromaSSE2(cb + (x >> shift), subsampling);
+        __m128i red = LoadYCbCrChromaSSE2(cr + (x >> shift), subsampling);
+
+        __m128i r_lo, g_lo, b_lo, r_hi, g_hi, b_hi;
+        ConvertYCbCr8SSE2(coefficients, _mm_unpacklo_epi8(luma, zero),
+                          _mm_sub_epi16(_mm_unpacklo_epi8(blue, zero), bias),
+                          _mm_sub_epi16(_mm_unpacklo_epi8(red, zero), bias), &r_lo, &g_lo, &b_lo);
+        ConvertYCbCr8SSE2(coefficients, _mm_unpackhi_epi8(luma, zero),
+                          _mm_sub_epi16(_mm_unpackhi_epi8(blue, zero), bias),
+                          _mm_sub_epi16(_mm_unpackhi_epi8(red, zero), bias), &r_hi, &g_hi, &b_hi);
+
+        __m128i r = _mm_packus_epi16(r_lo, r_hi);
+        __m128i g = _mm_packus_epi16(g_lo, g_hi);
+        __m128i b = _mm_packus_epi16(b_lo, b_hi);
+
+        __m128i rg_lo = _mm_unpacklo_epi8(r, g), rg_hi = _mm_unpackhi_epi8(r, g);
+        __m128i ba_lo = _mm_unpacklo_epi8(b, alpha), ba_hi = _mm_unpackhi_epi8(b, alpha);
+        __m128i pixels[4] = {
+                _mm_unpacklo_epi16(rg_lo, ba_lo), _mm_unpackhi_epi16(rg_lo, ba_lo),
+                _mm_unpacklo_epi16(rg_hi, ba_hi), _mm_unpackhi_epi16(rg_hi, ba_hi),
+        };
+
+        if(channels == 4) {
+            for(unsigned int i = 0; i < 4; ++i) {
+                _mm_storeu_si128((__m128i*)(dest + i * 16), pixels[i]);
+            }
+            continue;
+        }
+
+        /* each store runs over into the next, bar the last which mustn't */
+        for(unsigned int i = 0; i < 3; ++i) {
+            _mm_storeu_si128((__m128i*)(dest + i * 12), PackRGBSSE2(pixels[i]));
+        }
+        __m128i last = PackRGBSSE2(pixels[3]);
+        _mm_storel_epi64((__m128i*)(dest + 36), last);
+        int32_t tail = _mm_cvtsi128_si32(_mm_srli_si128(last, 8));
+        memcpy(dest + 44, &tail, sizeof(int32_t));
+    }
+
+    ConvertYCbCrRowC(coefficients, y + x, cb + (x >> shift), cr + (x >> shift), dest, width - x, subsampling, channels);
+}
+
+/////////////////////////////////////////////////////////////////
+// AVX2
+
+/* Loads the chroma covering 32 pixels, repeated out to one for each. */
+__attribute__((target("avx2")))
+static PL_INLINE void LoadYCbCrChromaAVX2(const uint8_t *src, unsigned int subsampling, __m256i *lo, __m256i *hi) {
+    __m128i first, second;
+    if(subsampling == 1) {
+        first = _mm_loadu_si128((const __m128i*)src);
+        second = _mm_loadu_si128((const __m128i*)(src + 16));
+    } else {
+        __m128i chroma;
+        if(subsampling == 2) {
+            chroma = _mm_loadu_si128((const __m128i*)src);
+        } else {
+            chroma = _mm_loadl_epi64((const __m128i*)src);
+            chroma = _mm_unpacklo_epi8(chroma, chroma);
+        }
+        first = _mm_unpacklo_epi8(chroma, chroma);
+        second = _mm_unpackhi_epi8(chroma, chroma);
+    }
+
+    const __m256i bias = _mm256_set1_epi16(128);
+    *lo = _mm256_sub_epi16(_mm256_cvtepu8_epi16(first), bias);
+    *hi = _mm256_sub_epi16(_mm256_cvtepu8_epi16(second), bias);
+}
+
+/* As with SSE2, but for 16 pixels. Unpacking and packing again both
+ * work within each half, so the pixels end up back in order. */
+__attribute__((target("avx2")))
+static PL_INLINE void ConvertYCbCr16AVX2(const YCbCrCoefficients *coefficients, __m256i y, __m256i cb, __m256i cr,
+                                         __m256i *red, __m256i *green, __m256i *blue) {
+    const __m256i k_red = _mm256_set1_epi32(PairYCbCr(YCBCR_ONE, coefficients->cr_r));
+    const __m256i k_green = _mm256_set1_epi32(PairYCbCr(YCBCR_ONE, coefficients->cb_g));
+    const __m256i k_green_cr = _mm256_set1_epi32(PairYCbCr(coefficients->cr_g, 0));
+    const __m256i k_blue = _mm256_set1_epi32(PairYCbCr(YCBCR_ONE, coefficients->cb_b));
+    const __m256i half = _mm256_set1_epi32(YCBCR_HALF);
+    const __m256i zero = _mm256_setzero_si256();
+
+    __m256i y_cr_lo = _mm256_unpacklo_epi16(y, cr), y_cr_hi = _mm256_unpackhi_epi16(y, cr);
+    __m256i y_cb_lo = _mm256_unpacklo_epi16(y, cb), y_cb_hi = _mm256_unpackhi_epi16(y, cb);
+    __m256i cr_lo = _mm256_unpacklo_epi16(cr, zero), cr_hi = _mm256_unpackhi_epi16(cr, zero);
+
+    __m256i lo = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(y_cr_lo, k_red), half), YCBCR_SHIFT);
+    __m256i hi = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(y_cr_hi, k_red), half), YCBCR_SHIFT);
+    *red = _mm256_packs_epi32(lo, hi);
+
+    lo = _mm256_add_epi32(_mm256_madd_epi16(y_cb_lo, k_green), _mm256_madd_epi16(cr_lo, k_green_cr));
+    hi = _mm256_add_epi32(_mm256_madd_epi16(y_cb_hi, k_green), _mm256_madd_epi16(cr_hi, k_green_cr));
+    lo = _mm256_srai_epi32(_mm256_add_epi32(lo, half), YCBCR_SHIFT);
+    hi = _mm256_srai_epi32(_mm256_add_epi32(hi, half), YCBCR_SHIFT);
+    *green = _mm256_packs_epi32(lo, hi);
+
+    lo = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(y_cb_lo, k_blue), half), YCBCR_SHIFT);
+    hi = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(y_cb_hi, k_blue), half), YCBCR_SHIFT);
+    *blue = _mm256_packs_epi32(lo, hi);
+}
+
+/* Interleaves 16 pixels worth of each channel into 48 bytes of RGB. */
+__attribute__((target("avx2")))
+static PL_INLINE void StoreRGBAVX2(uint8_t *dest, __m128i r, __m128i g, __m128i b) {
+    const __m128i r0 = _mm_setr_epi8(0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1, 5);
+    const __m128i g0 = _mm_setr_epi8(-1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1);
+    const __m128i b0 = _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1);
+    const __m128i r1 = _mm_setr_epi8(-1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10, -1);
+    const __m128i g1 = _mm_setr_epi8(5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10);
+    const __m128i b1 = _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1);
+    const __m128i r2 = _mm_setr_epi8(-1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1);
+    const __m128i g2 = _mm_setr_epi8(-1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1);
+    const __m128i b2 = _mm_setr_epi8(10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15);
+
+    _mm_storeu_si128((__m128i*)dest, _mm_or_si128(_mm_or_si128(
+            _mm_shuffle_epi8(r, r0), _mm_shuffle_epi8(g, g0)), _mm_shuffle_epi8(b, b0)));
+    _mm_storeu_si128((__m128i*)(dest + 16), _mm_or_si128(_mm_or_si128(
+            _mm_shuffle_epi8(r, r1), _mm_shuffle_epi8(g, g1)), _mm_shuffle_epi8(b, b1)));
+    _mm_storeu_si128((__m128i*)(dest + 32), _mm_or_si128(_mm_or_si128(
+            _mm_shuffle_epi8(r, r2), _mm_shuffle_epi8(g, g2)), _mm_shuffle_epi8(b, b2)));
+}
+
+__attribute__((target("avx2")))
+static void ConvertYCbCrRowAVX2(const YCbCrCoefficients *coefficients, const uint8_t *y, const uint8_t *cb,
+                                const uint8_t *cr, uint8_t *dest, unsigned int width, unsigned int subsampling,
+                                unsigned int channels) {
+    const __m256i alpha = _mm256_set1_epi8((char)0xFF);
+    unsigned int shift = GetYCbCrShift(subsampling);
+
+    unsigned int x = 0;
+    for(; x + 32 <= width; x += 32, dest += 32 * channels) {
+        __m256i cb_lo, cb_hi, cr_lo, cr_hi;
+        LoadYCbCrChromaAVX2(cb + (x >> shift), subsampling, &cb_lo, &cb_hi);
+        LoadYCbCrChromaAVX2(cr + (x >> shift), subsampling, &cr_lo, &cr_hi);
+
+        __m256i r_lo, g_lo, b_lo, r_hi, g_hi, b_hi;
+        ConvertYCbCr16AVX2(coefficients, _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(y + x))),
+                           cb_lo, cr_lo, &r_lo, &g_lo, &b_lo);
+        ConvertYCbCr16AVX2(coefficients, _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(y + x + 16))),
+                           cb_hi, cr_hi, &r_hi, &g_hi, &b_hi);
+
+        /* packing interleaves the halves, so swap the middle two quarters back */
+        __m256i r = _mm256_permute4x64_epi64(_mm256_packus_epi16(r_lo, r_hi), 0xD8);
+        __m256i g = _mm256_permute4x64_epi64(_mm256_packus_epi16(g_lo, g_hi), 0xD8);
+        __m256i b = _mm256_permute4x64_epi64(_mm256_packus_epi16(b_lo, b_hi), 0xD8);
+
+        if(channels == 3) {
+            StoreRGBAVX2(dest, _mm256_castsi256_si128(r), _mm256_castsi256_si128(g), _mm256_castsi256_si128(b));
+            StoreRGBAVX2(dest + 48, _mm256_extracti128_si256(r, 1), _mm256_extracti128_si256(g, 1),
+                         _mm256_extracti128_si256(b, 1));
+            continue;
+        }
+
+        __m256i rg_lo = _mm256_unpacklo_epi8(r, g), rg_hi = _mm256_unpackhi_epi8(r, g);
+        __m256i ba_lo = _mm256_unpacklo_epi8(b, alpha), ba_hi = _mm256_unpackhi_epi8(b, alpha);
+        __m256i p0 = _mm256_unpacklo_epi16(rg_lo, ba_lo), p1 = _mm256_unpackhi_epi16(rg_lo, ba_lo);
+        __m256i p2 = _mm256_unpacklo_epi16(rg_hi, ba_hi), p3 = _mm256_unpackhi_epi16(rg_hi, ba_hi);
+        _mm256_storeu_si256((__m256i*)dest, _mm256_permute2x128_si256(p0, p1, 0x20));
+        _mm256_storeu_si256((__m256i*)(dest + 32), _mm256_permute2x128_si256(p2, p3, 0x20));
+        _mm256_storeu_si256((__m256i*)(dest + 64), _mm256_permute2x128_si256(p0, p1, 0x31));
+        _mm256_storeu_si256((__m256i*)(dest + 96), _mm256_permute2x128_si256(p2, p3, 0x31));
+    }
+
+    ConvertYCbCrRowC(coefficients, y + x, cb + (x >> shift), cr + (x >> shift), dest, width - x, subsampling, channels);
+}
+
+#endif
+
+/////////////////////////////////////////////////////////////////
+
+typedef void (*YCbCrRowFunction)(const YCbCrCoefficients *coefficients, const uint8_t *y, const uint8_t *cb,
+                                 const uint8_t *cr, uint8_t *dest, unsigned int width, unsigned int subsampling,
+                                 unsigned int channels);
+
+static YCbCrRowFunction ConvertYCbCrRowKernel = ConvertYCbCrRowC;
+
+static void SetupYCbCrKernel(void) {
+#if defined(YCBCR_X86)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) {
+        ConvertYCbCrRowKernel = ConvertYCbCrRowAVX2;
+    } else if(__builtin_cpu_supports("sse2")) {
+        ConvertYCbCrRowKernel = ConvertYCbCrRowSSE2;
+    }
+#endif
+}
+
+/* Converts a row of width pixels to RGB, or RGBA if there are 4 channels.
+ * Chroma is given for every 1, 2 or 4 pixels across, as set by subsampling. */
+void ConvertYCbCrRow(const YCbCrCoefficients *coefficients, const uint8_t *y, const uint8_t *cb, const uint8_t *cr,
+                     uint8_t *dest, unsigned int width, unsigned int subsampling, unsigned int channels) {
+    static PLImageOnce once = PL_IMAGE_ONCE_INIT;
+    CallImageOnce(&once, SetupYCbCrKernel);
+
+    plAssert(subsampling == 1 || subsampling == 2 || subsampling == 4);
+    plAssert(channels == 3 || channels == 4);
+
+    ConvertYCbCrRowKernel(coefficients, y, cb, cr, dest, width, subsampling, channels);
+}
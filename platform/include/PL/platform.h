@@ -211,6 +211,8 @@ PL_EXTERN_C
 PLresult InitGraphics(void);
 void ShutdownGraphics(void);
 
+void ShutdownImage(void);
+
 PLresult _plInitIO(void);
 void _plShutdownIO(void);
 
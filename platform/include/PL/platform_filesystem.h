@@ -48,6 +48,14 @@ PL_EXTERN const char *plGetFileName(const char *path);
 
 PL_EXTERN void plScanDirectory(const char *path, const char *extension, void (*Function)(const char *), bool recursive);
 
+enum PLWalkFlag {
+    PL_WALKFLAG_RECURSIVE   = (1 << 0),     // Walk through every subdirectory too
+    PL_WALKFLAG_THREADED    = (1 << 1),     // Subdirectories are spread across threads, so the function must be thread-safe
+};
+
+PL_EXTERN void plWalkDirectory(const char *path, const char *extension,
+                               void (*Function)(const char *path, void *user), void *user, unsigned int flags);
+
 PL_EXTERN bool plCreateDirectory(const char *path);
 PL_EXTERN bool plCreatePath(const char *path);
 
@@ -57,6 +65,8 @@ PL_EXTERN bool plFileExists(const char *path);
 PL_EXTERN bool plPathExists(const char *path);
 
 PL_EXTERN bool plCopyFile(const char *path, const char *dest);
+PL_EXTERN bool plCopyFileWithProgress(const char *path, const char *dest,
+                                      bool (*Progress)(size_t copied, size_t total, void *user), void *user);
 PL_EXTERN bool plDeleteFile(const char *path);
 
 PL_EXTERN bool plIsFileModified(time_t oldtime, const char *path);
@@ -65,7 +75,145 @@ PL_EXTERN time_t plGetFileModifiedTime(const char *path);
 
 PL_EXTERN size_t plGetFileSize(const char *path);
 
+// Path Resolution ...
+
+/* Looks up the real path of anything on disk regardless of the case it's
+ * given in, caching each directory's listing on first use so that later
+ * lookups don't touch the disk. A directory's listing is only checked for
+ * changes, by its modified time, when a lookup within it fails. */
+PL_EXTERN bool plResolvePath(const char *path, char *dest, size_t length);
+PL_EXTERN void plInvalidatePathCache(const char *path);
+
+// File Watching ...
+
+enum PLWatchEventFlag {
+    PL_WATCHEVENT_MODIFIED  = (1 << 0),
+    PL_WATCHEVENT_CREATED   = (1 << 1),     // Also set when a file is moved or renamed over the path
+    PL_WATCHEVENT_DELETED   = (1 << 2),
+    PL_WATCHEVENT_OVERFLOW  = (1 << 3),     // Events were dropped, anything watched may have changed
+};
+
+typedef struct PLFileWatchEvent {
+    char path[PL_SYSTEM_MAX_PATH];
+    unsigned int events;    // Everything that's happened to the path since it was last polled
+} PLFileWatchEvent;
+
+typedef struct PLFileWatch PLFileWatch;
+
+PL_EXTERN PLFileWatch *plCreateFileWatch(void);
+PL_EXTERN void plDeleteFileWatch(PLFileWatch *watch);
+
+PL_EXTERN bool plAddFileWatch(PLFileWatch *watch, const char *path);
+PL_EXTERN void plRemoveFileWatch(PLFileWatch *watch, const char *path);
+
+PL_EXTERN unsigned int plPollFileWatch(PLFileWatch *watch, PLFileWatchEvent *events, unsigned int max_events);
+
 PL_EXTERN int16_t plGetLittleShort(FILE *fin);
 PL_EXTERN int32_t plGetLittleLong(FILE *fin);
 
+// Binary Reading ...
+
+/* Reads through a block of memory, a mapped file or a file through a large
+ * buffer, so that parsing a format doesn't mean a call into libc for each
+ * field. Reading beyond the end sets error and returns zeroes from then on,
+ * so a whole header can be read in and the error checked once at the end.
+ */
+typedef struct PLBinaryReader {
+    const uint8_t *data;    // What's currently available to read
+    size_t size;            // Number of bytes available within data
+    size_t position;        // Position within data
+
+    size_t offset;          // Where data begins within the source
+    size_t length;          // Length of the source, in bytes
+
+    /* only used for buffered files */
+    FILE *file;
+    bool owns_file;
+    uint8_t *buffer;
+    size_t buffer_size;
+
+    /* only used for mapped files */
+    uint8_t *mapping;
+    size_t mapping_size;
+
+    bool error;
+} PLBinaryReader;
+
+PL_EXTERN void plSetupBinaryReader(PLBinaryReader *reader, const void *data, size_t length);
+PL_EXTERN bool plSetupBinaryReaderFile(PLBinaryReader *reader, FILE *file);
+PL_EXTERN bool plOpenBinaryReader(PLBinaryReader *reader, const char *path, bool map);
+PL_EXTERN void plCloseBinaryReader(PLBinaryReader *reader);
+
+PL_EXTERN size_t plGetBinaryReaderOffset(const PLBinaryReader *reader);
+PL_EXTERN bool plSeekBinaryReader(PLBinaryReader *reader, size_t offset);
+PL_EXTERN bool plSkipBinaryReader(PLBinaryReader *reader, size_t length);
+
+PL_EXTERN bool plReadBinary(PLBinaryReader *reader, void *dest, size_t length);
+PL_EXTERN const uint8_t *plGetBinaryReaderData(PLBinaryReader *reader, size_t length);
+
+PL_EXTERN bool plReadBinaryLittleUInt16Array(PLBinaryReader *reader, uint16_t *dest, size_t count);
+PL_EXTERN bool plReadBinaryLittleUInt32Array(PLBinaryReader *reader, uint32_t *dest, size_t count);
+PL_EXTERN bool plReadBinaryBigUInt16Array(PLBinaryReader *reader, uint16_t *dest, size_t count);
+PL_EXTERN bool plReadBinaryBigUInt32Array(PLBinaryReader *reader, uint32_t *dest, size_t count);
+
 PL_EXTERN_C_END
+
+/* Returns a pointer to the next few bytes, either straight out of what's
+ * available or copied into tmp if they run over, or NULL past the end or
+ * once the reader has failed, just as plReadBinary does. */
+static PL_INLINE const uint8_t *_plReadBinaryBytes(PLBinaryReader *reader, uint8_t *tmp, size_t length) {
+    if(!reader->error && reader->size - reader->position >= length) {
+        const uint8_t *bytes = reader->data + reader->position;
+        reader->position += length;
+        return bytes;
+    }
+
+    return plReadBinary(reader, tmp, length) ? tmp : NULL;
+}
+
+static PL_INLINE uint8_t plReadBinaryUInt8(PLBinaryReader *reader) {
+    uint8_t tmp[1];
+    const uint8_t *b = _plReadBinaryBytes(reader, tmp, 1);
+    return (b != NULL) ? b[0] : 0;
+}
+
+static PL_INLINE uint16_t plReadBinaryLittleUInt16(PLBinaryReader *reader) {
+    uint8_t tmp[2];
+    const uint8_t *b = _plReadBinaryBytes(reader, tmp, 2);
+    return (b != NULL) ? (uint16_t)(b[0] | (b[1] << 8)) : 0;
+}
+
+static PL_INLINE uint32_t plReadBinaryLittleUInt32(PLBinaryReader *reader) {
+    uint8_t tmp[4];
+    const uint8_t *b = _plReadBinaryBytes(reader, tmp, 4);
+    return (b != NULL) ? ((uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24)) : 0;
+}
+
+static PL_INLINE uint64_t plReadBinaryLittleUInt64(PLBinaryReader *reader) {
+    uint64_t low = plReadBinaryLittleUInt32(reader);
+    return low | ((uint64_t)plReadBinaryLittleUInt32(reader) << 32);
+}
+
+static PL_INLINE uint16_t plReadBinaryBigUInt16(PLBinaryReader *reader) {
+    uint8_t tmp[2];
+    const uint8_t *b = _plReadBinaryBytes(reader, tmp, 2);
+    return (b != NULL) ? (uint16_t)((b[0] << 8) | b[1]) : 0;
+}
+
+static PL_INLINE uint32_t plReadBinaryBigUInt32(PLBinaryReader *reader) {
+    uint8_t tmp[4];
+    const uint8_t *b = _plReadBinaryBytes(reader, tmp, 4);
+    return (b != NULL) ? (((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 8) | (uint32_t)b[3]) : 0;
+}
+
+static PL_INLINE uint64_t plReadBinaryBigUInt64(PLBinaryReader *reader) {
+    uint64_t high = plReadBinaryBigUInt32(reader);
+    return (high << 32) | plReadBinaryBigUInt32(reader);
+}
+
+static PL_INLINE float plReadBinaryLittleFloat32(PLBinaryReader *reader) {
+    uint32_t bits = plReadBinaryLittleUInt32(reader);
+    float f;
+    memcpy(&f, &bits, sizeof(float));
+    return f;
+}
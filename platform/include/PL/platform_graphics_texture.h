@@ -62,7 +62,8 @@ typedef enum PLTextureTarget {
 } PLTextureTarget;
 
 enum PLTextureFlag {
-    PL_TEXTUREFLAG_PRESERVE = (1 << 0)
+    PL_TEXTUREFLAG_PRESERVE = (1 << 0),
+    PL_TEXTUREFLAG_COMPRESS = (1 << 1),     // Uncompressed images are compressed to S3TC as they're uploaded
 };
 
 typedef struct PLTextureMappingUnit {
@@ -27,6 +27,7 @@ For more information, please refer to <http://unlicense.org>
 #pragma once
 
 #include "platform.h"
+#include "platform_filesystem.h"
 
 typedef enum PLImageFormat {
     PL_IMAGEFORMAT_UNKNOWN,
@@ -47,7 +48,12 @@ typedef enum PLImageFormat {
     PL_IMAGEFORMAT_RGBA_DXT3,
     PL_IMAGEFORMAT_RGBA_DXT5,
 
-    PL_IMAGEFORMAT_RGB_FXT1
+    PL_IMAGEFORMAT_RGB_FXT1,
+
+    PL_IMAGEFORMAT_L1,        // 1, packed from the most significant bit down with each row padded out to a byte
+    PL_IMAGEFORMAT_L8,        // 8
+
+    PL_IMAGEFORMAT_RGBA32F,   // 32 32 32 32
 } PLImageFormat;
 
 typedef enum PLColourFormat {
@@ -57,8 +63,16 @@ typedef enum PLColourFormat {
     PL_COLOURFORMAT_BGR,
     PL_COLOURFORMAT_RGBA,
     PL_COLOURFORMAT_BGRA,
+    PL_COLOURFORMAT_L,      // Luminance, from black up to white
 } PLColourFormat;
 
+/* How much effort goes into compressing an image, trading speed for quality */
+typedef enum PLCompressionQuality {
+    PL_COMPRESSIONQUALITY_FAST,     // Endpoints taken from the bounds of each block
+    PL_COMPRESSIONQUALITY_NORMAL,   // Taken along the principal axis, then refit once
+    PL_COMPRESSIONQUALITY_HIGH,     // Refit until it stops getting better, and both DXT5 alpha modes tried
+} PLCompressionQuality;
+
 typedef struct PLImage {
 #if 1
     uint8_t **data;
@@ -85,45 +99,124 @@ typedef struct PLImage {
 #define PLIMAGE_EXTENSION_KTX   "ktx"
 #define PLIMAGE_EXTENSION_TGA   "tga"
 #define PLIMAGE_EXTENSION_PNG   "png"
+#define PLIMAGE_EXTENSION_JPG   "jpg"
 #define PLIMAGE_EXTENSION_DDS   "dds"
 #define PLIMAGE_EXTENSION_VTF   "vtf"   // Valve Texture Format (Source Engine)
+#define PLIMAGE_EXTENSION_TIFF  "tif"
 
 PL_EXTERN_C
 
 
 
+/* Images within a package are given as the path to the package
+ * followed by the name of the entry, e.g. example/package.wad:myimage */
 PL_EXTERN bool plLoadImage(const char *path, PLImage *out);
 PL_EXTERN PLresult plLoadImagef(FILE *fin, const char *path, PLImage *out);
+PL_EXTERN PLresult plLoadImageFromMemory(const uint8_t *data, size_t length, const char *path, PLImage *out);
 PL_EXTERN PLresult plWriteImage(const PLImage *image, const char *path);
 
+#define PL_MAX_IMAGE_CODECS         32
+#define PL_MAX_IMAGE_MAGIC_LENGTH   16
+
+/* Adds a format for plLoadImage to pick up on. An image is handed to the first
+ * codec whose magic matches the start of it, positioned just past the magic,
+ * or failing that the first without any magic whose extension matches. */
+PL_EXTERN bool plRegisterImageCodec(const char *extension, const uint8_t *magic, unsigned int magic_length,
+                                    PLresult (*LoadImage)(PLBinaryReader *reader, PLImage *out));
+
 PL_EXTERN unsigned int plGetSamplesPerPixel(PLColourFormat format);
 
+/* Converts every level of the image, with its channels stored in the order of
+ * the given colour format, which has to have as many as the image format does.
+ * Packed formats (RGB4 through to RGB565) are little-endian 16-bit words holding
+ * the channels from the least significant bit up, so RGB565 as BGR has blue in
+ * the bottom five bits. S3TC is always RGB or RGBA, and is compressed at normal
+ * quality. plConvertPixelFormat keeps to the order the image is already in, only
+ * adding or dropping alpha. */
+PL_EXTERN bool plConvertImageFormat(PLImage *image, PLImageFormat format, PLColourFormat colour_format);
 bool plConvertPixelFormat(PLImage *image, PLImageFormat new_format);
 
+/* Compresses every level of the image to one of the S3TC formats, spread out
+ * over as many threads as there are processors for any of a decent size. */
+PL_EXTERN bool plCompressImage(PLImage *image, PLImageFormat format, PLCompressionQuality quality);
+
 PL_EXTERN bool plIsValidImageSize(unsigned int width, unsigned int height);
 PL_EXTERN bool plIsCompressedImageFormat(PLImageFormat format);
 
 #if defined(PL_INTERNAL)
 
+#if !defined(_WIN32)
+#   include <pthread.h>
+#endif
+
+/* For setting up tables and picking kernels the once, however
+ * many threads happen to be loading images at the time */
+#if !defined(_WIN32)
+typedef pthread_once_t PLImageOnce;
+#   define PL_IMAGE_ONCE_INIT PTHREAD_ONCE_INIT
+#else
+typedef INIT_ONCE PLImageOnce;
+#   define PL_IMAGE_ONCE_INIT INIT_ONCE_STATIC_INIT
+#endif
+
+void CallImageOnce(PLImageOnce *once, void (*Setup)(void));
+
 void plFreeImage(PLImage *image);
 
 unsigned int _plGetImageSize(PLImageFormat format, unsigned int width, unsigned int height);
 
-bool DDSFormatCheck(FILE *fin);
-bool _plDTXFormatCheck(FILE *fin);
-bool _plVTFFormatCheck(FILE *fin);
-bool TIMFormatCheck(FILE *fin);
-bool _plBMPFormatCheck(FILE *fin);
-
-PLresult _plLoadFTXImage(FILE *fin, PLImage *out);           // Ritual's FTX image format.
-PLresult _plLoadPPMImage(FILE *fin, PLImage *out);           // Portable Pixel Map format.
-PLresult _plLoadDTXImage(FILE *fin, PLImage *out);           // Lithtech's DTX image format.
-PLresult _plLoadVTFImage(FILE *fin, PLImage *out);           // Valve's VTF image format.
-PLresult LoadDDSImage(FILE *fin, PLImage *out);
-PLresult LoadTIMImage(FILE *fin, PLImage *out);
-PLresult _plLoadBMPImage(FILE *fin, PLImage *out);
-
-uint8_t *_plImageDataRGB5A1toRGBA8(const uint8_t *src, size_t n_pixels);
+PLresult _plLoadFTXImage(PLBinaryReader *reader, PLImage *out);  // Ritual's FTX image format.
+PLresult _plLoadPPMImage(PLBinaryReader *reader, PLImage *out);  // Portable Pixel Map format.
+PLresult _plLoadDTXImage(PLBinaryReader *reader, PLImage *out);  // Lithtech's DTX image format.
+PLresult _plLoadVTFImage(PLBinaryReader *reader, PLImage *out);  // Valve's VTF image format.
+PLresult LoadDDSImage(PLBinaryReader *reader, PLImage *out);
+PLresult LoadTIMImage(PLBinaryReader *reader, PLImage *out);
+PLresult _plLoadBMPImage(PLBinaryReader *reader, PLImage *out);
+PLresult LoadSTBImage(PLBinaryReader *reader, PLImage *out);        // PNG, JPEG and TGA
+PLresult LoadTIFFImage(PLBinaryReader *reader, PLImage *out);
+
+uint8_t *DecodeSTBImage(const uint8_t *data, size_t length, unsigned int channels,
+                        unsigned int *width, unsigned int *height);
+
+/* CCITT fax coding, as found within TIFF */
+typedef enum CCITTCoding {
+    CCITT_CODING_RLE,   // Modified Huffman, each row starting on a new byte
+    CCITT_CODING_G3,    // T.4, rows may also be coded relative to the last, see CCITT_OPTION_2D
+    CCITT_CODING_G4,    // T.6, every row is coded relative to the last
+} CCITTCoding;
+
+#define CCITT_OPTION_2D     (1 << 0)    // Group 3 rows are tagged as either 1D or 2D
+
+bool DecodeCCITTImage(const uint8_t *src, size_t length, CCITTCoding coding, unsigned int options,
+                      unsigned int width, unsigned int rows, uint8_t *dest, size_t pitch);
+
+/* Fixed point, see SetupYCbCrCoefficients */
+typedef struct YCbCrCoefficients {
+    int16_t cr_r, cb_g, cr_g, cb_b;
+} YCbCrCoefficients;
+
+bool SetupYCbCrCoefficients(YCbCrCoefficients *coefficients, float luma_red, float luma_green, float luma_blue);
+void ConvertYCbCrRow(const YCbCrCoefficients *coefficients, const uint8_t *y, const uint8_t *cb, const uint8_t *cr,
+                     uint8_t *dest, unsigned int width, unsigned int subsampling, unsigned int channels);
+
+/* Between RGBA8, RGBA16, RGBA16F and RGBA32F */
+bool CanConvertHDRPixels(PLImageFormat from, PLImageFormat to);
+void ConvertHDRPixels(const uint8_t *src, PLImageFormat from, uint8_t *dest, PLImageFormat to, size_t count);
+
+void ConvertHalfToFloat(const uint16_t *src, float *dest, size_t count);
+void ConvertFloatToHalf(const float *src, uint16_t *dest, size_t count);
+
+/* LogLuv high dynamic range TIFFs, each to a row of RGBA floats */
+void ConvertLogLRow(const uint16_t *src, float *dest, unsigned int width);
+void ConvertLogLuv24Row(const uint8_t *src, float *dest, unsigned int width);
+void ConvertLogLuv32Row(const uint32_t *src, float *dest, unsigned int width);
+
+/* S3TC, otherwise known as DXT, a row of 4x4 blocks at a time to and from RGBA8 */
+unsigned int GetS3TCBlockSize(PLImageFormat format);
+void DecodeS3TCBlocks(const uint8_t *src, PLImageFormat format, uint8_t *dest, size_t pitch,
+                      unsigned int width, unsigned int rows);
+void EncodeS3TCBlocks(const uint8_t *src, size_t pitch, unsigned int width, unsigned int rows, uint8_t *dest,
+                      PLImageFormat format, PLCompressionQuality quality);
 
 #endif
 
@@ -29,26 +29,131 @@ For more information, please refer to <http://unlicense.org>
 
 #include <PL/platform.h>
 
+enum PLPackageFlag {
+    PL_PACKAGEFLAG_CACHE    = (1 << 0),     // Load in the data for every entry up front
+    PL_PACKAGEFLAG_MAP      = (1 << 1),     // Map the package into memory, entries point directly into it
+    PL_PACKAGEFLAG_NOCASE   = (1 << 2),     // Entry names are looked up without regard for case
+};
+
+/* How an entry's data is stored within a native package */
+typedef enum PLPackageCompression {
+    PL_PACKAGECOMPRESSION_NONE,
+    PL_PACKAGECOMPRESSION_DEFLATE,  // Split into blocks that are deflated independently, requires zlib
+} PLPackageCompression;
+
 typedef struct PLPackageIndex {
     char name[256];
     size_t length;
     size_t offset;
 
+    size_t stored_length;       // Length of the data within the package, only set if compressed
+    unsigned int compression;   // See PLPackageCompression
+
+    uint32_t hash;  // Hash of the entry name, see PL_PACKAGEFLAG_NOCASE
+
     uint8_t *data;
+
+    /* neighbours in the package's cache, +1, 0 for none */
+    unsigned int cache_prev, cache_next;
+
+    bool loading;   // Set while a thread is reading the data in
+    unsigned int pins;  // Loads yet to be released, see plReleasePackageFile
 } PLPackageIndex;
 
+/* Entries loaded on demand are tracked from most to least
+ * recently used, so that once the budget is exceeded the
+ * least recently used can be thrown away again */
+typedef struct PLPackageCache {
+    size_t budget;  // Maximum number of bytes to hold onto, 0 for no limit
+    size_t size;    // Number of bytes currently held
+
+    unsigned long hits, misses, evictions;
+
+    unsigned int head, tail;    // Most and least recently used entries, +1, 0 for none
+} PLPackageCache;
+
+struct PLPackageIO;
+
 typedef struct PLPackage {
     char path[PL_SYSTEM_MAX_PATH];
 
     unsigned int table_size;
     PLPackageIndex *table;
+
+    /* open-addressed table of indices into the above (+1, 0 marks
+     * an empty slot), built on load so lookups don't walk the table */
+    uint32_t *hash_table;
+    unsigned int hash_table_size;
+
+    unsigned int flags;
+    unsigned int compression;   // Used for every entry when written out, see plSetPackageCompression
+
+    PLPackageCache cache;
+
+    /* reads in and returns a newly allocated copy of the data for
+     * the given entry, may be called from any number of threads */
+    uint8_t *(*LoadFile)(struct PLPackage *package, const PLPackageIndex *pi);
+
+    struct PLPackageIO *io; // handle and lock used for loading entries
+
+    /* only used if the package was loaded with PL_PACKAGEFLAG_MAP,
+     * entry data then points into this rather than being allocated */
+    uint8_t *mapping;
+    size_t mapping_size;
 } PLPackage;
 
 PL_EXTERN_C
 
-PL_EXTERN PLPackage *plLoadPackage(const char *path, bool cache);
+PL_EXTERN PLPackage *plLoadPackage(const char *path, unsigned int flags);
 PL_EXTERN void plDeletePackage(PLPackage *package);
 
+/* Entries can be loaded from any number of threads at once,
+ * each is only ever read in once however many ask for it. The
+ * data stays put until it's released again, once for each file
+ * that was loaded, however much the cache is over its budget */
+PL_EXTERN bool plLoadPackageFile(PLPackage *package, const char *file, const uint8_t **data, size_t *size);
+PL_EXTERN bool plLoadPackageFiles(PLPackage *package, const char **files, unsigned int num_files, const uint8_t **data, size_t *sizes);
+PL_EXTERN void plReleasePackageFile(PLPackage *package, const char *file);
+PL_EXTERN void plReleasePackageFiles(PLPackage *package, const char **files, unsigned int num_files);
+
+/* Copies part of an entry into dest without loading in the rest of it,
+ * for compressed entries only the blocks covering the range are inflated */
+PL_EXTERN bool plReadPackageFileRange(PLPackage *package, const char *file, size_t offset, size_t length, uint8_t *dest);
+
+/* Once a budget is set, entries are thrown away least recently used
+ * first to stay within it, though never while they're still held onto */
+PL_EXTERN void plSetPackageCacheBudget(PLPackage *package, size_t budget);
+PL_EXTERN void plSetDefaultPackageCacheBudget(size_t budget);
+
+/* Mounted packages are searched as one, through a single merged index, with
+ * higher priorities taking precedence and later mounts winning out over any
+ * earlier ones of the same priority. Packages are unmounted on deletion.
+ * Mounting and unmounting can go on while other threads are loading mounted
+ * files, though a package from plGetMountedPackage is only good until it's
+ * unmounted. Mounted files are released with the data that was loaded, and
+ * any still held when their package is unmounted stay put until it's deleted.
+ * Any entries appended after mounting aren't seen until it's remounted.
+ *
+ * Each lookup matches by the rules of the package being looked in, so the
+ * same names differing only in case are kept apart in packages without
+ * PL_PACKAGEFLAG_NOCASE. A name in a higher package with the flag set hides
+ * every spelling of it in those below, as it would if looked up directly.
+ * plLoadMountedFileFrom only loads the file if it'd come from the package
+ * at the given path, checked under the same lock as the load itself */
+PL_EXTERN bool plMountPackage(PLPackage *package, int priority);
+PL_EXTERN void plUnmountPackage(PLPackage *package);
+
+PL_EXTERN PLPackage *plGetMountedPackage(const char *file);
+PL_EXTERN bool plLoadMountedFile(const char *file, const uint8_t **data, size_t *size);
+PL_EXTERN bool plLoadMountedFileFrom(const char *path, const char *file, const uint8_t **data, size_t *size);
+PL_EXTERN void plReleaseMountedFile(const char *file, const uint8_t *data);
+
+/* Not safe to call while other threads are loading from the package. Only
+ * packages created here or loaded from our own format can be written back out,
+ * and not while anything mapped in from them is still held onto */
 PL_EXTERN PLPackage *plCreatePackage(const char *dest);
+PL_EXTERN bool plAppendPackageFile(PLPackage *package, const char *name, const uint8_t *data, size_t size);
+PL_EXTERN bool plSetPackageCompression(PLPackage *package, unsigned int compression);
+PL_EXTERN bool plWritePackage(PLPackage *package);
 
 PL_EXTERN_C_END
\ No newline at end of file
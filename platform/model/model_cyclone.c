@@ -71,7 +71,8 @@ enum {
  *  7E71413F 4C1E0DBC 9F3CA83F
  */
 
-typedef struct __attribute__((packed)) MDLVertex {
+/* 12 bytes as stored, each coord little-endian */
+typedef struct MDLVertex {
     uint8_t unknown0[2];
     int16_t x;
     uint8_t unknown1[2];
@@ -94,7 +95,7 @@ typedef struct __attribute__((packed)) MDLVertex {
 
 typedef struct MDLFace {
     uint8_t num_indices;
-    uint16_t indices[5];
+    uint16_t indices[MAX_INDICES_PER_FACE];
 } MDLFace;
 
 #if 0
@@ -113,9 +114,8 @@ typedef struct MDLFace {
 /////////////////////////////////////////////////////////////////
 
 PLModel *_plLoadRequiemModel(const char *path) {
-    FILE *file = fopen(path, "rb");
-    if(file == NULL) {
-        ReportError(PL_RESULT_FILEREAD, plGetResultString(PL_RESULT_FILEREAD));
+    PLBinaryReader reader;
+    if(!plOpenBinaryReader(&reader, path, true)) {
         return NULL;
     }
 
@@ -123,16 +123,16 @@ PLModel *_plLoadRequiemModel(const char *path) {
 
     _plDebugPrint("%s\n", path);
 
-#define AbortLoad(...) _plDebugPrint(__VA_ARGS__); ReportError(PL_RESULT_FILEREAD, __VA_ARGS__); fclose(file)
+#define AbortLoad(...) _plDebugPrint(__VA_ARGS__); ReportError(PL_RESULT_FILEREAD, __VA_ARGS__); plCloseBinaryReader(&reader)
 
     // check which flags have been set for this particular mesh
-    int flags = fgetc(file);
+    int flags = plReadBinaryUInt8(&reader);
     if(flags & MDL_FLAG_FLAT) {} // flat
     if(flags & MDL_FLAG_UNLIT) {} // unlit
     if(!(flags & MDL_FLAG_FLAT) && !(flags & MDL_FLAG_UNLIT)) {} // shaded
 
-    uint32_t texture_name_length = 0;
-    if(fread(&texture_name_length, sizeof(uint32_t), 1, file) != 1) {
+    uint32_t texture_name_length = plReadBinaryLittleUInt32(&reader);
+    if(reader.error) {
         AbortLoad("Invalid file length, failed to get texture name length!\n");
         return NULL;
     }
@@ -142,24 +142,19 @@ PLModel *_plLoadRequiemModel(const char *path) {
         return NULL;
     }
 
-    char texture_name[texture_name_length];
-    if(fread(texture_name, sizeof(char), texture_name_length, file) != texture_name_length) {
+    char texture_name[texture_name_length + 1];
+    if(!plReadBinary(&reader, texture_name, texture_name_length)) {
         AbortLoad("Invalid file length, failed to get texture name!\n");
         return NULL;
     }
+    texture_name[texture_name_length] = '\0';
 
-    uint16_t num_vertices;
-    if(fread(&num_vertices, sizeof(uint16_t), 1, file) != 1) {
-        AbortLoad("Invalid file length, failed to get number of vertices!\n");
-        return NULL;
-    }
-
+    uint16_t num_vertices = plReadBinaryLittleUInt16(&reader);
     // todo, figure out these two unknown bytes, quads? iirc (we did discuss this)
-    fseek(file, 2, SEEK_CUR);
-
-    uint32_t num_faces;
-    if(fread(&num_faces, sizeof(uint32_t), 1, file) != 1) {
-        AbortLoad("Invalid file length, failed to get number of faces!\n");
+    plSkipBinaryReader(&reader, 2);
+    uint32_t num_faces = plReadBinaryLittleUInt32(&reader);
+    if(reader.error) {
+        AbortLoad("Invalid file length, failed to get number of vertices and faces!\n");
         return NULL;
     }
 
@@ -169,7 +164,16 @@ PLModel *_plLoadRequiemModel(const char *path) {
     }
 
     MDLVertex vertices[num_vertices];
-    if(fread(vertices, sizeof(MDLVertex), num_vertices, file) != num_vertices) {
+    for(unsigned int i = 0; i < num_vertices; ++i) {
+        plReadBinary(&reader, vertices[i].unknown0, sizeof(vertices[i].unknown0));
+        vertices[i].x = (int16_t)plReadBinaryLittleUInt16(&reader);
+        plReadBinary(&reader, vertices[i].unknown1, sizeof(vertices[i].unknown1));
+        vertices[i].y = (int16_t)plReadBinaryLittleUInt16(&reader);
+        plReadBinary(&reader, vertices[i].unknown2, sizeof(vertices[i].unknown2));
+        vertices[i].z = (int16_t)plReadBinaryLittleUInt16(&reader);
+    }
+
+    if(reader.error) {
         AbortLoad("Invalid file length, failed to load vertices!\n");
         return NULL;
     }
@@ -178,41 +182,48 @@ PLModel *_plLoadRequiemModel(const char *path) {
     MDLFace faces[num_faces];
     memset(faces, 0, sizeof(MDLFace) * num_faces);
     for(unsigned int i = 0; i < num_faces; ++i) {
-        long pos = ftell(file);
-        if(fread(&faces[i].num_indices, sizeof(uint32_t), 1, file) != 1) {
-            AbortLoad("Invalid file length, failed to load number of indices! (offset: %ld)\n", ftell(file));
+        size_t pos = plGetBinaryReaderOffset(&reader);
+        uint32_t num_indices = plReadBinaryLittleUInt32(&reader);
+        if(reader.error) {
+            AbortLoad("Invalid file length, failed to load number of indices! (offset: %lu)\n", (unsigned long)pos);
             return NULL;
         }
 
-        if(faces[i].num_indices < MIN_INDICES_PER_FACE || faces[i].num_indices > MAX_INDICES_PER_FACE) {
-            AbortLoad("Invalid number of indices, %d, required for face %d! (offset: %ld)\n",
-                      faces[i].num_indices, i, ftell(file));
+        if(num_indices < MIN_INDICES_PER_FACE || num_indices > MAX_INDICES_PER_FACE) {
+            AbortLoad("Invalid number of indices, %u, required for face %d! (offset: %lu)\n",
+                      num_indices, i, (unsigned long)plGetBinaryReaderOffset(&reader));
             return NULL;
         }
 
+        faces[i].num_indices = (uint8_t)num_indices;
         num_triangles += faces[i].num_indices - 2;
 
-        fseek(file, 16, SEEK_CUR); // todo, figure these out
-        if(fread(faces[i].indices, sizeof(uint16_t), faces[i].num_indices, file) != faces[i].num_indices) {
+        plSkipBinaryReader(&reader, 16); // todo, figure these out
+        if(!plReadBinaryLittleUInt16Array(&reader, faces[i].indices, faces[i].num_indices)) {
             AbortLoad("Invalid file length, failed to load indices!\n");
             return NULL;
         }
 
         if(faces[i].num_indices == 6) {
-            fseek(file, 54, SEEK_CUR); // skip over unknown bytes for now
+            plSkipBinaryReader(&reader, 54); // skip over unknown bytes for now
         } else if(faces[i].num_indices == 5) {
-            fseek(file, 42, SEEK_CUR); // skip over unknown bytes for now
+            plSkipBinaryReader(&reader, 42); // skip over unknown bytes for now
         } else if(faces[i].num_indices == 4) {
-            fseek(file, 32, SEEK_CUR); // skip over unknown bytes for now
+            plSkipBinaryReader(&reader, 32); // skip over unknown bytes for now
         } else if(faces[i].num_indices == 3) {
-            fseek(file, 24, SEEK_CUR); // skip over unknown bytes for now
+            plSkipBinaryReader(&reader, 24); // skip over unknown bytes for now
         }
 
-        long npos = ftell(file);
-        _plDebugPrint(" Read %ld bytes for face %d (indices %d)\n", npos - pos, i, faces[i].num_indices);
+        size_t npos = plGetBinaryReaderOffset(&reader);
+        _plDebugPrint(" Read %lu bytes for face %d (indices %d)\n", (unsigned long)(npos - pos), i, faces[i].num_indices);
+    }
+
+    if(reader.error) {
+        AbortLoad("Invalid file length, failed to load faces!\n");
+        return NULL;
     }
 
-    fclose(file);
+    plCloseBinaryReader(&reader);
 
     _plDebugPrint("    texture_name_length: %d\n", texture_name_length);
     _plDebugPrint("    texture_name:        %s\n", texture_name);
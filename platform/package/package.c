@@ -25,15 +25,352 @@ OTHER DEALINGS IN THE SOFTWARE.
 For more information, please refer to <http://unlicense.org>
 */
 
+#define _DEFAULT_SOURCE // preadv
+
 #include "package_private.h"
 
+#if !defined(_WIN32)
+#   include <sys/mman.h>
+#   include <sys/uio.h>
+#   include <fcntl.h>
+#   include <pthread.h>
+#endif
+
+/* Creates a new, empty, package which can then be
+ * populated and written out to the given destination
+ */
 PLPackage *plCreatePackage(const char *dest) {
     if(dest == NULL || dest[0] == '\0') {
         ReportError(PL_RESULT_FILEPATH, "invalid path");
         return NULL;
     }
 
-    return NULL;
+    PLPackage *package = calloc(1, sizeof(PLPackage));
+    if(package == NULL) {
+        ReportError(PL_RESULT_MEMORYALLOC, "failed to allocate package");
+        return NULL;
+    }
+
+    strncpy(package->path, dest, sizeof(package->path) - 1);
+
+    if(!OpenPackageIO(package, NULL)) {
+        free(package);
+        return NULL;
+    }
+
+    return package;
+}
+
+/* Maps the whole of the given file into memory for reading. On systems
+ * where we don't have mmap, the file is instead read in with a single
+ * read, which at least spares us from any per-entry allocations.
+ */
+uint8_t *MapPackageFile(const char *path, size_t *size) {
+#if !defined(_WIN32)
+    int fd = open(path, O_RDONLY);
+    if(fd == -1) {
+        ReportError(PL_RESULT_FILEREAD, "failed to open %s: %s", path, strerror(errno));
+        return NULL;
+    }
+
+    struct stat st;
+    if(fstat(fd, &st) == -1 || st.st_size <= 0) {
+        ReportError(PL_RESULT_FILESIZE, "failed to stat %s: %s", path, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+
+    void *mapping = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    /* the mapping keeps its own reference to the file */
+    close(fd);
+    if(mapping == MAP_FAILED) {
+        ReportError(PL_RESULT_FILEREAD, "failed to map %s: %s", path, strerror(errno));
+        return NULL;
+    }
+
+    *size = (size_t)st.st_size;
+    return mapping;
+#else
+    size_t file_size = plGetFileSize(path);
+    if(file_size == 0) {
+        return NULL;
+    }
+
+    FILE *fh = fopen(path, "rb");
+    if(fh == NULL) {
+        ReportError(PL_RESULT_FILEREAD, "failed to open %s", path);
+        return NULL;
+    }
+
+    uint8_t *mapping = malloc(file_size);
+    if(mapping == NULL) {
+        ReportError(PL_RESULT_MEMORYALLOC, "failed to allocate %u bytes", file_size);
+        fclose(fh);
+        return NULL;
+    }
+
+    if(fread(mapping, file_size, 1, fh) != 1) {
+        ReportError(PL_RESULT_FILEREAD, "failed to read %s", path);
+        free(mapping);
+        fclose(fh);
+        return NULL;
+    }
+
+    fclose(fh);
+
+    *size = file_size;
+    return mapping;
+#endif
+}
+
+void UnmapPackageFile(uint8_t *mapping, size_t size) {
+    if(mapping == NULL) {
+        return;
+    }
+
+#if !defined(_WIN32)
+    munmap(mapping, size);
+#else
+    free(mapping);
+#endif
+}
+
+/////////////////////////////////////////////////////////////////
+// Entry I/O
+
+/* Everything needed to read entries in on demand, from any number
+ * of threads at once. Reads are positioned, so there's no cursor to
+ * share, and the lock only covers the package's bookkeeping.
+ */
+typedef struct PLPackageIO {
+#if !defined(_WIN32)
+    int fd;
+    pthread_mutex_t lock;
+    pthread_cond_t loaded;  // signalled whenever an entry is done loading
+#else
+    HANDLE handle;
+    SRWLOCK lock;
+    CONDITION_VARIABLE loaded;
+#endif
+} PLPackageIO;
+
+static bool OpenPackageHandle(PLPackageIO *io, const char *path) {
+#if !defined(_WIN32)
+    io->fd = -1;
+    if(path != NULL && (io->fd = open(path, O_RDONLY)) == -1) {
+        ReportError(PL_RESULT_FILEREAD, "failed to open %s: %s", path, strerror(errno));
+        return false;
+    }
+#else
+    io->handle = INVALID_HANDLE_VALUE;
+    if(path != NULL) {
+        io->handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+                                 OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if(io->handle == INVALID_HANDLE_VALUE) {
+            ReportError(PL_RESULT_FILEREAD, "failed to open %s", path);
+            return false;
+        }
+    }
+#endif
+
+    return true;
+}
+
+static void ClosePackageHandle(PLPackageIO *io) {
+#if !defined(_WIN32)
+    if(io->fd != -1) {
+        close(io->fd);
+        io->fd = -1;
+    }
+#else
+    if(io->handle != INVALID_HANDLE_VALUE) {
+        CloseHandle(io->handle);
+        io->handle = INVALID_HANDLE_VALUE;
+    }
+#endif
+}
+
+/* Sets the package up for reading entries from the given path,
+ * or for none at all if the path is NULL.
+ */
+bool OpenPackageIO(PLPackage *package, const char *path) {
+    PLPackageIO *io = calloc(1, sizeof(PLPackageIO));
+    if(io == NULL) {
+        ReportError(PL_RESULT_MEMORYALLOC, "failed to allocate package io");
+        return false;
+    }
+
+    if(!OpenPackageHandle(io, path)) {
+        free(io);
+        return false;
+    }
+
+#if !defined(_WIN32)
+    pthread_mutex_init(&io->lock, NULL);
+    pthread_cond_init(&io->loaded, NULL);
+#else
+    InitializeSRWLock(&io->lock);
+    InitializeConditionVariable(&io->loaded);
+#endif
+
+    package->io = io;
+    return true;
+}
+
+/* Points the package at whatever now lives at its path,
+ * used once a package has been written back out. Any entries
+ * that came out of the old mapping are pointed into the new
+ * one, or dropped to be loaded again if they're since been
+ * compressed, so the old mapping can go.
+ */
+bool ReopenPackageIO(PLPackage *package) {
+    plAssert(package->io);
+
+    ClosePackageHandle(package->io);
+    bool result = OpenPackageHandle(package->io, package->path);
+
+    if(package->mapping == NULL) {
+        return result;
+    }
+
+    /* if the new one can't be mapped, we just fall back to reading it */
+    size_t mapping_size = 0;
+    uint8_t *mapping = MapPackageFile(package->path, &mapping_size);
+
+    for(unsigned int i = 0; i < package->table_size; ++i) {
+        PLPackageIndex *index = &package->table[i];
+        if(index->data == NULL || !IsMappedPackageData(package, index->data)) {
+            continue;
+        }
+
+        if(mapping != NULL && index->compression == PL_PACKAGECOMPRESSION_NONE && index->length > 0 &&
+           index->offset < mapping_size && index->length <= mapping_size - index->offset) {
+            index->data = mapping + index->offset;
+        } else {
+            index->data = NULL;
+        }
+    }
+
+    UnmapPackageFile(package->mapping, package->mapping_size);
+    package->mapping = mapping;
+    package->mapping_size = (mapping != NULL) ? mapping_size : 0;
+
+    return result;
+}
+
+static void ClosePackageIO(PLPackage *package) {
+    PLPackageIO *io = package->io;
+    if(io == NULL) {
+        return;
+    }
+
+    ClosePackageHandle(io);
+
+#if !defined(_WIN32)
+    pthread_cond_destroy(&io->loaded);
+    pthread_mutex_destroy(&io->lock);
+#endif
+
+    free(io);
+    package->io = NULL;
+}
+
+static void LockPackage(PLPackage *package) {
+#if !defined(_WIN32)
+    pthread_mutex_lock(&package->io->lock);
+#else
+    AcquireSRWLockExclusive(&package->io->lock);
+#endif
+}
+
+static void UnlockPackage(PLPackage *package) {
+#if !defined(_WIN32)
+    pthread_mutex_unlock(&package->io->lock);
+#else
+    ReleaseSRWLockExclusive(&package->io->lock);
+#endif
+}
+
+/* Waits for another thread to finish loading an entry, must be locked. */
+static void WaitPackage(PLPackage *package) {
+#if !defined(_WIN32)
+    pthread_cond_wait(&package->io->loaded, &package->io->lock);
+#else
+    SleepConditionVariableSRW(&package->io->loaded, &package->io->lock, INFINITE, 0);
+#endif
+}
+
+static void SignalPackage(PLPackage *package) {
+#if !defined(_WIN32)
+    pthread_cond_broadcast(&package->io->loaded);
+#else
+    WakeAllConditionVariable(&package->io->loaded);
+#endif
+}
+
+/* Reads the given range of the package, safe to call from any thread. */
+bool ReadPackageData(PLPackage *package, uint8_t *dest, size_t length, size_t offset) {
+    plAssert(package->io);
+
+    if(package->mapping != NULL) {
+        if(offset > package->mapping_size || length > package->mapping_size - offset) {
+            ReportError(PL_RESULT_FILESIZE, "read beyond end of %s", package->path);
+            return false;
+        }
+
+        memcpy(dest, package->mapping + offset, length);
+        return true;
+    }
+
+#if !defined(_WIN32)
+    if(package->io->fd == -1) {
+        ReportError(PL_RESULT_FILEREAD, "no file to read %s from", package->path);
+        return false;
+    }
+
+    while(length > 0) {
+        ssize_t bytes = pread(package->io->fd, dest, length, (off_t)offset);
+        if(bytes < 0 && errno == EINTR) {
+            continue;
+        } else if(bytes <= 0) {
+            ReportError(PL_RESULT_FILEREAD, "failed to read from %s", package->path);
+            return false;
+        }
+
+        dest += bytes;
+        offset += (size_t)bytes;
+        length -= (size_t)bytes;
+    }
+#else
+    while(length > 0) {
+        OVERLAPPED ov;
+        memset(&ov, 0, sizeof(OVERLAPPED));
+        ov.Offset = (DWORD)((uint64_t)offset & 0xFFFFFFFF);
+        ov.OffsetHigh = (DWORD)((uint64_t)offset >> 32);
+
+        DWORD chunk = (length > 0x40000000) ? 0x40000000 : (DWORD)length;
+        DWORD bytes = 0;
+        if(!ReadFile(package->io->handle, dest, chunk, &bytes, &ov) || bytes == 0) {
+            ReportError(PL_RESULT_FILEREAD, "failed to read from %s", package->path);
+            return false;
+        }
+
+        dest += bytes;
+        offset += bytes;
+        length -= bytes;
+    }
+#endif
+
+    return true;
+}
+
+/* Returns true if the given buffer lives within the package's mapping,
+ * in which case it's not ours to free. The end of the mapping counts too,
+ * so nothing pointing just past it can ever be handed to free.
+ */
+bool IsMappedPackageData(const PLPackage *package, const uint8_t *data) {
+    return (package->mapping != NULL &&
+            data >= package->mapping && data <= package->mapping + package->mapping_size);
 }
 
 void PurgePackageData(PLPackage *package) {
@@ -41,10 +378,17 @@ void PurgePackageData(PLPackage *package) {
 
     for(unsigned int i = 0; i < package->table_size; ++i) {
         if(package->table[i].data != NULL) {
-            free(package->table[i].data);
+            if(!IsMappedPackageData(package, package->table[i].data)) {
+                free(package->table[i].data);
+            }
             package->table[i].data = NULL;
         }
+
+        package->table[i].cache_prev = package->table[i].cache_next = 0;
     }
+
+    package->cache.head = package->cache.tail = 0;
+    package->cache.size = 0;
 }
 
 /* Unloads package from memory
@@ -52,26 +396,261 @@ void PurgePackageData(PLPackage *package) {
 void plDeletePackage(PLPackage *package) {
     plAssert(package);
 
+    plUnmountPackage(package);
+
     PurgePackageData(package);
+    ClosePackageIO(package);
+    UnmapPackageFile(package->mapping, package->mapping_size);
+    free(package->hash_table);
     free(package->table);
     free(package);
 }
-#if 0 // todo
-void plWritePackage(PLPackage *package) {
 
+/////////////////////////////////////////////////////////////////
+// Entry Lookup
+
+/* FNV-1a, folding the case of each character
+ * first if we're asked to.
+ */
+uint32_t HashPackageName(const char *name, bool nocase) {
+    uint32_t hash = 2166136261u;
+    for(const unsigned char *c = (const unsigned char*)name; *c != '\0'; ++c) {
+        hash ^= (uint32_t)(nocase ? tolower(*c) : *c);
+        hash *= 16777619u;
+    }
+    return hash;
 }
-#endif
+
+bool ComparePackageNames(const PLPackage *package, const char *a, const char *b) {
+    if(package->flags & PL_PACKAGEFLAG_NOCASE) {
+        return (pl_strcasecmp(a, b) == 0);
+    }
+
+    return (strcmp(a, b) == 0);
+}
+
+static void InsertPackageHash(PLPackage *package, unsigned int i) {
+    PLPackageIndex *index = &package->table[i];
+    index->hash = HashPackageName(index->name, (bool)(package->flags & PL_PACKAGEFLAG_NOCASE));
+
+    unsigned int mask = package->hash_table_size - 1;
+    for(unsigned int slot = index->hash & mask;; slot = (slot + 1) & mask) {
+        uint32_t entry = package->hash_table[slot];
+        if(entry == 0) {
+            package->hash_table[slot] = i + 1;
+            return;
+        }
+
+        /* if a name turns up more than once, the first one wins, as it always has */
+        PLPackageIndex *other = &package->table[entry - 1];
+        if(other->hash == index->hash && ComparePackageNames(package, other->name, index->name)) {
+            return;
+        }
+    }
+}
+
+/* Builds the hashed lookup table for the package, should
+ * only be called once the package table has been filled in.
+ */
+static bool BuildPackageHashTable(PLPackage *package) {
+    /* keep the table at most half full, so probes stay short */
+    unsigned int size = 16;
+    while(size < package->table_size * 2) {
+        size <<= 1;
+    }
+
+    package->hash_table = calloc(size, sizeof(uint32_t));
+    if(package->hash_table == NULL) {
+        ReportError(PL_RESULT_MEMORYALLOC, "failed to allocate hash table for package");
+        return false;
+    }
+    package->hash_table_size = size;
+
+    for(unsigned int i = 0; i < package->table_size; ++i) {
+        InsertPackageHash(package, i);
+    }
+
+    return true;
+}
+
+PLPackageIndex *FindPackageIndex(PLPackage *package, const char *name) {
+    plAssert(package);
+
+    if(package->hash_table == NULL) {
+        for(unsigned int i = 0; i < package->table_size; ++i) {
+            if(ComparePackageNames(package, name, package->table[i].name)) {
+                return &package->table[i];
+            }
+        }
+
+        return NULL;
+    }
+
+    uint32_t hash = HashPackageName(name, (bool)(package->flags & PL_PACKAGEFLAG_NOCASE));
+    unsigned int mask = package->hash_table_size - 1;
+    for(unsigned int slot = hash & mask;; slot = (slot + 1) & mask) {
+        uint32_t entry = package->hash_table[slot];
+        if(entry == 0) {
+            return NULL;
+        }
+
+        PLPackageIndex *index = &package->table[entry - 1];
+        if(index->hash == hash && ComparePackageNames(package, name, index->name)) {
+            return index;
+        }
+    }
+}
+
+/////////////////////////////////////////////////////////////////
+// Entry Cache
+
+static size_t default_cache_budget = 0;
+
+static bool IsCachedPackageIndex(const PLPackage *package, unsigned int i) {
+    return (package->cache.head == i + 1 || package->table[i].cache_prev != 0);
+}
+
+static void UnlinkPackageCacheIndex(PLPackage *package, unsigned int i) {
+    PLPackageIndex *index = &package->table[i];
+    if(index->cache_prev != 0) {
+        package->table[index->cache_prev - 1].cache_next = index->cache_next;
+    } else {
+        package->cache.head = index->cache_next;
+    }
+
+    if(index->cache_next != 0) {
+        package->table[index->cache_next - 1].cache_prev = index->cache_prev;
+    } else {
+        package->cache.tail = index->cache_prev;
+    }
+
+    index->cache_prev = index->cache_next = 0;
+}
+
+/* Moves the given entry to the front of the cache,
+ * marking it as the most recently used. */
+static void TouchPackageCacheIndex(PLPackage *package, unsigned int i) {
+    if(package->cache.head == i + 1) {
+        return;
+    }
+
+    if(IsCachedPackageIndex(package, i)) {
+        UnlinkPackageCacheIndex(package, i);
+    }
+
+    PLPackageIndex *index = &package->table[i];
+    index->cache_next = package->cache.head;
+    if(package->cache.head != 0) {
+        package->table[package->cache.head - 1].cache_prev = i + 1;
+    }
+    package->cache.head = i + 1;
+
+    if(package->cache.tail == 0) {
+        package->cache.tail = i + 1;
+    }
+}
+
+/* Throws away the least recently used entries until we're back within
+ * budget, skipping over any that are still held onto by someone. */
+static void TrimPackageCache(PLPackage *package) {
+    if(package->cache.budget == 0) {
+        return;
+    }
+
+    unsigned int next = package->cache.tail;
+    while(package->cache.size > package->cache.budget && next != 0) {
+        unsigned int i = next - 1;
+        PLPackageIndex *index = &package->table[i];
+        next = index->cache_prev;
+        if(index->pins > 0) {
+            continue;
+        }
+
+        UnlinkPackageCacheIndex(package, i);
+        free(index->data);
+        __atomic_store_n(&index->data, NULL, __ATOMIC_RELEASE);
+
+        package->cache.size -= index->length;
+        package->cache.evictions++;
+    }
+}
+
+void plSetPackageCacheBudget(PLPackage *package, size_t budget) {
+    plAssert(package);
+
+    LockPackage(package);
+    package->cache.budget = budget;
+    TrimPackageCache(package);
+    UnlockPackage(package);
+}
+
+/* Sets the budget given to packages as they're loaded. */
+void plSetDefaultPackageCacheBudget(size_t budget) {
+    default_cache_budget = budget;
+}
+
+/* Adds a copy of the given data to the package under the given
+ * name, the package isn't updated on disk until plWritePackage
+ */
+bool plAppendPackageFile(PLPackage *package, const char *name, const uint8_t *data, size_t size) {
+    plAssert(package);
+
+    if(name == NULL || name[0] == '\0' || strlen(name) >= sizeof(package->table->name)) {
+        ReportError(PL_RESULT_FILEPATH, "invalid name for package entry");
+        return false;
+    }
+
+    uint8_t *copy = malloc(size > 0 ? size : 1);
+    if(copy == NULL) {
+        ReportError(PL_RESULT_MEMORYALLOC, "failed to allocate %u bytes for package entry", size);
+        return false;
+    }
+
+    if(size > 0) {
+        memcpy(copy, data, size);
+    }
+
+    PLPackageIndex *table = realloc(package->table, (package->table_size + 1) * sizeof(PLPackageIndex));
+    if(table == NULL) {
+        ReportError(PL_RESULT_MEMORYALLOC, "failed to grow package table");
+        free(copy);
+        return false;
+    }
+
+    package->table = table;
+
+    PLPackageIndex *index = &package->table[package->table_size];
+    memset(index, 0, sizeof(PLPackageIndex));
+    strcpy(index->name, name);
+    index->length = size;
+    index->data = copy;
+
+    /* keep the lookup table in step, if we have one */
+    unsigned int i = package->table_size++;
+    if(package->hash_table != NULL) {
+        if(package->table_size * 2 > package->hash_table_size) {
+            free(package->hash_table);
+            package->hash_table = NULL;
+            return BuildPackageHashTable(package);
+        }
+
+        InsertPackageHash(package, i);
+    }
+
+    return true;
+}
+
 /////////////////////////////////////////////////////////////////
 
 typedef struct PLPackageLoader {
     const char *extensions[32];
     unsigned int num_extensions;
 
-    PLPackage*(*LoadPackage)(const char *path, bool precache);
+    PLPackage*(*LoadPackage)(const char *path, unsigned int flags);
 } PLPackageLoader;
 
 PLPackageLoader load_packs[]= {
-        { { "package" }, 1, NULL },
+        { { "package" }, 1, LoadPACKPackage },
 
         // Third-party package formats
         { { "mad", "mtd" }, 2, LoadMADPackage },
@@ -79,7 +658,29 @@ PLPackageLoader load_packs[]= {
 };
 unsigned int num_load_packs = plArrayElements(load_packs);
 
-PLPackage *plLoadPackage(const char *path, bool cache) {
+static PLPackage *SetupPackage(PLPackage *package, const char *path, unsigned int flags) {
+    strncpy(package->path, path, sizeof(package->path));
+    package->flags = flags;
+    package->cache.budget = default_cache_budget;
+
+    if(!BuildPackageHashTable(package) || !OpenPackageIO(package, path)) {
+        plDeletePackage(package);
+        return NULL;
+    }
+
+    /* Read in each file's data */
+    if((flags & PL_PACKAGEFLAG_CACHE) && package->LoadFile != NULL) {
+        for(unsigned int i = 0; i < package->table_size; ++i) {
+            if(package->table[i].data == NULL) {
+                package->table[i].data = package->LoadFile(package, &package->table[i]);
+            }
+        }
+    }
+
+    return package;
+}
+
+PLPackage *plLoadPackage(const char *path, unsigned int flags) {
     if(!plFileExists(path)) {
         ReportError(PL_RESULT_FILEREAD, "Failed to load package, %s!", path);
         return NULL;
@@ -90,10 +691,13 @@ PLPackage *plLoadPackage(const char *path, bool cache) {
         for(unsigned int i = 0; i < num_load_packs; ++i) {
             for (unsigned int j = 0; j < load_packs[i].num_extensions; ++j) {
                 if (pl_strcasecmp(ext, load_packs[i].extensions[j]) == 0) {
-                    PLPackage *package = load_packs[i].LoadPackage(path, cache);
+                    if(load_packs[i].LoadPackage == NULL) {
+                        break;
+                    }
+
+                    PLPackage *package = load_packs[i].LoadPackage(path, flags);
                     if (package != NULL) {
-                        strncpy(package->path, path, sizeof(package->path));
-                        return package;
+                        return SetupPackage(package, path, flags);
                     }
                     break;
                 }
@@ -101,10 +705,13 @@ PLPackage *plLoadPackage(const char *path, bool cache) {
         }
     } else {
         for(unsigned int i = 0; i < num_load_packs; ++i) {
-            PLPackage *package = load_packs[i].LoadPackage(path, cache);
+            if(load_packs[i].LoadPackage == NULL) {
+                continue;
+            }
+
+            PLPackage *package = load_packs[i].LoadPackage(path, flags);
             if(package != NULL) {
-                strncpy(package->path, path, sizeof(package->path));
-                return package;
+                return SetupPackage(package, path, flags);
             }
         }
     }
@@ -112,26 +719,385 @@ PLPackage *plLoadPackage(const char *path, bool cache) {
     return NULL;
 }
 
+/* Returns the data for the given entry, loading it in if it isn't already,
+ * and holds onto it until it's released again. Safe to call from any number
+ * of threads.
+ */
+bool LoadPackageIndex(PLPackage *package, PLPackageIndex *index, const uint8_t **data, size_t *size) {
+    unsigned int i = (unsigned int)(index - package->table);
+
+    LockPackage(package);
+
+    while(index->data == NULL && index->loading) {
+        WaitPackage(package);
+    }
+
+    if(index->data == NULL) {
+        if(package->LoadFile == NULL) {
+            UnlockPackage(package);
+            ReportError(PL_RESULT_FILEREAD, "no means to load %s from package", index->name);
+            return false;
+        }
+
+        /* Anyone else after this entry waits on us, rather than loading it again. */
+        index->loading = true;
+        UnlockPackage(package);
+
+        uint8_t *buffer = package->LoadFile(package, index);
+
+        LockPackage(package);
+        index->loading = false;
+        SignalPackage(package);
+
+        if(buffer == NULL) {
+            UnlockPackage(package);
+            return false;
+        }
+
+        __atomic_store_n(&index->data, buffer, __ATOMIC_RELEASE);
+        __atomic_fetch_add(&package->cache.misses, 1, __ATOMIC_RELAXED);
+        package->cache.size += index->length;
+        TouchPackageCacheIndex(package, i);
+    } else {
+        __atomic_fetch_add(&package->cache.hits, 1, __ATOMIC_RELAXED);
+        if(IsCachedPackageIndex(package, i)) {
+            TouchPackageCacheIndex(package, i);
+        }
+    }
+
+    index->pins++;
+    TrimPackageCache(package);
+
+    *data = index->data;
+    *size = index->length;
+
+    UnlockPackage(package);
+
+    return true;
+}
+
 bool plLoadPackageFile(PLPackage *package, const char *file, const uint8_t **data, size_t *size) {
-    for(unsigned int i = 0; i < package->table_size; ++i) {
-        if(strcmp(file, package->table[i].name) == 0) {
-            if(package->table[i].data == NULL) {
-                FILE *fh = fopen(package->path, "rb");
-                if (fh == NULL) {
-                    return false;
+    PLPackageIndex *index = FindPackageIndex(package, file);
+    if(index == NULL) {
+        return false;
+    }
+
+    return LoadPackageIndex(package, index, data, size);
+}
+
+/* Lets go of an entry returned by a load, once for every load. Anything
+ * that isn't currently held onto, or was never found, is left alone. */
+void ReleasePackageIndex(PLPackage *package, PLPackageIndex *index) {
+    LockPackage(package);
+    if(index->data != NULL && index->pins > 0) {
+        index->pins--;
+        TrimPackageCache(package);
+    }
+    UnlockPackage(package);
+}
+
+void plReleasePackageFile(PLPackage *package, const char *file) {
+    plAssert(package);
+
+    PLPackageIndex *index = FindPackageIndex(package, file);
+    if(index != NULL) {
+        ReleasePackageIndex(package, index);
+    }
+}
+
+void plReleasePackageFiles(PLPackage *package, const char **files, unsigned int num_files) {
+    for(unsigned int i = 0; i < num_files; ++i) {
+        plReleasePackageFile(package, files[i]);
+    }
+}
+
+bool plReadPackageFileRange(PLPackage *package, const char *file, size_t offset, size_t length, uint8_t *dest) {
+    plAssert(package);
+
+    PLPackageIndex *index = FindPackageIndex(package, file);
+    if(index == NULL) {
+        return false;
+    }
+
+    if(offset > index->length || length > index->length - offset) {
+        ReportError(PL_RESULT_FILESIZE, "range is beyond the end of %s", file);
+        return false;
+    }
+
+    /* if it's already been loaded, just copy it out of there, locking
+     * so that it isn't thrown out of the cache underneath us */
+    LockPackage(package);
+    if(index->data != NULL) {
+        memcpy(dest, index->data + offset, length);
+        UnlockPackage(package);
+        return true;
+    }
+    UnlockPackage(package);
+
+    if(index->compression != PL_PACKAGECOMPRESSION_NONE) {
+        return ReadPACKPackageRange(package, index, offset, length, dest);
+    }
+
+    return ReadPackageData(package, dest, length, index->offset + offset);
+}
+
+/////////////////////////////////////////////////////////////////
+// Batched Loading
+
+/* entries further apart than this are read in separately,
+ * rather than reading through the gap between them */
+#define PLPACKAGE_MAX_READ_GAP      (64 * 1024)
+/* keeps each read well within IOV_MAX */
+#define PLPACKAGE_MAX_READ_ENTRIES  256
+
+static int ComparePackageIndexOffsets(const void *a, const void *b) {
+    const PLPackageIndex *ia = *(const PLPackageIndex**)a;
+    const PLPackageIndex *ib = *(const PLPackageIndex**)b;
+    if(ia->offset != ib->offset) {
+        return (ia->offset < ib->offset) ? -1 : 1;
+    }
+
+    /* entries sharing an offset go by where they sit in the table, so the order is always the same */
+    return (ia < ib) ? -1 : (ia > ib);
+}
+
+typedef struct PLPackageRead {
+    PLPackageIndex *index;
+    uint8_t *data;
+} PLPackageRead;
+
+static int ComparePackageReads(const void *a, const void *b) {
+    return ComparePackageIndexOffsets(&((const PLPackageRead*)a)->index, &((const PLPackageRead*)b)->index);
+}
+
+/* Reads a run of entries, sorted by offset and not overlapping,
+ * straight into their buffers with a single positioned read. */
+static bool ReadPackageRun(PLPackage *package, PLPackageRead *run, unsigned int num_entries, uint8_t *gap) {
+#if !defined(_WIN32)
+    struct iovec iov[PLPACKAGE_MAX_READ_ENTRIES * 2];
+    unsigned int num_iov = 0;
+
+    size_t end = run[0].index->offset;
+    for(unsigned int i = 0; i < num_entries; ++i) {
+        if(run[i].index->offset > end) {
+            iov[num_iov].iov_base = gap;
+            iov[num_iov++].iov_len = run[i].index->offset - end;
+        }
+
+        iov[num_iov].iov_base = run[i].data;
+        iov[num_iov++].iov_len = run[i].index->length;
+
+        end = run[i].index->offset + run[i].index->length;
+    }
+
+    off_t position = (off_t)run[0].index->offset;
+    struct iovec *cur = iov;
+    while(num_iov > 0) {
+        ssize_t bytes = preadv(package->io->fd, cur, (int)num_iov, position);
+        if(bytes < 0 && errno == EINTR) {
+            continue;
+        } else if(bytes <= 0) {
+            return false;
+        }
+
+        position += bytes;
+
+        while(num_iov > 0 && (size_t)bytes >= cur->iov_len) {
+            bytes -= cur->iov_len;
+            ++cur;
+            --num_iov;
+        }
+
+        if(num_iov > 0) {
+            cur->iov_base = (uint8_t*)cur->iov_base + bytes;
+            cur->iov_len -= (size_t)bytes;
+        }
+    }
+#else
+    for(unsigned int i = 0; i < num_entries; ++i) {
+        if(!ReadPackageData(package, run[i].data, run[i].index->length, run[i].index->offset)) {
+            return false;
+        }
+    }
+#endif
+
+    return true;
+}
+
+/* Loads a number of entries at once. Any that aren't already loaded
+ * are read in offset order, with neighbouring entries merged into one
+ * read, rather than seeking back and forth for each. Returns false if
+ * any couldn't be found or loaded, in which case their data is NULL.
+ * Safe to call from any number of threads.
+ */
+bool plLoadPackageFiles(PLPackage *package, const char **files, unsigned int num_files, const uint8_t **data, size_t *sizes) {
+    plAssert(package);
+
+    if(num_files == 0) {
+        return true;
+    }
+
+    PLPackageIndex **indices = malloc(sizeof(PLPackageIndex*) * num_files);
+    PLPackageRead *reads = malloc(sizeof(PLPackageRead) * num_files);
+    if(indices == NULL || reads == NULL) {
+        ReportError(PL_RESULT_MEMORYALLOC, "failed to allocate %u indices", num_files);
+        free(indices);
+        free(reads);
+        return false;
+    }
+
+    bool result = true;
+    for(unsigned int i = 0; i < num_files; ++i) {
+        indices[i] = FindPackageIndex(package, files[i]);
+        if(indices[i] == NULL) {
+            result = false;
+        }
+    }
+
+    /* Claim everything that isn't loaded yet, anything
+     * another thread is already loading we'll wait on. */
+
+    unsigned int num_reads = 0;
+
+    LockPackage(package);
+    for(unsigned int i = 0; i < num_files; ++i) {
+        PLPackageIndex *index = indices[i];
+        if(index == NULL) {
+            continue;
+        }
+
+        if(index->data != NULL) {
+            __atomic_fetch_add(&package->cache.hits, 1, __ATOMIC_RELAXED);
+        } else if(!index->loading && package->LoadFile != NULL) {
+            index->loading = true;
+            reads[num_reads].index = index;
+            reads[num_reads++].data = NULL;
+        }
+    }
+    UnlockPackage(package);
+
+    if(num_reads > 0) {
+        qsort(reads, num_reads, sizeof(PLPackageRead), ComparePackageReads);
+
+        for(unsigned int i = 0; i < num_reads; ++i) {
+            /* compressed entries can't be read straight in, so are left to the loader */
+            if(reads[i].index->compression != PL_PACKAGECOMPRESSION_NONE) {
+                reads[i].data = package->LoadFile(package, reads[i].index);
+                continue;
+            }
+
+            reads[i].data = malloc(reads[i].index->length > 0 ? reads[i].index->length : 1);
+            if(reads[i].data == NULL) {
+                ReportError(PL_RESULT_MEMORYALLOC, "failed to allocate %u bytes", reads[i].index->length);
+            }
+        }
+
+        uint8_t *gap = malloc(PLPACKAGE_MAX_READ_GAP);
+        if(gap == NULL) {
+            ReportError(PL_RESULT_MEMORYALLOC, "failed to allocate %u bytes", PLPACKAGE_MAX_READ_GAP);
+        }
+
+        for(unsigned int start = 0; start < num_reads && gap != NULL;) {
+            if(reads[start].data == NULL || reads[start].index->compression != PL_PACKAGECOMPRESSION_NONE) {
+                ++start;
+                continue;
+            }
+
+            size_t end = reads[start].index->offset + reads[start].index->length;
+
+            unsigned int next = start + 1;
+            for(; next < num_reads && next - start < PLPACKAGE_MAX_READ_ENTRIES; ++next) {
+                PLPackageIndex *index = reads[next].index;
+                if(reads[next].data == NULL || index->compression != PL_PACKAGECOMPRESSION_NONE ||
+                   index->offset < end || index->offset - end > PLPACKAGE_MAX_READ_GAP) {
+                    break;
                 }
 
-                if (!LoadMADPackageFile(fh, &(package->table[i]))) {
-                    fclose(fh);
-                    return false;
+                end = index->offset + index->length;
+            }
+
+            if(!ReadPackageRun(package, &reads[start], next - start, gap)) {
+                ReportError(PL_RESULT_FILEREAD, "failed to read entries from %s", package->path);
+                for(unsigned int i = start; i < next; ++i) {
+                    free(reads[i].data);
+                    reads[i].data = NULL;
                 }
             }
 
-            *data = package->table[i].data;
-            *size = package->table[i].length;
-            return true;
+            start = next;
+        }
+
+        free(gap);
+    }
+
+    LockPackage(package);
+
+    for(unsigned int i = 0; i < num_reads; ++i) {
+        PLPackageIndex *index = reads[i].index;
+        index->loading = false;
+
+        if(reads[i].data == NULL) {
+            continue;
+        }
+
+        __atomic_store_n(&index->data, reads[i].data, __ATOMIC_RELEASE);
+        __atomic_fetch_add(&package->cache.misses, 1, __ATOMIC_RELAXED);
+        package->cache.size += index->length;
+        TouchPackageCacheIndex(package, (unsigned int)(index - package->table));
+    }
+
+    if(num_reads > 0) {
+        SignalPackage(package);
+    }
+
+    for(unsigned int i = 0; i < num_files; ++i) {
+        while(indices[i] != NULL && indices[i]->data == NULL && indices[i]->loading) {
+            WaitPackage(package);
         }
     }
 
-    return false;
+    /* Touch everything in the order it was asked for, holding onto
+     * each so that trimming the cache doesn't throw it away. */
+
+    bool missing = false;
+    for(unsigned int i = 0; i < num_files; ++i) {
+        PLPackageIndex *index = indices[i];
+        data[i] = NULL;
+        sizes[i] = 0;
+        if(index == NULL) {
+            result = false;
+            continue;
+        } else if(index->data == NULL) {
+            missing = true;
+            continue;
+        }
+
+        unsigned int j = (unsigned int)(index - package->table);
+        if(IsCachedPackageIndex(package, j)) {
+            TouchPackageCacheIndex(package, j);
+        }
+        index->pins++;
+
+        data[i] = index->data;
+        sizes[i] = index->length;
+    }
+
+    TrimPackageCache(package);
+
+    UnlockPackage(package);
+
+    /* anything that failed to read, or was thrown out again
+     * before we got to it, is given another go on its own */
+    for(unsigned int i = 0; i < num_files && missing; ++i) {
+        if(indices[i] != NULL && data[i] == NULL && !LoadPackageIndex(package, indices[i], &data[i], &sizes[i])) {
+            data[i] = NULL;
+            sizes[i] = 0;
+            result = false;
+        }
+    }
+
+    free(indices);
+    free(reads);
+
+    return result;
 }
@@ -51,15 +51,63 @@ typedef struct __attribute__((packed)) MADIndex {
     uint32_t length;
 } MADIndex;
 
-PLPackage *LoadMADPackage(const char *filename, bool cache) {
-    FILE *fh = fopen(filename, "rb");
-    if(fh == NULL) {
-        goto FAILED;
-    }
+PLPackage *LoadMADPackage(const char *filename, unsigned int flags) {
+    PLPackage *package = NULL;
+    FILE *fh = NULL;
 
-    size_t file_size = plGetFileSize(filename);
-    if(plGetFunctionResult() != PL_RESULT_SUCCESS) {
-        goto FAILED;
+    uint8_t *mapping = NULL;
+    uint8_t *index_data = NULL;
+
+    const uint8_t *index_region = NULL;
+    size_t index_region_size = 0;
+    size_t file_size = 0;
+
+    if(flags & PL_PACKAGEFLAG_MAP) {
+        /* Everything, including the index, is read straight out of the mapping. */
+        mapping = MapPackageFile(filename, &file_size);
+        if(mapping == NULL) {
+            goto FAILED;
+        }
+
+        index_region = mapping;
+        index_region_size = file_size;
+    } else {
+        fh = fopen(filename, "rb");
+        if(fh == NULL) {
+            goto FAILED;
+        }
+
+        file_size = plGetFileSize(filename);
+        if(plGetFunctionResult() != PL_RESULT_SUCCESS) {
+            goto FAILED;
+        }
+
+        /* None of the headers can start beyond the data of the first, so that
+         * gives us the size of the region to read in for the whole index. */
+
+        MADIndex first;
+        if(fread(&first, sizeof(MADIndex), 1, fh) != 1) {
+            goto FAILED;
+        }
+
+        if(first.offset >= file_size) {
+            goto FAILED;
+        }
+
+        index_region_size = first.offset > sizeof(MADIndex) ? first.offset : sizeof(MADIndex);
+        index_data = malloc(index_region_size);
+        if(index_data == NULL) {
+            ReportError(PL_RESULT_MEMORYALLOC, "Failed to allocate %d bytes!\n", index_region_size);
+            goto FAILED;
+        }
+
+        memcpy(index_data, &first, sizeof(MADIndex));
+        if(index_region_size > sizeof(MADIndex) &&
+           fread(index_data + sizeof(MADIndex), index_region_size - sizeof(MADIndex), 1, fh) != 1) {
+            goto FAILED;
+        }
+
+        index_region = index_data;
     }
 
     /* Figure out the number of headers in the MAD file by reading them in until we cross into the data region of one
@@ -70,12 +118,14 @@ PLPackage *LoadMADPackage(const char *filename, bool cache) {
     unsigned int num_indices = 0;
 
     while((num_indices + 1) * sizeof(MADIndex) <= data_begin) {
-        MADIndex index;
-        if(fread(&index, sizeof(MADIndex), 1, fh) != 1) {
+        if((num_indices + 1) * sizeof(MADIndex) > index_region_size) {
             /* EOF, or read error */
             goto FAILED;
         }
 
+        MADIndex index;
+        memcpy(&index, index_region + num_indices * sizeof(MADIndex), sizeof(MADIndex));
+
         // ensure the file name is valid...
         for(unsigned int i = 0; i < 16; ++i) {
             if(isprint(index.file[i]) == 0 && index.file[i] != '\0') {
@@ -98,38 +148,25 @@ PLPackage *LoadMADPackage(const char *filename, bool cache) {
 
     /* Allocate the basic package structure now we know how many files are in the archive. */
 
-    PLPackage *package = malloc(sizeof(PLPackage));
+    package = malloc(sizeof(PLPackage));
     if(package == NULL) {
         goto FAILED;
     }
 
     memset(package, 0, sizeof(PLPackage));
 
-#if 0 // done after package load now
-    package->path = malloc(strlen(filename) + 1);
-    if(package->path == NULL) {
-        goto FAILED;
-    }
-
-    strcpy(package->path, filename);
-#endif
-
+    package->LoadFile   = LoadMADPackageFile;
     package->table_size = num_indices;
     package->table      = calloc(num_indices, sizeof(struct PLPackageIndex));
     if(package->table == NULL) {
         goto FAILED;
     }
 
-    /* Rewind the file handle and populate package->table with the metadata from the headers. */
-
-    rewind(fh);
+    /* Populate package->table with the metadata from the headers. */
 
     for(unsigned int i = 0; i < num_indices; ++i) {
         MADIndex index;
-        if(fread(&index, sizeof(MADIndex), 1, fh) != 1) {
-            /* EOF, or read error */
-            goto FAILED;
-        }
+        memcpy(&index, index_region + i * sizeof(MADIndex), sizeof(MADIndex));
 
         strncpy(package->table[i].name, index.file, sizeof(index.file));
         package->table[i].name[sizeof(index.file)] = '\0';
@@ -138,14 +175,19 @@ PLPackage *LoadMADPackage(const char *filename, bool cache) {
         package->table[i].offset = index.offset;
     }
 
-    /* Read in each file's data */
-
-    if(cache) {
-        for (unsigned int i = 0; i < num_indices; ++i) {
-            LoadMADPackageFile(fh, &(package->table[i]));
+    if(mapping != NULL) {
+        /* Entries are stored as-is, so just point them at their data. */
+        for(unsigned int i = 0; i < num_indices; ++i) {
+            package->table[i].data = mapping + package->table[i].offset;
         }
+
+        package->mapping      = mapping;
+        package->mapping_size = file_size;
+
+        return package;
     }
 
+    free(index_data);
     fclose(fh);
 
     return package;
@@ -156,6 +198,9 @@ PLPackage *LoadMADPackage(const char *filename, bool cache) {
         plDeletePackage(package);
     }
 
+    UnmapPackageFile(mapping, file_size);
+    free(index_data);
+
     if(fh != NULL) {
         fclose(fh);
     }
@@ -163,19 +208,17 @@ PLPackage *LoadMADPackage(const char *filename, bool cache) {
     return NULL;
 }
 
-bool LoadMADPackageFile(FILE *fh, PLPackageIndex *pi) {
-    pi->data = malloc(pi->length);
-    if(pi->data == NULL) {
+uint8_t *LoadMADPackageFile(PLPackage *package, const PLPackageIndex *pi) {
+    uint8_t *data = malloc(pi->length);
+    if(data == NULL) {
         ReportError(PL_RESULT_MEMORYALLOC, "Failed to allocate %d bytes!\n", pi->length);
-        return false;
+        return NULL;
     }
 
-    if(fseek(fh, pi->offset, SEEK_SET) != 0 || fread(pi->data, pi->length, 1, fh) != 1) {
-        free(pi->data);
-        pi->data = NULL;
-
-        return false;
+    if(!ReadPackageData(package, data, pi->length, pi->offset)) {
+        free(data);
+        return NULL;
     }
 
-    return true;
+    return data;
 }
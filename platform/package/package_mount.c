@@ -0,0 +1,372 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+
+#define _DEFAULT_SOURCE // pthread_rwlock_t
+
+#include "package_private.h"
+
+#if !defined(_WIN32)
+#   include <pthread.h>
+#endif
+
+/*  Package Mounting  */
+/* Every entry from every mounted package goes into one merged
+ * table, so finding a file is a single probe no matter how many
+ * packages are mounted. A name only keeps the one slot when the
+ * package that outranks the rest would match every spelling the
+ * others do, so patches and mods can simply be mounted over the
+ * top of the base packages.
+ *
+ * Names are always hashed without regard for case, so packages
+ * with and without PL_PACKAGEFLAG_NOCASE can be mixed; it's then
+ * down to each package whether or not a lookup matches, and the
+ * highest ranked match wins out.
+ *
+ * Lookups share a lock that mounting and unmounting take for
+ * themselves, so both can go on while other threads are loading.
+ */
+
+typedef struct PLPackageMount {
+    PLPackage *package;
+    int priority;
+    unsigned int order;     // when it was mounted, later wins out on equal priority
+} PLPackageMount;
+
+typedef struct PLMountedIndex {
+    uint32_t hash;
+    unsigned int mount;     // +1, 0 marks an empty slot
+    unsigned int index;     // into the package's table
+} PLMountedIndex;
+
+static PLPackageMount *mounts = NULL;
+static unsigned int num_mounts = 0;
+static unsigned int mount_order = 0;
+
+static PLMountedIndex *mount_table = NULL;
+static unsigned int mount_table_size = 0;
+static unsigned int mount_table_used = 0;
+
+#if !defined(_WIN32)
+static pthread_rwlock_t mount_lock = PTHREAD_RWLOCK_INITIALIZER;
+#else
+static SRWLOCK mount_lock = SRWLOCK_INIT;
+#endif
+
+static void LockMounts(void) {
+#if !defined(_WIN32)
+    pthread_rwlock_wrlock(&mount_lock);
+#else
+    AcquireSRWLockExclusive(&mount_lock);
+#endif
+}
+
+static void UnlockMounts(void) {
+#if !defined(_WIN32)
+    pthread_rwlock_unlock(&mount_lock);
+#else
+    ReleaseSRWLockExclusive(&mount_lock);
+#endif
+}
+
+static void LockMountsShared(void) {
+#if !defined(_WIN32)
+    pthread_rwlock_rdlock(&mount_lock);
+#else
+    AcquireSRWLockShared(&mount_lock);
+#endif
+}
+
+static void UnlockMountsShared(void) {
+#if !defined(_WIN32)
+    pthread_rwlock_unlock(&mount_lock);
+#else
+    ReleaseSRWLockShared(&mount_lock);
+#endif
+}
+
+static bool OutranksMount(const PLPackageMount *a, const PLPackageMount *b) {
+    if(a->priority != b->priority) {
+        return (a->priority > b->priority);
+    }
+
+    return (a->order > b->order);
+}
+
+/* A name hides another below it if every lookup that would find the
+ * other finds it first, so a package without PL_PACKAGEFLAG_NOCASE
+ * can't hide the other spellings of a name in a package with it. */
+static bool HidesMountedName(const PLPackageMount *a, const char *a_name, const PLPackageMount *b, const char *b_name) {
+    if(!ComparePackageNames(a->package, a_name, b_name)) {
+        return false;
+    }
+
+    return ((a->package->flags & PL_PACKAGEFLAG_NOCASE) || !(b->package->flags & PL_PACKAGEFLAG_NOCASE));
+}
+
+static void InsertMountedIndex(unsigned int mount, unsigned int i) {
+    const PLPackageMount *m = &mounts[mount];
+    const PLPackageIndex *index = &m->package->table[i];
+
+    uint32_t hash = HashPackageName(index->name, true);
+    unsigned int mask = mount_table_size - 1;
+    PLMountedIndex *hidden = NULL;
+    for(unsigned int slot = hash & mask;; slot = (slot + 1) & mask) {
+        PLMountedIndex *entry = &mount_table[slot];
+        if(entry->mount == 0) {
+            /* take over from the first one we hide, anything else we hide just loses out on lookup */
+            if(hidden == NULL) {
+                hidden = entry;
+                ++mount_table_used;
+            }
+
+            hidden->hash  = hash;
+            hidden->mount = mount + 1;
+            hidden->index = i;
+            return;
+        }
+
+        if(entry->hash != hash) {
+            continue;
+        }
+
+        const PLPackageMount *other = &mounts[entry->mount - 1];
+        const char *name = other->package->table[entry->index].name;
+        if(OutranksMount(m, other)) {
+            if(hidden == NULL && HidesMountedName(m, index->name, other, name)) {
+                hidden = entry;
+            }
+        } else if(HidesMountedName(other, name, m, index->name)) {
+            return;
+        }
+    }
+}
+
+/* Rebuilds the merged table from scratch, large enough to take at least the given number of entries. */
+static bool BuildMountTable(unsigned int num_entries) {
+    /* keep the table at most half full, so probes stay short */
+    unsigned int size = 16;
+    while(size < num_entries * 2) {
+        size <<= 1;
+    }
+
+    PLMountedIndex *table = calloc(size, sizeof(PLMountedIndex));
+    if(table == NULL) {
+        ReportError(PL_RESULT_MEMORYALLOC, "failed to allocate mount table");
+        return false;
+    }
+
+    free(mount_table);
+    mount_table = table;
+    mount_table_size = size;
+    mount_table_used = 0;
+
+    for(unsigned int i = 0; i < num_mounts; ++i) {
+        for(unsigned int j = 0; j < mounts[i].package->table_size; ++j) {
+            InsertMountedIndex(i, j);
+        }
+    }
+
+    return true;
+}
+
+static bool MountPackage(PLPackage *package, int priority) {
+    for(unsigned int i = 0; i < num_mounts; ++i) {
+        if(mounts[i].package == package) {
+            ReportError(PL_RESULT_FILEERR, "%s is already mounted", package->path);
+            return false;
+        }
+    }
+
+    PLPackageMount *new_mounts = realloc(mounts, sizeof(PLPackageMount) * (num_mounts + 1));
+    if(new_mounts == NULL) {
+        ReportError(PL_RESULT_MEMORYALLOC, "failed to allocate mount for %s", package->path);
+        return false;
+    }
+    mounts = new_mounts;
+
+    unsigned int mount = num_mounts++;
+    mounts[mount].package = package;
+    mounts[mount].priority = priority;
+    mounts[mount].order = mount_order++;
+
+    /* only grow the table if we have to, otherwise the package's entries just go on in */
+    if((mount_table_used + package->table_size) * 2 > mount_table_size) {
+        if(!BuildMountTable(mount_table_used + package->table_size)) {
+            --num_mounts;
+            return false;
+        }
+
+        return true;
+    }
+
+    for(unsigned int i = 0; i < package->table_size; ++i) {
+        InsertMountedIndex(mount, i);
+    }
+
+    return true;
+}
+
+bool plMountPackage(PLPackage *package, int priority) {
+    plAssert(package);
+
+    LockMounts();
+    bool result = MountPackage(package, priority);
+    UnlockMounts();
+
+    return result;
+}
+
+static void UnmountPackage(PLPackage *package) {
+    for(unsigned int i = 0; i < num_mounts; ++i) {
+        if(mounts[i].package != package) {
+            continue;
+        }
+
+        memmove(&mounts[i], &mounts[i + 1], sizeof(PLPackageMount) * (num_mounts - i - 1));
+        --num_mounts;
+
+        if(num_mounts == 0) {
+            free(mounts);
+            free(mount_table);
+            mounts = NULL;
+            mount_table = NULL;
+            mount_table_size = mount_table_used = 0;
+            return;
+        }
+
+        /* whatever this package was hiding needs to come back out, so start over */
+        unsigned int num_entries = 0;
+        for(unsigned int j = 0; j < num_mounts; ++j) {
+            num_entries += mounts[j].package->table_size;
+        }
+
+        if(!BuildMountTable(num_entries)) {
+            /* the old table refers to mounts that have since moved */
+            free(mount_table);
+            mount_table = NULL;
+            mount_table_size = mount_table_used = 0;
+        }
+        return;
+    }
+}
+
+void plUnmountPackage(PLPackage *package) {
+    plAssert(package);
+
+    LockMounts();
+    UnmountPackage(package);
+    UnlockMounts();
+}
+
+/* Must be called with the mounts locked, shared or otherwise. */
+static PLMountedIndex *FindMountedIndex(const char *file) {
+    if(mount_table == NULL) {
+        return NULL;
+    }
+
+    /* the same name can be held by several packages, if they each match it differently */
+    PLMountedIndex *found = NULL;
+    uint32_t hash = HashPackageName(file, true);
+    unsigned int mask = mount_table_size - 1;
+    for(unsigned int slot = hash & mask;; slot = (slot + 1) & mask) {
+        PLMountedIndex *entry = &mount_table[slot];
+        if(entry->mount == 0) {
+            return found;
+        }
+
+        const PLPackageMount *m = &mounts[entry->mount - 1];
+        if(entry->hash != hash || !ComparePackageNames(m->package, file, m->package->table[entry->index].name)) {
+            continue;
+        }
+
+        if(found == NULL || OutranksMount(m, &mounts[found->mount - 1])) {
+            found = entry;
+        }
+    }
+}
+
+/* Returns the package the given file would be loaded from, if any. */
+PLPackage *plGetMountedPackage(const char *file) {
+    LockMountsShared();
+    PLMountedIndex *entry = FindMountedIndex(file);
+    PLPackage *package = (entry != NULL) ? mounts[entry->mount - 1].package : NULL;
+    UnlockMountsShared();
+
+    return package;
+}
+
+static bool LoadMountedFile(const char *path, const char *file, const uint8_t **data, size_t *size) {
+    LockMountsShared();
+
+    PLMountedIndex *entry = FindMountedIndex(file);
+    if(entry == NULL) {
+        UnlockMountsShared();
+        ReportError(PL_RESULT_FILEPATH, "failed to find %s in mounted packages", file);
+        return false;
+    }
+
+    /* held onto throughout, so the package can't be unmounted from under us */
+    PLPackage *package = mounts[entry->mount - 1].package;
+    if(path != NULL && strcmp(package->path, path) != 0) {
+        UnlockMountsShared();
+        ReportError(PL_RESULT_FILEPATH, "%s isn't mounted from %s", file, path);
+        return false;
+    }
+
+    bool result = LoadPackageIndex(package, &package->table[entry->index], data, size);
+
+    UnlockMountsShared();
+
+    return result;
+}
+
+bool plLoadMountedFile(const char *file, const uint8_t **data, size_t *size) {
+    return LoadMountedFile(NULL, file, data, size);
+}
+
+/* As above, but only if the file would be loaded from the package at the given path. */
+bool plLoadMountedFileFrom(const char *path, const char *file, const uint8_t **data, size_t *size) {
+    plAssert(path);
+    return LoadMountedFile(path, file, data, size);
+}
+
+/* Whichever package now holds the name may not be the one the data came from,
+ * if anything's been mounted since, so the data is used to find it again. */
+void plReleaseMountedFile(const char *file, const uint8_t *data) {
+    LockMountsShared();
+
+    for(unsigned int i = 0; i < num_mounts; ++i) {
+        PLPackage *package = mounts[i].package;
+        PLPackageIndex *index = FindPackageIndex(package, file);
+        if(index != NULL && __atomic_load_n(&index->data, __ATOMIC_ACQUIRE) == data) {
+            ReleasePackageIndex(package, index);
+            break;
+        }
+    }
+
+    UnlockMountsShared();
+}
@@ -0,0 +1,854 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+
+#include "package_private.h"
+
+#if defined(PL_USE_ZLIB)
+#   include <zlib.h>
+#endif
+
+#if !defined(_WIN32)
+#   include <pthread.h>
+#   include <unistd.h>
+#endif
+
+/*  Platform Package Format  */
+/* Our own package format. The header and the indexes
+ * for every entry come first, so the whole table of
+ * contents can be pulled in with a single read, followed
+ * by the data for each entry, in the order of the indexes.
+ *
+ * Each entry's data begins on a PLPACKAGE_ALIGNMENT
+ * boundary, so that it can be mapped in as-is. Entries
+ * with identical data share it, with their indexes all
+ * pointing at the same offset.
+ *
+ * Entries can optionally be compressed, in which case
+ * they're split into PLPACKAGE_BLOCK_SIZE blocks that
+ * are each deflated on their own, so that part of an
+ * entry can be read without inflating all of it, and
+ * larger entries can be inflated across several threads.
+ */
+
+#define AlignPackageOffset(a)   (((a) + (PLPACKAGE_ALIGNMENT - 1)) & ~((uint64_t)PLPACKAGE_ALIGNMENT - 1))
+
+#define GetPackageBlockCount(length)    (((length) + (PLPACKAGE_BLOCK_SIZE - 1)) / PLPACKAGE_BLOCK_SIZE)
+
+/////////////////////////////////////////////////////////////////
+// Block Compression
+
+#define PLPACKAGE_MAX_INFLATE_THREADS   8
+
+bool plSetPackageCompression(PLPackage *package, unsigned int compression) {
+    plAssert(package);
+
+    switch(compression) {
+        case PL_PACKAGECOMPRESSION_NONE:
+#if defined(PL_USE_ZLIB)
+        case PL_PACKAGECOMPRESSION_DEFLATE:
+#endif
+            package->compression = compression;
+            return true;
+
+        default:
+            ReportError(PL_RESULT_FILETYPE, "unsupported package compression, %u", compression);
+            return false;
+    }
+}
+
+#if defined(PL_USE_ZLIB)
+
+static size_t GetPackageBlockLength(size_t length, size_t block) {
+    size_t remaining = length - block * PLPACKAGE_BLOCK_SIZE;
+    return (remaining < PLPACKAGE_BLOCK_SIZE) ? remaining : PLPACKAGE_BLOCK_SIZE;
+}
+
+static size_t GetPackageBlockEnd(const uint8_t *table, size_t block) {
+    uint32_t end;
+    memcpy(&end, table + block * sizeof(uint32_t), sizeof(uint32_t));
+    return end;
+}
+
+/* Makes sure the block table for an entry adds up, before we go anywhere near it. */
+static bool ValidatePackageBlocks(const PLPackageIndex *pi, const uint8_t *table) {
+    size_t num_blocks = GetPackageBlockCount(pi->length);
+    size_t blocks_length = pi->stored_length - num_blocks * sizeof(uint32_t);
+
+    size_t begin = 0;
+    for(size_t i = 0; i < num_blocks; ++i) {
+        size_t end = GetPackageBlockEnd(table, i);
+        if(end < begin || end - begin > GetPackageBlockLength(pi->length, i)) {
+            ReportError(PL_RESULT_FILETYPE, "invalid block table for %s", pi->name);
+            return false;
+        }
+
+        begin = end;
+    }
+
+    if(begin != blocks_length) {
+        ReportError(PL_RESULT_FILETYPE, "invalid block table for %s", pi->name);
+        return false;
+    }
+
+    return true;
+}
+
+/* Returns the entry split into deflated blocks, or NULL if it wasn't
+ * worth compressing, in which case it's just stored as-is. */
+static uint8_t *DeflatePackageEntry(const uint8_t *data, size_t length, size_t *stored_length) {
+    if(length == 0) {
+        return NULL;
+    }
+
+    size_t num_blocks = GetPackageBlockCount(length);
+    size_t table_length = num_blocks * sizeof(uint32_t);
+
+    uint8_t *stored = malloc(table_length + num_blocks * compressBound(PLPACKAGE_BLOCK_SIZE));
+    if(stored == NULL) {
+        ReportError(PL_RESULT_MEMORYALLOC, "failed to allocate compression buffer");
+        return NULL;
+    }
+
+    uint8_t *blocks = stored + table_length;
+    uint32_t end = 0;
+    for(size_t i = 0; i < num_blocks; ++i) {
+        const uint8_t *src = data + i * PLPACKAGE_BLOCK_SIZE;
+        size_t block_length = GetPackageBlockLength(length, i);
+
+        /* anything that doesn't get any smaller is stored as-is */
+        uLongf dest_length = compressBound(PLPACKAGE_BLOCK_SIZE);
+        if(compress2(blocks + end, &dest_length, src, block_length, Z_BEST_COMPRESSION) != Z_OK ||
+           dest_length >= block_length) {
+            memcpy(blocks + end, src, block_length);
+            dest_length = block_length;
+        }
+
+        end += (uint32_t)dest_length;
+        memcpy(stored + i * sizeof(uint32_t), &end, sizeof(uint32_t));
+    }
+
+    *stored_length = table_length + end;
+    if(*stored_length >= length) {
+        free(stored);
+        return NULL;
+    }
+
+    return stored;
+}
+
+/* helper threads currently inflating, across every load that's in flight */
+static unsigned int num_inflate_threads = 0;
+
+typedef struct PLPackageInflate {
+    const uint8_t *table;   // ends of every block in the entry
+    const uint8_t *blocks;  // stored data, from the first block we're after
+    size_t base;            // where the first block begins, relative to the end of the table
+    size_t length;          // uncompressed length of the entry
+
+    unsigned int first, num_blocks;
+    uint8_t *dest;          // where the first block is inflated to
+
+    unsigned int next;      // next block up for grabs
+    bool failed;
+} PLPackageInflate;
+
+static bool InflatePackageBlock(PLPackageInflate *job, unsigned int i) {
+    size_t block = job->first + i;
+    size_t begin = (block > 0) ? GetPackageBlockEnd(job->table, block - 1) : 0;
+    size_t end = GetPackageBlockEnd(job->table, block);
+    size_t block_length = GetPackageBlockLength(job->length, block);
+
+    const uint8_t *src = job->blocks + (begin - job->base);
+    uint8_t *dest = job->dest + (size_t)i * PLPACKAGE_BLOCK_SIZE;
+
+    if(end - begin == block_length) {
+        memcpy(dest, src, block_length);
+        return true;
+    }
+
+    uLongf dest_length = block_length;
+    return (uncompress(dest, &dest_length, src, end - begin) == Z_OK && dest_length == block_length);
+}
+
+static void *InflatePackageBlocks(void *data) {
+    PLPackageInflate *job = data;
+    for(;;) {
+        unsigned int i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+        if(i >= job->num_blocks) {
+            break;
+        }
+
+        if(!InflatePackageBlock(job, i)) {
+            __atomic_store_n(&job->failed, true, __ATOMIC_RELAXED);
+        }
+    }
+
+    return NULL;
+}
+
+#if !defined(_WIN32)
+/* Takes one of the helper threads that are shared between every load,
+ * so that many loads at once don't each go and spawn their own. */
+static bool ReserveInflateThread(unsigned int max_threads) {
+    unsigned int n = __atomic_load_n(&num_inflate_threads, __ATOMIC_RELAXED);
+    do {
+        if(n >= max_threads) {
+            return false;
+        }
+    } while(!__atomic_compare_exchange_n(&num_inflate_threads, &n, n + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    return true;
+}
+#endif
+
+/* Inflates each of the blocks for the job, spreading them
+ * across as many threads as is worthwhile for larger entries,
+ * with the calling thread always doing its share. */
+static bool InflatePackageEntry(PLPackageInflate *job) {
+    job->next = 0;
+    job->failed = false;
+
+#if !defined(_WIN32)
+    pthread_t threads[PLPACKAGE_MAX_INFLATE_THREADS - 1];
+    unsigned int num_threads = 0;
+
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned int max_helpers = PLPACKAGE_MAX_INFLATE_THREADS - 1;
+    if(num_cpus > 0 && max_helpers > (unsigned int)num_cpus - 1) {
+        max_helpers = (unsigned int)num_cpus - 1;
+    }
+
+    unsigned int wanted = job->num_blocks / 2;
+    while(num_threads + 1 < wanted && num_threads < max_helpers && ReserveInflateThread(max_helpers)) {
+        if(pthread_create(&threads[num_threads], NULL, InflatePackageBlocks, job) != 0) {
+            __atomic_fetch_sub(&num_inflate_threads, 1, __ATOMIC_RELAXED);
+            break;
+        }
+
+        ++num_threads;
+    }
+#endif
+
+    InflatePackageBlocks(job);
+
+#if !defined(_WIN32)
+    for(unsigned int i = 0; i < num_threads; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    __atomic_fetch_sub(&num_inflate_threads, num_threads, __ATOMIC_RELAXED);
+#endif
+
+    return !job->failed;
+}
+
+#endif
+
+/////////////////////////////////////////////////////////////////
+
+typedef struct PLPackageWriteIndex {
+    uint64_t offset;
+    uint32_t stored_length;
+    uint8_t compression;
+
+    uint32_t crc;       // of the entry's data, used to spot duplicates
+    unsigned int next;  // next entry written with the same hash, +1, 0 for none
+} PLPackageWriteIndex;
+
+/* Returns an entry that's already been written out with exactly the
+ * same data as the given one, or -1 if it's the first of its kind. */
+static int FindDuplicatePackageEntry(PLPackage *package, const PLPackageWriteIndex *indexes, unsigned int head,
+                                     unsigned int i, const uint8_t *data) {
+    const PLPackageIndex *index = &package->table[i];
+    for(unsigned int j = head; j != 0; j = indexes[j - 1].next) {
+        const PLPackageIndex *other = &package->table[j - 1];
+        if(indexes[j - 1].crc != indexes[i].crc || other->length != index->length) {
+            continue;
+        }
+
+        /* already sharing the same data within the package we're replacing, offsets
+         * only mean anything here as plWritePackage won't replace any other format */
+        if(package->LoadFile == LoadPACKPackageFile &&
+           index->data == NULL && other->data == NULL && index->offset == other->offset) {
+            return (int)(j - 1);
+        }
+
+        /* hashes can collide, so make sure */
+        const uint8_t *other_data = other->data;
+        uint8_t *loaded = NULL;
+        if(other_data == NULL) {
+            if((other_data = loaded = package->LoadFile(package, other)) == NULL) {
+                continue;
+            }
+        }
+
+        bool match = (memcmp(data, other_data, index->length) == 0);
+        free(loaded);
+
+        if(match) {
+            return (int)(j - 1);
+        }
+    }
+
+    return -1;
+}
+
+bool plWritePackage(PLPackage *package) {
+    plAssert(package);
+
+    if(!plIsValidString(package->path)) {
+        ReportError(PL_RESULT_FILEPATH, "invalid path for package");
+        return false;
+    }
+
+    /* we'd otherwise end up writing our own format over the top of someone else's */
+    if(package->LoadFile != NULL && package->LoadFile != LoadPACKPackageFile) {
+        ReportError(PL_RESULT_FILETYPE, "%s isn't one of our own packages, refusing to write over it", package->path);
+        return false;
+    }
+
+    /* anything mapped in goes once it's been replaced, so nothing can still be holding onto it */
+    for(unsigned int i = 0; i < package->table_size; ++i) {
+        if(package->table[i].pins > 0 && IsMappedPackageData(package, package->table[i].data)) {
+            ReportError(PL_RESULT_FILEERR, "%s is still held onto, can't replace %s", package->table[i].name, package->path);
+            return false;
+        }
+    }
+
+    size_t toc_length = 0;
+    for(unsigned int i = 0; i < package->table_size; ++i) {
+        if(package->table[i].length > UINT32_MAX) {
+            ReportError(PL_RESULT_FILESIZE, "%s is too large for package", package->table[i].name);
+            return false;
+        }
+
+        toc_length += PLPACKAGE_INDEX_LENGTH + strlen(package->table[i].name);
+    }
+
+    if(toc_length > UINT32_MAX) {
+        ReportError(PL_RESULT_FILESIZE, "too many entries for package");
+        return false;
+    }
+
+    /* Entries are hashed as they're written out, so that any sharing the same
+     * data can point at the same place rather than being written out again. */
+
+    unsigned int num_buckets = 16;
+    while(num_buckets < package->table_size) {
+        num_buckets <<= 1;
+    }
+
+    PLPackageWriteIndex *indexes = calloc(package->table_size > 0 ? package->table_size : 1, sizeof(PLPackageWriteIndex));
+    unsigned int *buckets = calloc(num_buckets, sizeof(unsigned int));
+    if(indexes == NULL || buckets == NULL) {
+        ReportError(PL_RESULT_MEMORYALLOC, "failed to allocate indexes for package");
+        free(indexes);
+        free(buckets);
+        return false;
+    }
+
+    /* The package is written out under a temporary name first, as we may well be
+     * reading entries out of the one we're replacing as we go. */
+
+    char tmp_path[PL_SYSTEM_MAX_PATH + 5];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", package->path);
+
+    FILE *out = fopen(tmp_path, "wb");
+    if(out == NULL) {
+        ReportError(PL_RESULT_FILEREAD, "failed to open %s for writing: %s", tmp_path, strerror(errno));
+        free(indexes);
+        free(buckets);
+        return false;
+    }
+
+    /* Where each entry ends up isn't known until it's been compressed, so the data
+     * is written first and the table of contents goes in ahead of it afterwards. */
+
+    static const uint8_t padding[PLPACKAGE_ALIGNMENT] = { 0 };
+
+    uint64_t position = PLPACKAGE_HEADER_LENGTH + toc_length;
+    if(fseek(out, (long)position, SEEK_SET) != 0) {
+        ReportError(PL_RESULT_FILEERR, "failed to seek in %s", tmp_path);
+        goto FAILED;
+    }
+
+    for(unsigned int i = 0; i < package->table_size; ++i) {
+        PLPackageIndex *index = &package->table[i];
+
+        const uint8_t *data = index->data;
+        uint8_t *loaded = NULL;
+        if(data == NULL) {
+            /* Entry hasn't been loaded in, so pull it through from the original. */
+
+            if(package->LoadFile == NULL) {
+                ReportError(PL_RESULT_FILEREAD, "no means to load %s from package", index->name);
+                goto FAILED;
+            }
+
+            if((data = loaded = package->LoadFile(package, index)) == NULL) {
+                goto FAILED;
+            }
+        }
+
+        pl_crc32(data, index->length, &indexes[i].crc);
+
+        unsigned int *bucket = &buckets[indexes[i].crc & (num_buckets - 1)];
+        int duplicate = FindDuplicatePackageEntry(package, indexes, *bucket, i, data);
+        if(duplicate != -1) {
+            indexes[i].offset = indexes[duplicate].offset;
+            indexes[i].stored_length = indexes[duplicate].stored_length;
+            indexes[i].compression = indexes[duplicate].compression;
+
+            free(loaded);
+            continue;
+        }
+
+        indexes[i].next = *bucket;
+        *bucket = i + 1;
+
+        indexes[i].offset = AlignPackageOffset(position);
+        fwrite(padding, sizeof(uint8_t), (size_t)(indexes[i].offset - position), out);
+
+        size_t stored_length = index->length;
+        uint8_t *stored = NULL;
+#if defined(PL_USE_ZLIB)
+        if(package->compression == PL_PACKAGECOMPRESSION_DEFLATE) {
+            stored = DeflatePackageEntry(data, index->length, &stored_length);
+        }
+#endif
+
+        if(stored != NULL) {
+            indexes[i].compression = PL_PACKAGECOMPRESSION_DEFLATE;
+            fwrite(stored, sizeof(uint8_t), stored_length, out);
+        } else {
+            stored_length = index->length;
+            indexes[i].compression = PL_PACKAGECOMPRESSION_NONE;
+            fwrite(data, sizeof(uint8_t), stored_length, out);
+        }
+
+        indexes[i].stored_length = (uint32_t)stored_length;
+        position = indexes[i].offset + stored_length;
+
+        free(stored);
+        free(loaded);
+    }
+
+    if(fseek(out, 0, SEEK_SET) != 0) {
+        ReportError(PL_RESULT_FILEERR, "failed to seek in %s", tmp_path);
+        goto FAILED;
+    }
+
+    WritePackageHeader(out, package->table_size, (uint32_t)toc_length);
+    for(unsigned int i = 0; i < package->table_size; ++i) {
+        WritePackageIndexHeader(out, PLPACKAGE_UNKNOWN_INDEX, (uint32_t)package->table[i].length);
+        fwrite(&indexes[i].offset, sizeof(uint64_t), 1, out);
+        fwrite(&indexes[i].stored_length, sizeof(uint32_t), 1, out);
+        fwrite(&indexes[i].compression, sizeof(uint8_t), 1, out);
+
+        uint8_t name_length = (uint8_t)strlen(package->table[i].name);
+        fwrite(&name_length, sizeof(uint8_t), 1, out);
+        fwrite(package->table[i].name, sizeof(char), name_length, out);
+    }
+
+    if(ferror(out) || fclose(out) != 0) {
+        out = NULL;
+        ReportError(PL_RESULT_FILEERR, "failed to write %s", tmp_path);
+        goto FAILED;
+    }
+    out = NULL;
+
+#if !defined(_WIN32)
+    if(rename(tmp_path, package->path) != 0) {
+        ReportError(PL_RESULT_FILEERR, "failed to replace %s: %s", package->path, strerror(errno));
+        goto FAILED;
+    }
+#else
+    /* rename won't go over the top of an existing file here */
+    if(!MoveFileExA(tmp_path, package->path, MOVEFILE_REPLACE_EXISTING)) {
+        ReportError(PL_RESULT_FILEERR, "failed to replace %s: %s", package->path,
+                    GetLastError_strerror(GetLastError()));
+        goto FAILED;
+    }
+#endif
+
+    /* Anything loaded on demand from here on comes out of what we just wrote. */
+    for(unsigned int i = 0; i < package->table_size; ++i) {
+        PLPackageIndex *index = &package->table[i];
+        index->offset = indexes[i].offset;
+        index->compression = indexes[i].compression;
+        index->stored_length = (index->compression != PL_PACKAGECOMPRESSION_NONE) ? indexes[i].stored_length : 0;
+    }
+    package->LoadFile = LoadPACKPackageFile;
+
+    free(indexes);
+    free(buckets);
+
+    return ReopenPackageIO(package);
+
+    FAILED:
+
+    if(out != NULL) {
+        fclose(out);
+    }
+
+    remove(tmp_path);
+    free(indexes);
+    free(buckets);
+
+    return false;
+}
+
+/////////////////////////////////////////////////////////////////
+
+PLPackage *LoadPACKPackage(const char *filename, unsigned int flags) {
+    PLPackage *package = NULL;
+    FILE *fh = NULL;
+
+    uint8_t *mapping = NULL;
+    uint8_t *toc_data = NULL;
+
+    const uint8_t *header;
+    const uint8_t *toc;
+    size_t file_size = 0;
+
+    uint8_t header_data[PLPACKAGE_HEADER_LENGTH];
+
+    if(flags & PL_PACKAGEFLAG_MAP) {
+        mapping = MapPackageFile(filename, &file_size);
+        if(mapping == NULL || file_size < PLPACKAGE_HEADER_LENGTH) {
+            goto FAILED;
+        }
+
+        header = mapping;
+    } else {
+        fh = fopen(filename, "rb");
+        if(fh == NULL) {
+            goto FAILED;
+        }
+
+        file_size = plGetFileSize(filename);
+        if(fread(header_data, sizeof(header_data), 1, fh) != 1) {
+            goto FAILED;
+        }
+
+        header = header_data;
+    }
+
+    if(memcmp(header, "PACK", 4) != 0) {
+        goto FAILED;
+    }
+
+    if(header[4] != PLPACKAGE_VERSION_MAJOR) {
+        ReportError(PL_RESULT_FILEVERSION, "unsupported package version, %d.%d", header[4], header[5]);
+        goto FAILED;
+    }
+
+    /* 1.0 packages predate compression, so their indexes are shorter */
+    size_t index_length = (header[5] >= 1) ? PLPACKAGE_INDEX_LENGTH : PLPACKAGE_INDEX_LENGTH_1_0;
+
+    uint32_t num_indexes, toc_length;
+    memcpy(&num_indexes, header + 6, sizeof(uint32_t));
+    memcpy(&toc_length, header + 10, sizeof(uint32_t));
+
+    if(toc_length > file_size - PLPACKAGE_HEADER_LENGTH ||
+       (uint64_t)num_indexes * index_length > toc_length) {
+        ReportError(PL_RESULT_FILESIZE, "invalid table of contents in package");
+        goto FAILED;
+    }
+
+    if(mapping != NULL) {
+        toc = mapping + PLPACKAGE_HEADER_LENGTH;
+    } else {
+        toc_data = malloc(toc_length > 0 ? toc_length : 1);
+        if(toc_data == NULL) {
+            ReportError(PL_RESULT_MEMORYALLOC, "failed to allocate %u bytes for package", toc_length);
+            goto FAILED;
+        }
+
+        if(toc_length > 0 && fread(toc_data, toc_length, 1, fh) != 1) {
+            ReportError(PL_RESULT_FILEREAD, "failed to read table of contents for package");
+            goto FAILED;
+        }
+
+        toc = toc_data;
+    }
+
+    package = calloc(1, sizeof(PLPackage));
+    if(package == NULL) {
+        goto FAILED;
+    }
+
+    package->LoadFile   = LoadPACKPackageFile;
+    package->table_size = num_indexes;
+    package->table      = calloc(num_indexes, sizeof(struct PLPackageIndex));
+    if(package->table == NULL && num_indexes > 0) {
+        goto FAILED;
+    }
+
+    const uint8_t *pos = toc, *end = toc + toc_length;
+    for(unsigned int i = 0; i < num_indexes; ++i) {
+        if((size_t)(end - pos) < index_length) {
+            goto INVALID_INDEX;
+        }
+
+        uint32_t length;
+        uint64_t offset;
+        memcpy(&length, pos + 2, sizeof(uint32_t));
+        memcpy(&offset, pos + 6, sizeof(uint64_t));
+
+        uint32_t stored_length = length;
+        uint8_t compression = PL_PACKAGECOMPRESSION_NONE;
+        if(index_length == PLPACKAGE_INDEX_LENGTH) {
+            memcpy(&stored_length, pos + 14, sizeof(uint32_t));
+            compression = pos[18];
+        }
+
+        uint8_t name_length = pos[index_length - 1];
+        pos += index_length;
+        if(name_length == 0 || end - pos < name_length) {
+            goto INVALID_INDEX;
+        }
+
+        if(offset > file_size || stored_length > file_size - offset) {
+            goto INVALID_INDEX;
+        }
+
+        if(compression == PL_PACKAGECOMPRESSION_NONE) {
+            if(stored_length != length) {
+                goto INVALID_INDEX;
+            }
+        } else if(compression == PL_PACKAGECOMPRESSION_DEFLATE) {
+            if(stored_length < GetPackageBlockCount((uint64_t)length) * sizeof(uint32_t)) {
+                goto INVALID_INDEX;
+            }
+
+            package->table[i].stored_length = stored_length;
+        } else {
+            goto INVALID_INDEX;
+        }
+
+        package->table[i].compression = compression;
+
+        memcpy(package->table[i].name, pos, name_length);
+        package->table[i].name[name_length] = '\0';
+        pos += name_length;
+
+        package->table[i].length = length;
+        package->table[i].offset = (size_t)offset;
+
+        /* compressed entries are inflated on demand, even when mapped, and empty
+         * ones would otherwise point off the end of the mapping */
+        if(mapping != NULL && compression == PL_PACKAGECOMPRESSION_NONE && length > 0) {
+            package->table[i].data = mapping + offset;
+        }
+    }
+
+    if(mapping != NULL) {
+        package->mapping      = mapping;
+        package->mapping_size = file_size;
+        return package;
+    }
+
+    free(toc_data);
+    fclose(fh);
+
+    return package;
+
+    INVALID_INDEX:
+    ReportError(PL_RESULT_FILETYPE, "invalid index in package");
+
+    FAILED:
+
+    if(package != NULL) {
+        plDeletePackage(package);
+    }
+
+    UnmapPackageFile(mapping, file_size);
+    free(toc_data);
+
+    if(fh != NULL) {
+        fclose(fh);
+    }
+
+    return NULL;
+}
+
+#if defined(PL_USE_ZLIB)
+static uint8_t *InflatePACKPackageFile(PLPackage *package, const PLPackageIndex *pi) {
+    size_t table_length = GetPackageBlockCount(pi->length) * sizeof(uint32_t);
+
+    /* mapped packages can be inflated from directly, otherwise it all comes in with a single read */
+    const uint8_t *stored = NULL;
+    uint8_t *stored_data = NULL;
+    if(package->mapping != NULL) {
+        stored = package->mapping + pi->offset;
+    } else {
+        stored_data = malloc(pi->stored_length > 0 ? pi->stored_length : 1);
+        if(stored_data == NULL) {
+            ReportError(PL_RESULT_MEMORYALLOC, "Failed to allocate %d bytes!\n", pi->stored_length);
+            return NULL;
+        }
+
+        if(!ReadPackageData(package, stored_data, pi->stored_length, pi->offset)) {
+            free(stored_data);
+            return NULL;
+        }
+
+        stored = stored_data;
+    }
+
+    uint8_t *data = NULL;
+    if(!ValidatePackageBlocks(pi, stored)) {
+        goto FAILED;
+    }
+
+    data = malloc(pi->length > 0 ? pi->length : 1);
+    if(data == NULL) {
+        ReportError(PL_RESULT_MEMORYALLOC, "Failed to allocate %d bytes!\n", pi->length);
+        goto FAILED;
+    }
+
+    PLPackageInflate job;
+    memset(&job, 0, sizeof(PLPackageInflate));
+    job.table       = stored;
+    job.blocks      = stored + table_length;
+    job.length      = pi->length;
+    job.num_blocks  = (unsigned int)GetPackageBlockCount(pi->length);
+    job.dest        = data;
+    if(!InflatePackageEntry(&job)) {
+        ReportError(PL_RESULT_FILEREAD, "failed to inflate %s", pi->name);
+        goto FAILED;
+    }
+
+    free(stored_data);
+
+    return data;
+
+    FAILED:
+
+    free(stored_data);
+    free(data);
+
+    return NULL;
+}
+#endif
+
+uint8_t *LoadPACKPackageFile(PLPackage *package, const PLPackageIndex *pi) {
+    if(pi->compression != PL_PACKAGECOMPRESSION_NONE) {
+#if defined(PL_USE_ZLIB)
+        return InflatePACKPackageFile(package, pi);
+#else
+        ReportError(PL_RESULT_FILETYPE, "%s is compressed, but compression isn't supported", pi->name);
+        return NULL;
+#endif
+    }
+
+    uint8_t *data = malloc(pi->length > 0 ? pi->length : 1);
+    if(data == NULL) {
+        ReportError(PL_RESULT_MEMORYALLOC, "Failed to allocate %d bytes!\n", pi->length);
+        return NULL;
+    }
+
+    if(!ReadPackageData(package, data, pi->length, pi->offset)) {
+        free(data);
+        return NULL;
+    }
+
+    return data;
+}
+
+/* Reads part of an entry, inflating only the blocks it spans. */
+bool ReadPACKPackageRange(PLPackage *package, const PLPackageIndex *pi, size_t offset, size_t length, uint8_t *dest) {
+    if(pi->compression == PL_PACKAGECOMPRESSION_NONE) {
+        return ReadPackageData(package, dest, length, pi->offset + offset);
+    }
+
+    if(length == 0) {
+        return true;
+    }
+
+#if !defined(PL_USE_ZLIB)
+    ReportError(PL_RESULT_FILETYPE, "%s is compressed, but compression isn't supported", pi->name);
+    return false;
+#else
+    size_t num_blocks = GetPackageBlockCount(pi->length);
+    size_t table_length = num_blocks * sizeof(uint32_t);
+
+    size_t first = offset / PLPACKAGE_BLOCK_SIZE;
+    size_t last = (offset + length - 1) / PLPACKAGE_BLOCK_SIZE;
+
+    bool result = false;
+    uint8_t *blocks = NULL, *inflated = NULL;
+    uint8_t *table = malloc(table_length);
+    if(table == NULL) {
+        ReportError(PL_RESULT_MEMORYALLOC, "Failed to allocate %d bytes!\n", table_length);
+        return false;
+    }
+
+    if(!ReadPackageData(package, table, table_length, pi->offset) || !ValidatePackageBlocks(pi, table)) {
+        goto FINISHED;
+    }
+
+    size_t begin = (first > 0) ? GetPackageBlockEnd(table, first - 1) : 0;
+    size_t end = GetPackageBlockEnd(table, last);
+
+    blocks = malloc(end - begin > 0 ? end - begin : 1);
+    inflated = malloc((last - first + 1) * PLPACKAGE_BLOCK_SIZE);
+    if(blocks == NULL || inflated == NULL) {
+        ReportError(PL_RESULT_MEMORYALLOC, "failed to allocate buffers for %s", pi->name);
+        goto FINISHED;
+    }
+
+    if(!ReadPackageData(package, blocks, end - begin, pi->offset + table_length + begin)) {
+        goto FINISHED;
+    }
+
+    PLPackageInflate job;
+    memset(&job, 0, sizeof(PLPackageInflate));
+    job.table       = table;
+    job.blocks      = blocks;
+    job.base        = begin;
+    job.length      = pi->length;
+    job.first       = (unsigned int)first;
+    job.num_blocks  = (unsigned int)(last - first + 1);
+    job.dest        = inflated;
+    if(!InflatePackageEntry(&job)) {
+        ReportError(PL_RESULT_FILEREAD, "failed to inflate %s", pi->name);
+        goto FINISHED;
+    }
+
+    memcpy(dest, inflated + (offset - first * PLPACKAGE_BLOCK_SIZE), length);
+    result = true;
+
+    FINISHED:
+
+    free(table);
+    free(blocks);
+    free(inflated);
+
+    return result;
+#endif
+}
@@ -31,7 +31,15 @@ For more information, please refer to <http://unlicense.org>
 #include <PL/platform_package.h>
 
 #define PLPACKAGE_VERSION_MAJOR     1
-#define PLPACKAGE_VERSION_MINOR     0
+#define PLPACKAGE_VERSION_MINOR     1
+
+/* data for each entry starts on a page boundary,
+ * so it can be mapped in directly */
+#define PLPACKAGE_ALIGNMENT         4096
+
+/* compressed entries are split into blocks of this size
+ * (bar the last), each of which inflates on its own */
+#define PLPACKAGE_BLOCK_SIZE        65536
 
 enum {
     PLPACKAGE_LEVEL_INDEX,
@@ -60,22 +68,37 @@ typedef struct PLPackageHeader { // (PACKAGE)
     uint8_t     identity[4];    // Descriptor/name of the data type. "PACK"
     uint8_t     version[2];     // Version of this type.
 
-    uint32_t    num_indexes;    // Number of data indexes (each _should_ be a fixed size?)
+    uint32_t    num_indexes;    // Number of data indexes
+    uint32_t    toc_length;     // Length of all the indexes that follow, in bytes
 
     // followed by num_indexes + length
-    // then followed by rest of data
+    // then followed by rest of data, each aligned to PLPACKAGE_ALIGNMENT
 } PLPackageHeader;
 
+#define PLPACKAGE_HEADER_LENGTH     14  // as written, without any padding
+
 typedef struct PLPackageIndexHeader {
     uint16_t type;
-    uint32_t length;
+    uint32_t length;    // Length of the entry's data
 
     // followed by type-specific index information
+    //  uint64_t    offset          offset of the entry's data from the start of the package
+    //  uint32_t    stored_length   length of the data as stored (1.1)
+    //  uint8_t     compression     see PLPackageCompression (1.1)
+    //  uint8_t     name_length
+    //  char        name[name_length]
+
+    // compressed data begins with the end of each block, as uint32_t
+    // and relative to the end of that table, followed by the blocks;
+    // any block that's as long as its uncompressed data is stored as-is
 } PLPackageIndexHeader;
 
+#define PLPACKAGE_INDEX_LENGTH      (2 + 4 + 8 + 4 + 1 + 1)  // as written, without the name
+#define PLPACKAGE_INDEX_LENGTH_1_0  (2 + 4 + 8 + 1)
+
 PL_EXTERN_C
 
-PL_INLINE static void WritePackageHeader(FILE *handle, uint32_t num_indexes) {
+PL_INLINE static void WritePackageHeader(FILE *handle, uint32_t num_indexes, uint32_t toc_length) {
     plAssert(handle);
     uint8_t identity [4]= { 'P', 'A', 'C', 'K' };
     fwrite(identity, sizeof(char), sizeof(identity), handle);
@@ -85,6 +108,7 @@ PL_INLINE static void WritePackageHeader(FILE *handle, uint32_t num_indexes) {
     };
     fwrite(version, sizeof(uint8_t), sizeof(version), handle);
     fwrite(&num_indexes, sizeof(uint32_t), 1, handle);
+    fwrite(&toc_length, sizeof(uint32_t), 1, handle);
 }
 
 PL_INLINE static void WritePackageIndexHeader(FILE *handle, uint16_t type, uint32_t length) {
@@ -95,11 +119,29 @@ PL_INLINE static void WritePackageIndexHeader(FILE *handle, uint16_t type, uint3
 
 /////////////////////////////////////////////////////////////////
 
-PLPackage *LoadMADPackage(const char *filename, bool cache);
-bool LoadMADPackageFile(FILE *fh, PLPackageIndex *pi);
+uint32_t HashPackageName(const char *name, bool nocase);
+bool ComparePackageNames(const PLPackage *package, const char *a, const char *b);
+PLPackageIndex *FindPackageIndex(PLPackage *package, const char *name);
+bool LoadPackageIndex(PLPackage *package, PLPackageIndex *index, const uint8_t **data, size_t *size);
+void ReleasePackageIndex(PLPackage *package, PLPackageIndex *index);
+
+uint8_t *MapPackageFile(const char *path, size_t *size);
+void UnmapPackageFile(uint8_t *mapping, size_t size);
+bool IsMappedPackageData(const PLPackage *package, const uint8_t *data);
+
+bool OpenPackageIO(PLPackage *package, const char *path);
+bool ReopenPackageIO(PLPackage *package);
+bool ReadPackageData(PLPackage *package, uint8_t *dest, size_t length, size_t offset);
+
+PLPackage *LoadPACKPackage(const char *filename, unsigned int flags);
+uint8_t *LoadPACKPackageFile(PLPackage *package, const PLPackageIndex *pi);
+bool ReadPACKPackageRange(PLPackage *package, const PLPackageIndex *pi, size_t offset, size_t length, uint8_t *dest);
+
+PLPackage *LoadMADPackage(const char *filename, unsigned int flags);
+uint8_t *LoadMADPackageFile(PLPackage *package, const PLPackageIndex *pi);
 
-PLPackage *LoadARTPackage(const char *filename, bool precache);
-bool LoadARTPackageFile(FILE *fh, PLPackageIndex *pi);
+PLPackage *LoadARTPackage(const char *filename, unsigned int flags);
+uint8_t *LoadARTPackageFile(PLPackage *package, const PLPackageIndex *pi);
 
 PL_EXTERN_C_END
 
@@ -68,7 +68,7 @@ PLSubSystem pl_subsystems[]= {
         {
                 PL_SUBSYSTEM_IMAGE,
                 NULL,
-                NULL
+                &ShutdownImage
         },
 
         {
@@ -0,0 +1,357 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+#define _FILE_OFFSET_BITS 64        // so off_t can reach beyond 2GiB everywhere
+#define _POSIX_C_SOURCE 200809L     // fseeko, ftello
+
+#include <PL/platform_filesystem.h>
+
+#if !defined(_WIN32)
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <fcntl.h>
+#   include <unistd.h>
+#endif
+
+/*	Binary Reading	*/
+
+#define PL_BINARY_READER_BUFFER_SIZE    (64 * 1024)
+
+/* long is only 32-bit on Windows and 32-bit systems, which would
+ * leave anything past the first 2GiB of a file out of reach */
+static int64_t TellBinaryFile(FILE *file) {
+#if !defined(_WIN32)
+    return (int64_t)ftello(file);
+#else
+    return _ftelli64(file);
+#endif
+}
+
+static bool SeekBinaryFile(FILE *file, int64_t offset, int whence) {
+#if !defined(_WIN32)
+    return (fseeko(file, (off_t)offset, whence) == 0);
+#else
+    return (_fseeki64(file, offset, whence) == 0);
+#endif
+}
+
+void plSetupBinaryReader(PLBinaryReader *reader, const void *data, size_t length) {
+    plAssert(reader);
+
+    memset(reader, 0, sizeof(PLBinaryReader));
+    reader->data = data;
+    reader->size = length;
+    reader->length = length;
+}
+
+/* Reads through the given file from wherever it currently is, the
+ * file shouldn't be touched by anything else until we're done. */
+bool plSetupBinaryReaderFile(PLBinaryReader *reader, FILE *file) {
+    plAssert(reader);
+    plAssert(file);
+
+    memset(reader, 0, sizeof(PLBinaryReader));
+
+    int64_t start = TellBinaryFile(file);
+    if(start < 0 || !SeekBinaryFile(file, 0, SEEK_END)) {
+        ReportError(PL_RESULT_FILEERR, "failed to seek through file");
+        return false;
+    }
+
+    int64_t end = TellBinaryFile(file);
+    if(end < start || !SeekBinaryFile(file, start, SEEK_SET)) {
+        ReportError(PL_RESULT_FILEERR, "failed to seek through file");
+        return false;
+    }
+
+    if((uint64_t)end > SIZE_MAX) {
+        ReportError(PL_RESULT_FILEERR, "file is too large to read through");
+        return false;
+    }
+
+    reader->buffer = malloc(PL_BINARY_READER_BUFFER_SIZE);
+    if(reader->buffer == NULL) {
+        ReportError(PL_RESULT_MEMORYALLOC, "failed to allocate read buffer");
+        return false;
+    }
+
+    reader->buffer_size = PL_BINARY_READER_BUFFER_SIZE;
+    reader->data = reader->buffer;
+    reader->offset = (size_t)start;
+    reader->length = (size_t)end;
+    reader->file = file;
+
+    return true;
+}
+
+/* Opens the given file for reading, mapping it in if asked
+ * and possible, otherwise reading through it in chunks. */
+bool plOpenBinaryReader(PLBinaryReader *reader, const char *path, bool map) {
+    plAssert(reader);
+
+#if !defined(_WIN32)
+    if(map) {
+        int fd = open(path, O_RDONLY);
+        if(fd == -1) {
+            ReportError(PL_RESULT_FILEREAD, "failed to open %s: %s", path, strerror(errno));
+            return false;
+        }
+
+        struct stat st;
+        void *mapping = MAP_FAILED;
+        if(fstat(fd, &st) == 0 && st.st_size > 0) {
+            mapping = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        close(fd);
+
+        /* anything that can't be mapped, such as an empty file, is just read instead */
+        if(mapping != MAP_FAILED) {
+            plSetupBinaryReader(reader, mapping, (size_t)st.st_size);
+            reader->mapping = mapping;
+            reader->mapping_size = (size_t)st.st_size;
+            return true;
+        }
+    }
+#endif
+
+    FILE *file = fopen(path, "rb");
+    if(file == NULL) {
+        ReportError(PL_RESULT_FILEREAD, "failed to open %s: %s", path, strerror(errno));
+        return false;
+    }
+
+    if(!plSetupBinaryReaderFile(reader, file)) {
+        fclose(file);
+        return false;
+    }
+
+    reader->owns_file = true;
+    return true;
+}
+
+void plCloseBinaryReader(PLBinaryReader *reader) {
+    if(reader == NULL) {
+        return;
+    }
+
+    free(reader->buffer);
+
+    if(reader->owns_file) {
+        fclose(reader->file);
+    }
+
+#if !defined(_WIN32)
+    if(reader->mapping != NULL) {
+        munmap(reader->mapping, reader->mapping_size);
+    }
+#endif
+
+    memset(reader, 0, sizeof(PLBinaryReader));
+}
+
+size_t plGetBinaryReaderOffset(const PLBinaryReader *reader) {
+    return reader->offset + reader->position;
+}
+
+bool plSeekBinaryReader(PLBinaryReader *reader, size_t offset) {
+    plAssert(reader);
+
+    if(offset > reader->length) {
+        ReportError(PL_RESULT_FILEREAD, "seek beyond end of data, %lu", (unsigned long)offset);
+        reader->error = true;
+        return false;
+    }
+
+    if(offset >= reader->offset && offset - reader->offset <= reader->size) {
+        reader->position = offset - reader->offset;
+        return true;
+    }
+
+    /* outside of what's buffered, so throw it away and pick back up from there next read */
+    plAssert(reader->file);
+    reader->offset = offset;
+    reader->size = reader->position = 0;
+
+    return true;
+}
+
+bool plSkipBinaryReader(PLBinaryReader *reader, size_t length) {
+    return plSeekBinaryReader(reader, plGetBinaryReaderOffset(reader) + length);
+}
+
+/* Fills the buffer from the given offset onwards, with at least length bytes. */
+static bool FillBinaryReader(PLBinaryReader *reader, size_t offset, size_t length) {
+    if(length > reader->buffer_size) {
+        uint8_t *buffer = realloc(reader->buffer, length);
+        if(buffer == NULL) {
+            ReportError(PL_RESULT_MEMORYALLOC, "failed to allocate read buffer");
+            return false;
+        }
+
+        reader->buffer = buffer;
+        reader->buffer_size = length;
+    }
+
+    reader->data = reader->buffer;
+    reader->offset = offset;
+    reader->size = reader->position = 0;
+
+    if(!SeekBinaryFile(reader->file, (int64_t)offset, SEEK_SET)) {
+        return false;
+    }
+
+    reader->size = fread(reader->buffer, 1, reader->buffer_size, reader->file);
+    return (reader->size >= length);
+}
+
+bool plReadBinary(PLBinaryReader *reader, void *dest, size_t length) {
+    uint8_t *out = dest;
+    size_t remaining = length;
+
+    if(reader->error) {
+        goto FAILED;
+    }
+
+    size_t available = reader->size - reader->position;
+    if(available >= remaining) {
+        memcpy(out, reader->data + reader->position, remaining);
+        reader->position += remaining;
+        return true;
+    }
+
+    if(reader->file == NULL) {
+        goto UNEXPECTED_EOF;
+    }
+
+    memcpy(out, reader->data + reader->position, available);
+    out += available;
+    remaining -= available;
+    reader->position = reader->size;
+
+    size_t offset = reader->offset + reader->size;
+    if(remaining >= reader->buffer_size) {
+        /* too big to be worth buffering, so read it straight in */
+        if(!SeekBinaryFile(reader->file, (int64_t)offset, SEEK_SET) || fread(out, 1, remaining, reader->file) != remaining) {
+            goto UNEXPECTED_EOF;
+        }
+
+        reader->offset = offset + remaining;
+        reader->size = reader->position = 0;
+        return true;
+    }
+
+    if(!FillBinaryReader(reader, offset, remaining)) {
+        goto UNEXPECTED_EOF;
+    }
+
+    memcpy(out, reader->data, remaining);
+    reader->position = remaining;
+    return true;
+
+    UNEXPECTED_EOF:
+    ReportError(PL_RESULT_FILEREAD, "unexpected end of data at %lu", (unsigned long)plGetBinaryReaderOffset(reader));
+    reader->error = true;
+
+    FAILED:
+    memset(dest, 0, length);
+    return false;
+}
+
+/* Returns the next length bytes without copying them out, if the
+ * source is in memory, and advances past them. The pointer is only
+ * valid until the next read. */
+const uint8_t *plGetBinaryReaderData(PLBinaryReader *reader, size_t length) {
+    if(reader->error) {
+        return NULL;
+    }
+
+    if(reader->size - reader->position < length &&
+       (reader->file == NULL || !FillBinaryReader(reader, plGetBinaryReaderOffset(reader), length))) {
+        ReportError(PL_RESULT_FILEREAD, "unexpected end of data at %lu", (unsigned long)plGetBinaryReaderOffset(reader));
+        reader->error = true;
+        return NULL;
+    }
+
+    const uint8_t *data = reader->data + reader->position;
+    reader->position += length;
+    return data;
+}
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#   define PL_BINARY_BIG_ENDIAN
+#endif
+
+static void SwapBinaryUInt16(uint16_t *data, size_t count) {
+    for(size_t i = 0; i < count; ++i) {
+        data[i] = (uint16_t)((data[i] >> 8) | (data[i] << 8));
+    }
+}
+
+static void SwapBinaryUInt32(uint32_t *data, size_t count) {
+    for(size_t i = 0; i < count; ++i) {
+        data[i] = __builtin_bswap32(data[i]);
+    }
+}
+
+bool plReadBinaryLittleUInt16Array(PLBinaryReader *reader, uint16_t *dest, size_t count) {
+    if(!plReadBinary(reader, dest, count * sizeof(uint16_t))) {
+        return false;
+    }
+#if defined(PL_BINARY_BIG_ENDIAN)
+    SwapBinaryUInt16(dest, count);
+#endif
+    return true;
+}
+
+bool plReadBinaryLittleUInt32Array(PLBinaryReader *reader, uint32_t *dest, size_t count) {
+    if(!plReadBinary(reader, dest, count * sizeof(uint32_t))) {
+        return false;
+    }
+#if defined(PL_BINARY_BIG_ENDIAN)
+    SwapBinaryUInt32(dest, count);
+#endif
+    return true;
+}
+
+bool plReadBinaryBigUInt16Array(PLBinaryReader *reader, uint16_t *dest, size_t count) {
+    if(!plReadBinary(reader, dest, count * sizeof(uint16_t))) {
+        return false;
+    }
+#if !defined(PL_BINARY_BIG_ENDIAN)
+    SwapBinaryUInt16(dest, count);
+#endif
+    return true;
+}
+
+bool plReadBinaryBigUInt32Array(PLBinaryReader *reader, uint32_t *dest, size_t count) {
+    if(!plReadBinary(reader, dest, count * sizeof(uint32_t))) {
+        return false;
+    }
+#if !defined(PL_BINARY_BIG_ENDIAN)
+    SwapBinaryUInt32(dest, count);
+#endif
+    return true;
+}
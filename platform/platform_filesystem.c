@@ -24,10 +24,17 @@ OTHER DEALINGS IN THE SOFTWARE.
 
 For more information, please refer to <http://unlicense.org>
 */
+#define _GNU_SOURCE // copy_file_range
+
 #ifndef _WIN32
 #   include <sys/stat.h>
 #include <sys/types.h>
+#if defined(__linux__)
+#   include <sys/sendfile.h>
+#endif
 #include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
 #endif
 
 #include <PL/platform_filesystem.h>
@@ -168,73 +175,309 @@ void plGetUserName(char *out) {
     //strncpy(out, cUser, sizeof(out));
 }
 
-/*	Scans the given directory.
-	On each found file it calls the given function to handle the file.
-*/
-void plScanDirectory(const char *path, const char *extension, void (*Function)(const char *), bool recursive) {
-    char filestring[PL_SYSTEM_MAX_PATH + 1];
-#ifdef _WIN32
-        WIN32_FIND_DATA	finddata;
-        HANDLE			find;
+/////////////////////////////////////////////////////////////////////////////////////
+// Directory Scanning
+
+#define PL_MAX_WALK_THREADS     8
+
+typedef struct PLDirectoryWalk {
+    const char *extension;
+    void (*Function)(const char *path, void *user);
+    void *user;
+    unsigned int flags;
+
+#if !defined(_WIN32)
+    /* directories waiting on a thread to walk them, only used with PL_WALKFLAG_THREADED */
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    char **queue;
+    unsigned int queue_size, queue_max;
+    unsigned int num_busy, num_idle;
+#endif
+} PLDirectoryWalk;
+
+static void WalkDirectoryFile(PLDirectoryWalk *walk, const char *path, const char *name) {
+    if(walk->extension == NULL || pl_strcasecmp(plGetFileExtension(name), walk->extension) == 0) {
+        walk->Function(path, walk->user);
+    }
+}
+
+#if !defined(_WIN32)
+
+static bool QueueWalkDirectory(PLDirectoryWalk *walk, const char *path) {
+    char *copy = strdup(path);
+    if(copy == NULL) {
+        return false;
+    }
+
+    pthread_mutex_lock(&walk->lock);
+    if(walk->queue_size == walk->queue_max) {
+        unsigned int max = (walk->queue_max > 0) ? walk->queue_max * 2 : 64;
+        char **queue = realloc(walk->queue, sizeof(char*) * max);
+        if(queue == NULL) {
+            pthread_mutex_unlock(&walk->lock);
+            free(copy);
+            return false;
+        }
+
+        walk->queue = queue;
+        walk->queue_max = max;
+    }
+
+    walk->queue[walk->queue_size++] = copy;
+    pthread_cond_signal(&walk->wake);
+    pthread_mutex_unlock(&walk->lock);
+
+    return true;
+}
+
+typedef struct PLDirectoryFrame {
+    DIR *directory;
+    size_t length;  // of the path up to and including this directory
+} PLDirectoryFrame;
+
+/* Walks everything under the given directory without recursing, keeping
+ * a handle open for each level so every directory is opened relative to
+ * its parent, and only stat'ing entries whose type isn't already known.
+ * When threaded, subdirectories are handed off to any idle threads.
+ */
+static void WalkDirectoryTree(PLDirectoryWalk *walk, const char *root) {
+    char path[PL_SYSTEM_MAX_PATH + 1];
+    strncpy(path, root, sizeof(path) - 1);
+    path[sizeof(path) - 1] = '\0';
+
+    size_t length = strlen(path);
+    while(length > 1 && path[length - 1] == '/') {
+        path[--length] = '\0';
+    }
 
-        snprintf(filestring, sizeof(filestring), "%s/*", path);
+    DIR *directory = opendir(path);
+    if(directory == NULL) {
+        ReportError(PL_RESULT_FILEPATH, "failed to open %s: %s", path, strerror(errno));
+        return;
+    }
 
-        find = FindFirstFile(filestring, &finddata);
-        if (find == INVALID_HANDLE_VALUE) {
-            plSetError("Failed to find an initial file!\n");
-            return;
+    unsigned int num_frames = 0, max_frames = 16;
+    PLDirectoryFrame *frames = malloc(sizeof(PLDirectoryFrame) * max_frames);
+    if(frames == NULL) {
+        ReportError(PL_RESULT_MEMORYALLOC, "failed to allocate directory stack");
+        closedir(directory);
+        return;
+    }
+
+    frames[num_frames].directory = directory;
+    frames[num_frames++].length = length;
+
+    while(num_frames > 0) {
+        PLDirectoryFrame *frame = &frames[num_frames - 1];
+
+        struct dirent *entry = readdir(frame->directory);
+        if(entry == NULL) {
+            closedir(frame->directory);
+            --num_frames;
+            continue;
         }
 
-        do {
-            if(strcmp(finddata.cFileName, ".") == 0 || strcmp(finddata.cFileName, "..") == 0) {
+        if(strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+
+        int n = snprintf(path + frame->length, sizeof(path) - frame->length, "/%s", entry->d_name);
+        if(n < 0 || (size_t)n >= sizeof(path) - frame->length) {
+            continue;
+        }
+
+        /* symbolic links are followed, as stat would */
+        unsigned char type = entry->d_type;
+        if(type == DT_UNKNOWN || type == DT_LNK) {
+            struct stat st;
+            if(fstatat(dirfd(frame->directory), entry->d_name, &st, 0) != 0) {
                 continue;
             }
 
-            snprintf(filestring, sizeof(filestring), "%s/%s", path, finddata.cFileName);
+            type = S_ISDIR(st.st_mode) ? DT_DIR : (S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN);
+        }
 
-            if(finddata.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
-                if(recursive) {
-                    plScanDirectory(filestring, extension, Function, recursive);
-                }
+        if(type == DT_REG) {
+            WalkDirectoryFile(walk, path, entry->d_name);
+            continue;
+        } else if(type != DT_DIR || !(walk->flags & PL_WALKFLAG_RECURSIVE)) {
+            continue;
+        }
+
+        if((walk->flags & PL_WALKFLAG_THREADED) && __atomic_load_n(&walk->num_idle, __ATOMIC_RELAXED) > 0 &&
+           QueueWalkDirectory(walk, path)) {
+            continue;
+        }
+
+        int fd = openat(dirfd(frame->directory), entry->d_name, O_RDONLY | O_DIRECTORY);
+        if(fd == -1) {
+            continue;
+        }
+
+        if((directory = fdopendir(fd)) == NULL) {
+            close(fd);
+            continue;
+        }
+
+        length = frame->length + (size_t)n;
+        if(num_frames == max_frames) {
+            PLDirectoryFrame *new_frames = realloc(frames, sizeof(PLDirectoryFrame) * max_frames * 2);
+            if(new_frames == NULL) {
+                closedir(directory);
+                continue;
             }
-            else{
-                if(pl_strcasecmp(plGetFileExtension(finddata.cFileName), extension) == 0) {
-                    Function(filestring);
-                }
+
+            frames = new_frames;
+            max_frames *= 2;
+        }
+
+        frames[num_frames].directory = directory;
+        frames[num_frames++].length = length;
+    }
+
+    free(frames);
+}
+
+/* Each thread takes the next directory off the queue, until
+ * it's empty and nobody's left who could add anything more. */
+static void *WalkDirectoryThread(void *data) {
+    PLDirectoryWalk *walk = data;
+
+    pthread_mutex_lock(&walk->lock);
+    for(;;) {
+        if(walk->queue_size == 0) {
+            if(walk->num_busy == 0) {
+                break;
             }
-        } while(FindNextFile(find, &finddata));
 
-        FindClose(find);
+            __atomic_add_fetch(&walk->num_idle, 1, __ATOMIC_RELAXED);
+            pthread_cond_wait(&walk->wake, &walk->lock);
+            __atomic_sub_fetch(&walk->num_idle, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+
+        char *path = walk->queue[--walk->queue_size];
+        walk->num_busy++;
+        pthread_mutex_unlock(&walk->lock);
+
+        WalkDirectoryTree(walk, path);
+        free(path);
+
+        pthread_mutex_lock(&walk->lock);
+        walk->num_busy--;
+    }
+
+    /* wake everyone else up so they see we're done */
+    pthread_cond_broadcast(&walk->wake);
+    pthread_mutex_unlock(&walk->lock);
+
+    return NULL;
+}
+
 #else
-    DIR *directory = opendir(path);
-    if (directory) {
-        struct dirent *entry;
-        while ((entry = readdir(directory))) {
-            if(strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
-                continue;
-            }
 
-            snprintf(filestring, sizeof(filestring), "%s/%s", path, entry->d_name);
+static void WalkDirectoryTree(PLDirectoryWalk *walk, const char *path) {
+    char filestring[PL_SYSTEM_MAX_PATH + 1];
+    WIN32_FIND_DATA finddata;
 
-            struct stat st;
-            if(stat(filestring, &st) == 0) {
-                if(S_ISREG(st.st_mode)) {
-                    if(pl_strcasecmp(plGetFileExtension(entry->d_name), extension) == 0) {
-                        Function(filestring);
-                    }
-                } else if(S_ISDIR(st.st_mode) && recursive) {
-                    plScanDirectory(filestring, extension, Function, recursive);
-                }
+    snprintf(filestring, sizeof(filestring), "%s/*", path);
+
+    HANDLE find = FindFirstFile(filestring, &finddata);
+    if (find == INVALID_HANDLE_VALUE) {
+        ReportError(PL_RESULT_FILEPATH, "failed to find an initial file in %s", path);
+        return;
+    }
+
+    do {
+        if(strcmp(finddata.cFileName, ".") == 0 || strcmp(finddata.cFileName, "..") == 0) {
+            continue;
+        }
+
+        snprintf(filestring, sizeof(filestring), "%s/%s", path, finddata.cFileName);
+
+        if(finddata.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            if(walk->flags & PL_WALKFLAG_RECURSIVE) {
+                WalkDirectoryTree(walk, filestring);
             }
+        } else {
+            WalkDirectoryFile(walk, filestring, finddata.cFileName);
         }
+    } while(FindNextFile(find, &finddata));
 
-        closedir(directory);
+    FindClose(find);
+}
+
+#endif
+
+/*	Walks the given directory, calling the given function for each file found
+	with a matching extension, or for every file if the extension is NULL.
+*/
+void plWalkDirectory(const char *path, const char *extension,
+                     void (*Function)(const char *path, void *user), void *user, unsigned int flags) {
+    plAssert(path);
+    plAssert(Function);
+
+    PLDirectoryWalk walk;
+    memset(&walk, 0, sizeof(PLDirectoryWalk));
+    walk.extension = extension;
+    walk.Function = Function;
+    walk.user = user;
+    walk.flags = flags;
+
+#if !defined(_WIN32)
+    if(!(flags & PL_WALKFLAG_THREADED) || !(flags & PL_WALKFLAG_RECURSIVE)) {
+        WalkDirectoryTree(&walk, path);
+        return;
+    }
+
+    pthread_mutex_init(&walk.lock, NULL);
+    pthread_cond_init(&walk.wake, NULL);
+
+    if(!QueueWalkDirectory(&walk, path)) {
+        ReportError(PL_RESULT_MEMORYALLOC, "failed to queue %s", path);
     } else {
-        ReportError(PL_RESULT_FILEPATH, "opendir failed!");
+        long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        unsigned int max_threads = (num_cpus > 0 && num_cpus < PL_MAX_WALK_THREADS) ? (unsigned int)num_cpus : PL_MAX_WALK_THREADS;
+
+        pthread_t threads[PL_MAX_WALK_THREADS - 1];
+        unsigned int num_threads = 0;
+        while(num_threads + 1 < max_threads &&
+              pthread_create(&threads[num_threads], NULL, WalkDirectoryThread, &walk) == 0) {
+            ++num_threads;
+        }
+
+        WalkDirectoryThread(&walk);
+
+        for(unsigned int i = 0; i < num_threads; ++i) {
+            pthread_join(threads[i], NULL);
+        }
     }
+
+    free(walk.queue);
+    pthread_cond_destroy(&walk.wake);
+    pthread_mutex_destroy(&walk.lock);
+#else
+    WalkDirectoryTree(&walk, path);
 #endif
 }
 
+typedef struct PLScanDirectory {
+    void (*Function)(const char *);
+} PLScanDirectory;
+
+static void ScanDirectoryFunction(const char *path, void *user) {
+    ((PLScanDirectory*)user)->Function(path);
+}
+
+/*	Scans the given directory.
+	On each found file it calls the given function to handle the file.
+*/
+void plScanDirectory(const char *path, const char *extension, void (*Function)(const char *), bool recursive) {
+    PLScanDirectory scan = { Function };
+    plWalkDirectory(path, extension, ScanDirectoryFunction, &scan, recursive ? PL_WALKFLAG_RECURSIVE : 0);
+}
+
 const char *plGetWorkingDirectory(void) {
     static char out[PL_SYSTEM_MAX_PATH] = { '\0' };
     if (getcwd(out, PL_SYSTEM_MAX_PATH) == NULL) {
@@ -286,38 +529,221 @@ bool plDeleteFile(const char *path) {
     return false;
 }
 
+#define PL_COPY_CHUNK_SIZE      (8 * 1024 * 1024)   // copied between each progress update
+#define PL_COPY_BUFFER_SIZE     (256 * 1024)        // used if the copy can't be done for us
+
+#if !defined(_WIN32)
+
+enum {
+    PL_COPY_RANGE,      // copy_file_range, can be done entirely by the filesystem
+    PL_COPY_SENDFILE,   // sendfile, still kept within the kernel
+    PL_COPY_BUFFERED,   // read and write through our own buffer
+};
+
+/* copy_file_range and this form of sendfile are only found on Linux */
+#if defined(__linux__)
+#   define PL_COPY_FIRST_METHOD PL_COPY_RANGE
+#else
+#   define PL_COPY_FIRST_METHOD PL_COPY_BUFFERED
+#endif
+
+/* Copies up to length bytes from one to the other, falling back on each
+ * method in turn if it's not supported here. Returns the number of bytes
+ * copied, 0 once the end of the file is reached or -1 on failure. */
+static ssize_t CopyFileChunk(int in, int out, size_t length, int *method, uint8_t **buffer) {
+    for(;;) {
+        ssize_t bytes;
+        switch(*method) {
+#if defined(__linux__)
+            case PL_COPY_RANGE:
+                bytes = copy_file_range(in, NULL, out, NULL, length, 0);
+                if(bytes < 0 && (errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP)) {
+                    *method = PL_COPY_SENDFILE;
+                    continue;
+                }
+                break;
+
+            case PL_COPY_SENDFILE:
+                bytes = sendfile(out, in, NULL, length);
+                if(bytes < 0 && (errno == ENOSYS || errno == EINVAL)) {
+                    *method = PL_COPY_BUFFERED;
+                    continue;
+                }
+                break;
+#endif
+
+            default:
+                if(*buffer == NULL && (*buffer = malloc(PL_COPY_BUFFER_SIZE)) == NULL) {
+                    return -1;
+                }
+
+                if(length > PL_COPY_BUFFER_SIZE) {
+                    length = PL_COPY_BUFFER_SIZE;
+                }
+
+                if((bytes = read(in, *buffer, length)) > 0) {
+                    for(ssize_t written = 0; written < bytes;) {
+                        ssize_t n = write(out, *buffer + written, (size_t)(bytes - written));
+                        if(n < 0 && errno == EINTR) {
+                            continue;
+                        } else if(n <= 0) {
+                            return -1;
+                        }
+                        written += n;
+                    }
+                }
+                break;
+        }
+
+        if(bytes < 0 && errno == EINTR) {
+            continue;
+        }
+
+        return bytes;
+    }
+}
+
+#endif
+
 bool plCopyFile(const char *path, const char *dest) {
-    FILE *fold = fopen(path, "rb");
-    if(fold == NULL) {
+    return plCopyFileWithProgress(path, dest, NULL, NULL);
+}
+
+/* Copies the file without ever holding more than a small buffer of it,
+ * and where supported without it ever leaving the kernel. The callback,
+ * if given, is called as the copy progresses and can return false to
+ * cancel it, in which case the partial copy is removed.
+ */
+bool plCopyFileWithProgress(const char *path, const char *dest,
+                            bool (*Progress)(size_t copied, size_t total, void *user), void *user) {
+    size_t copied = 0;
+    bool result = false;
+
+#if !defined(_WIN32)
+    int in = open(path, O_RDONLY);
+    if(in == -1) {
         ReportError(PL_RESULT_FILEREAD, "Failed to open %s!", path);
         return false;
     }
 
-    fseek(fold, 0, SEEK_END);
-    size_t file_size = (size_t)ftell(fold);
-    fseek(fold, 0, SEEK_SET);
+    struct stat st;
+    if(fstat(in, &st) != 0) {
+        ReportError(PL_RESULT_FILEERR, "failed to stat %s: %s", path, strerror(errno));
+        close(in);
+        return false;
+    }
 
-    uint8_t *data = calloc(file_size, 1);
-    if(data == NULL) {
-        fclose(fold);
-        ReportError(PL_RESULT_MEMORYALLOC, "Failed to allocate buffer for %s, with size %d!", path, file_size);
+    /* not truncated until we know it isn't the file we're copying from */
+    int out = open(dest, O_WRONLY | O_CREAT, st.st_mode & 0777);
+    if(out == -1) {
+        ReportError(PL_RESULT_FILEREAD, "Failed to write %s!", dest);
+        close(in);
         return false;
     }
 
-    fread(data, 1, file_size, fold);
-    fclose(fold);
+    struct stat dest_st;
+    if(fstat(out, &dest_st) != 0) {
+        ReportError(PL_RESULT_FILEERR, "failed to stat %s: %s", dest, strerror(errno));
+        close(in);
+        close(out);
+        return false;
+    } else if(dest_st.st_dev == st.st_dev && dest_st.st_ino == st.st_ino) {
+        ReportError(PL_RESULT_FILEERR, "can't copy %s over itself", path);
+        close(in);
+        close(out);
+        return false;
+    }
+
+    if(ftruncate(out, 0) != 0) {
+        ReportError(PL_RESULT_FILEERR, "failed to truncate %s: %s", dest, strerror(errno));
+        close(in);
+        close(out);
+        remove(dest);
+        return false;
+    }
+
+#if defined(__linux__)
+    posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    size_t total = (size_t)st.st_size;
+    int method = PL_COPY_FIRST_METHOD;
+    uint8_t *buffer = NULL;
+
+    for(;;) {
+        ssize_t bytes = CopyFileChunk(in, out, PL_COPY_CHUNK_SIZE, &method, &buffer);
+        if(bytes < 0) {
+            ReportError(PL_RESULT_FILEERR, "failed to copy %s to %s: %s", path, dest, strerror(errno));
+            break;
+        } else if(bytes == 0) {
+            result = true;
+            break;
+        }
+
+        copied += (size_t)bytes;
+        if(Progress != NULL && !Progress(copied, total, user)) {
+            ReportError(PL_RESULT_FILEERR, "copy of %s was cancelled", path);
+            break;
+        }
+    }
+
+    free(buffer);
+    close(in);
+
+    if(close(out) != 0 && result) {
+        ReportError(PL_RESULT_FILEERR, "failed to write %s: %s", dest, strerror(errno));
+        result = false;
+    }
+#else
+    FILE *in = fopen(path, "rb");
+    if(in == NULL) {
+        ReportError(PL_RESULT_FILEREAD, "Failed to open %s!", path);
+        return false;
+    }
 
     FILE *out = fopen(dest, "wb");
-    if(out == NULL || (fwrite(data, 1, file_size, out) != file_size)) {
-        free(data);
+    uint8_t *buffer = malloc(PL_COPY_BUFFER_SIZE);
+    if(out == NULL || buffer == NULL) {
         ReportError(PL_RESULT_FILEREAD, "Failed to write %s!", dest);
-        return false;
+        goto FINISHED;
     }
-    fclose(out);
 
-    free(data);
+    size_t total = plGetFileSize(path);
+    for(;;) {
+        size_t bytes = fread(buffer, 1, PL_COPY_BUFFER_SIZE, in);
+        if(bytes == 0) {
+            result = !ferror(in);
+            break;
+        }
 
-    return true;
+        if(fwrite(buffer, 1, bytes, out) != bytes) {
+            ReportError(PL_RESULT_FILEERR, "failed to write %s", dest);
+            break;
+        }
+
+        copied += bytes;
+        if(Progress != NULL && !Progress(copied, total, user)) {
+            ReportError(PL_RESULT_FILEERR, "copy of %s was cancelled", path);
+            break;
+        }
+    }
+
+    FINISHED:
+
+    free(buffer);
+    fclose(in);
+
+    if(out != NULL && fclose(out) != 0 && result) {
+        ReportError(PL_RESULT_FILEERR, "failed to write %s", dest);
+        result = false;
+    }
+#endif
+
+    if(!result) {
+        remove(dest);
+    }
+
+    return result;
 }
 
 size_t plGetFileSize(const char *path) {
@@ -333,15 +759,17 @@ size_t plGetFileSize(const char *path) {
 ///////////////////////////////////////////
 
 int16_t plGetLittleShort(FILE *fin) {
-    int b1 = fgetc(fin);
-    int b2 = fgetc(fin);
-    return (int16_t) (b1 + b2 * 256);
+    uint8_t b[2] = { 0 };
+    if(fread(b, sizeof(b), 1, fin) != 1) {
+        return -1;
+    }
+    return (int16_t)(b[0] | (b[1] << 8));
 }
 
 int32_t plGetLittleLong(FILE *fin) {
-    int b1 = fgetc(fin);
-    int b2 = fgetc(fin);
-    int b3 = fgetc(fin);
-    int b4 = fgetc(fin);
-    return b1 + (b2 << 8) + (b3 << 16) + (b4 << 24);
+    uint8_t b[4] = { 0 };
+    if(fread(b, sizeof(b), 1, fin) != 1) {
+        return -1;
+    }
+    return (int32_t)((uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24));
 }
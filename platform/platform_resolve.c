@@ -0,0 +1,427 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+
+#define _DEFAULT_SOURCE // strdup, d_type
+
+#include <PL/platform_filesystem.h>
+
+#if !defined(_WIN32)
+#   include <sys/stat.h>
+#   include <dirent.h>
+#   include <pthread.h>
+#endif
+
+/*	Path Resolution	*/
+/* Each directory passed through is listed once and kept in a table keyed
+ * by its name folded to lower case, so later lookups within it are done
+ * without going anywhere near the disk. Nothing is checked on a hit, but
+ * before a lookup is allowed to fail, each directory it was answered from
+ * has its modified time checked against the one it was listed with, and
+ * is listed again if it's changed.
+ *
+ * Windows already ignores case, so paths are just passed through there.
+ */
+
+#if !defined(_WIN32)
+
+#if defined(__APPLE__)
+#   define PL_RESOLVE_MTIME(st) ((st).st_mtimespec)
+#else
+#   define PL_RESOLVE_MTIME(st) ((st).st_mtim)
+#endif
+
+typedef struct PLResolveName {
+    uint32_t hash;      // Of the name folded to lower case
+    uint32_t name;      // Offset of the name within names, +1, 0 for an empty slot
+} PLResolveName;
+
+typedef struct PLResolveDirectory {
+    char *path;         // As found on disk
+    uint32_t hash;
+    struct timespec mtime;
+
+    char *names;        // Every entry's name, one after the other
+    PLResolveName *table;
+    unsigned int table_size;
+} PLResolveDirectory;
+
+static struct {
+    PLResolveDirectory **directories;   // Open-addressed, keyed on path
+    unsigned int size, used;
+
+    pthread_mutex_t lock;
+} resolve_cache = { NULL, 0, 0, PTHREAD_MUTEX_INITIALIZER };
+
+static uint32_t HashResolveName(const char *name, size_t length, bool nocase) {
+    uint32_t hash = 2166136261u;
+    for(size_t i = 0; i < length; ++i) {
+        unsigned char c = (unsigned char)name[i];
+        hash ^= nocase ? (unsigned char)tolower(c) : c;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static void DeleteResolveDirectory(PLResolveDirectory *directory) {
+    if(directory == NULL) {
+        return;
+    }
+
+    free(directory->path);
+    free(directory->names);
+    free(directory->table);
+    free(directory);
+}
+
+static bool ListResolveDirectory(PLResolveDirectory *directory) {
+    DIR *dir = opendir(directory->path);
+    if(dir == NULL) {
+        return false;
+    }
+
+    struct stat st;
+    if(fstat(dirfd(dir), &st) != 0) {
+        closedir(dir);
+        return false;
+    }
+
+    size_t names_length = 0, names_size = 1024;
+    char *names = malloc(names_size);
+    unsigned int num_names = 0;
+    if(names == NULL) {
+        closedir(dir);
+        return false;
+    }
+
+    struct dirent *entry;
+    while((entry = readdir(dir)) != NULL) {
+        if(strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+
+        size_t length = strlen(entry->d_name) + 1;
+        if(names_length + length > names_size) {
+            while(names_length + length > names_size) {
+                names_size *= 2;
+            }
+
+            char *resized = realloc(names, names_size);
+            if(resized == NULL) {
+                free(names);
+                closedir(dir);
+                return false;
+            }
+            names = resized;
+        }
+
+        memcpy(names + names_length, entry->d_name, length);
+        names_length += length;
+        num_names++;
+    }
+    closedir(dir);
+
+    unsigned int table_size = 16;
+    while(table_size < num_names * 2) {
+        table_size *= 2;
+    }
+
+    PLResolveName *table = calloc(table_size, sizeof(PLResolveName));
+    if(table == NULL) {
+        free(names);
+        return false;
+    }
+
+    for(size_t offset = 0; offset < names_length; offset += strlen(names + offset) + 1) {
+        uint32_t hash = HashResolveName(names + offset, strlen(names + offset), true);
+        unsigned int slot = hash & (table_size - 1);
+        while(table[slot].name != 0) {
+            slot = (slot + 1) & (table_size - 1);
+        }
+
+        table[slot].hash = hash;
+        table[slot].name = (uint32_t)(offset + 1);
+    }
+
+    free(directory->names);
+    free(directory->table);
+
+    directory->names = names;
+    directory->table = table;
+    directory->table_size = table_size;
+    directory->mtime = PL_RESOLVE_MTIME(st);
+
+    return true;
+}
+
+/* Returns the real name of the given entry, preferring one that
+ * matches exactly if there's more than one differing only in case. */
+static const char *FindResolveName(const PLResolveDirectory *directory, const char *name, size_t length) {
+    const char *found = NULL;
+
+    uint32_t hash = HashResolveName(name, length, true);
+    for(unsigned int slot = hash & (directory->table_size - 1); directory->table[slot].name != 0;
+        slot = (slot + 1) & (directory->table_size - 1)) {
+        if(directory->table[slot].hash != hash) {
+            continue;
+        }
+
+        const char *candidate = directory->names + directory->table[slot].name - 1;
+        if(strlen(candidate) != length || pl_strncasecmp(candidate, name, length) != 0) {
+            continue;
+        }
+
+        if(strncmp(candidate, name, length) == 0) {
+            return candidate;
+        }
+
+        if(found == NULL) {
+            found = candidate;
+        }
+    }
+
+    return found;
+}
+
+static bool GrowResolveCache(void) {
+    unsigned int size = (resolve_cache.size == 0) ? 64 : resolve_cache.size * 2;
+    PLResolveDirectory **directories = calloc(size, sizeof(PLResolveDirectory*));
+    if(directories == NULL) {
+        return false;
+    }
+
+    for(unsigned int i = 0; i < resolve_cache.size; ++i) {
+        PLResolveDirectory *directory = resolve_cache.directories[i];
+        if(directory == NULL) {
+            continue;
+        }
+
+        unsigned int slot = directory->hash & (size - 1);
+        while(directories[slot] != NULL) {
+            slot = (slot + 1) & (size - 1);
+        }
+        directories[slot] = directory;
+    }
+
+    free(resolve_cache.directories);
+    resolve_cache.directories = directories;
+    resolve_cache.size = size;
+
+    return true;
+}
+
+/* Returns the cached listing for the given directory, listing it if
+ * we've not been through it before. Must be called with the lock held. */
+static PLResolveDirectory *GetResolveDirectory(const char *path, bool *listed) {
+    *listed = false;
+
+    size_t length = strlen(path);
+    uint32_t hash = HashResolveName(path, length, false);
+    if(resolve_cache.size > 0) {
+        for(unsigned int slot = hash & (resolve_cache.size - 1); resolve_cache.directories[slot] != NULL;
+            slot = (slot + 1) & (resolve_cache.size - 1)) {
+            PLResolveDirectory *directory = resolve_cache.directories[slot];
+            if(directory->hash == hash && strcmp(directory->path, path) == 0) {
+                return directory;
+            }
+        }
+    }
+
+    if((resolve_cache.used + 1) * 2 > resolve_cache.size && !GrowResolveCache()) {
+        return NULL;
+    }
+
+    PLResolveDirectory *directory = calloc(1, sizeof(PLResolveDirectory));
+    if(directory == NULL || (directory->path = strdup(path)) == NULL || !ListResolveDirectory(directory)) {
+        DeleteResolveDirectory(directory);
+        return NULL;
+    }
+    directory->hash = hash;
+
+    unsigned int slot = hash & (resolve_cache.size - 1);
+    while(resolve_cache.directories[slot] != NULL) {
+        slot = (slot + 1) & (resolve_cache.size - 1);
+    }
+    resolve_cache.directories[slot] = directory;
+    resolve_cache.used++;
+
+    *listed = true;
+    return directory;
+}
+
+/* Lists the directory again if it's been modified since it was last listed. */
+static bool RefreshResolveDirectory(PLResolveDirectory *directory) {
+    struct stat st;
+    if(stat(directory->path, &st) != 0) {
+        return false;
+    }
+
+    struct timespec mtime = PL_RESOLVE_MTIME(st);
+    if(mtime.tv_sec == directory->mtime.tv_sec && mtime.tv_nsec == directory->mtime.tv_nsec) {
+        return false;
+    }
+
+    return ListResolveDirectory(directory);
+}
+
+static bool ResolvePath(const char *path, char *dest, size_t dest_length) {
+    size_t length = 0;
+    if(path[0] == '/') {
+        dest[length++] = '/';
+    }
+    dest[length] = '\0';
+
+    const char *c = path;
+    while(*c != '\0') {
+        while(*c == '/') {
+            c++;
+        }
+        if(*c == '\0') {
+            break;
+        }
+
+        const char *name = c;
+        while(*c != '\0' && *c != '/') {
+            c++;
+        }
+        size_t name_length = (size_t)(c - name);
+
+        const char *real = NULL;
+        if((name_length == 1 && name[0] == '.') || (name_length == 2 && name[0] == '.' && name[1] == '.')) {
+            real = name;
+        } else {
+            bool listed;
+            PLResolveDirectory *directory = GetResolveDirectory((length == 0) ? "." : dest, &listed);
+            if(directory == NULL) {
+                return false;
+            }
+
+            real = FindResolveName(directory, name, name_length);
+            if(real == NULL && !listed && RefreshResolveDirectory(directory)) {
+                real = FindResolveName(directory, name, name_length);
+            }
+
+            if(real == NULL) {
+                return false;
+            }
+        }
+
+        if(length > 0 && dest[length - 1] != '/') {
+            if(length + 1 >= dest_length) {
+                return false;
+            }
+            dest[length++] = '/';
+        }
+
+        if(length + name_length >= dest_length) {
+            return false;
+        }
+
+        memcpy(dest + length, real, name_length);
+        length += name_length;
+        dest[length] = '\0';
+    }
+
+    return true;
+}
+
+#endif
+
+/* Finds the file or directory on disk matching the given path, regardless
+ * of the case of each part of it, and writes out its real path. Safe to
+ * call from any number of threads. */
+bool plResolvePath(const char *path, char *dest, size_t length) {
+    plAssert(path && dest && length > 0);
+
+    if(*path == '\0') {
+        ReportError(PL_RESULT_FILEPATH, "empty path");
+        return false;
+    }
+
+#if !defined(_WIN32)
+    pthread_mutex_lock(&resolve_cache.lock);
+    bool result = ResolvePath(path, dest, length);
+    pthread_mutex_unlock(&resolve_cache.lock);
+#else
+    bool result = (strlen(path) < length && plFileExists(path));
+    if(result) {
+        strcpy(dest, path);
+    }
+#endif
+
+    if(!result) {
+        ReportError(PL_RESULT_FILEPATH, "failed to resolve %s", path);
+        dest[0] = '\0';
+    }
+
+    return result;
+}
+
+/* Throws away the listing for the given directory, as it was resolved,
+ * or for every directory if NULL, so it's listed again on next use. */
+void plInvalidatePathCache(const char *path) {
+#if !defined(_WIN32)
+    pthread_mutex_lock(&resolve_cache.lock);
+
+    for(unsigned int i = 0; i < resolve_cache.size; ++i) {
+        PLResolveDirectory *directory = resolve_cache.directories[i];
+        if(directory == NULL || (path != NULL && strcmp(directory->path, path) != 0)) {
+            continue;
+        }
+
+        DeleteResolveDirectory(directory);
+        resolve_cache.directories[i] = NULL;
+        resolve_cache.used--;
+    }
+
+    /* removing anything leaves holes in the chains, so put the rest back in */
+    PLResolveDirectory **directories = resolve_cache.directories;
+    unsigned int size = resolve_cache.size;
+    resolve_cache.directories = NULL;
+    resolve_cache.size = resolve_cache.used = 0;
+
+    for(unsigned int i = 0; i < size; ++i) {
+        if(directories[i] == NULL) {
+            continue;
+        }
+
+        if((resolve_cache.used + 1) * 2 > resolve_cache.size && !GrowResolveCache()) {
+            DeleteResolveDirectory(directories[i]);
+            continue;
+        }
+
+        unsigned int slot = directories[i]->hash & (resolve_cache.size - 1);
+        while(resolve_cache.directories[slot] != NULL) {
+            slot = (slot + 1) & (resolve_cache.size - 1);
+        }
+        resolve_cache.directories[slot] = directories[i];
+        resolve_cache.used++;
+    }
+    free(directories);
+
+    pthread_mutex_unlock(&resolve_cache.lock);
+#endif
+}
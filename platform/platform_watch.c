@@ -0,0 +1,616 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org>
+*/
+#define _DEFAULT_SOURCE // strdup
+
+#include <PL/platform_filesystem.h>
+
+#if defined(__linux__)
+#   include <sys/inotify.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#endif
+
+/*	File Watching	*/
+/* Rather than checking each file for changes, the directories they're in
+ * are handed over to inotify, which queues up anything that happens in
+ * them. Nothing is done until the queue is polled, at which point it's
+ * read through in one go and the changes for each path are merged into
+ * a single event. Watching the directory rather than the file itself
+ * means that files which are replaced, as many editors do, keep being
+ * watched. Directories aren't watched recursively.
+ *
+ * Paths are kept without any "." or doubled up and trailing slashes, so
+ * that they can be removed again however they're spelt, and events are
+ * given for them as they're kept.
+ */
+
+#define PL_WATCH_REMOVED    ((char*)1)  // marks a slot in the file set that's been emptied
+
+typedef struct PLWatchDirectory {
+    int wd;
+    dev_t dev;                      // so it can be found again by some other route
+    ino_t ino;
+    char path[PL_SYSTEM_MAX_PATH];  // as it prefixes anything found within it
+    bool all;                       // watched as a whole, rather than for the files within it
+    unsigned int num_files;
+} PLWatchDirectory;
+
+struct PLFileWatch {
+    int fd;
+
+    PLWatchDirectory *directories;
+    unsigned int num_directories;
+
+    /* open-addressed set of the full paths for every file watched */
+    char **files;
+    unsigned int files_size, files_used;
+
+    /* anything that's happened since we were last polled, along
+     * with a table of indices into it (+1, 0 marks an empty slot)
+     * so that further changes to the same path can be merged */
+    PLFileWatchEvent *events;
+    unsigned int num_events, max_events;
+    unsigned int *event_table;
+    unsigned int event_table_size;
+};
+
+static uint32_t HashWatchPath(const char *path) {
+    uint32_t hash = 2166136261u;
+    for(const unsigned char *c = (const unsigned char*)path; *c != '\0'; ++c) {
+        hash ^= *c;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+#if defined(__linux__)
+
+/* Drops any "." along with doubled up or trailing slashes. Anything going up
+ * a directory is left alone, as where that ends up depends on what's linked. */
+static bool NormaliseWatchPath(char *dest, const char *path) {
+    size_t length = 0;
+    if(path[0] == '/') {
+        dest[length++] = '/';
+    }
+
+    for(const char *c = path; *c != '\0';) {
+        while(*c == '/') {
+            ++c;
+        }
+
+        const char *end = c;
+        while(*end != '\0' && *end != '/') {
+            ++end;
+        }
+
+        size_t part = (size_t)(end - c);
+        if(part == 0 || (part == 1 && c[0] == '.')) {
+            c = end;
+            continue;
+        }
+
+        bool slash = (length > 0 && dest[length - 1] != '/');
+        if(length + slash + part >= PL_SYSTEM_MAX_PATH) {
+            return false;
+        }
+
+        if(slash) {
+            dest[length++] = '/';
+        }
+        memcpy(dest + length, c, part);
+        length += part;
+
+        c = end;
+    }
+
+    dest[length] = '\0';
+    return true;
+}
+
+static int FindWatchFile(const PLFileWatch *watch, const char *path) {
+    if(watch->files_size == 0) {
+        return -1;
+    }
+
+    unsigned int mask = watch->files_size - 1;
+    for(unsigned int slot = HashWatchPath(path) & mask;; slot = (slot + 1) & mask) {
+        if(watch->files[slot] == NULL) {
+            return -1;
+        }
+
+        if(watch->files[slot] != PL_WATCH_REMOVED && strcmp(watch->files[slot], path) == 0) {
+            return (int)slot;
+        }
+    }
+}
+
+static void PlaceWatchFile(char **files, unsigned int size, char *path) {
+    unsigned int mask = size - 1;
+    unsigned int slot = HashWatchPath(path) & mask;
+    while(files[slot] != NULL) {
+        slot = (slot + 1) & mask;
+    }
+    files[slot] = path;
+}
+
+static bool InsertWatchFile(PLFileWatch *watch, const char *path) {
+    /* keep the set at most half full, counting anything removed */
+    if((watch->files_used + 1) * 2 > watch->files_size) {
+        unsigned int size = 16;
+        while(size < (watch->files_used + 1) * 4) {
+            size <<= 1;
+        }
+
+        char **files = calloc(size, sizeof(char*));
+        if(files == NULL) {
+            ReportError(PL_RESULT_MEMORYALLOC, "failed to allocate watch table");
+            return false;
+        }
+
+        unsigned int used = 0;
+        for(unsigned int i = 0; i < watch->files_size; ++i) {
+            if(watch->files[i] != NULL && watch->files[i] != PL_WATCH_REMOVED) {
+                PlaceWatchFile(files, size, watch->files[i]);
+                ++used;
+            }
+        }
+
+        free(watch->files);
+        watch->files = files;
+        watch->files_size = size;
+        watch->files_used = used;
+    }
+
+    char *copy = strdup(path);
+    if(copy == NULL) {
+        ReportError(PL_RESULT_MEMORYALLOC, "failed to allocate watch path");
+        return false;
+    }
+
+    PlaceWatchFile(watch->files, watch->files_size, copy);
+    watch->files_used++;
+
+    return true;
+}
+
+static PLWatchDirectory *FindWatchDirectory(PLFileWatch *watch, int wd) {
+    for(unsigned int i = 0; i < watch->num_directories; ++i) {
+        if(watch->directories[i].wd == wd) {
+            return &watch->directories[i];
+        }
+    }
+
+    return NULL;
+}
+
+/* Starts watching the given directory, or returns the existing
+ * watch on it, however it happened to be spelt at the time. */
+static PLWatchDirectory *AddWatchDirectory(PLFileWatch *watch, const char *path) {
+    int wd = inotify_add_watch(watch->fd, (path[0] != '\0') ? path : ".",
+                               IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE |
+                               IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+    if(wd == -1) {
+        ReportError(PL_RESULT_FILEPATH, "failed to watch %s: %s", path, strerror(errno));
+        return NULL;
+    }
+
+    PLWatchDirectory *directory = FindWatchDirectory(watch, wd);
+    if(directory != NULL) {
+        return directory;
+    }
+
+    PLWatchDirectory *directories = realloc(watch->directories, sizeof(PLWatchDirectory) * (watch->num_directories + 1));
+    if(directories == NULL) {
+        ReportError(PL_RESULT_MEMORYALLOC, "failed to allocate watch for %s", path);
+        inotify_rm_watch(watch->fd, wd);
+        return NULL;
+    }
+    watch->directories = directories;
+
+    directory = &watch->directories[watch->num_directories++];
+    memset(directory, 0, sizeof(PLWatchDirectory));
+    directory->wd = wd;
+    strncpy(directory->path, path, sizeof(directory->path) - 1);
+
+    struct stat st;
+    if(stat((path[0] != '\0') ? path : ".", &st) == 0) {
+        directory->dev = st.st_dev;
+        directory->ino = st.st_ino;
+    }
+
+    return directory;
+}
+
+/* Returns whichever directory being watched is the same one as the
+ * given path, however either of them happened to be spelt. */
+static PLWatchDirectory *FindWatchDirectoryByPath(PLFileWatch *watch, const char *path) {
+    struct stat st;
+    bool found = (stat((path[0] != '\0') ? path : ".", &st) == 0);
+
+    for(unsigned int i = 0; i < watch->num_directories; ++i) {
+        PLWatchDirectory *directory = &watch->directories[i];
+        if(found ? (directory->dev == st.st_dev && directory->ino == st.st_ino) :
+                   (strcmp(directory->path, path) == 0)) {
+            return directory;
+        }
+    }
+
+    return NULL;
+}
+
+/* Copies out the directory the given path lives in, returning its name within that. */
+static const char *SplitWatchPath(char *dir, const char *path) {
+    const char *name = strrchr(path, '/');
+    if(name == NULL) {
+        dir[0] = '\0';
+        return path;
+    }
+
+    /* keep hold of the root */
+    size_t length = (name > path) ? (size_t)(name - path) : 1;
+    memcpy(dir, path, length);
+    dir[length] = '\0';
+
+    return name + 1;
+}
+
+static bool JoinWatchPath(char *dest, const PLWatchDirectory *directory, const char *name) {
+    int length;
+    if(directory->path[0] == '\0') {
+        length = snprintf(dest, PL_SYSTEM_MAX_PATH, "%s", name);
+    } else {
+        bool root = (directory->path[strlen(directory->path) - 1] == '/');
+        length = snprintf(dest, PL_SYSTEM_MAX_PATH, root ? "%s%s" : "%s/%s", directory->path, name);
+    }
+
+    return (length >= 0 && length < PL_SYSTEM_MAX_PATH);
+}
+
+static void QueueWatchEvent(PLFileWatch *watch, const char *path, unsigned int events) {
+    uint32_t hash = HashWatchPath(path);
+    unsigned int mask = watch->event_table_size - 1;
+    unsigned int slot = hash & mask;
+    for(; watch->event_table[slot] != 0; slot = (slot + 1) & mask) {
+        PLFileWatchEvent *event = &watch->events[watch->event_table[slot] - 1];
+        if(strcmp(event->path, path) == 0) {
+            event->events |= events;
+            return;
+        }
+    }
+
+    if(watch->num_events == watch->max_events || (watch->num_events + 1) * 2 > watch->event_table_size) {
+        /* can't take any more, so let whoever's polling know they've missed something */
+        if(watch->num_events > 0) {
+            watch->events[watch->num_events - 1].events |= PL_WATCHEVENT_OVERFLOW;
+        }
+        return;
+    }
+
+    PLFileWatchEvent *event = &watch->events[watch->num_events++];
+    strncpy(event->path, path, sizeof(event->path) - 1);
+    event->path[sizeof(event->path) - 1] = '\0';
+    event->events = events;
+    watch->event_table[slot] = watch->num_events;
+}
+
+static void RebuildWatchEventTable(PLFileWatch *watch) {
+    memset(watch->event_table, 0, sizeof(unsigned int) * watch->event_table_size);
+
+    unsigned int mask = watch->event_table_size - 1;
+    for(unsigned int i = 0; i < watch->num_events; ++i) {
+        unsigned int slot = HashWatchPath(watch->events[i].path) & mask;
+        while(watch->event_table[slot] != 0) {
+            slot = (slot + 1) & mask;
+        }
+        watch->event_table[slot] = i + 1;
+    }
+}
+
+/* Stops watching the directory, along with any files still watched within it,
+ * which are given as deleted if the watch was lost rather than removed. */
+static void RemoveWatchDirectory(PLFileWatch *watch, PLWatchDirectory *directory, bool rm) {
+    if(rm) {
+        inotify_rm_watch(watch->fd, directory->wd);
+    }
+
+    if(directory->num_files > 0) {
+        char dir[PL_SYSTEM_MAX_PATH];
+        for(unsigned int i = 0; i < watch->files_size; ++i) {
+            char *file = watch->files[i];
+            if(file == NULL || file == PL_WATCH_REMOVED) {
+                continue;
+            }
+
+            SplitWatchPath(dir, file);
+            if(strcmp(dir, directory->path) != 0) {
+                continue;
+            }
+
+            if(!rm) {
+                QueueWatchEvent(watch, file, PL_WATCHEVENT_DELETED);
+            }
+
+            free(file);
+            watch->files[i] = PL_WATCH_REMOVED;
+        }
+    }
+
+    unsigned int i = (unsigned int)(directory - watch->directories);
+    memmove(&watch->directories[i], &watch->directories[i + 1],
+            sizeof(PLWatchDirectory) * (watch->num_directories - i - 1));
+    watch->num_directories--;
+}
+
+/* Reads in everything inotify has queued up for us, without blocking. */
+static void ReadWatchEvents(PLFileWatch *watch) {
+    uint8_t buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    char path[PL_SYSTEM_MAX_PATH];
+
+    for(;;) {
+        ssize_t length = read(watch->fd, buffer, sizeof(buffer));
+        if(length < 0 && errno == EINTR) {
+            continue;
+        } else if(length <= 0) {
+            break;
+        }
+
+        for(ssize_t i = 0; i < length;) {
+            const struct inotify_event *event = (const struct inotify_event*)(buffer + i);
+            i += sizeof(struct inotify_event) + event->len;
+
+            if(event->mask & IN_Q_OVERFLOW) {
+                QueueWatchEvent(watch, "", PL_WATCHEVENT_OVERFLOW);
+                continue;
+            }
+
+            PLWatchDirectory *directory = FindWatchDirectory(watch, event->wd);
+            if(directory == NULL) {
+                continue;
+            }
+
+            /* the directory itself has gone, so has its watch */
+            if(event->mask & IN_IGNORED) {
+                RemoveWatchDirectory(watch, directory, false);
+                continue;
+            }
+
+            if(event->len == 0) {
+                if(event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+                    QueueWatchEvent(watch, directory->path, PL_WATCHEVENT_DELETED);
+                }
+                continue;
+            }
+
+            if(!JoinWatchPath(path, directory, event->name) ||
+               (!directory->all && FindWatchFile(watch, path) == -1)) {
+                continue;
+            }
+
+            unsigned int events = 0;
+            if(event->mask & (IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB)) {
+                events |= PL_WATCHEVENT_MODIFIED;
+            }
+            if(event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                events |= PL_WATCHEVENT_CREATED;
+            }
+            if(event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                events |= PL_WATCHEVENT_DELETED;
+            }
+
+            QueueWatchEvent(watch, path, events);
+        }
+    }
+}
+
+#endif
+
+PLFileWatch *plCreateFileWatch(void) {
+#if defined(__linux__)
+    PLFileWatch *watch = calloc(1, sizeof(PLFileWatch));
+    if(watch == NULL) {
+        ReportError(PL_RESULT_MEMORYALLOC, "failed to allocate file watch");
+        return NULL;
+    }
+
+    watch->max_events = 1024;
+    watch->event_table_size = watch->max_events * 2;
+    watch->events = malloc(sizeof(PLFileWatchEvent) * watch->max_events);
+    watch->event_table = calloc(watch->event_table_size, sizeof(unsigned int));
+    if(watch->events == NULL || watch->event_table == NULL) {
+        ReportError(PL_RESULT_MEMORYALLOC, "failed to allocate file watch events");
+        goto FAILED;
+    }
+
+    watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(watch->fd == -1) {
+        ReportError(PL_RESULT_SYSERR, "failed to initialize inotify: %s", strerror(errno));
+        goto FAILED;
+    }
+
+    return watch;
+
+    FAILED:
+
+    free(watch->events);
+    free(watch->event_table);
+    free(watch);
+
+    return NULL;
+#else
+    ReportError(PL_RESULT_SYSERR, "file watching is unsupported on this platform");
+    return NULL;
+#endif
+}
+
+void plDeleteFileWatch(PLFileWatch *watch) {
+    if(watch == NULL) {
+        return;
+    }
+
+#if defined(__linux__)
+    close(watch->fd);
+
+    for(unsigned int i = 0; i < watch->files_size; ++i) {
+        if(watch->files[i] != PL_WATCH_REMOVED) {
+            free(watch->files[i]);
+        }
+    }
+
+    free(watch->files);
+    free(watch->directories);
+    free(watch->events);
+    free(watch->event_table);
+    free(watch);
+#endif
+}
+
+/* Watches the given file, or everything within the given directory. */
+bool plAddFileWatch(PLFileWatch *watch, const char *path) {
+    plAssert(watch);
+
+#if defined(__linux__)
+    if(!plIsValidString(path)) {
+        ReportError(PL_RESULT_FILEPATH, "invalid path for file watch");
+        return false;
+    }
+
+    char normal[PL_SYSTEM_MAX_PATH];
+    if(!NormaliseWatchPath(normal, path)) {
+        ReportError(PL_RESULT_FILEPATH, "path is too long to watch, %s", path);
+        return false;
+    }
+
+    if(plPathExists((normal[0] != '\0') ? normal : ".")) {
+        PLWatchDirectory *directory = AddWatchDirectory(watch, normal);
+        if(directory == NULL) {
+            return false;
+        }
+
+        directory->all = true;
+        return true;
+    }
+
+    /* for anything else, watch the directory it lives in */
+    char dir[PL_SYSTEM_MAX_PATH];
+    const char *name = SplitWatchPath(dir, normal);
+
+    PLWatchDirectory *directory = AddWatchDirectory(watch, dir);
+    if(directory == NULL) {
+        return false;
+    }
+
+    char file[PL_SYSTEM_MAX_PATH];
+    if(!JoinWatchPath(file, directory, name)) {
+        ReportError(PL_RESULT_FILEPATH, "path is too long to watch, %s", path);
+        return false;
+    }
+
+    if(FindWatchFile(watch, file) != -1) {
+        return true;
+    }
+
+    if(!InsertWatchFile(watch, file)) {
+        if(directory->num_files == 0 && !directory->all) {
+            RemoveWatchDirectory(watch, directory, true);
+        }
+        return false;
+    }
+
+    directory->num_files++;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void plRemoveFileWatch(PLFileWatch *watch, const char *path) {
+    plAssert(watch);
+
+#if defined(__linux__)
+    char normal[PL_SYSTEM_MAX_PATH];
+    if(!plIsValidString(path) || !NormaliseWatchPath(normal, path)) {
+        return;
+    }
+
+    PLWatchDirectory *directory = FindWatchDirectoryByPath(watch, normal);
+    if(directory != NULL && directory->all) {
+        directory->all = false;
+        if(directory->num_files == 0) {
+            RemoveWatchDirectory(watch, directory, true);
+        }
+        return;
+    }
+
+    /* files are kept under whichever spelling their directory was first watched by */
+    char dir[PL_SYSTEM_MAX_PATH];
+    const char *name = SplitWatchPath(dir, normal);
+    directory = FindWatchDirectoryByPath(watch, dir);
+    if(directory == NULL) {
+        return;
+    }
+
+    char file[PL_SYSTEM_MAX_PATH];
+    int slot = JoinWatchPath(file, directory, name) ? FindWatchFile(watch, file) : -1;
+    if(slot == -1) {
+        return;
+    }
+
+    if(--directory->num_files == 0 && !directory->all) {
+        RemoveWatchDirectory(watch, directory, true);
+    }
+
+    free(watch->files[slot]);
+    watch->files[slot] = PL_WATCH_REMOVED;
+#endif
+}
+
+/* Fills in events for anything that's changed since we were last
+ * polled, one per path, and returns how many there were. Anything
+ * that doesn't fit is held on to for the next call.
+ */
+unsigned int plPollFileWatch(PLFileWatch *watch, PLFileWatchEvent *events, unsigned int max_events) {
+    plAssert(watch);
+
+#if defined(__linux__)
+    ReadWatchEvents(watch);
+
+    unsigned int num_events = (watch->num_events < max_events) ? watch->num_events : max_events;
+    if(num_events == 0) {
+        return 0;
+    }
+
+    memcpy(events, watch->events, sizeof(PLFileWatchEvent) * num_events);
+
+    watch->num_events -= num_events;
+    memmove(watch->events, watch->events + num_events, sizeof(PLFileWatchEvent) * watch->num_events);
+    RebuildWatchEventTable(watch);
+
+    return num_events;
+#else
+    return 0;
+#endif
+}